@@ -34,6 +34,7 @@
 #include "debugger/dbg_memory.h"
 #include "device/device.h"
 #include "device/memory/memory.h"
+#include "device/r4300/new_dynarec/new_dynarec.h"
 #include "device/r4300/r4300_core.h"
 #include "device/r4300/tlb.h"
 #include "m64p_debugger.h"
@@ -140,9 +141,9 @@ EXPORT int CALL DebugGetState(m64p_dbg_state statenum)
         case M64P_DBG_NUM_BREAKPOINTS:
             return g_NumBreakpoints;
         case M64P_DBG_CPU_DYNACORE:
-            return get_r4300_emumode(&g_dev.r4300);
+            return get_r4300_emumode(&g_instance->dev->r4300);
         case M64P_DBG_CPU_NEXT_INTERRUPT:
-            return *r4300_cp0_next_interrupt(&g_dev.r4300.cp0);
+            return *r4300_cp0_next_interrupt(&g_instance->dev->r4300.cp0);
         default:
             DebugMessage(M64MSG_WARNING, "Bug: invalid m64p_dbg_state input in DebugGetState()");
             return 0;
@@ -178,7 +179,7 @@ EXPORT void CALL DebugDecodeOp(unsigned int instruction, char *op, char *args, i
 EXPORT void * CALL DebugMemGetRecompInfo(m64p_dbg_mem_info recomp_type, unsigned int address, int index)
 {
 #ifdef DBG
-    struct r4300_core* r4300 = &g_dev.r4300;
+    struct r4300_core* r4300 = &g_instance->dev->r4300;
 
     switch (recomp_type)
     {
@@ -201,7 +202,7 @@ EXPORT void * CALL DebugMemGetRecompInfo(m64p_dbg_mem_info recomp_type, unsigned
 EXPORT int CALL DebugMemGetMemInfo(m64p_dbg_mem_info mem_info_type, unsigned int address)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
     struct r4300_core* r4300 = &dev->r4300;
 
     switch (mem_info_type)
@@ -229,17 +230,17 @@ EXPORT void * CALL DebugMemGetPointer(m64p_dbg_memptr_type mem_ptr_type)
     switch (mem_ptr_type)
     {
         case M64P_DBG_PTR_RDRAM:
-            return g_dev.rdram.dram;
+            return g_instance->dev->rdram.dram;
         case M64P_DBG_PTR_PI_REG:
-            return g_dev.pi.regs;
+            return g_instance->dev->pi.regs;
         case M64P_DBG_PTR_SI_REG:
-            return g_dev.si.regs;
+            return g_instance->dev->si.regs;
         case M64P_DBG_PTR_VI_REG:
-            return g_dev.vi.regs;
+            return g_instance->dev->vi.regs;
         case M64P_DBG_PTR_RI_REG:
-            return g_dev.ri.regs;
+            return g_instance->dev->ri.regs;
         case M64P_DBG_PTR_AI_REG:
-            return g_dev.ai.regs;
+            return g_instance->dev->ai.regs;
         default:
             DebugMessage(M64MSG_ERROR, "Bug: DebugMemGetPointer() called with invalid m64p_dbg_memptr_type");
             return NULL;
@@ -249,7 +250,7 @@ EXPORT void * CALL DebugMemGetPointer(m64p_dbg_memptr_type mem_ptr_type)
 EXPORT unsigned long long CALL DebugMemRead64(unsigned int address)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     if ((address & 3) == 0)
         return read_memory_64(dev, address);
@@ -264,7 +265,7 @@ EXPORT unsigned long long CALL DebugMemRead64(unsigned int address)
 EXPORT unsigned int CALL DebugMemRead32(unsigned int address)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     if ((address & 3) == 0)
         return read_memory_32(dev, address);
@@ -279,7 +280,7 @@ EXPORT unsigned int CALL DebugMemRead32(unsigned int address)
 EXPORT unsigned short CALL DebugMemRead16(unsigned int address)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     return read_memory_16(dev, address);
 #else
@@ -291,7 +292,7 @@ EXPORT unsigned short CALL DebugMemRead16(unsigned int address)
 EXPORT unsigned char CALL DebugMemRead8(unsigned int address)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     return read_memory_8(dev, address);
 #else
@@ -303,7 +304,7 @@ EXPORT unsigned char CALL DebugMemRead8(unsigned int address)
 EXPORT void CALL DebugMemWrite64(unsigned int address, unsigned long long value)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     if ((address & 3) == 0)
         write_memory_64(dev, address, value);
@@ -317,7 +318,7 @@ EXPORT void CALL DebugMemWrite64(unsigned int address, unsigned long long value)
 EXPORT void CALL DebugMemWrite32(unsigned int address, unsigned int value)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     if ((address & 3) == 0)
         write_memory_32(dev, address, value);
@@ -331,7 +332,7 @@ EXPORT void CALL DebugMemWrite32(unsigned int address, unsigned int value)
 EXPORT void CALL DebugMemWrite16(unsigned int address, unsigned short value)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     write_memory_16(dev, address, value);
 #else
@@ -342,7 +343,7 @@ EXPORT void CALL DebugMemWrite16(unsigned int address, unsigned short value)
 EXPORT void CALL DebugMemWrite8(unsigned int address, unsigned char value)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
 
     write_memory_8(dev, address, value);
 #else
@@ -352,7 +353,7 @@ EXPORT void CALL DebugMemWrite8(unsigned int address, unsigned char value)
 
 EXPORT void * CALL DebugGetCPUDataPtr(m64p_dbg_cpu_data cpu_data_type)
 {
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
     struct r4300_core* r4300 = &dev->r4300;
 
     cp1_reg *cp1_regs = r4300_cp1_regs(&r4300->cp1);
@@ -376,6 +377,14 @@ EXPORT void * CALL DebugGetCPUDataPtr(m64p_dbg_cpu_data cpu_data_type)
             return &cp1_regs->dword;
         case M64P_CPU_TLB:
             return r4300->cp0.tlb.entries;
+        case M64P_CPU_DYNAREC_HT_STATS:
+#ifdef NEW_DYNAREC
+            return new_dynarec_ht_stats();
+#else
+            return NULL;
+#endif
+        case M64P_CPU_TLB_MICRO_STATS:
+            return r4300->cp0.tlb.micro_stats;
         default:
             DebugMessage(M64MSG_ERROR, "Bug: DebugGetCPUDataPtr() called with invalid input m64p_dbg_cpu_data");
             return NULL;
@@ -395,7 +404,7 @@ EXPORT int CALL DebugBreakpointLookup(unsigned int address, unsigned int size, u
 EXPORT int CALL DebugBreakpointCommand(m64p_dbg_bkp_command command, unsigned int index, m64p_breakpoint *bkp)
 {
 #ifdef DBG
-    struct memory* mem = &g_dev.mem;
+    struct memory* mem = &g_instance->dev->mem;
 
     switch (command)
     {
@@ -443,7 +452,7 @@ EXPORT void CALL DebugBreakpointTriggeredBy(uint32_t *flags, uint32_t *accessed)
 EXPORT uint32_t CALL DebugVirtualToPhysical(uint32_t address)
 {
 #ifdef DBG
-    struct device* dev = &g_dev;
+    struct device* dev = g_instance->dev;
     struct r4300_core* r4300 = &dev->r4300;
 
     if ((address & UINT32_C(0xc0000000)) != UINT32_C(0x80000000)) {
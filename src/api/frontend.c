@@ -38,6 +38,7 @@
 #include "m64p_types.h"
 #include "main/cheat.h"
 #include "main/eventloop.h"
+#include "main/instance.h"
 #include "main/main.h"
 #include "main/rom.h"
 #include "main/savestates.h"
@@ -52,13 +53,19 @@
 #include "jimmi/input_manager.h"
 #include "jimmi/replay_manager.h"
 #include "jimmi/playback_manager.h"
+#include "jimmi/replay_writer.h"
+#include "jimmi/keyframe_manager.h"
+#include "jimmi/hash_manager.h"
+#include "jimmi/watch_manager.h"
 
 /* some local state variables */
 static int l_CoreInit = 0;
-static int l_ROMOpen = 0;
-static int l_DiskOpen = 0;
 static int l_CallerUsingSDL = 0;
 
+/* per-instance state, see main/instance.h */
+#define l_ROMOpen (g_instance->frontend.rom_open)
+#define l_DiskOpen (g_instance->frontend.disk_open)
+
 /* functions exported outside of libmupen64plus to front-end application */
 EXPORT m64p_error CALL CoreStartup(int APIVersion, const char *ConfigPath, const char *DataPath, void *Context,
                                    void (*DebugCallback)(void *, int, const char *), void *Context2,
@@ -82,8 +89,8 @@ EXPORT m64p_error CALL CoreStartup(int APIVersion, const char *ConfigPath, const
         return M64ERR_INCOMPATIBLE;
     }
 
-    /* Initialize the main device structure to all zeros */
-    memset(&g_dev, 0, sizeof(struct device));
+    /* Initialize the default instance and its device structure to all zeros */
+    core_instance_reset(core_instance_default());
 
     /* set up the default (dummy) plugins */
     plugin_connect(M64PLUGIN_GFX, NULL);
@@ -122,6 +129,7 @@ EXPORT m64p_error CALL CoreStartup(int APIVersion, const char *ConfigPath, const
 
     
     workqueue_init();
+    replay_writer_init();
     
     l_CoreInit = 1;
     return M64ERR_SUCCESS;
@@ -131,10 +139,14 @@ EXPORT m64p_error CALL CoreShutdown(void)
 {
     if (!l_CoreInit)
         return M64ERR_NOT_INIT;
+    if (core_instance_count() != 0)
+        return M64ERR_INVALID_STATE;
 
     /* close down some core sub-systems */
     romdatabase_close();
     playback_manager_close();
+    ScreenshotShutdown();
+    replay_writer_shutdown();
     ConfigShutdown();
     workqueue_shutdown();
     savestates_deinit();
@@ -162,6 +174,9 @@ EXPORT m64p_error CALL CoreAttachPlugin(m64p_plugin_type PluginType, m64p_dynlib
         return M64ERR_NOT_INIT;
     if (g_EmulatorRunning || (!l_ROMOpen && !l_DiskOpen))
         return M64ERR_INVALID_STATE;
+    /* plugins are shared by all instances, only the dummy ones can serve several */
+    if (PluginLibHandle != NULL && core_instance_count() != 0)
+        return M64ERR_INVALID_STATE;
 
     rval = plugin_connect(PluginType, PluginLibHandle);
     if (rval != M64ERR_SUCCESS)
@@ -388,6 +403,31 @@ EXPORT m64p_error CALL CoreDoCommand(m64p_command Command, int ParamInt, void *P
                 return M64ERR_INCOMPATIBLE;
         case M64CMD_NETPLAY_CLOSE:
             return netplay_stop();
+        case M64CMD_REPLAY_SEEK:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamInt < 0)
+                return M64ERR_INPUT_INVALID;
+            return keyframe_manager_seek((uint64_t)ParamInt) ? M64ERR_SUCCESS : M64ERR_INPUT_INVALID;
+        case M64CMD_BATCH_REPLAY:
+            if (netplay_is_init())
+                return M64ERR_INVALID_STATE;
+            return main_set_batch_replay((const char *) ParamPtr);
+        case M64CMD_BATCH_REPLAY_STATS:
+            if (ParamPtr == NULL || ParamInt != sizeof(m64p_batch_replay_stats))
+                return M64ERR_INPUT_INVALID;
+            return main_get_batch_replay_stats((m64p_batch_replay_stats *) ParamPtr);
+        case M64CMD_STATE_SNAPSHOT:
+        case M64CMD_STATE_RESTORE:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamPtr == NULL || ParamInt < 0 || (size_t) ParamInt < savestates_get_memory_size())
+                return M64ERR_INPUT_INVALID;
+            if (Command == M64CMD_STATE_SNAPSHOT)
+                main_state_snapshot(ParamPtr, (size_t) ParamInt);
+            else
+                main_state_restore(ParamPtr, (size_t) ParamInt);
+            return M64ERR_SUCCESS;
         default:
             return M64ERR_INPUT_INVALID;
     }
@@ -395,6 +435,100 @@ EXPORT m64p_error CALL CoreDoCommand(m64p_command Command, int ParamInt, void *P
     return M64ERR_INTERNAL;
 }
 
+EXPORT m64p_error CALL CoreCreateInstance(m64p_instance *Instance)
+{
+    struct core_instance* instance;
+
+    if (!l_CoreInit)
+        return M64ERR_NOT_INIT;
+    if (Instance == NULL)
+        return M64ERR_INPUT_ASSERT;
+    /* plugins are shared by all instances, only the dummy ones can serve several */
+    if (plugin_is_attached() || netplay_is_init())
+        return M64ERR_INVALID_STATE;
+
+    instance = core_instance_create();
+    if (instance == NULL)
+        return M64ERR_NO_MEMORY;
+
+    *Instance = instance;
+    return M64ERR_SUCCESS;
+}
+
+EXPORT m64p_error CALL CoreDestroyInstance(m64p_instance Instance)
+{
+    struct core_instance* instance = (struct core_instance *) Instance;
+    struct core_instance* previous;
+
+    if (!l_CoreInit)
+        return M64ERR_NOT_INIT;
+    if (instance == NULL || instance == core_instance_default())
+        return M64ERR_INPUT_INVALID;
+
+    previous = core_instance_enter(instance);
+    if (g_EmulatorRunning)
+    {
+        core_instance_enter(previous);
+        return M64ERR_INVALID_STATE;
+    }
+
+    if (l_ROMOpen || l_DiskOpen)
+    {
+        cheat_delete_all(&g_cheat_ctx);
+        cheat_uninit(&g_cheat_ctx);
+        if (l_ROMOpen)
+            close_rom();
+        else
+            close_disk();
+        l_ROMOpen = 0;
+        l_DiskOpen = 0;
+    }
+    main_set_batch_replay(NULL);
+    playback_manager_set_path(NULL);
+    keyframe_manager_unload();
+    hash_manager_unload();
+    watch_manager_close();
+    replay_manager_set_path(NULL);
+    savestates_set_job(savestates_job_nothing, savestates_type_unknown, NULL);
+    savestates_release_buffers();
+    core_instance_enter(previous);
+
+    core_instance_destroy(instance);
+    return M64ERR_SUCCESS;
+}
+
+EXPORT m64p_error CALL CoreDoCommandEx(m64p_instance Instance, m64p_command Command, int ParamInt, void *ParamPtr)
+{
+    struct core_instance* instance = (Instance != NULL) ? (struct core_instance *) Instance : core_instance_default();
+    struct core_instance* previous;
+    m64p_error rval;
+
+    if (!l_CoreInit)
+        return M64ERR_NOT_INIT;
+
+    /* netplay and the SDL event loop only drive the default instance */
+    if (instance != core_instance_default())
+    {
+        switch (Command)
+        {
+            case M64CMD_SEND_SDL_KEYDOWN:
+            case M64CMD_SEND_SDL_KEYUP:
+            case M64CMD_NETPLAY_INIT:
+            case M64CMD_NETPLAY_CONTROL_PLAYER:
+            case M64CMD_NETPLAY_CLOSE:
+                return M64ERR_INVALID_STATE;
+            default:
+                break;
+        }
+    }
+
+    previous = core_instance_enter(instance);
+    rval = CoreDoCommand(Command, ParamInt, ParamPtr);
+    core_instance_enter(previous);
+
+    return rval;
+}
+
 EXPORT m64p_error CALL CoreOverrideVidExt(m64p_video_extension_functions *VideoFunctionStruct)
 {
     if (!l_CoreInit)
@@ -164,7 +164,9 @@ EXPORT void CALL DebugMemWrite8(unsigned int, unsigned char);
 /* DebugGetCPUDataPtr()
  *
  * This function returns a memory pointer (in x86 memory space) to a specific
- * register in the emulated R4300 CPU.
+ * register in the emulated R4300 CPU. M64P_CPU_DYNAREC_HT_STATS returns NULL
+ * if the core wasn't built with the new dynamic recompiler.
+ * M64P_CPU_TLB_MICRO_STATS counts since the last power on.
  */
 typedef void * (*ptr_DebugGetCPUDataPtr)(m64p_dbg_cpu_data);
 #if defined(M64P_CORE_PROTOTYPES)
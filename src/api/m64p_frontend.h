@@ -90,6 +90,38 @@ typedef m64p_error (*ptr_CoreDoCommand)(m64p_command, int, void *);
 EXPORT m64p_error CALL CoreDoCommand(m64p_command, int, void *);
 #endif
 
+/* CoreCreateInstance()
+ *
+ * This function creates an additional emulator instance, with its own ROM,
+ * memory and device state, that can run on another thread next to the default
+ * one. Plugins are shared, so this is only possible while the dummy plugins
+ * are attached.
+ */
+typedef m64p_error (*ptr_CoreCreateInstance)(m64p_instance *);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT m64p_error CALL CoreCreateInstance(m64p_instance *);
+#endif
+
+/* CoreDestroyInstance()
+ *
+ * This function closes the ROM of an instance created by CoreCreateInstance()
+ * and releases it. The instance must not be running.
+ */
+typedef m64p_error (*ptr_CoreDestroyInstance)(m64p_instance);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT m64p_error CALL CoreDestroyInstance(m64p_instance);
+#endif
+
+/* CoreDoCommandEx()
+ *
+ * This function sends a command to the given emulator instance, or to the
+ * default one if the instance is NULL.
+ */
+typedef m64p_error (*ptr_CoreDoCommandEx)(m64p_instance, m64p_command, int, void *);
+#if defined(M64P_CORE_PROTOTYPES)
+EXPORT m64p_error CALL CoreDoCommandEx(m64p_instance, m64p_command, int, void *);
+#endif
+
 /* CoreOverrideVidExt()
  *
  * This function overrides the core's internal SDL-based OpenGL functions. This
@@ -53,6 +53,9 @@
 
 typedef void * m64p_handle;
 
+/* Emulator instance created by CoreCreateInstance() */
+typedef void * m64p_instance;
+
 /* Generic function pointer returned from osal_dynlib_getproc (and the like)
  * Don't use it directly, cast to proper type before using it.
  */
@@ -140,6 +143,7 @@ typedef enum {
   M64CORE_STATE_LOADCOMPLETE,
   M64CORE_STATE_SAVECOMPLETE,
   M64CORE_SCREENSHOT_CAPTURED,
+  M64CORE_STATE_SNAPSHOT_SIZE,
 } m64p_core_param;
 
 typedef enum {
@@ -172,9 +176,23 @@ typedef enum {
   M64CMD_PIF_OPEN,
   M64CMD_ROM_SET_SETTINGS,
   M64CMD_DISK_OPEN,
-  M64CMD_DISK_CLOSE
+  M64CMD_DISK_CLOSE,
+  M64CMD_REPLAY_SEEK,
+  M64CMD_BATCH_REPLAY,
+  M64CMD_BATCH_REPLAY_STATS,
+  M64CMD_STATE_SNAPSHOT,
+  M64CMD_STATE_RESTORE
 } m64p_command;
 
+typedef struct {
+  unsigned int frames;        /* vertical interrupts emulated */
+  unsigned int milliseconds;  /* wall clock time of the whole run */
+  float        fps;
+  int          match_ended;   /* 0 if the replay stopped before the match end */
+  unsigned int hashes_checked;  /* RDRAM hashes of the replay compared */
+  unsigned int divergent_frame; /* first replay frame whose hash did not match, 0 if none */
+} m64p_batch_replay_stats;
+
 typedef struct {
   uint32_t address;
   int      value;
@@ -365,7 +383,9 @@ typedef enum {
   M64P_CPU_REG_COP1_DOUBLE_PTR,
   M64P_CPU_REG_COP1_SIMPLE_PTR,
   M64P_CPU_REG_COP1_FGR_64,
-  M64P_CPU_TLB
+  M64P_CPU_TLB,
+  M64P_CPU_DYNAREC_HT_STATS, /* uint64_t[2]: new dynarec block lookups that hit / missed its hash table */
+  M64P_CPU_TLB_MICRO_STATS   /* uint64_t[2]: TLB mapped address translations that hit / missed the micro TLB */
 } m64p_dbg_cpu_data;
 
 typedef enum {
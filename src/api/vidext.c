@@ -37,6 +37,7 @@
 
 #define M64P_CORE_PROTOTYPES 1
 #include "osal/preproc.h"
+#include "../main/main.h"
 #include "../osd/osd.h"
 #include "callbacks.h"
 #include "m64p_types.h"
@@ -679,6 +680,10 @@ EXPORT m64p_error CALL VidExt_GL_GetAttribute(m64p_GLattr Attr, int *pValue)
 
 EXPORT m64p_error CALL VidExt_GL_SwapBuffers(void)
 {
+    /* nothing is presented during batch replays */
+    if (main_is_batch_replay())
+        return M64ERR_SUCCESS;
+
     /* call video extension override if necessary */
     if (l_VideoExtensionActive)
         return (*l_ExternalVideoFuncTable.VidExtFuncGLSwapBuf)();
@@ -0,0 +1,50 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - av_dump_backend.c                                       *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "av_dump_backend.h"
+
+#include <string.h>
+
+/* exported audio/video dump backends */
+extern const struct av_dump_backend_interface g_iy4m_av_dump_backend;
+
+
+const struct av_dump_backend_interface* g_av_dump_backend_interfaces[] =
+{
+    &g_iy4m_av_dump_backend,
+    NULL /* sentinel - must be last element */
+};
+
+
+const struct av_dump_backend_interface* get_av_dump_backend(const char* name)
+{
+    const struct av_dump_backend_interface** i;
+
+    /* passing NULL or empty string disables dumping */
+    if (!name || strlen(name) == 0) { return NULL; }
+
+    /* iterate through interfaces to find matching name */
+    for (i = g_av_dump_backend_interfaces; (*i) != NULL; ++i) {
+        if (strcmp((*i)->name, name) == 0) { return (*i); }
+    }
+
+    return NULL;
+}
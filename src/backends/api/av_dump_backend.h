@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - av_dump_backend.h                                       *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_BACKENDS_API_AV_DUMP_BACKEND_H
+#define M64P_BACKENDS_API_AV_DUMP_BACKEND_H
+
+#include <stddef.h>
+
+#include "api/m64p_types.h"
+
+struct av_dump_backend_interface
+{
+    /* Backend class name.
+     * Must be unique.
+     */
+    const char* name;
+
+    /* Initialize backend instance (*dump) for a video of fps frames per second
+     * using (when provided) parameters from config section.
+     *
+     * Returns M64ERR_SUCCESS on success.
+     *
+     * You must call corresponding release method to release any allocated resources.
+     */
+    m64p_error (*init)(void** dump, const char* section, unsigned int fps);
+
+    /* Finish writing everything pushed so far, then release backend instance
+     * and any associated resources.
+     */
+    void (*release)(void* dump);
+
+    /* Get a buffer of at least size bytes to read the next video frame in.
+     * Unless it returned NULL (frame can't be dumped), it must be followed by push_frame.
+     */
+    void* (*get_frame_buffer)(void* dump, size_t size);
+
+    /* Queue the frame read in the last buffer returned by get_frame_buffer,
+     * a bottom-up RGB image as returned by the video plugin readScreen.
+     */
+    void (*push_frame)(void* dump, unsigned int width, unsigned int height);
+
+    /* Notify the backend of the sample frequency of the samples pushed next.
+     */
+    void (*set_frequency)(void* dump, unsigned int frequency);
+
+    /* Queue stereo 16-bit samples as stored in RDRAM by the AI.
+     */
+    void (*push_samples)(void* dump, const void* samples, size_t size);
+};
+
+/* collection of available audio/video dump backends */
+extern const struct av_dump_backend_interface* g_av_dump_backend_interfaces[];
+
+/* helper function which find backend by name (NULL when not found or NULL/empty) */
+const struct av_dump_backend_interface* get_av_dump_backend(const char* name);
+
+#endif
@@ -0,0 +1,471 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - y4m_av_dump.c                                           *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "backends/api/av_dump_backend.h"
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define M64P_CORE_PROTOTYPES 1
+#include "api/callbacks.h"
+#include "api/m64p_config.h"
+#include "api/m64p_types.h"
+#include "main/util.h"
+#include "osal/files.h"
+
+#if defined(WIN32)
+#define popen _popen
+#define pclose _pclose
+#define POPEN_WRITE "wb"
+#else
+#define POPEN_WRITE "w"
+#endif
+
+/* Y4M + WAV dump backend
+ *
+ * Video frames go to <path>.y4m, or to the standard input of video_command
+ * (an external encoder), as 4:4:4 YUV. Samples go to <path>.wav.
+ *
+ * The emulation thread only copies frames and samples in a ring of slots,
+ * and a writer thread converts and writes them. Each side owns its end of the
+ * ring and waits on a semaphore only when the ring is full or empty, so the
+ * emulation blocks when the writer can't keep up instead of dropping frames.
+ */
+
+#define Y4M_DUMP_SLOTS 16
+
+enum
+{
+    Y4M_SLOT_FRAME,
+    Y4M_SLOT_SAMPLES,
+    Y4M_SLOT_FREQUENCY,
+    Y4M_SLOT_END
+};
+
+struct y4m_slot
+{
+    int type;
+    unsigned char* data;
+    size_t capacity;
+    size_t size;
+    unsigned int width;     /* frame width, or the sample frequency */
+    unsigned int height;
+};
+
+struct y4m_av_dump
+{
+    struct y4m_slot slots[Y4M_DUMP_SLOTS];
+    SDL_sem* free_slots;
+    SDL_sem* used_slots;
+    unsigned int head;      /* emulation thread */
+    unsigned int tail;      /* writer thread */
+    SDL_Thread* thread;
+
+    unsigned int fps;
+
+    /* writer thread */
+    FILE* video;
+    int video_is_pipe;
+    unsigned int width;
+    unsigned int height;
+    unsigned char* yuv;
+    uint64_t frames;
+    int write_failed;
+
+    FILE* audio;
+    unsigned int frequency;
+    uint64_t audio_bytes;
+};
+
+static void y4m_write_wav_header(struct y4m_av_dump* dump)
+{
+    unsigned char header[44];
+    uint32_t data_size = (dump->audio_bytes > 0xffffffd3u) ? 0xffffffd3u : (uint32_t)dump->audio_bytes;
+    uint32_t frequency = dump->frequency;
+
+    memcpy(header, "RIFF", 4);
+    header[4] = (unsigned char)(data_size + 36);
+    header[5] = (unsigned char)((data_size + 36) >> 8);
+    header[6] = (unsigned char)((data_size + 36) >> 16);
+    header[7] = (unsigned char)((data_size + 36) >> 24);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    header[16] = 16; header[17] = 0; header[18] = 0; header[19] = 0;
+    header[20] = 1; header[21] = 0;     /* PCM */
+    header[22] = 2; header[23] = 0;     /* stereo */
+    header[24] = (unsigned char)frequency;
+    header[25] = (unsigned char)(frequency >> 8);
+    header[26] = (unsigned char)(frequency >> 16);
+    header[27] = (unsigned char)(frequency >> 24);
+    header[28] = (unsigned char)(frequency * 4);
+    header[29] = (unsigned char)((frequency * 4) >> 8);
+    header[30] = (unsigned char)((frequency * 4) >> 16);
+    header[31] = (unsigned char)((frequency * 4) >> 24);
+    header[32] = 4; header[33] = 0;     /* block align */
+    header[34] = 16; header[35] = 0;    /* bits per sample */
+    memcpy(header + 36, "data", 4);
+    header[40] = (unsigned char)data_size;
+    header[41] = (unsigned char)(data_size >> 8);
+    header[42] = (unsigned char)(data_size >> 16);
+    header[43] = (unsigned char)(data_size >> 24);
+
+    fseek(dump->audio, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), dump->audio);
+    fseek(dump->audio, 0, SEEK_END);
+}
+
+static void y4m_write_frame(struct y4m_av_dump* dump, const struct y4m_slot* slot)
+{
+    size_t plane = (size_t)dump->width * dump->height;
+    unsigned char* y_plane = dump->yuv;
+    unsigned char* u_plane = y_plane + plane;
+    unsigned char* v_plane = u_plane + plane;
+    unsigned int x, y;
+
+    /* the size of the stream is set by the first frame */
+    if (dump->yuv == NULL)
+    {
+        dump->width = slot->width;
+        dump->height = slot->height;
+        plane = (size_t)dump->width * dump->height;
+        dump->yuv = malloc(plane * 3);
+        if (dump->yuv == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "AV dump: Failed to allocate %ux%u frame", dump->width, dump->height);
+            return;
+        }
+        y_plane = dump->yuv;
+        u_plane = y_plane + plane;
+        v_plane = u_plane + plane;
+
+        fprintf(dump->video, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", dump->width, dump->height, dump->fps);
+    }
+    else if (slot->width != dump->width || slot->height != dump->height)
+    {
+        /* later frames of another size are cropped or padded with black */
+        memset(y_plane, 16, plane);
+        memset(u_plane, 128, plane * 2);
+    }
+
+    /* BT.601 limited range, the image is bottom-up */
+    for (y = 0; y < dump->height && y < slot->height; y++)
+    {
+        const unsigned char* rgb = slot->data + (size_t)(slot->height - 1 - y) * slot->width * 3;
+        size_t row = (size_t)y * dump->width;
+
+        for (x = 0; x < dump->width && x < slot->width; x++, rgb += 3)
+        {
+            int r = rgb[0], g = rgb[1], b = rgb[2];
+
+            y_plane[row + x] = (unsigned char)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+            u_plane[row + x] = (unsigned char)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+            v_plane[row + x] = (unsigned char)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+        }
+    }
+
+    /* a pipe closed by the encoder fails every frame, only tell once */
+    if ((fputs("FRAME\n", dump->video) < 0 || fwrite(dump->yuv, 1, plane * 3, dump->video) != plane * 3)
+        && !dump->write_failed)
+    {
+        DebugMessage(M64MSG_ERROR, "AV dump: Failed to write video frame %llu", (unsigned long long)dump->frames);
+        dump->write_failed = 1;
+    }
+    ++dump->frames;
+}
+
+static void y4m_write_samples(struct y4m_av_dump* dump, struct y4m_slot* slot)
+{
+    unsigned char* samples = slot->data;
+    size_t i;
+
+    /* each RDRAM word holds the left sample in its upper half */
+    for (i = 0; i + 4 <= slot->size; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, samples + i, 4);
+        samples[i + 0] = (unsigned char)(word >> 16);
+        samples[i + 1] = (unsigned char)(word >> 24);
+        samples[i + 2] = (unsigned char)word;
+        samples[i + 3] = (unsigned char)(word >> 8);
+    }
+
+    if (fwrite(samples, 1, i, dump->audio) != i)
+    {
+        DebugMessage(M64MSG_ERROR, "AV dump: Failed to write audio samples");
+    }
+    dump->audio_bytes += i;
+}
+
+static int y4m_writer_thread(void* opaque)
+{
+    struct y4m_av_dump* dump = (struct y4m_av_dump*)opaque;
+
+    for (;;)
+    {
+        struct y4m_slot* slot;
+
+        SDL_SemWait(dump->used_slots);
+        slot = &dump->slots[dump->tail];
+
+        if (slot->type == Y4M_SLOT_END)
+            break;
+
+        switch (slot->type)
+        {
+        case Y4M_SLOT_FRAME:
+            y4m_write_frame(dump, slot);
+            break;
+        case Y4M_SLOT_SAMPLES:
+            y4m_write_samples(dump, slot);
+            break;
+        case Y4M_SLOT_FREQUENCY:
+            if (dump->frequency != 0 && dump->frequency != slot->width)
+            {
+                DebugMessage(M64MSG_WARNING, "AV dump: Sample frequency changed from %u to %u, the audio will drift",
+                    dump->frequency, slot->width);
+            }
+            else
+            {
+                dump->frequency = slot->width;
+            }
+            break;
+        }
+
+        dump->tail = (dump->tail + 1) % Y4M_DUMP_SLOTS;
+        SDL_SemPost(dump->free_slots);
+    }
+
+    return 0;
+}
+
+static struct y4m_slot* y4m_get_slot(struct y4m_av_dump* dump, size_t size)
+{
+    struct y4m_slot* slot = &dump->slots[dump->head];
+
+    SDL_SemWait(dump->free_slots);
+
+    if (slot->capacity < size)
+    {
+        unsigned char* data = realloc(slot->data, size);
+        if (data == NULL)
+        {
+            SDL_SemPost(dump->free_slots);
+            return NULL;
+        }
+        slot->data = data;
+        slot->capacity = size;
+    }
+
+    slot->size = size;
+    return slot;
+}
+
+static void y4m_push_slot(struct y4m_av_dump* dump, int type)
+{
+    dump->slots[dump->head].type = type;
+    dump->head = (dump->head + 1) % Y4M_DUMP_SLOTS;
+    SDL_SemPost(dump->used_slots);
+}
+
+static void y4m_release(void* opaque)
+{
+    struct y4m_av_dump* dump = (struct y4m_av_dump*)opaque;
+    unsigned int i;
+
+    if (dump == NULL)
+        return;
+
+    if (dump->thread != NULL)
+    {
+        y4m_get_slot(dump, 0);
+        y4m_push_slot(dump, Y4M_SLOT_END);
+        SDL_WaitThread(dump->thread, NULL);
+    }
+
+    if (dump->video != NULL)
+    {
+        if (dump->video_is_pipe)
+            pclose(dump->video);
+        else
+            fclose(dump->video);
+    }
+    if (dump->audio != NULL)
+    {
+        y4m_write_wav_header(dump);
+        fclose(dump->audio);
+    }
+    if (dump->frames != 0)
+    {
+        DebugMessage(M64MSG_INFO, "AV dump: Wrote %llu frames and %llu samples",
+            (unsigned long long)dump->frames, (unsigned long long)(dump->audio_bytes / 4));
+    }
+
+    if (dump->free_slots != NULL)
+        SDL_DestroySemaphore(dump->free_slots);
+    if (dump->used_slots != NULL)
+        SDL_DestroySemaphore(dump->used_slots);
+    for (i = 0; i < Y4M_DUMP_SLOTS; i++)
+        free(dump->slots[i].data);
+    free(dump->yuv);
+    free(dump);
+}
+
+static m64p_error y4m_init(void** opaque, const char* section, unsigned int fps)
+{
+    struct y4m_av_dump* dump;
+    const char* path = "";
+    const char* video_command = "";
+    char* filename;
+
+    *opaque = NULL;
+
+    if (section && strlen(section) > 0) {
+        m64p_handle config = NULL;
+
+        ConfigOpenSection(section, &config);
+
+        /* set default parameters */
+        ConfigSetDefaultString(config, "path", path, "Path of the dump without extension, .y4m and .wav are appended");
+        ConfigSetDefaultString(config, "video_command", video_command, "Command the video is piped to instead of the .y4m file, e.g. \"ffmpeg -i - out.mkv\"");
+
+        /* get parameters */
+        path = ConfigGetParamString(config, "path");
+        video_command = ConfigGetParamString(config, "video_command");
+    }
+
+    if (path == NULL || strlen(path) == 0)
+    {
+        DebugMessage(M64MSG_ERROR, "AV dump: No output path set in [%s]", section);
+        return M64ERR_INPUT_INVALID;
+    }
+
+    dump = calloc(1, sizeof(*dump));
+    if (dump == NULL)
+        return M64ERR_NO_MEMORY;
+    dump->fps = fps;
+
+    if (video_command != NULL && strlen(video_command) > 0)
+    {
+        dump->video = popen(video_command, POPEN_WRITE);
+        dump->video_is_pipe = 1;
+    }
+    else
+    {
+        filename = formatstr("%s.y4m", path);
+        dump->video = (filename != NULL) ? osal_file_open(filename, "wb") : NULL;
+        free(filename);
+    }
+
+    filename = formatstr("%s.wav", path);
+    dump->audio = (filename != NULL) ? osal_file_open(filename, "wb") : NULL;
+    free(filename);
+
+    if (dump->video == NULL || dump->audio == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "AV dump: Failed to open the outputs of %s", path);
+        y4m_release(dump);
+        return M64ERR_FILES;
+    }
+    /* the header is written again with the final sizes */
+    y4m_write_wav_header(dump);
+
+    dump->free_slots = SDL_CreateSemaphore(Y4M_DUMP_SLOTS);
+    dump->used_slots = SDL_CreateSemaphore(0);
+    if (dump->free_slots == NULL || dump->used_slots == NULL)
+    {
+        y4m_release(dump);
+        return M64ERR_SYSTEM_FAIL;
+    }
+
+    dump->thread = SDL_CreateThread(y4m_writer_thread, "m64pdump", dump);
+    if (dump->thread == NULL)
+    {
+        y4m_release(dump);
+        return M64ERR_SYSTEM_FAIL;
+    }
+
+    DebugMessage(M64MSG_INFO, "AV dump: Dumping to %s", path);
+    *opaque = dump;
+    return M64ERR_SUCCESS;
+}
+
+static void* y4m_get_frame_buffer(void* opaque, size_t size)
+{
+    struct y4m_slot* slot = y4m_get_slot((struct y4m_av_dump*)opaque, size);
+    return (slot != NULL) ? slot->data : NULL;
+}
+
+static void y4m_push_frame(void* opaque, unsigned int width, unsigned int height)
+{
+    struct y4m_av_dump* dump = (struct y4m_av_dump*)opaque;
+    struct y4m_slot* slot = &dump->slots[dump->head];
+
+    /* a frame larger than its buffer was already a buffer overflow */
+    if ((size_t)width * height * 3 > slot->size)
+    {
+        width = 0;
+        height = 0;
+    }
+    slot->width = width;
+    slot->height = height;
+    y4m_push_slot(dump, Y4M_SLOT_FRAME);
+}
+
+static void y4m_set_frequency(void* opaque, unsigned int frequency)
+{
+    struct y4m_av_dump* dump = (struct y4m_av_dump*)opaque;
+    struct y4m_slot* slot = y4m_get_slot(dump, 0);
+
+    if (slot == NULL)
+        return;
+
+    slot->width = frequency;
+    y4m_push_slot(dump, Y4M_SLOT_FREQUENCY);
+}
+
+static void y4m_push_samples(void* opaque, const void* samples, size_t size)
+{
+    struct y4m_av_dump* dump = (struct y4m_av_dump*)opaque;
+    struct y4m_slot* slot = y4m_get_slot(dump, size);
+
+    if (slot == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "AV dump: Out of memory, dropping %u bytes of samples", (unsigned int)size);
+        return;
+    }
+
+    memcpy(slot->data, samples, size);
+    y4m_push_slot(dump, Y4M_SLOT_SAMPLES);
+}
+
+const struct av_dump_backend_interface g_iy4m_av_dump_backend =
+{
+    "y4m",
+    y4m_init,
+    y4m_release,
+    y4m_get_frame_buffer,
+    y4m_push_frame,
+    y4m_set_frequency,
+    y4m_push_samples
+};
@@ -142,10 +142,10 @@ static void decode_recompiled(struct r4300_core* r4300, uint32_t addr)
 
     lines_recompiled=0;
 
-    if (r4300->cached_interp.blocks[addr>>12] == NULL)
+    if (cached_interp_block(&r4300->cached_interp, addr>>12) == NULL)
         return;
 
-    if (r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4].ops == r4300->cached_interp.not_compiled)
+    if (cached_interp_block(&r4300->cached_interp, addr>>12)->block[(addr&0xFFF)/4].ops == r4300->cached_interp.not_compiled)
     {
         strcpy(opcode_recompiled[0],"INVLD");
         strcpy(args_recompiled[0],"NOTCOMPILED");
@@ -155,15 +155,15 @@ static void decode_recompiled(struct r4300_core* r4300, uint32_t addr)
         return;
     }
 
-    assemb = (r4300->cached_interp.blocks[addr>>12]->code) +
-        (r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4].local_addr);
+    assemb = (cached_interp_block(&r4300->cached_interp, addr>>12)->code) +
+        (cached_interp_block(&r4300->cached_interp, addr>>12)->block[(addr&0xFFF)/4].local_addr);
 
-    end_addr = r4300->cached_interp.blocks[addr>>12]->code;
+    end_addr = cached_interp_block(&r4300->cached_interp, addr>>12)->code;
 
     if ((addr & 0xFFF) >= 0xFFC)
-        end_addr += r4300->cached_interp.blocks[addr>>12]->code_length;
+        end_addr += cached_interp_block(&r4300->cached_interp, addr>>12)->code_length;
     else
-        end_addr += r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4+1].local_addr;
+        end_addr += cached_interp_block(&r4300->cached_interp, addr>>12)->block[(addr&0xFFF)/4+1].local_addr;
 
     while (assemb < end_addr)
     {
@@ -223,18 +223,18 @@ int get_has_recompiled(struct r4300_core* r4300, uint32_t addr)
 {
     unsigned char *assemb, *end_addr;
 
-    if (r4300->emumode != EMUMODE_DYNAREC || r4300->cached_interp.blocks[addr>>12] == NULL)
+    if (r4300->emumode != EMUMODE_DYNAREC || cached_interp_block(&r4300->cached_interp, addr>>12) == NULL)
         return FALSE;
 
-    assemb = (r4300->cached_interp.blocks[addr>>12]->code) +
-        (r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4].local_addr);
+    assemb = (cached_interp_block(&r4300->cached_interp, addr>>12)->code) +
+        (cached_interp_block(&r4300->cached_interp, addr>>12)->block[(addr&0xFFF)/4].local_addr);
 
-    end_addr = r4300->cached_interp.blocks[addr>>12]->code;
+    end_addr = cached_interp_block(&r4300->cached_interp, addr>>12)->code;
 
     if ((addr & 0xFFF) >= 0xFFC)
-        end_addr += r4300->cached_interp.blocks[addr>>12]->code_length;
+        end_addr += cached_interp_block(&r4300->cached_interp, addr>>12)->code_length;
     else
-        end_addr += r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4+1].local_addr;
+        end_addr += cached_interp_block(&r4300->cached_interp, addr>>12)->block[(addr&0xFFF)/4+1].local_addr;
     if(assemb==end_addr)
         return FALSE;
 
@@ -373,7 +373,7 @@ uint32_t get_memory_flags(struct device* dev, uint32_t addr)
     switch(type)
     {
         case M64P_MEM_NOMEM:
-            if(dev->r4300.cp0.tlb.LUT_r[addr>>12])
+            if(tlb_lut(dev->r4300.cp0.tlb.LUT_r, addr>>12))
                 flags = M64P_MEM_FLAG_READABLE | M64P_MEM_FLAG_WRITABLE_EMUONLY;
             break;
         case M64P_MEM_NOTHING:
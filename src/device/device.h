@@ -123,6 +123,7 @@ void init_device(struct device* dev,
     unsigned int count_per_op,
     unsigned int count_per_op_denom_pot,
     int no_compiled_jump,
+    int fuse_ops,
     int randomize_interrupt,
     uint32_t start_address,
     /* ai */
@@ -27,6 +27,7 @@
 #include "device/device.h"
 #include "device/rcp/rsp/rsp_core.h"
 #include "device/pif/pif.h"
+#include "main/instance.h"
 
 #ifdef DBG
 #include <string.h>
@@ -236,8 +237,9 @@ enum {
 #define MEM_BASE_PTR(mem_base)  ((void*)((uintptr_t)(mem_base) & ~0x1))
 #define SET_MEM_BASE_MODE(mem_base) (mem_base = (void*)((uintptr_t)(mem_base) | 0x1))
 
-static void*    mem_rom = NULL;
-static uint32_t mem_rom_size = 0;
+/* per-instance, see main/instance.h */
+#define mem_rom      (g_instance->mem_rom)
+#define mem_rom_size (g_instance->mem_rom_size)
 
 void* init_mem_base(void)
 {
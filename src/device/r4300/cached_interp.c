@@ -50,7 +50,7 @@
 #define UPDATE_DEBUGGER() do { } while(0)
 #endif
 
-#define DECLARE_R4300 struct r4300_core* r4300 = &g_dev.r4300;
+#define DECLARE_R4300 struct r4300_core* r4300 = &g_instance->dev->r4300;
 #define PCADDR *r4300_pc(r4300)
 #ifdef NEW_DYNAREC
 #define ADD_TO_PC(x) \
@@ -231,7 +231,7 @@ Used by dynarec only, check should be unnecessary
 void cached_interp_NOTCOMPILED(void)
 {
     DECLARE_R4300
-    uint32_t *mem = fast_mem_access(r4300, r4300->cached_interp.blocks[*r4300_pc(r4300)>>12]->start);
+    uint32_t *mem = fast_mem_access(r4300, cached_interp_block(&r4300->cached_interp, *r4300_pc(r4300)>>12)->start);
 #ifdef DBG
     DebugMessage(M64MSG_INFO, "NOTCOMPILED: addr = %x ops = %lx", *r4300_pc(r4300), (long) (*r4300_pc_struct(r4300))->ops);
 #endif
@@ -240,7 +240,7 @@ void cached_interp_NOTCOMPILED(void)
         DebugMessage(M64MSG_ERROR, "not compiled exception");
     }
     else {
-        r4300->cached_interp.recompile_block(r4300, mem, r4300->cached_interp.blocks[*r4300_pc(r4300) >> 12], *r4300_pc(r4300));
+        r4300->cached_interp.recompile_block(r4300, mem, cached_interp_block(&r4300->cached_interp, *r4300_pc(r4300) >> 12), *r4300_pc(r4300));
     }
 
 /*
@@ -340,6 +340,46 @@ static void (*const ci_table[R4300_OPCODES_COUNT])(void) =
 };
 #undef X
 
+// -----------------------------------------------------------
+// Superinstructions
+// -----------------------------------------------------------
+/* Frequent straight-line pairs are fused into a single op so they cost one
+ * dispatch instead of two. The second instruction keeps its own decoded op,
+ * so jumping to it directly still works. It is skipped when the first one
+ * raised an exception or is being executed as a delay slot. */
+#define FUSED_OPS \
+    X(LUI, ADDIU) X(LUI, ORI) X(LUI, LW) X(LUI, SW) X(LUI, LBU) X(LUI, LHU) \
+    X(LW, ADDIU) X(LW, ADDU) X(LW, LW) X(LW, SW) X(LW, BEQ) X(LW, BNE) \
+    X(LBU, ANDI) X(LBU, BEQ) X(LBU, BNE) \
+    X(ADDIU, LW) X(ADDIU, SW) X(ADDIU, BNE) \
+    X(SLL, ADDU) X(SLL, SRA) \
+    X(SLT, BEQ) X(SLT, BNE) X(SLTU, BEQ) X(SLTU, BNE) \
+    X(SLTI, BEQ) X(SLTI, BNE) X(SLTIU, BEQ) X(SLTIU, BNE) \
+    X(ANDI, BEQ) X(ANDI, BNE)
+
+#define X(first, second) \
+static void cached_interp_##first##_##second(void) \
+{ \
+    DECLARE_R4300 \
+    struct precomp_instr** pc = r4300_pc_struct(r4300); \
+    const struct precomp_instr* next = (*pc) + 1; \
+    cached_interp_##first(); \
+    if ((*pc) == next && !r4300->delay_slot) \
+        cached_interp_##second(); \
+}
+FUSED_OPS
+#undef X
+
+static void (*get_fused_op(enum r4300_opcode first, enum r4300_opcode second))(void)
+{
+#define X(a, b) \
+    if (first == R4300_OP_##a && second == R4300_OP_##b) \
+        return cached_interp_##a##_##b;
+    FUSED_OPS
+#undef X
+    return NULL;
+}
+
 /* return 0:normal, 1:idle, 2:out */
 static int infer_jump_sub_type(uint32_t target, uint32_t pc, uint32_t next_iw, const struct precomp_block* block)
 {
@@ -747,13 +787,62 @@ size_t get_block_memsize(const struct precomp_block *block)
     return ((length+1)+(length>>2)) * sizeof(struct precomp_instr);
 }
 
+/* Hash the RDRAM page backing a KSEG0/KSEG1 block.
+ * TLB pages are hashed by TLBWrite against their current mapping,
+ * and pages outside RDRAM are never revalidated, so both yield 0.
+ */
+uint64_t hash_block_page(const struct r4300_core* r4300, const struct precomp_block* block)
+{
+    uint32_t paddr;
+
+    if ((block->start & UINT32_C(0xc0000000)) != UINT32_C(0x80000000)) {
+        return 0;
+    }
+
+    paddr = block->start & UINT32_C(0x1ffff000);
+    if (paddr >= r4300->rdram->dram_size) {
+        return 0;
+    }
+
+    return XXH3_64bits(&r4300->rdram->dram[paddr/4], 0x1000);
+}
+
+int cached_interp_revalidate_block(struct r4300_core* r4300, uint32_t address)
+{
+    const struct precomp_block* b = cached_interp_block(&r4300->cached_interp, address >> 12);
+    uint32_t alt_addr;
+
+    if (b == NULL || b->block == NULL || b->xxhash == 0
+     || b->xxhash != hash_block_page(r4300, b)) {
+        return 0;
+    }
+
+    /* page content is unchanged since the block was set up: keep its ops */
+    r4300->cached_interp.invalid_code[address >> 12] = 0;
+
+    alt_addr = b->start ^ UINT32_C(0x20000000);
+    if (r4300->cached_interp.invalid_code[alt_addr>>12])
+    {
+        r4300->cached_interp.init_block(r4300, alt_addr);
+    }
+
+    return 1;
+}
+
 void cached_interp_init_block(struct r4300_core* r4300, uint32_t address)
 {
     int i, length;
 
-    struct precomp_block** block = &r4300->cached_interp.blocks[address >> 12];
+    if (cached_interp_revalidate_block(r4300, address)) {
+        return;
+    }
+
+    struct precomp_block** block = cached_interp_block_slot(&r4300->cached_interp, address >> 12);
 
     /* allocate block */
+    if (block == NULL) {
+        return;
+    }
     if (*block == NULL) {
         *block = malloc(sizeof(struct precomp_block));
         (*block)->block = NULL;
@@ -788,6 +877,7 @@ void cached_interp_init_block(struct r4300_core* r4300, uint32_t address)
         b->block[i].addr = b->start + 4*i;
         b->block[i].ops = cached_interp_NOTCOMPILED;
     }
+    b->xxhash = hash_block_page(r4300, b);
 
     /* here we're marking the block as a valid code even if it's not compiled
      * yet as the game should have already set up the code correctly.
@@ -830,7 +920,9 @@ void cached_interp_recompile_block(struct r4300_core* r4300, const uint32_t* iw,
 {
     int i, length, length2, finished;
     struct precomp_instr* inst;
-    enum r4300_opcode opcode;
+    enum r4300_opcode opcode, prev_opcode = R4300_OP_RESERVED;
+    void (*fused_op)(void);
+    int fuse_ops = r4300->cached_interp.fuse_ops;
 
     /* ??? not sure why we need these 2 different tests */
     int block_start_in_tlb = ((block->start & UINT32_C(0xc0000000)) != UINT32_C(0x80000000));
@@ -839,8 +931,15 @@ void cached_interp_recompile_block(struct r4300_core* r4300, const uint32_t* iw,
     length = get_block_length(block);
     length2 = length - 2 + (length >> 2);
 
-    /* reset xxhash */
-    block->xxhash = 0;
+#ifdef DBG
+    /* breakpoints have to see every instruction */
+    if (g_DebuggerActive) { fuse_ops = 0; }
+#endif
+
+    /* reset xxhash (TLB pages are rehashed by TLBWrite on unmap) */
+    if (block_start_in_tlb) {
+        block->xxhash = 0;
+    }
 
 
     for (i = (func & 0xFFF) / 4, finished = 0; finished != 2; ++i)
@@ -853,14 +952,21 @@ void cached_interp_recompile_block(struct r4300_core* r4300, const uint32_t* iw,
         if (block_start_in_tlb)
         {
             uint32_t address2 = virtual_to_physical_address(r4300, inst->addr, 0);
-            if (r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops == cached_interp_NOTCOMPILED) {
-                r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops = cached_interp_NOTCOMPILED2;
+            if (cached_interp_block(&r4300->cached_interp, address2>>12)->block[(address2&UINT32_C(0xFFF))/4].ops == cached_interp_NOTCOMPILED) {
+                cached_interp_block(&r4300->cached_interp, address2>>12)->block[(address2&UINT32_C(0xFFF))/4].ops = cached_interp_NOTCOMPILED2;
             }
         }
 
         /* decode instruction */
         opcode = r4300_decode(inst, r4300, r4300_get_idec(iw[i]), iw[i], iw[i+1], block);
 
+        /* fuse with the previous instruction if both were decoded in this pass */
+        if (fuse_ops && i > (func & 0xFFF) / 4
+        && (fused_op = get_fused_op(prev_opcode, opcode)) != NULL) {
+            (inst-1)->ops = fused_op;
+        }
+        prev_opcode = opcode;
+
         /* decode ending conditions */
         if (i >= length2) { finished = 2; }
         if (i >= (length-1)
@@ -914,32 +1020,81 @@ void cached_interpreter_jump_to(struct r4300_core* r4300, uint32_t address)
     }
 
     /* set new PC */
-    cinterp->actual = cinterp->blocks[address >> 12];
+    cinterp->actual = cached_interp_block(cinterp, address >> 12);
     (*r4300_pc_struct(r4300)) = cinterp->actual->block + ((address - cinterp->actual->start) >> 2);
 }
 
 
+struct precomp_block** cached_interp_block_slot(struct cached_interp* cinterp, uint32_t page)
+{
+    struct precomp_block*** leaf = &cinterp->blocks[page >> CACHED_INTERP_LEAF_BITS];
+
+    if (*leaf == NULL)
+    {
+        *leaf = calloc(CACHED_INTERP_LEAF_SIZE, sizeof(**leaf));
+        if (*leaf == NULL) {
+            DebugMessage(M64MSG_ERROR, "Memory error: couldn't allocate block table leaf.");
+            return NULL;
+        }
+    }
+
+    return &(*leaf)[page & (CACHED_INTERP_LEAF_SIZE - 1)];
+}
+
+/* Prevents every block from being revalidated by its page hash,
+ * so the next init_block regenerates its code. */
+void cached_interp_drop_block_hashes(struct cached_interp* cinterp)
+{
+    size_t i, j;
+    for (i = 0; i < CACHED_INTERP_LEAVES; ++i)
+    {
+        struct precomp_block** leaf = cinterp->blocks[i];
+
+        if (leaf == NULL)
+            continue;
+
+        for (j = 0; j < CACHED_INTERP_LEAF_SIZE; ++j)
+        {
+            if (leaf[j])
+            {
+                leaf[j]->xxhash = 0;
+            }
+        }
+    }
+}
+
 void init_blocks(struct cached_interp* cinterp)
 {
     size_t i;
-    for (i = 0; i < 0x100000; ++i)
+
+    memset(cinterp->invalid_code, 1, 0x100000);
+    for (i = 0; i < CACHED_INTERP_LEAVES; ++i)
     {
-        cinterp->invalid_code[i] = 1;
         cinterp->blocks[i] = NULL;
     }
 }
 
 void free_blocks(struct cached_interp* cinterp)
 {
-    size_t i;
-    for (i = 0; i < 0x100000; ++i)
+    size_t i, j;
+    for (i = 0; i < CACHED_INTERP_LEAVES; ++i)
     {
-        if (cinterp->blocks[i])
+        struct precomp_block** leaf = cinterp->blocks[i];
+
+        if (leaf == NULL)
+            continue;
+
+        for (j = 0; j < CACHED_INTERP_LEAF_SIZE; ++j)
         {
-            cinterp->free_block(cinterp->blocks[i]);
-            free(cinterp->blocks[i]);
-            cinterp->blocks[i] = NULL;
+            if (leaf[j])
+            {
+                cinterp->free_block(leaf[j]);
+                free(leaf[j]);
+            }
         }
+
+        free(leaf);
+        cinterp->blocks[i] = NULL;
     }
 }
 
@@ -965,14 +1120,21 @@ void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address
 
             if (r4300->cached_interp.invalid_code[i] == 0)
             {
-                if (r4300->cached_interp.blocks[i] == NULL
-                 || r4300->cached_interp.blocks[i]->block[(addr & 0xfff) / 4].ops != r4300->cached_interp.not_compiled)
+                struct precomp_block* b = cached_interp_block(&r4300->cached_interp, i);
+
+                if (b == NULL
+                 || b->block[(addr & 0xfff) / 4].ops != r4300->cached_interp.not_compiled)
                 {
                     r4300->cached_interp.invalid_code[i] = 1;
                     /* go directly to next i */
                     addr &= ~0xfff;
                     addr |= 0xffc;
                 }
+                else
+                {
+                    /* page stays valid, but no longer matches its hash */
+                    b->xxhash = 0;
+                }
             }
             else
             {
@@ -37,12 +37,18 @@ enum r4300_opcode r4300_decode(struct precomp_instr* inst, struct r4300_core* r4
 
 int get_block_length(const struct precomp_block *block);
 size_t get_block_memsize(const struct precomp_block *block);
+uint64_t hash_block_page(const struct r4300_core* r4300, const struct precomp_block* block);
 
 void cached_interp_init_block(struct r4300_core* r4300, uint32_t address);
+int cached_interp_revalidate_block(struct r4300_core* r4300, uint32_t address);
 void cached_interp_free_block(struct precomp_block* block);
 
 void cached_interp_recompile_block(struct r4300_core* r4300, const uint32_t* iw, struct precomp_block* block, uint32_t func);
 
+struct precomp_block** cached_interp_block_slot(struct cached_interp* cinterp, uint32_t page);
+
+void cached_interp_drop_block_hashes(struct cached_interp* cinterp);
+
 void init_blocks(struct cached_interp* cinterp);
 void free_blocks(struct cached_interp* cinterp);
 
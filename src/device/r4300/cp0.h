@@ -22,6 +22,7 @@
 #ifndef M64P_DEVICE_R4300_CP0_H
 #define M64P_DEVICE_R4300_CP0_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "interrupt.h"
@@ -140,7 +141,7 @@ enum r4300_cp0_registers
 
 
 
-enum { INTERRUPT_NODES_POOL_CAPACITY = 16 };
+enum { INTERRUPT_QUEUE_CAPACITY = 16 };
 
 struct interrupt_event
 {
@@ -148,23 +149,12 @@ struct interrupt_event
     unsigned int count;
 };
 
-struct node
-{
-    struct interrupt_event data;
-    struct node *next;
-};
-
-struct pool
-{
-    struct node nodes [INTERRUPT_NODES_POOL_CAPACITY];
-    struct node* stack[INTERRUPT_NODES_POOL_CAPACITY];
-    size_t index;
-};
-
+/* Events in the order they happen, stored from the last one to the next one
+ * so that the next event is read and removed without moving the others */
 struct interrupt_queue
 {
-    struct pool pool;
-    struct node* first;
+    struct interrupt_event events[INTERRUPT_QUEUE_CAPACITY];
+    size_t size;
 };
 
 struct interrupt_handler
@@ -43,73 +43,54 @@
 #include "device/r4300/recomp.h"
 #include "device/rcp/ai/ai_controller.h"
 #include "device/rcp/vi/vi_controller.h"
+#include "jimmi/keyframe_manager.h"
 #include "main/main.h"
+#include "main/rollback.h"
 #include "main/savestates.h"
 
 
 /***************************************************************************
- * Pool of Single Linked List Nodes
+ * Interrupt Queue
  **************************************************************************/
 
-static struct node* alloc_node(struct pool* p);
-static void free_node(struct pool* p, struct node* node);
-static void clear_pool(struct pool* p);
-
-
-/* node allocation/deallocation on a given pool */
-static struct node* alloc_node(struct pool* p)
+static void clear_queue(struct interrupt_queue* q)
 {
-    /* return NULL if pool is too small */
-    if (p->index >= INTERRUPT_NODES_POOL_CAPACITY) {
-        return NULL;
-    }
-
-    return p->stack[p->index++];
+    q->size = 0;
 }
 
-static void free_node(struct pool* p, struct node* node)
+/* next event, the queue must not be empty */
+static struct interrupt_event* first_event(const struct interrupt_queue* q)
 {
-    if (p->index == 0 || node == NULL) {
-        return;
-    }
-
-    p->stack[--p->index] = node;
+    return (struct interrupt_event*)&q->events[q->size - 1];
 }
 
-/* release all nodes */
-static void clear_pool(struct pool* p)
+/* index of the event of the given type, or -1 */
+static int find_event(const struct interrupt_queue* q, int type)
 {
-    size_t i;
+    int i;
 
-    for (i = 0; i < INTERRUPT_NODES_POOL_CAPACITY; ++i) {
-        p->stack[i] = &p->nodes[i];
+    for (i = (int)q->size - 1; i >= 0; --i) {
+        if (q->events[i].type == type) {
+            return i;
+        }
     }
 
-    p->index = 0;
+    return -1;
 }
 
-/***************************************************************************
- * Interrupt Queue
- **************************************************************************/
-
-static void clear_queue(struct interrupt_queue* q)
+static void update_next_interrupt(struct cp0* cp0)
 {
-    q->first = NULL;
-    clear_pool(&q->pool);
-}
-
-static int before_event(const struct cp0* cp0, unsigned int evt1, unsigned int evt2, int type2)
-{
-    const uint32_t* cp0_regs = r4300_cp0_regs((struct cp0*)cp0); /* OK to cast away const qualifier */
-    uint32_t count = cp0_regs[CP0_COUNT_REG];
-    int* cp0_cycle_count = r4300_cp0_cycle_count((struct cp0*)cp0);
+    const uint32_t* cp0_regs = r4300_cp0_regs(cp0);
+    unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(cp0);
+    int* cp0_cycle_count = r4300_cp0_cycle_count(cp0);
 
-    /* At least one other interrupt is pending */
-    if (*cp0_cycle_count > 0)
-        count -= *cp0_cycle_count;
+    *cp0_next_interrupt = (cp0->q.size != 0)
+        ? first_event(&cp0->q)->count
+        : 0;
 
-    if ((evt1 - count) < (evt2 - count)) return 1;
-    else return 0;
+    *cp0_cycle_count = (cp0->q.size != 0)
+        ? (cp0_regs[CP0_COUNT_REG] - first_event(&cp0->q)->count)
+        : 0;
 }
 
 unsigned int add_random_interrupt_time(struct r4300_core* r4300)
@@ -134,145 +115,94 @@ void add_interrupt_event(struct cp0* cp0, int type, unsigned int delay)
 
 void add_interrupt_event_count(struct cp0* cp0, int type, unsigned int count)
 {
-    struct node* event;
-    struct node* e;
+    struct interrupt_queue* q = &cp0->q;
     const uint32_t* cp0_regs = r4300_cp0_regs(cp0);
     unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(cp0);
     int* cp0_cycle_count = r4300_cp0_cycle_count(cp0);
+    uint32_t base = cp0_regs[CP0_COUNT_REG];
+    size_t i;
 
-    if (get_event(&cp0->q, type)) {
+    if (get_event(q, type)) {
         DebugMessage(M64MSG_WARNING, "two events of type 0x%x in interrupt queue", type);
     }
 
-    event = alloc_node(&cp0->q.pool);
-    if (event == NULL)
+    if (q->size >= INTERRUPT_QUEUE_CAPACITY)
     {
         DebugMessage(M64MSG_ERROR, "Failed to allocate node for new interrupt event");
         return;
     }
 
-    event->data.count = count;
-    event->data.type = type;
+    /* At least one other interrupt is pending */
+    if (*cp0_cycle_count > 0)
+        base -= *cp0_cycle_count;
 
-    if (cp0->q.first == NULL)
-    {
-        cp0->q.first = event;
-        event->next = NULL;
-    }
-    else if (before_event(cp0, count, cp0->q.first->data.count, cp0->q.first->data.type))
-    {
-        event->next = cp0->q.first;
-        cp0->q.first = event;
-    }
-    else
-    {
-        for (e = cp0->q.first;
-            e->next != NULL &&
-            (!before_event(cp0, count, e->next->data.count, e->next->data.type));
-            e = e->next);
+    /* the new event goes before the first event it happens strictly before,
+     * so after the ones due at the same count. Searching from the next event
+     * stops early for the events scheduled soon, which are the most common. */
+    for (i = q->size; i > 0 && !((count - base) < (q->events[i - 1].count - base)); --i);
 
-        if (e->next == NULL)
-        {
-            e->next = event;
-            event->next = NULL;
-        }
-        else
-        {
-            for(; e->next != NULL && e->next->data.count == count; e = e->next);
+    memmove(&q->events[i + 1], &q->events[i], (q->size - i) * sizeof(q->events[0]));
+    q->events[i].count = count;
+    q->events[i].type = type;
+    ++q->size;
 
-            event->next = e->next;
-            e->next = event;
-        }
-    }
-    *cp0_next_interrupt = cp0->q.first->data.count;
-    *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - cp0->q.first->data.count;
+    *cp0_next_interrupt = first_event(q)->count;
+    *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - first_event(q)->count;
 }
 
 void remove_interrupt_event(struct cp0* cp0)
 {
-    struct node* e;
-    const uint32_t* cp0_regs = r4300_cp0_regs(cp0);
-    unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(cp0);
-    int* cp0_cycle_count = r4300_cp0_cycle_count(cp0);
-
-    e = cp0->q.first;
-    cp0->q.first = e->next;
-    free_node(&cp0->q.pool, e);
-
-    *cp0_next_interrupt = (cp0->q.first != NULL)
-        ? cp0->q.first->data.count
-        : 0;
-
-    *cp0_cycle_count = (cp0->q.first != NULL)
-        ? (cp0_regs[CP0_COUNT_REG] - cp0->q.first->data.count)
-        : 0;
+    --cp0->q.size;
+    update_next_interrupt(cp0);
 }
 
 unsigned int* get_event(const struct interrupt_queue* q, int type)
 {
-    struct node* e = q->first;
+    int i = find_event(q, type);
 
-    if (e == NULL) {
-        return NULL;
-    }
-
-    if (e->data.type == type) {
-        return &e->data.count;
-    }
-
-    for (; e->next != NULL && e->next->data.type != type; e = e->next);
-
-    return (e->next != NULL)
-        ? &e->next->data.count
+    return (i >= 0)
+        ? (unsigned int*)&q->events[i].count
         : NULL;
 }
 
 int get_next_event_type(const struct interrupt_queue* q)
 {
-    return (q->first == NULL)
+    return (q->size == 0)
+        ? 0
+        : first_event(q)->type;
+}
+
+unsigned int get_next_event_count(const struct interrupt_queue* q)
+{
+    return (q->size == 0)
         ? 0
-        : q->first->data.type;
+        : first_event(q)->count;
 }
 
 void remove_event(struct interrupt_queue* q, int type)
 {
-    struct node* to_del;
-    struct node* e = q->first;
+    int i = find_event(q, type);
 
-    if (e == NULL) {
+    if (i < 0) {
         return;
     }
 
-    if (e->data.type == type)
-    {
-        q->first = e->next;
-        free_node(&q->pool, e);
-    }
-    else
-    {
-        for (; e->next != NULL && e->next->data.type != type; e = e->next);
-
-        if (e->next != NULL)
-        {
-            to_del = e->next;
-            e->next = to_del->next;
-            free_node(&q->pool, to_del);
-        }
-    }
+    memmove(&q->events[i], &q->events[i + 1], (q->size - i - 1) * sizeof(q->events[0]));
+    --q->size;
 }
 
 void translate_event_queue(struct cp0* cp0, unsigned int base)
 {
-    struct node* e;
+    size_t i;
     uint32_t* cp0_regs = r4300_cp0_regs(cp0);
     int* cp0_cycle_count = r4300_cp0_cycle_count(cp0);
 
     remove_event(&cp0->q, COMPARE_INT);
     remove_event(&cp0->q, SPECIAL_INT);
 
-    for (e = cp0->q.first; e != NULL; e = e->next)
+    for (i = 0; i < cp0->q.size; ++i)
     {
-        e->data.count = (e->data.count - cp0_regs[CP0_COUNT_REG]) + base;
+        cp0->q.events[i].count = (cp0->q.events[i].count - cp0_regs[CP0_COUNT_REG]) + base;
     }
 
     cp0_regs[CP0_COUNT_REG] = base;
@@ -285,20 +215,21 @@ void translate_event_queue(struct cp0* cp0, unsigned int base)
     cp0_regs[CP0_COUNT_REG] -= cp0->count_per_op;
 
     /* Update next interrupt in case first event is COMPARE_INT */
-    *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - cp0->q.first->data.count;
+    *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - first_event(&cp0->q)->count;
 }
 
 int save_eventqueue_infos(const struct cp0* cp0, char *buf)
 {
     int len;
-    struct node* e;
+    size_t i;
 
     len = 0;
 
-    for (e = cp0->q.first; e != NULL; e = e->next)
+    /* in the order they happen */
+    for (i = cp0->q.size; i > 0; --i)
     {
-        memcpy(buf + len    , &e->data.type , 4);
-        memcpy(buf + len + 4, &e->data.count, 4);
+        memcpy(buf + len    , &cp0->q.events[i - 1].type , 4);
+        memcpy(buf + len + 4, &cp0->q.events[i - 1].count, 4);
         len += 8;
     }
 
@@ -334,7 +265,7 @@ void init_interrupt(struct cp0* cp0)
 
 void r4300_check_interrupt(struct r4300_core* r4300, uint32_t cause_ip, int set_cause)
 {
-    struct node* event;
+    struct interrupt_queue* q = &r4300->cp0.q;
     uint32_t* cp0_regs = r4300_cp0_regs(&r4300->cp0);
     unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(&r4300->cp0);
     int* cp0_cycle_count = r4300_cp0_cycle_count(&r4300->cp0);
@@ -351,29 +282,17 @@ void r4300_check_interrupt(struct r4300_core* r4300, uint32_t cause_ip, int set_
     }
     if (cp0_regs[CP0_STATUS_REG] & cp0_regs[CP0_CAUSE_REG] & UINT32_C(0xFF00))
     {
-        event = alloc_node(&r4300->cp0.q.pool);
-
-        if (event == NULL)
+        if (q->size >= INTERRUPT_QUEUE_CAPACITY)
         {
             DebugMessage(M64MSG_ERROR, "Failed to allocate node for new interrupt event");
             return;
         }
 
-        event->data.count = *cp0_next_interrupt = cp0_regs[CP0_COUNT_REG];
-        event->data.type = CHECK_INT;
+        /* happens right away, before anything else */
+        q->events[q->size].count = *cp0_next_interrupt = cp0_regs[CP0_COUNT_REG];
+        q->events[q->size].type = CHECK_INT;
+        ++q->size;
         *cp0_cycle_count = 0;
-
-        if (r4300->cp0.q.first == NULL)
-        {
-            r4300->cp0.q.first = event;
-            event->next = NULL;
-        }
-        else
-        {
-            event->next = r4300->cp0.q.first;
-            r4300->cp0.q.first = event;
-
-        }
     }
 }
 
@@ -406,7 +325,7 @@ void compare_int_handler(void* opaque)
     cp0_regs[CP0_COUNT_REG] -= r4300->cp0.count_per_op;
 
     /* Update next interrupt in case first event is COMPARE_INT */
-    *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - r4300->cp0.q.first->data.count;
+    *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - first_event(&r4300->cp0.q)->count;
 
     raise_maskable_interrupt(r4300, CP0_CAUSE_IP7);
 }
@@ -534,10 +453,6 @@ static void call_interrupt_handler(const struct cp0* cp0, size_t index)
 
 void gen_interrupt(struct r4300_core* r4300)
 {
-    uint32_t* cp0_regs = r4300_cp0_regs(&r4300->cp0);
-    unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(&r4300->cp0);
-    int* cp0_cycle_count = r4300_cp0_cycle_count(&r4300->cp0);
-
     if (*r4300_stop(r4300) == 1)
     {
         g_gs_vi_counter = 0; // debug
@@ -556,6 +471,12 @@ void gen_interrupt(struct r4300_core* r4300)
             return;
         }
 
+        if (keyframe_manager_get_job() == KEYFRAME_JOB_RESTORE)
+        {
+            keyframe_manager_restore();
+            return;
+        }
+
         if (r4300->reset_hard_job)
         {
             call_interrupt_handler(&r4300->cp0, 11);
@@ -568,20 +489,14 @@ void gen_interrupt(struct r4300_core* r4300)
         uint32_t dest = r4300->skip_jump;
         r4300->skip_jump = 0;
 
-        *cp0_next_interrupt = (r4300->cp0.q.first != NULL)
-            ? r4300->cp0.q.first->data.count
-            : 0;
-
-        *cp0_cycle_count = (r4300->cp0.q.first != NULL)
-            ? (cp0_regs[CP0_COUNT_REG] - r4300->cp0.q.first->data.count)
-            : 0;
+        update_next_interrupt(&r4300->cp0);
 
         r4300->cp0.last_addr = dest;
         generic_jump_to(r4300, dest);
         return;
     }
 
-    switch (r4300->cp0.q.first->data.type)
+    switch (first_event(&r4300->cp0.q)->type)
     {
         case VI_INT:
             call_interrupt_handler(&r4300->cp0, 0);
@@ -657,7 +572,7 @@ void gen_interrupt(struct r4300_core* r4300)
             break;
 
         default:
-            DebugMessage(M64MSG_ERROR, "Unknown interrupt queue event type %.8X.", r4300->cp0.q.first->data.type);
+            DebugMessage(M64MSG_ERROR, "Unknown interrupt queue event type %.8X.", first_event(&r4300->cp0.q)->type);
             remove_interrupt_event(&r4300->cp0);
             exception_general(r4300);
             break;
@@ -670,6 +585,16 @@ void gen_interrupt(struct r4300_core* r4300)
             savestates_save();
             return;
         }
+
+        if (keyframe_manager_get_job() == KEYFRAME_JOB_CAPTURE)
+        {
+            keyframe_manager_capture();
+        }
+
+        if (rollback_get_job() != ROLLBACK_JOB_NONE)
+        {
+            rollback_run_job();
+        }
     }
 }
 
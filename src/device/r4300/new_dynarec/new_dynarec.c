@@ -54,6 +54,9 @@
 #include "device/rcp/mi/mi_controller.h"
 #include "device/rcp/rsp/rsp_core.h"
 
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
 #if !defined(WIN32)
 #include <sys/mman.h>
 #endif
@@ -81,6 +84,13 @@ void recomp_dbg_block(int addr);
 #error "NEW_DYNAREC_CACHE_SIZE must match TARGET_SIZE_2"
 #endif
 
+// x86-64 output is position independent apart from the dirty stubs and
+// the mini_ht return addresses, so it can be kept in a code cache file
+// (see new_dynarec_load_cache).
+#if NEW_DYNAREC == NEW_DYNAREC_X64 && !defined(RECOMP_DBG)
+#define CODE_CACHE_FILE
+#endif
+
 static size_t dynarec_host_page_size(void)
 {
 #if defined(WIN32)
@@ -131,6 +141,7 @@ static void ensure_dynarec_cache_alignment(void)
 #define ASSEM_DEBUG 0
 #define INV_DEBUG 0
 #define COUNT_NOTCOMPILEDS 0
+#define HT_TRACE 0 // Write the address of every block lookup to ht_trace.bin (see tools/dynarec_ht_bench.c)
 
 //#define INTERPRET_LOAD
 //#define INTERPRET_STORE
@@ -274,6 +285,32 @@ struct ll_entry
   u_int length;
 };
 
+// Block lookup table: HT_WAYS entries per set, most recently inserted
+// first, used ways packed at the start of the set.  The virtual
+// addresses are kept next to the pointers so a lookup compares all
+// the ways of a set without branching or touching the entries.
+#ifndef NEW_DYNAREC_HT_WAYS
+#define NEW_DYNAREC_HT_WAYS 4
+#endif
+#ifndef NEW_DYNAREC_HT_BITS
+#define NEW_DYNAREC_HT_BITS 15
+#endif
+#if NEW_DYNAREC_HT_BITS < 11
+#error NEW_DYNAREC_HT_BITS must be at least 11 (the expiry clears HT_SETS/2048 sets per step)
+#endif
+#if (NEW_DYNAREC_HT_WAYS & (NEW_DYNAREC_HT_WAYS-1)) != 0
+#error NEW_DYNAREC_HT_WAYS must be a power of two
+#endif
+#define HT_WAYS NEW_DYNAREC_HT_WAYS
+#define HT_SETS (1<<NEW_DYNAREC_HT_BITS)
+#define HT_EMPTY 0xFFFFFFFF // Address of unused ways, never a block entry
+
+struct ht_set
+{
+  u_int vaddr[HT_WAYS];
+  struct ll_entry *head[HT_WAYS];
+};
+
 /* linkage */
 void verify_code(void);
 void cc_interrupt(void);
@@ -352,7 +389,15 @@ static char *copy;
 static int expirep;
 static u_int dirty_entry_count;
 static u_int copy_size;
-static struct ll_entry* hash_table[65536][2];
+static u_char *out_top; // Highest address written in the output buffer
+#ifdef CODE_CACHE_FILE
+static u_char reloc_map[(1<<TARGET_SIZE_2)/8]; // Absolute pointers into the output buffer, one bit per byte
+static u_int block_relocs[MAXBLOCK];
+static int block_reloc_count;
+static int code_cache_dirty; // Blocks were compiled since the cache was loaded
+#endif
+static struct ht_set hash_table[HT_SETS];
+static uint64_t ht_stats[2]; // Lookups that hit / missed hash_table
 static struct ll_entry *jump_in[4096];
 static struct ll_entry *jump_dirty[4096];
 static struct ll_entry *jump_out[4096];
@@ -1883,19 +1928,112 @@ static void add_stub(int type,intptr_t addr,intptr_t retaddr,int a,intptr_t b,in
   stubcount++;
 }
 
-static void remove_hash(u_int vaddr)
+static struct ht_set *get_ht_set(u_int vaddr)
 {
-  //DebugMessage(M64MSG_VERBOSE, "remove hash: %x",vaddr);
-  struct ll_entry **ht_bin=hash_table[(((vaddr)>>16)^vaddr)&0xFFFF];
-  if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) {
-    ht_bin[1]=NULL;
+  return &hash_table[(vaddr*0x9E3779B1u)>>(32-NEW_DYNAREC_HT_BITS)];
+}
+
+static void ht_clear(void)
+{
+  int n,i;
+  for(n=0;n<HT_SETS;n++) {
+    for(i=0;i<HT_WAYS;i++) {
+      hash_table[n].vaddr[i]=HT_EMPTY;
+      hash_table[n].head[i]=NULL;
+    }
   }
-  if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-    ht_bin[0]=ht_bin[1];
-    ht_bin[1]=NULL;
+}
+
+// Way of the set holding vaddr, or -1
+static int ht_find(const struct ht_set *set,u_int vaddr)
+{
+  int i;
+  for(i=0;i<HT_WAYS&&set->head[i];i++)
+    if(set->vaddr[i]==vaddr) return i;
+  return -1;
+}
+
+// Drop way i and pack the ones after it
+static void ht_remove_way(struct ht_set *set,int i)
+{
+  for(;i<HT_WAYS-1;i++) {
+    set->vaddr[i]=set->vaddr[i+1];
+    set->head[i]=set->head[i+1];
+  }
+  set->vaddr[HT_WAYS-1]=HT_EMPTY;
+  set->head[HT_WAYS-1]=NULL;
+}
+
+// Make head the most recent entry of its set, evicting the oldest
+// one if the set is full
+static void ht_insert(u_int vaddr,struct ll_entry *head)
+{
+  struct ht_set *set=get_ht_set(vaddr);
+  int i=ht_find(set,vaddr);
+  if(i<0) i=HT_WAYS-1;
+  for(;i>0;i--) {
+    set->vaddr[i]=set->vaddr[i-1];
+    set->head[i]=set->head[i-1];
+  }
+  set->vaddr[0]=vaddr;
+  set->head[0]=head;
+}
+
+// Insert with low priority: update an existing entry or use a free way,
+// but don't evict anything
+static void ht_insert_free(u_int vaddr,struct ll_entry *head)
+{
+  struct ht_set *set=get_ht_set(vaddr);
+  int i;
+  for(i=0;i<HT_WAYS;i++) {
+    if(set->head[i]==NULL||set->vaddr[i]==vaddr) {
+      set->vaddr[i]=vaddr;
+      set->head[i]=head;
+      return;
+    }
   }
 }
 
+// Point an existing entry at head, don't add new entries
+static void ht_replace(u_int vaddr,struct ll_entry *head)
+{
+  struct ht_set *set=get_ht_set(vaddr);
+  int i=ht_find(set,vaddr);
+  if(i>=0) set->head[i]=head;
+}
+
+static void remove_hash(u_int vaddr)
+{
+  //DebugMessage(M64MSG_VERBOSE, "remove hash: %x",vaddr);
+  struct ht_set *set=get_ht_set(vaddr);
+  int i=ht_find(set,vaddr);
+  if(i>=0) ht_remove_way(set,i);
+}
+
+static void *ht_lookup(u_int vaddr)
+{
+  const struct ht_set *set=get_ht_set(vaddr);
+  int i,hit=0,way=0;
+#if HT_TRACE
+  static FILE *trace=NULL;
+  if(trace==NULL) trace=fopen("ht_trace.bin","wb");
+  if(trace!=NULL) fwrite(&vaddr,sizeof(vaddr),1,trace);
+#endif
+  // A set holds an address at most once, unless it is HT_EMPTY,
+  // so or-ing the matching ways stays in range
+  for(i=0;i<HT_WAYS;i++) {
+    int match=set->vaddr[i]==vaddr;
+    hit|=match;
+    way|=match*i;
+  }
+  if(hit&&set->head[way]) {
+    ht_stats[0]++;
+    return (void *)(((intptr_t)set->head[way]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
+  }
+  ht_stats[1]++;
+  return NULL;
+}
+
 /**** Interpreted opcodes ****/
 #define UPDATE_COUNT_IN \
   struct r4300_core* r4300 = &g_dev.r4300; \
@@ -1990,16 +2128,16 @@ static void TLBWI_new(int pcaddr, int count)
      for fast look up. */
   for (i=r4300->cp0.tlb.entries[state->cp0_regs[CP0_INDEX_REG]&0x3F].start_even>>12; i<=r4300->cp0.tlb.entries[state->cp0_regs[CP0_INDEX_REG]&0x3F].end_even>>12; i++)
   {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,r4300->cp0.tlb.LUT_r[i],r4300->cp0.tlb.LUT_w[i]);
+    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,tlb_lut(r4300->cp0.tlb.LUT_r, i),tlb_lut(r4300->cp0.tlb.LUT_w, i));
     if(i<0x80000||i>0xBFFFF)
     {
-      if(r4300->cp0.tlb.LUT_r[i]) {
-        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((r4300->cp0.tlb.LUT_r[i]&0xFFFFF000)-0x80000000)-(i<<12))>>2;
+      if(tlb_lut(r4300->cp0.tlb.LUT_r, i)) {
+        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((tlb_lut(r4300->cp0.tlb.LUT_r, i)&0xFFFFF000)-0x80000000)-(i<<12))>>2;
         // FIXME: should make sure the physical page is invalid too
-        if(!r4300->cp0.tlb.LUT_w[i]||!r4300->cached_interp.invalid_code[i]) {
+        if(!tlb_lut(r4300->cp0.tlb.LUT_w, i)||!r4300->cached_interp.invalid_code[i]) {
           state->memory_map[i]|=WRITE_PROTECT; // Write protect
         }else{
-          assert(r4300->cp0.tlb.LUT_r[i]==r4300->cp0.tlb.LUT_w[i]);
+          assert(tlb_lut(r4300->cp0.tlb.LUT_r, i)==tlb_lut(r4300->cp0.tlb.LUT_w, i));
         }
         if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
         // Tell the dynamic recompiler to generate tlb lookup code
@@ -2011,16 +2149,16 @@ static void TLBWI_new(int pcaddr, int count)
   }
   for (i=r4300->cp0.tlb.entries[state->cp0_regs[CP0_INDEX_REG]&0x3F].start_odd>>12; i<=r4300->cp0.tlb.entries[state->cp0_regs[CP0_INDEX_REG]&0x3F].end_odd>>12; i++)
   {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,r4300->cp0.tlb.LUT_r[i],r4300->cp0.tlb.LUT_w[i]);
+    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,tlb_lut(r4300->cp0.tlb.LUT_r, i),tlb_lut(r4300->cp0.tlb.LUT_w, i));
     if(i<0x80000||i>0xBFFFF)
     {
-      if(r4300->cp0.tlb.LUT_r[i]) {
-        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((r4300->cp0.tlb.LUT_r[i]&0xFFFFF000)-0x80000000)-(i<<12))>>2;
+      if(tlb_lut(r4300->cp0.tlb.LUT_r, i)) {
+        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((tlb_lut(r4300->cp0.tlb.LUT_r, i)&0xFFFFF000)-0x80000000)-(i<<12))>>2;
         // FIXME: should make sure the physical page is invalid too
-        if(!r4300->cp0.tlb.LUT_w[i]||!r4300->cached_interp.invalid_code[i]) {
+        if(!tlb_lut(r4300->cp0.tlb.LUT_w, i)||!r4300->cached_interp.invalid_code[i]) {
           state->memory_map[i]|=WRITE_PROTECT; // Write protect
         }else{
-          assert(r4300->cp0.tlb.LUT_r[i]==r4300->cp0.tlb.LUT_w[i]);
+          assert(tlb_lut(r4300->cp0.tlb.LUT_r, i)==tlb_lut(r4300->cp0.tlb.LUT_w, i));
         }
         if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
         // Tell the dynamic recompiler to generate tlb lookup code
@@ -2066,16 +2204,16 @@ static void TLBWR_new(int pcaddr, int count)
      for fast look up. */
   for (i=r4300->cp0.tlb.entries[state->cp0_regs[CP0_RANDOM_REG]&0x3F].start_even>>12; i<=r4300->cp0.tlb.entries[state->cp0_regs[CP0_RANDOM_REG]&0x3F].end_even>>12; i++)
   {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,r4300->cp0.tlb.LUT_r[i],r4300->cp0.tlb.LUT_w[i]);
+    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,tlb_lut(r4300->cp0.tlb.LUT_r, i),tlb_lut(r4300->cp0.tlb.LUT_w, i));
     if(i<0x80000||i>0xBFFFF)
     {
-      if(r4300->cp0.tlb.LUT_r[i]) {
-        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((r4300->cp0.tlb.LUT_r[i]&0xFFFFF000)-0x80000000)-(i<<12))>>2;
+      if(tlb_lut(r4300->cp0.tlb.LUT_r, i)) {
+        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((tlb_lut(r4300->cp0.tlb.LUT_r, i)&0xFFFFF000)-0x80000000)-(i<<12))>>2;
         // FIXME: should make sure the physical page is invalid too
-        if(!r4300->cp0.tlb.LUT_w[i]||!r4300->cached_interp.invalid_code[i]) {
+        if(!tlb_lut(r4300->cp0.tlb.LUT_w, i)||!r4300->cached_interp.invalid_code[i]) {
           state->memory_map[i]|=WRITE_PROTECT; // Write protect
         }else{
-          assert(r4300->cp0.tlb.LUT_r[i]==r4300->cp0.tlb.LUT_w[i]);
+          assert(tlb_lut(r4300->cp0.tlb.LUT_r, i)==tlb_lut(r4300->cp0.tlb.LUT_w, i));
         }
         if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
         // Tell the dynamic recompiler to generate tlb lookup code
@@ -2087,16 +2225,16 @@ static void TLBWR_new(int pcaddr, int count)
   }
   for (i=r4300->cp0.tlb.entries[state->cp0_regs[CP0_RANDOM_REG]&0x3F].start_odd>>12; i<=r4300->cp0.tlb.entries[state->cp0_regs[CP0_RANDOM_REG]&0x3F].end_odd>>12; i++)
   {
-    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,r4300->cp0.tlb.LUT_r[i],r4300->cp0.tlb.LUT_w[i]);
+    //DebugMessage(M64MSG_VERBOSE, "%x: r:%8x w:%8x",i,tlb_lut(r4300->cp0.tlb.LUT_r, i),tlb_lut(r4300->cp0.tlb.LUT_w, i));
     if(i<0x80000||i>0xBFFFF)
     {
-      if(r4300->cp0.tlb.LUT_r[i]) {
-        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((r4300->cp0.tlb.LUT_r[i]&0xFFFFF000)-0x80000000)-(i<<12))>>2;
+      if(tlb_lut(r4300->cp0.tlb.LUT_r, i)) {
+        state->memory_map[i]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((tlb_lut(r4300->cp0.tlb.LUT_r, i)&0xFFFFF000)-0x80000000)-(i<<12))>>2;
         // FIXME: should make sure the physical page is invalid too
-        if(!r4300->cp0.tlb.LUT_w[i]||!r4300->cached_interp.invalid_code[i]) {
+        if(!tlb_lut(r4300->cp0.tlb.LUT_w, i)||!r4300->cached_interp.invalid_code[i]) {
           state->memory_map[i]|=WRITE_PROTECT; // Write protect
         }else{
-          assert(r4300->cp0.tlb.LUT_r[i]==r4300->cp0.tlb.LUT_w[i]);
+          assert(tlb_lut(r4300->cp0.tlb.LUT_r, i)==tlb_lut(r4300->cp0.tlb.LUT_w, i));
         }
         if(!using_tlb) DebugMessage(M64MSG_VERBOSE, "Enabled TLB");
         // Tell the dynamic recompiler to generate tlb lookup code
@@ -2339,6 +2477,29 @@ static void SDR_new(int pcaddr, int count)
   UPDATE_COUNT_OUT
 }
 
+#ifdef CODE_CACHE_FILE
+// Record an absolute pointer into the output buffer written by the
+// block being assembled, so that the code cache can relocate it.
+static void code_cache_add_reloc(void *ptr)
+{
+  assert(block_reloc_count<MAXBLOCK);
+  block_relocs[block_reloc_count++]=(u_int)((u_char *)ptr-(u_char *)base_addr);
+}
+
+// The block in [beginning,end) overwrote older code: forget the pointers
+// that code held and keep the ones of the new block.
+static void code_cache_commit_relocs(u_char *beginning,u_char *end)
+{
+  u_int i;
+  for(i=(u_int)(beginning-(u_char *)base_addr);i<(u_int)(end-(u_char *)base_addr);i++)
+    reloc_map[i>>3]&=~(1<<(i&7));
+  for(i=0;i<(u_int)block_reloc_count;i++)
+    reloc_map[block_relocs[i]>>3]|=1<<(block_relocs[i]&7);
+  block_reloc_count=0;
+  code_cache_dirty=1;
+}
+#endif
+
 #if NEW_DYNAREC == NEW_DYNAREC_X86
 #include "x86/assem_x86.c"
 #elif NEW_DYNAREC == NEW_DYNAREC_X64
@@ -2535,7 +2696,7 @@ static void ll_kill_pointers(struct ll_entry *head,intptr_t addr,int shift)
 static void add_link(u_int vaddr,void *src)
 {
   u_int page=(vaddr^0x80000000)>>12;
-  if(page>262143&&g_dev.r4300.cp0.tlb.LUT_r[vaddr>>12]) page=(g_dev.r4300.cp0.tlb.LUT_r[vaddr>>12]^0x80000000)>>12;
+  if(page>262143&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, vaddr>>12)) page=(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, vaddr>>12)^0x80000000)>>12;
   if(page>4095) page=2048+(page&2047);
   inv_debug("add_link: %x -> %x (%d)\n",(intptr_t)src,vaddr,page);
   (void)ll_add(jump_out+page,vaddr,src,src,0,NULL,0);
@@ -2546,7 +2707,7 @@ static void add_link(u_int vaddr,void *src)
 static struct ll_entry *get_clean(struct r4300_core* r4300,u_int vaddr,u_int flags)
 {
   u_int page=(vaddr^0x80000000)>>12;
-  if(page>262143&&r4300->cp0.tlb.LUT_r[vaddr>>12]) page=(r4300->cp0.tlb.LUT_r[vaddr>>12]^0x80000000)>>12;
+  if(page>262143&&tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)) page=(tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)^0x80000000)>>12;
   if(page>2048) page=2048+(page&2047);
   struct ll_entry *head;
   head=jump_in[page];
@@ -2563,9 +2724,9 @@ static struct ll_entry *get_dirty(struct r4300_core* r4300,u_int vaddr,u_int fla
 {
   u_int page=(vaddr^0x80000000)>>12;
   u_int vpage=page;
-  if(page>262143&&r4300->cp0.tlb.LUT_r[vaddr>>12]) page=(r4300->cp0.tlb.LUT_r[vaddr>>12]^0x80000000)>>12;
+  if(page>262143&&tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)) page=(tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)^0x80000000)>>12;
   if(page>2048) page=2048+(page&2047);
-  if(vpage>262143&&r4300->cp0.tlb.LUT_r[vaddr>>12]) vpage&=2047; // jump_dirty uses a hash of the virtual address instead
+  if(vpage>262143&&tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)) vpage&=2047; // jump_dirty uses a hash of the virtual address instead
   if(vpage>2048) vpage=2048+(vpage&2047);
   struct ll_entry *head;
   head=jump_dirty[vpage];
@@ -2577,9 +2738,9 @@ static struct ll_entry *get_dirty(struct r4300_core* r4300,u_int vaddr,u_int fla
           r4300->cached_interp.invalid_code[vaddr>>12]=0;
           r4300->new_dynarec_hot_state.memory_map[vaddr>>12]|=WRITE_PROTECT;
           if(vpage<2048) {
-            if(r4300->cp0.tlb.LUT_r[vaddr>>12]) {
-              r4300->cached_interp.invalid_code[r4300->cp0.tlb.LUT_r[vaddr>>12]>>12]=0;
-              r4300->new_dynarec_hot_state.memory_map[r4300->cp0.tlb.LUT_r[vaddr>>12]>>12]|=WRITE_PROTECT;
+            if(tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)) {
+              r4300->cached_interp.invalid_code[tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)>>12]=0;
+              r4300->new_dynarec_hot_state.memory_map[tlb_lut(r4300->cp0.tlb.LUT_r, vaddr>>12)>>12]|=WRITE_PROTECT;
             }
             restore_candidate[vpage>>3]|=1<<(vpage&7);
           }
@@ -2616,36 +2777,27 @@ void *dynamic_linker(void * src, u_int vaddr)
   }
 #endif
 
-  struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
-  if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[0]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
-  if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[1]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
+  void *addr=ht_lookup(vaddr);
+  if(addr!=NULL) return addr;
 
 #ifdef DISABLE_BLOCK_LINKING
   head=get_clean(r4300,vaddr,~0);
   if(head!=NULL){
-    ht_bin[1]=ht_bin[0];
-    ht_bin[0]=head;
+    ht_insert(vaddr,head);
     return (void*)(((intptr_t)head->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 #endif
 
   head=get_dirty(r4300,vaddr,~0);
   if(head!=NULL){
-    if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-      ht_bin[0]=head; // Replace existing entry
-    }
-    else
-    {
-      ht_bin[1]=ht_bin[0];
-      ht_bin[0]=head;
-    }
+    ht_insert(vaddr,head);
     return (void*)(((intptr_t)head->clean_addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 
   int r=new_recompile_block(vaddr);
   if(r==0) return dynamic_linker(src,vaddr);
   // Execute in unmapped page, generate pagefault execption
-  assert(r4300->cp0.tlb.LUT_r[(vaddr&~1) >> 12] == 0);
+  assert(tlb_lut(r4300->cp0.tlb.LUT_r, (vaddr&~1) >> 12) == 0);
   assert((intptr_t)r4300->new_dynarec_hot_state.memory_map[(vaddr&~1) >> 12] < 0);
   r4300->delay_slot = vaddr&1;
   TLB_refill_exception(r4300, vaddr&~1, 2);
@@ -2674,36 +2826,27 @@ void *dynamic_linker_ds(void * src, u_int vaddr)
   }
 #endif
 
-  struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
-  if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[0]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
-  if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[1]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
+  void *addr=ht_lookup(vaddr);
+  if(addr!=NULL) return addr;
 
 #ifdef DISABLE_BLOCK_LINKING
   head=get_clean(r4300,vaddr,~0);
   if(head!=NULL){
-    ht_bin[1]=ht_bin[0];
-    ht_bin[0]=head;
+    ht_insert(vaddr,head);
     return (void*)(((intptr_t)head->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 #endif
 
   head=get_dirty(r4300,vaddr,~0);
   if(head!=NULL){
-    if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-      ht_bin[0]=head; // Replace existing entry
-    }
-    else
-    {
-      ht_bin[1]=ht_bin[0];
-      ht_bin[0]=head;
-    }
+    ht_insert(vaddr,head);
     return (void*)(((intptr_t)head->clean_addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 
   int r=new_recompile_block((vaddr&0xFFFFFFF8)+1);
   if(r==0) return dynamic_linker_ds(src,vaddr);
   // Execute in unmapped page, generate pagefault execption
-  assert(r4300->cp0.tlb.LUT_r[(vaddr&~1) >> 12] == 0);
+  assert(tlb_lut(r4300->cp0.tlb.LUT_r, (vaddr&~1) >> 12) == 0);
   assert((intptr_t)r4300->new_dynarec_hot_state.memory_map[(vaddr&~1) >> 12] < 0);
   r4300->delay_slot = vaddr&1;
   TLB_refill_exception(r4300, vaddr&~1, 2);
@@ -2716,32 +2859,23 @@ void *get_addr(u_int vaddr)
 {
   struct r4300_core* r4300 = &g_dev.r4300;
   struct ll_entry *head;
-  struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
 
   head=get_clean(r4300,vaddr,~0);
   if(head!=NULL){
-    ht_bin[1]=ht_bin[0];
-    ht_bin[0]=head;
+    ht_insert(vaddr,head);
     return (void*)(((intptr_t)head->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 
   head=get_dirty(r4300,vaddr,~0);
   if(head!=NULL){
-    if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-      ht_bin[0]=head; // Replace existing entry
-    }
-    else
-    {
-      ht_bin[1]=ht_bin[0];
-      ht_bin[0]=head;
-    }
+    ht_insert(vaddr,head);
     return (void*)(((intptr_t)head->clean_addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 
   int r=new_recompile_block(vaddr);
   if(r==0) return get_addr(vaddr);
   // Execute in unmapped page, generate pagefault execption
-  assert(r4300->cp0.tlb.LUT_r[(vaddr&~1) >> 12] == 0);
+  assert(tlb_lut(r4300->cp0.tlb.LUT_r, (vaddr&~1) >> 12) == 0);
   assert((intptr_t)r4300->new_dynarec_hot_state.memory_map[(vaddr&~1) >> 12] < 0);
   r4300->delay_slot = vaddr&1;
   TLB_refill_exception(r4300, vaddr&~1, 2);
@@ -2751,48 +2885,39 @@ void *get_addr(u_int vaddr)
 // Look up address in hash table first
 void *get_addr_ht(u_int vaddr)
 {
-  struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
-  if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[0]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
-  if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[1]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
+  void *addr=ht_lookup(vaddr);
+  if(addr!=NULL) return addr;
   return get_addr(vaddr);
 }
 
+uint64_t *new_dynarec_ht_stats(void)
+{
+  return ht_stats;
+}
+
 void *get_addr_32(u_int vaddr,u_int flags)
 {
-  struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
-  if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[0]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
-  if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) return (void *)(((intptr_t)ht_bin[1]->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
+  void *addr=ht_lookup(vaddr);
+  if(addr!=NULL) return addr;
 
   struct r4300_core* r4300 = &g_dev.r4300;
   struct ll_entry *head;
   head=get_clean(r4300,vaddr,flags);
   if(head!=NULL){
-    if(head->reg32==0) {
-      if(ht_bin[0]==NULL) {
-        ht_bin[0]=head;
-      }else if(ht_bin[1]==NULL) {
-        ht_bin[1]=head;
-      }
-    }
+    if(head->reg32==0) ht_insert_free(vaddr,head);
     return (void*)(((intptr_t)head->addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 
   head=get_dirty(r4300,vaddr,flags);
   if(head!=NULL){
-     if(head->reg32==0) {
-      if(ht_bin[0]==NULL) {
-        ht_bin[0]=head;
-      }else if(ht_bin[1]==NULL) {
-        ht_bin[1]=head;
-      }
-     }
+    if(head->reg32==0) ht_insert_free(vaddr,head);
     return (void*)(((intptr_t)head->clean_addr-(intptr_t)base_addr)+(intptr_t)base_addr_rx);
   }
 
   int r=new_recompile_block(vaddr);
   if(r==0) return get_addr(vaddr);
   // Execute in unmapped page, generate pagefault execption
-  assert(r4300->cp0.tlb.LUT_r[(vaddr&~1) >> 12] == 0);
+  assert(tlb_lut(r4300->cp0.tlb.LUT_r, (vaddr&~1) >> 12) == 0);
   assert((intptr_t)r4300->new_dynarec_hot_state.memory_map[(vaddr&~1) >> 12] < 0);
   r4300->delay_slot = vaddr&1;
   TLB_refill_exception(r4300, vaddr&~1, 2);
@@ -2803,15 +2928,13 @@ void *get_addr_32(u_int vaddr,u_int flags)
 // but don't return addresses which are about to expire from the cache
 static void *check_addr(u_int vaddr)
 {
-  struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
+  struct ht_set *set=get_ht_set(vaddr);
+  int i=ht_find(set,vaddr);
 
-  if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-    if((((uintptr_t)ht_bin[0]->addr-MAX_OUTPUT_BLOCK_SIZE-(uintptr_t)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2)))
-      if(ht_bin[0]->addr==ht_bin[0]->clean_addr) return ht_bin[0]->addr; //jump_in
-  }
-  if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) {
-    if((((uintptr_t)ht_bin[1]->addr-MAX_OUTPUT_BLOCK_SIZE-(uintptr_t)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2)))
-      if(ht_bin[1]->addr==ht_bin[1]->clean_addr) return ht_bin[1]->addr; //jump_in
+  if(i>=0) {
+    struct ll_entry *ht_head=set->head[i];
+    if((((uintptr_t)ht_head->addr-MAX_OUTPUT_BLOCK_SIZE-(uintptr_t)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2)))
+      if(ht_head->addr==ht_head->clean_addr) return ht_head->addr; //jump_in
   }
 
   struct r4300_core* r4300 = &g_dev.r4300;
@@ -2819,23 +2942,11 @@ static void *check_addr(u_int vaddr)
   head=get_clean(r4300,vaddr,~0);
   if(head!=NULL){
     if((((uintptr_t)head->addr-(uintptr_t)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
-      // Update existing entry with current address
-      if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-        ht_bin[0]=head;
-        return head->addr;
-      }
-      if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) {
-        ht_bin[1]=head;
-        return head->addr;
-      }
-      // Insert into hash table with low priority.
+      // Update existing entry with current address, or insert
+      // into hash table with low priority.
       // Don't evict existing entries, as they are probably
       // addresses that are being accessed frequently.
-      if(ht_bin[0]==NULL) {
-        ht_bin[0]=head;
-      }else if(ht_bin[1]==NULL) {
-        ht_bin[1]=head;
-      }
+      ht_insert_free(vaddr,head);
       return head->addr;
     }
   }
@@ -2877,7 +2988,7 @@ void invalidate_block(u_int block)
 {
   u_int page;
   page=block^0x80000;
-  if(block<0x100000&&page>262143&&g_dev.r4300.cp0.tlb.LUT_r[block]) page=(g_dev.r4300.cp0.tlb.LUT_r[block]^0x80000000)>>12;
+  if(block<0x100000&&page>262143&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, block)) page=(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, block)^0x80000000)>>12;
   if(page>2048) page=2048+(page&2047);
   inv_debug("INVALIDATE: %x (%d)\n",block<<12,page);
   u_int first,last;
@@ -2937,10 +3048,10 @@ void invalidate_block(u_int block)
     g_dev.r4300.cached_interp.invalid_code[block]=1;
   }
   // If there is a valid TLB entry for this page, remove write protect
-  if(block<0x100000&&g_dev.r4300.cp0.tlb.LUT_w[block]) {
-    assert(g_dev.r4300.cp0.tlb.LUT_r[block]==g_dev.r4300.cp0.tlb.LUT_w[block]);
-    g_dev.r4300.new_dynarec_hot_state.memory_map[block]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((g_dev.r4300.cp0.tlb.LUT_w[block]&0xFFFFF000)-0x80000000)-(block<<12))>>2;
-    u_int real_block=g_dev.r4300.cp0.tlb.LUT_w[block]>>12;
+  if(block<0x100000&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_w, block)) {
+    assert(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, block)==tlb_lut(g_dev.r4300.cp0.tlb.LUT_w, block));
+    g_dev.r4300.new_dynarec_hot_state.memory_map[block]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((tlb_lut(g_dev.r4300.cp0.tlb.LUT_w, block)&0xFFFFF000)-0x80000000)-(block<<12))>>2;
+    u_int real_block=tlb_lut(g_dev.r4300.cp0.tlb.LUT_w, block)>>12;
     g_dev.r4300.cached_interp.invalid_code[real_block]=1;
     if(real_block>=0x80000&&real_block<0x80800) g_dev.r4300.new_dynarec_hot_state.memory_map[real_block]=((uintptr_t)g_dev.rdram.dram-(uintptr_t)0x80000000)>>2;
   }
@@ -2972,9 +3083,9 @@ static void invalidate_all_pages(void)
   #endif
   // TLB
   for(page=0;page<0x100000;page++) {
-    if(g_dev.r4300.cp0.tlb.LUT_r[page]) {
-      g_dev.r4300.new_dynarec_hot_state.memory_map[page]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((g_dev.r4300.cp0.tlb.LUT_r[page]&0xFFFFF000)-0x80000000)-(page<<12))>>2;
-      if(!g_dev.r4300.cp0.tlb.LUT_w[page]||!g_dev.r4300.cached_interp.invalid_code[page])
+    if(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, page)) {
+      g_dev.r4300.new_dynarec_hot_state.memory_map[page]=((uintptr_t)g_dev.rdram.dram+(uintptr_t)((tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, page)&0xFFFFF000)-0x80000000)-(page<<12))>>2;
+      if(!tlb_lut(g_dev.r4300.cp0.tlb.LUT_w, page)||!g_dev.r4300.cached_interp.invalid_code[page])
         g_dev.r4300.new_dynarec_hot_state.memory_map[page]|=WRITE_PROTECT; // Write protect
     }
     else g_dev.r4300.new_dynarec_hot_state.memory_map[page]=(uintptr_t)-1;
@@ -3051,19 +3162,13 @@ void clean_blocks(u_int page)
           if(!inv) {
             if((((uintptr_t)head->clean_addr-(uintptr_t)out)<<(32-TARGET_SIZE_2))>0x60000000+(MAX_OUTPUT_BLOCK_SIZE<<(32-TARGET_SIZE_2))) {
               u_int ppage=page;
-              if(page<2048&&g_dev.r4300.cp0.tlb.LUT_r[head->vaddr>>12]) ppage=(g_dev.r4300.cp0.tlb.LUT_r[head->vaddr>>12]^0x80000000)>>12;
+              if(page<2048&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, head->vaddr>>12)) ppage=(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, head->vaddr>>12)^0x80000000)>>12;
               inv_debug("INV: Restored %x (%x/%x)\n",head->vaddr, (intptr_t)head->addr, (intptr_t)head->clean_addr);
               //DebugMessage(M64MSG_VERBOSE, "page=%x, addr=%x",page,head->vaddr);
               //assert(head->vaddr>>12==(page|0x80000));
               struct ll_entry *clean_head=ll_add_32(jump_in+ppage,head->vaddr,head->reg32,head->clean_addr,head->clean_addr,head->start,head->copy,head->length);
-              struct ll_entry **ht_bin=hash_table[((head->vaddr>>16)^head->vaddr)&0xFFFF];
               if(!head->reg32) {
-                if(ht_bin[0]&&ht_bin[0]->vaddr==head->vaddr) {
-                  ht_bin[0]=clean_head; // Replace existing entry
-                }
-                if(ht_bin[1]&&ht_bin[1]->vaddr==head->vaddr) {
-                  ht_bin[1]=clean_head; // Replace existing entry
-                }
+                ht_replace(head->vaddr,clean_head); // Replace existing entry
               }
             }
           }
@@ -7150,7 +7255,7 @@ static void ujump_assemble(int i,struct regstat *i_regs)
   {
     int return_address=start+i*4+8;
     if(get_reg(branch_regs[i].regmap,31)>0)
-    if(i_regmap[temp]==PTEMP) emit_movimm((intptr_t)hash_table[((return_address>>16)^return_address)&0xFFFF],temp);
+    if(i_regmap[temp]==PTEMP) emit_movimm((intptr_t)get_ht_set(return_address),temp);
   }
   #endif
   ds_assemble(i+1,i_regs);
@@ -7183,12 +7288,12 @@ static void ujump_assemble(int i,struct regstat *i_regs)
         #ifdef REG_PREFETCH
         if(temp>=0)
         {
-          if(i_regmap[temp]!=PTEMP) emit_movimm((intptr_t)hash_table[((return_address>>16)^return_address)&0xFFFF],temp);
+          if(i_regmap[temp]!=PTEMP) emit_movimm((intptr_t)get_ht_set(return_address),temp);
         }
         #endif
         emit_movimm(return_address,rt); // PC into link register
         #ifdef IMM_PREFETCH
-        emit_prefetch(hash_table[((return_address>>16)^return_address)&0xFFFF]);
+        emit_prefetch(get_ht_set(return_address));
         #endif
       }
     }
@@ -7241,7 +7346,7 @@ static void rjump_assemble(int i,struct regstat *i_regs)
   {
     if((temp=get_reg(branch_regs[i].regmap,PTEMP))>=0) {
       int return_address=start+i*4+8;
-      if(i_regmap[temp]==PTEMP) emit_movimm((intptr_t)hash_table[((return_address>>16)^return_address)&0xFFFF],temp);
+      if(i_regmap[temp]==PTEMP) emit_movimm((intptr_t)get_ht_set(return_address),temp);
     }
   }
   #endif
@@ -7270,12 +7375,12 @@ static void rjump_assemble(int i,struct regstat *i_regs)
     #ifdef REG_PREFETCH
     if(temp>=0)
     {
-      if(i_regmap[temp]!=PTEMP) emit_movimm((intptr_t)hash_table[((return_address>>16)^return_address)&0xFFFF],temp);
+      if(i_regmap[temp]!=PTEMP) emit_movimm((intptr_t)get_ht_set(return_address),temp);
     }
     #endif
     emit_movimm(return_address,rt); // PC into link register
     #ifdef IMM_PREFETCH
-    emit_prefetch(hash_table[((return_address>>16)^return_address)&0xFFFF]);
+    emit_prefetch(get_ht_set(return_address));
     #endif
   }
 #ifndef NDEBUG
@@ -7794,7 +7899,7 @@ static void sjump_assemble(int i,struct regstat *i_regs)
         return_address=start+i*4+8;
         emit_movimm(return_address,rt); // PC into link register
         #ifdef IMM_PREFETCH
-        if(!nevertaken) emit_prefetch(hash_table[((return_address>>16)^return_address)&0xFFFF]);
+        if(!nevertaken) emit_prefetch(get_ht_set(return_address));
         #endif
       }
     }
@@ -8593,9 +8698,9 @@ static void pagespan_ds(void)
   u_int vaddr=start+1;
   u_int page=(0x80000000^vaddr)>>12;
   u_int vpage=page;
-  if(page>262143&&g_dev.r4300.cp0.tlb.LUT_r[vaddr>>12]) page=(g_dev.r4300.cp0.tlb.LUT_r[page^0x80000]^0x80000000)>>12;
+  if(page>262143&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, vaddr>>12)) page=(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, page^0x80000)^0x80000000)>>12;
   if(page>2048) page=2048+(page&2047);
-  if(vpage>262143&&g_dev.r4300.cp0.tlb.LUT_r[vaddr>>12]) vpage&=2047; // jump_dirty uses a hash of the virtual address instead
+  if(vpage>262143&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, vaddr>>12)) vpage&=2047; // jump_dirty uses a hash of the virtual address instead
   if(vpage>2048) vpage=2048+(vpage&2047);
   struct ll_entry *head=ll_add(jump_dirty+vpage,vaddr,(void *)out,NULL,start,copy,slen*4);
   dirty_entry_count++;
@@ -8771,6 +8876,12 @@ void new_dynarec_init(void)
 
   assert(((uintptr_t)g_dev.rdram.dram&7)==0); //8 bytes aligned
   out=(u_char *)base_addr;
+  out_top=out;
+#ifdef CODE_CACHE_FILE
+  memset(reloc_map,0,sizeof(reloc_map));
+  block_reloc_count=0;
+  code_cache_dirty=0;
+#endif
 
   g_dev.r4300.new_dynarec_hot_state.pc = &g_dev.r4300.new_dynarec_hot_state.fake_pc;
   g_dev.r4300.new_dynarec_hot_state.fake_pc.f.r.rs = &g_dev.r4300.new_dynarec_hot_state.rs;
@@ -8779,8 +8890,8 @@ void new_dynarec_init(void)
   int n;
   for(n=0x80000;n<0x80800;n++)
     g_dev.r4300.cached_interp.invalid_code[n]=1;
-  for(n=0;n<65536;n++)
-    hash_table[n][0]=hash_table[n][1]=NULL;
+  ht_clear();
+  memset(ht_stats,0,sizeof(ht_stats));
   memset(g_dev.r4300.new_dynarec_hot_state.mini_ht,-1,sizeof(g_dev.r4300.new_dynarec_hot_state.mini_ht));
   memset(restore_candidate,0,sizeof(restore_candidate));
   copy_size=0;
@@ -8830,6 +8941,271 @@ void new_dynarec_cleanup(void)
 #endif
 }
 
+/**** Code cache file ****/
+
+// Blocks compiled during a run are written to a file named after the
+// ROM's MD5 and reloaded when the same ROM is started again.  The output
+// buffer lives in g_dev, so calls and rip-relative accesses to g_dev and
+// to the core stay valid wherever the core is loaded, as long as it is
+// the same build.  The absolute pointers into the buffer recorded in
+// reloc_map are moved with it, and the dirty stubs are pointed at the
+// reloaded ll_entry records.  Blocks are reloaded as dirty entries only:
+// each one is compared to RDRAM by verify_dirty() before it is entered
+// and moved back to jump_in through restore_candidate, like a block that
+// was invalidated by a write to its page.
+
+#ifdef CODE_CACHE_FILE
+
+#define CODE_CACHE_MAGIC "M64PNDC"
+#define CODE_CACHE_VERSION 2
+#define CODE_CACHE_LAYOUT 5
+
+struct code_cache_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t count_per_op;
+  uint32_t count_per_op_denom_pot;
+  uint32_t code_size;
+  uint32_t out_offset;
+  uint32_t expirep;
+  uint32_t entry_count;
+  uint32_t reloc_count; // Followed by the code, then reloc_count offsets
+  char md5[32];
+  uint64_t base;        // Address of the output buffer when it was saved
+  uint64_t layout[CODE_CACHE_LAYOUT];
+  uint64_t code_hash;
+};
+
+struct code_cache_entry
+{
+  uint32_t page;
+  uint32_t vaddr;
+  uint32_t reg32;
+  uint32_t addr;       // Offset of the dirty stub in the output buffer
+  uint32_t clean_addr; // Offset of the entry point
+  uint32_t start;
+  uint32_t length;     // Followed by length bytes of source
+};
+
+static void code_cache_header_init(struct code_cache_header *header)
+{
+  memset(header,0,sizeof(*header));
+  memcpy(header->magic,CODE_CACHE_MAGIC,sizeof(header->magic));
+  header->version=CODE_CACHE_VERSION;
+  header->count_per_op=g_dev.r4300.cp0.count_per_op;
+  header->count_per_op_denom_pot=g_dev.r4300.cp0.count_per_op_denom_pot;
+  memcpy(header->md5,ROM_SETTINGS.MD5,sizeof(header->md5));
+  header->base=(uintptr_t)base_addr;
+  // Distances between the buffer, g_dev and the core code, which only
+  // change with another build of the core
+  header->layout[0]=(uintptr_t)base_addr-(uintptr_t)&g_dev;
+  header->layout[1]=(uintptr_t)base_addr_rx-(uintptr_t)base_addr;
+  header->layout[2]=(uintptr_t)verify_code-(uintptr_t)&g_dev;
+  header->layout[3]=(uintptr_t)new_recompile_block-(uintptr_t)&g_dev;
+  header->layout[4]=(uintptr_t)hash_table-(uintptr_t)&g_dev;
+}
+
+static int code_cache_filename(char *filename,size_t size)
+{
+  const char *path=get_dynarec_cachepath();
+  if(path==NULL||ROM_SETTINGS.MD5[0]==0) return 0;
+  snprintf(filename,size,"%s%.32s-x64.ndc",path,ROM_SETTINGS.MD5);
+  filename[size-1]=0;
+  return 1;
+}
+
+static int code_cache_entry_valid(const struct code_cache_entry *e,u_int code_size)
+{
+  if(e->page>=2048) return 0;
+  if(e->vaddr<0x80000000||e->vaddr>=0x80800000) return 0;
+  if(((e->vaddr^0x80000000)>>12)!=e->page) return 0;
+  if(e->length==0||(e->length&3)||e->length>MAXBLOCK*4) return 0;
+  if(e->start<0x80000000||e->start+e->length>0x80800000) return 0;
+  if((e->vaddr&~1)<e->start||(e->vaddr&~1)>=e->start+e->length) return 0;
+  if(e->addr+16>code_size||e->clean_addr>=code_size) return 0;
+  return 1;
+}
+
+// Move the pointer at offset of the reloaded code to the current buffer
+static int code_cache_relocate(u_int offset,const struct code_cache_header *header)
+{
+  u_char *ptr=(u_char *)base_addr+offset;
+  uint64_t value;
+  if(offset<2||offset+8>header->code_size||ptr[-1]!=0xbf) return 0;
+  memcpy(&value,ptr,8);
+  if(value-header->base>=header->code_size) return 0;
+  value=value-header->base+(uintptr_t)base_addr;
+  memcpy(ptr,&value,8);
+  reloc_map[offset>>3]|=1<<(offset&7);
+  return 1;
+}
+
+#endif
+
+void new_dynarec_load_cache(void)
+{
+#ifdef CODE_CACHE_FILE
+  char filename[1024];
+  struct code_cache_header header,expected;
+  struct code_cache_entry e;
+  struct ll_entry *tail[2048];
+  struct ll_entry *last=NULL;
+  u_int n,page,offset;
+  FILE *f;
+
+  if(!code_cache_filename(filename,sizeof(filename))) return;
+  f=fopen(filename,"rb");
+  if(f==NULL) return;
+
+  code_cache_header_init(&expected);
+  if(fread(&header,sizeof(header),1,f)!=1||
+     memcmp(header.magic,expected.magic,sizeof(header.magic))||
+     header.version!=expected.version) {
+    DebugMessage(M64MSG_WARNING, "Dynarec cache %s is not valid", filename);
+    fclose(f);
+    return;
+  }
+  if(header.count_per_op!=expected.count_per_op||
+     header.count_per_op_denom_pot!=expected.count_per_op_denom_pot||
+     memcmp(header.md5,expected.md5,sizeof(header.md5))||
+     memcmp(header.layout,expected.layout,sizeof(header.layout))) {
+    DebugMessage(M64MSG_INFO, "Dynarec cache %s was written by another core build, ignoring it", filename);
+    fclose(f);
+    return;
+  }
+  if(header.code_size>(1u<<TARGET_SIZE_2)||header.out_offset>header.code_size||header.expirep>65535||
+     header.reloc_count>header.code_size/10||
+     fread(base_addr,1,header.code_size,f)!=header.code_size||
+     XXH3_64bits(base_addr,header.code_size)!=header.code_hash) {
+    DebugMessage(M64MSG_WARNING, "Dynarec cache %s is not valid", filename);
+    fclose(f);
+    return;
+  }
+
+  for(n=0;n<header.reloc_count;n++) {
+    if(fread(&offset,sizeof(offset),1,f)!=1||!code_cache_relocate(offset,&header))
+      break;
+  }
+  if(n!=header.reloc_count) {
+    DebugMessage(M64MSG_WARNING, "Dynarec cache %s is not valid", filename);
+    memset(reloc_map,0,sizeof(reloc_map));
+    fclose(f);
+    return;
+  }
+
+  for(page=0;page<2048;page++) tail[page]=NULL;
+  for(n=0;n<header.entry_count;n++) {
+    if(fread(&e,sizeof(e),1,f)!=1||!code_cache_entry_valid(&e,header.code_size))
+      break;
+    u_int *copy_ptr=(u_int *)malloc(e.length+4);
+    assert(copy_ptr!=NULL);
+    if(fread(copy_ptr,1,e.length,f)!=e.length) {
+      free(copy_ptr);
+      break;
+    }
+    // Entries of the same block share their copy of the source
+    if(last&&last->start==e.start&&last->length==e.length&&!memcmp(last->copy,copy_ptr,e.length)) {
+      free(copy_ptr);
+      copy_ptr=(u_int *)last->copy;
+      copy_ptr[e.length>>2]++;
+    }
+    else {
+      copy_ptr[e.length>>2]=1;
+      copy_size+=e.length+4;
+    }
+    struct ll_entry **head=tail[e.page]?&tail[e.page]->next:jump_dirty+e.page;
+    last=ll_add_32(head,e.vaddr,e.reg32,(u_char *)base_addr+e.addr,(u_char *)base_addr+e.clean_addr,e.start,copy_ptr,e.length);
+    tail[e.page]=last;
+    if(!set_dirty_stub_head(last->addr,last))
+      break;
+  }
+  fclose(f);
+
+  if(n!=header.entry_count) {
+    DebugMessage(M64MSG_WARNING, "Dynarec cache %s is not valid", filename);
+    for(page=0;page<2048;page++) ll_clear(jump_dirty+page);
+    memset(reloc_map,0,sizeof(reloc_map));
+    return;
+  }
+
+  out=(u_char *)base_addr+header.out_offset;
+  out_top=(u_char *)base_addr+header.code_size;
+  expirep=header.expirep;
+  code_cache_dirty=0;
+  DebugMessage(M64MSG_INFO, "Loaded %u blocks from dynarec cache %s", header.entry_count, filename);
+#endif
+}
+
+void new_dynarec_save_cache(void)
+{
+#ifdef CODE_CACHE_FILE
+  char filename[1024];
+  struct code_cache_header header;
+  struct code_cache_entry e;
+  struct ll_entry *head;
+  u_int page,offset;
+  FILE *f;
+
+  // Nothing was compiled since the file was loaded (or the run started)
+  if(!code_cache_dirty) return;
+  if(!code_cache_filename(filename,sizeof(filename))) return;
+  // Blocks compiled with the TLB in use may have been generated for the
+  // mappings at that time, which the source check can't catch.
+  if(using_tlb) return;
+
+  code_cache_header_init(&header);
+  header.code_size=(u_int)(out_top-(u_char *)base_addr);
+  header.out_offset=(u_int)(out-(u_char *)base_addr);
+  header.expirep=expirep;
+
+  // Unlink the blocks so that each one goes through its dirty stub
+  // when it is next entered.  The links can't be kept: they would enter
+  // the target block before verify_dirty() checked it against RDRAM.
+  for(page=0;page<4096;page++)
+    for(head=jump_out[page];head!=NULL;head=head->next)
+      (void)kill_pointer(head->addr);
+
+  for(page=0;page<2048;page++)
+    for(head=jump_dirty[page];head!=NULL;head=head->next)
+      if(head->vaddr>=0x80000000&&head->vaddr<0x80800000) header.entry_count++;
+  for(offset=0;offset<header.code_size;offset++)
+    if(reloc_map[offset>>3]&(1<<(offset&7))) header.reloc_count++;
+  header.code_hash=XXH3_64bits(base_addr,header.code_size);
+
+  f=fopen(filename,"wb");
+  if(f==NULL) {
+    DebugMessage(M64MSG_WARNING, "Couldn't open dynarec cache %s for writing", filename);
+    return;
+  }
+  int ok=fwrite(&header,sizeof(header),1,f)==1&&
+         fwrite(base_addr,1,header.code_size,f)==header.code_size;
+  for(offset=0;ok&&offset<header.code_size;offset++)
+    if(reloc_map[offset>>3]&(1<<(offset&7)))
+      ok=fwrite(&offset,sizeof(offset),1,f)==1;
+  for(page=0;ok&&page<2048;page++) {
+    for(head=jump_dirty[page];ok&&head!=NULL;head=head->next) {
+      if(head->vaddr<0x80000000||head->vaddr>=0x80800000) continue;
+      e.page=page;
+      e.vaddr=head->vaddr;
+      e.reg32=head->reg32;
+      e.addr=(u_int)((u_char *)head->addr-(u_char *)base_addr);
+      e.clean_addr=(u_int)((u_char *)head->clean_addr-(u_char *)base_addr);
+      e.start=head->start;
+      e.length=head->length;
+      ok=fwrite(&e,sizeof(e),1,f)==1&&fwrite(head->copy,1,head->length,f)==head->length;
+    }
+  }
+  if(fclose(f)!=0) ok=0;
+  if(!ok) {
+    DebugMessage(M64MSG_WARNING, "Couldn't write dynarec cache %s", filename);
+    remove(filename);
+  }
+  else
+    DebugMessage(M64MSG_INFO, "Saved %u blocks to dynarec cache %s", header.entry_count, filename);
+#endif
+}
+
 int new_recompile_block(int addr)
 {
 #if defined(RECOMPILER_DEBUG) && !defined(RECOMP_DBG)
@@ -8857,8 +9233,8 @@ int new_recompile_block(int addr)
   }
   else if ((signed int)addr >= (signed int)0xC0000000) {
     //DebugMessage(M64MSG_VERBOSE, "addr=%x mm=%x",(u_int)addr,(g_dev.r4300.new_dynarec_hot_state.memory_map[start>>12]<<2));
-    //if(g_dev.r4300.cp0.tlb.LUT_r[start>>12])
-    //source = (u_int *)(((intptr_t)g_dev.rdram.dram)+(g_dev.r4300.cp0.tlb.LUT_r[start>>12]&0xFFFFF000)+(((int)addr)&0xFFF)-(intptr_t)0x80000000);
+    //if(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, start>>12))
+    //source = (u_int *)(((intptr_t)g_dev.rdram.dram)+(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, start>>12)&0xFFFFF000)+(((int)addr)&0xFFF)-(intptr_t)0x80000000);
     if((intptr_t)g_dev.r4300.new_dynarec_hot_state.memory_map[start>>12]>=0) {
       source = (u_int *)((uintptr_t)(start+(uintptr_t)(g_dev.r4300.new_dynarec_hot_state.memory_map[start>>12]<<2)));
       pagelimit=(start+4096)&0xFFFFF000;
@@ -11555,6 +11931,9 @@ int new_recompile_block(int addr)
 
   /* Pass 8 - Assembly */
   linkcount=0;stubcount=0;
+#ifdef CODE_CACHE_FILE
+  block_reloc_count=0;
+#endif
   ds=0;is_delayslot=0;
   cop1_usable=0;
   dirty_entry_count=0;
@@ -11569,7 +11948,7 @@ int new_recompile_block(int addr)
   copy_size+=((slen*4)+4);
   //DebugMessage(M64MSG_VERBOSE, "Currently used memory for copy: %d",copy_size);
 
-#if !defined(NDEBUG) || NEW_DYNAREC >= NEW_DYNAREC_ARM
+#if !defined(NDEBUG) || NEW_DYNAREC >= NEW_DYNAREC_ARM || defined(CODE_CACHE_FILE)
   uintptr_t beginning=(uintptr_t)out;
 #endif
   if((u_int)addr&1) {
@@ -11824,9 +12203,9 @@ int new_recompile_block(int addr)
         u_int vaddr=start+i*4;
         u_int page=(0x80000000^vaddr)>>12;
         u_int vpage=page;
-        if(page>262143&&g_dev.r4300.cp0.tlb.LUT_r[vaddr>>12]) page=(g_dev.r4300.cp0.tlb.LUT_r[page^0x80000]^0x80000000)>>12;
+        if(page>262143&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, vaddr>>12)) page=(tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, page^0x80000)^0x80000000)>>12;
         if(page>2048) page=2048+(page&2047);
-        if(vpage>262143&&g_dev.r4300.cp0.tlb.LUT_r[vaddr>>12]) vpage&=2047; // jump_dirty uses a hash of the virtual address instead
+        if(vpage>262143&&tlb_lut(g_dev.r4300.cp0.tlb.LUT_r, vaddr>>12)) vpage&=2047; // jump_dirty uses a hash of the virtual address instead
         if(vpage>2048) vpage=2048+(vpage&2047);
         literal_pool(256);
         //if(!(is32[i]&(~unneeded_reg_upper[i])&~(1LL<<CCREG)))
@@ -11843,13 +12222,7 @@ int new_recompile_block(int addr)
           // replace it with the new address.
           // Don't add new entries.  We'll insert the
           // ones that actually get used in check_addr().
-          struct ll_entry **ht_bin=hash_table[((vaddr>>16)^vaddr)&0xFFFF];
-          if(ht_bin[0]&&ht_bin[0]->vaddr==vaddr) {
-            ht_bin[0]=head;
-          }
-          if(ht_bin[1]&&ht_bin[1]->vaddr==vaddr) {
-            ht_bin[1]=head;
-          }
+          ht_replace(vaddr,head);
         }
         else
         {
@@ -11890,6 +12263,11 @@ int new_recompile_block(int addr)
   cache_flush((char *)beginning_rx,(char *)out_rx);
   #endif
 
+  if(out>out_top) out_top=out;
+#ifdef CODE_CACHE_FILE
+  code_cache_commit_relocs((u_char *)beginning,out);
+#endif
+
   // If we're within 256K of the end of the buffer,
   // start over from the beginning. (Is 256K enough?)
   if(out > (u_char *)((u_char *)base_addr+(1<<TARGET_SIZE_2)-MAX_OUTPUT_BLOCK_SIZE-JUMP_TABLE_SIZE))
@@ -11933,18 +12311,16 @@ int new_recompile_block(int addr)
         break;
       case 2:
         // Clear hash table
-        for(i=0;i<32;i++) {
-          struct ll_entry **ht_bin=hash_table[((expirep&2047)<<5)+i];
-          if(ht_bin[1]&&((((uintptr_t)ht_bin[1]->addr-(uintptr_t)base_addr)>>shift)==((base-(uintptr_t)base_addr)>>shift) ||
-             (((uintptr_t)ht_bin[1]->addr-(uintptr_t)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((base-(uintptr_t)base_addr)>>shift))) {
-            inv_debug("EXP: Remove hash %x -> %x\n",ht_bin[1]->vaddr,ht_bin[1]->addr);
-            ht_bin[1]=NULL;
-          }
-          if(ht_bin[0]&&((((uintptr_t)ht_bin[0]->addr-(uintptr_t)base_addr)>>shift)==((base-(uintptr_t)base_addr)>>shift) ||
-             (((uintptr_t)ht_bin[0]->addr-(uintptr_t)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((base-(uintptr_t)base_addr)>>shift))) {
-            inv_debug("EXP: Remove hash %x -> %x\n",ht_bin[0]->vaddr,ht_bin[0]->addr);
-            ht_bin[0]=ht_bin[1];
-            ht_bin[1]=NULL;
+        for(i=0;i<HT_SETS/2048;i++) {
+          struct ht_set *set=&hash_table[(expirep&2047)*(HT_SETS/2048)+i];
+          int way=HT_WAYS;
+          while(way-->0) {
+            struct ll_entry *ht_head=set->head[way];
+            if(ht_head&&((((uintptr_t)ht_head->addr-(uintptr_t)base_addr)>>shift)==((base-(uintptr_t)base_addr)>>shift) ||
+               (((uintptr_t)ht_head->addr-(uintptr_t)base_addr-MAX_OUTPUT_BLOCK_SIZE)>>shift)==((base-(uintptr_t)base_addr)>>shift))) {
+              inv_debug("EXP: Remove hash %x -> %x\n",ht_head->vaddr,ht_head->addr);
+              ht_remove_way(set,way);
+            }
           }
         }
         break;
@@ -96,5 +96,8 @@ void invalidate_cached_code_new_dynarec(struct r4300_core* r4300, uint32_t addre
 void new_dynarec_init(void);
 void new_dyna_start(void);
 void new_dynarec_cleanup(void);
+void new_dynarec_load_cache(void);
+void new_dynarec_save_cache(void);
+uint64_t* new_dynarec_ht_stats(void);
 
 #endif /* M64P_DEVICE_R4300_NEW_DYNAREC_H */
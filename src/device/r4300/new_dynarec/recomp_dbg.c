@@ -59,6 +59,9 @@
 #define invalidate_cached_code_new_dynarec      recomp_dbg_invalidate_cached_code_new_dynarec
 #define new_dynarec_cleanup                     recomp_dbg_new_dynarec_cleanup
 #define new_dynarec_init                        recomp_dbg_new_dynarec_init
+#define new_dynarec_load_cache                  recomp_dbg_new_dynarec_load_cache
+#define new_dynarec_save_cache                  recomp_dbg_new_dynarec_save_cache
+#define new_dynarec_ht_stats                    recomp_dbg_new_dynarec_ht_stats
 #define new_recompile_block                     recomp_dbg_new_recompile_block
 #define ERET_new                                recomp_dbg_ERET_new
 #define dynarec_gen_interrupt                   recomp_dbg_dynarec_gen_interrupt
@@ -829,8 +832,7 @@ void recomp_dbg_init(void)
   /* New dynarec init */
   recomp_dbg_out=(u_char *)recomp_dbg_base_addr;
 
-  for(int n=0;n<65536;n++)
-    hash_table[n][0]=hash_table[n][1]=NULL;
+  ht_clear();
 
   copy_size=0;
   expirep=16384; // Expiry pointer, +2 blocks
@@ -87,6 +87,9 @@ static void set_jump_target(uintptr_t addr,uintptr_t target)
     assert(*(ptr+1)==0xbf); /* mov immediate to r15 (store address) */
     uintptr_t *ptr2=(uintptr_t *)(ptr+2);
     *ptr2=target;
+#ifdef CODE_CACHE_FILE
+    code_cache_add_reloc(ptr2);
+#endif
   }
 }
 
@@ -3093,6 +3096,16 @@ static void do_dirty_stub_ds(struct ll_entry *head)
   emit_call((intptr_t)verify_code);
 }
 
+// Point an existing dirty stub at another ll_entry (used when reloading
+// the code cache).  Returns 0 if stub doesn't look like a dirty stub.
+static int set_dirty_stub_head(void *stub, struct ll_entry *head)
+{
+  u_char *ptr=(u_char *)stub;
+  if(ptr[0]!=0x48||(ptr[1]&0xf8)!=0xb8||ptr[10]!=0xe8) return 0;
+  *((uint64_t *)(ptr+2))=(uintptr_t)head;
+  return 1;
+}
+
 /* TLB */
 
 static int do_tlb_r(int s,int ar,int map,int cache,int x,int c,u_int addr)
@@ -22,6 +22,7 @@
 #include "pure_interp.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -29,6 +30,7 @@
 #include "api/callbacks.h"
 #include "api/debugger.h"
 #include "api/m64p_types.h"
+#include "device/memory/memory.h"
 #include "device/r4300/r4300_core.h"
 #include "osal/preproc.h"
 
@@ -108,7 +110,7 @@ static void InterpretOpcode(struct r4300_core* r4300);
  * relative to the instruction in the delay slot, so 1 instruction backwards
  * (-1) goes back to the jump. */
 #define IS_RELATIVE_IDLE_LOOP(r4300, op, addr) \
-	(IMM16S_OF(op) == -1 && *fast_mem_access((r4300), (addr) + 4) == 0)
+	(IMM16S_OF(op) == -1 && (IDLE_LOOP_CHECKED(), *fast_mem_access((r4300), (addr) + 4) == 0))
 
 /* Determines whether an absolute jump in a 26-bit immediate goes back to the
  * same instruction without doing any work in its delay slot. The jump is
@@ -117,7 +119,11 @@ static void InterpretOpcode(struct r4300_core* r4300);
 #define IS_ABSOLUTE_IDLE_LOOP(r4300, op, addr) \
 	(JUMP_OF(op) == ((addr) & UINT32_C(0x0FFFFFFF)) >> 2 \
 	 && ((addr) & UINT32_C(0x0FFFFFFF)) != UINT32_C(0x0FFFFFFC) \
-	 && *fast_mem_access((r4300), (addr) + 4) == 0)
+	 && (IDLE_LOOP_CHECKED(), *fast_mem_access((r4300), (addr) + 4) == 0))
+
+/* Hook for the decode cache of the threaded build: whether a jump is an idle
+ * loop depends on its delay slot, so such a decoding must not be kept. */
+#define IDLE_LOOP_CHECKED() ((void)0)
 
 /* These macros parse opcode fields. */
 #define rrt r4300_regs(r4300)[RT_OF(op)]
@@ -169,580 +175,178 @@ void InterpretOpcode(struct r4300_core* r4300)
 		return;
 	uint32_t op = *op_address;
 
-	switch ((op >> 26) & 0x3F) {
-	case 0: /* SPECIAL prefix */
-		switch (op & 0x3F) {
-		case 0: /* SPECIAL opcode 0: SLL */
-			if (RD_OF(op) != 0) SLL(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 2: /* SPECIAL opcode 2: SRL */
-			if (RD_OF(op) != 0) SRL(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 3: /* SPECIAL opcode 3: SRA */
-			if (RD_OF(op) != 0) SRA(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 4: /* SPECIAL opcode 4: SLLV */
-			if (RD_OF(op) != 0) SLLV(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 6: /* SPECIAL opcode 6: SRLV */
-			if (RD_OF(op) != 0) SRLV(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 7: /* SPECIAL opcode 7: SRAV */
-			if (RD_OF(op) != 0) SRAV(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 8: JR(r4300, op); break;
-		case 9: /* SPECIAL opcode 9: JALR */
-			/* Note: This can omit the check for Rd == 0 because the JALR
-			 * function checks for link_register != &r4300_regs(4300)[0]. If you're
-			 * using this as a reference for a JIT, do check Rd == 0 in it. */
-			JALR(r4300, op);
-			break;
-		case 12: SYSCALL(r4300, op); break;
-		case 13: /* SPECIAL opcode 13: BREAK */
-			BREAK(r4300, op);
-			break;
-		case 15: SYNC(r4300, op); break;
-		case 16: /* SPECIAL opcode 16: MFHI */
-			if (RD_OF(op) != 0) MFHI(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 17: MTHI(r4300, op); break;
-		case 18: /* SPECIAL opcode 18: MFLO */
-			if (RD_OF(op) != 0) MFLO(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 19: MTLO(r4300, op); break;
-		case 20: /* SPECIAL opcode 20: DSLLV */
-			if (RD_OF(op) != 0) DSLLV(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 22: /* SPECIAL opcode 22: DSRLV */
-			if (RD_OF(op) != 0) DSRLV(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 23: /* SPECIAL opcode 23: DSRAV */
-			if (RD_OF(op) != 0) DSRAV(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 24: MULT(r4300, op); break;
-		case 25: MULTU(r4300, op); break;
-		case 26: DIV(r4300, op); break;
-		case 27: DIVU(r4300, op); break;
-		case 28: DMULT(r4300, op); break;
-		case 29: DMULTU(r4300, op); break;
-		case 30: DDIV(r4300, op); break;
-		case 31: DDIVU(r4300, op); break;
-		case 32: /* SPECIAL opcode 32: ADD */
-			if (RD_OF(op) != 0) ADD(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 33: /* SPECIAL opcode 33: ADDU */
-			if (RD_OF(op) != 0) ADDU(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 34: /* SPECIAL opcode 34: SUB */
-			if (RD_OF(op) != 0) SUB(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 35: /* SPECIAL opcode 35: SUBU */
-			if (RD_OF(op) != 0) SUBU(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 36: /* SPECIAL opcode 36: AND */
-			if (RD_OF(op) != 0) AND(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 37: /* SPECIAL opcode 37: OR */
-			if (RD_OF(op) != 0) OR(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 38: /* SPECIAL opcode 38: XOR */
-			if (RD_OF(op) != 0) XOR(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 39: /* SPECIAL opcode 39: NOR */
-			if (RD_OF(op) != 0) NOR(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 42: /* SPECIAL opcode 42: SLT */
-			if (RD_OF(op) != 0) SLT(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 43: /* SPECIAL opcode 43: SLTU */
-			if (RD_OF(op) != 0) SLTU(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 44: /* SPECIAL opcode 44: DADD */
-			if (RD_OF(op) != 0) DADD(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 45: /* SPECIAL opcode 45: DADDU */
-			if (RD_OF(op) != 0) DADDU(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 46: /* SPECIAL opcode 46: DSUB */
-			if (RD_OF(op) != 0) DSUB(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 47: /* SPECIAL opcode 47: DSUBU */
-			if (RD_OF(op) != 0) DSUBU(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 48: TGE(r4300, op); break;
-		case 49: TGEU(r4300, op); break;
-		case 50: TLT(r4300, op); break;
-		case 51: TLTU(r4300, op); break;
-		case 52: TEQ(r4300, op); break;
-		case 54: TNE(r4300, op); break;
-		case 56: /* SPECIAL opcode 56: DSLL */
-			if (RD_OF(op) != 0) DSLL(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 58: /* SPECIAL opcode 58: DSRL */
-			if (RD_OF(op) != 0) DSRL(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 59: /* SPECIAL opcode 59: DSRA */
-			if (RD_OF(op) != 0) DSRA(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 60: /* SPECIAL opcode 60: DSLL32 */
-			if (RD_OF(op) != 0) DSLL32(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 62: /* SPECIAL opcode 62: DSRL32 */
-			if (RD_OF(op) != 0) DSRL32(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 63: /* SPECIAL opcode 63: DSRA32 */
-			if (RD_OF(op) != 0) DSRA32(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		default: /* SPECIAL opcodes 1, 5, 10, 11, 14, 21, 40, 41, 53, 55, 57,
-		            61: Reserved Instructions */
-			RESERVED(r4300, op);
-			break;
-		} /* switch (op & 0x3F) for the SPECIAL prefix */
-		break;
-	case 1: /* REGIMM prefix */
-		switch ((op >> 16) & 0x1F) {
-		case 0: /* REGIMM opcode 0: BLTZ */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BLTZ_IDLE(r4300, op);
-			else                                             BLTZ(r4300, op);
-			break;
-		case 1: /* REGIMM opcode 1: BGEZ */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BGEZ_IDLE(r4300, op);
-			else                                             BGEZ(r4300, op);
-			break;
-		case 2: /* REGIMM opcode 2: BLTZL */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BLTZL_IDLE(r4300, op);
-			else                                             BLTZL(r4300, op);
-			break;
-		case 3: /* REGIMM opcode 3: BGEZL */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BGEZL_IDLE(r4300, op);
-			else                                             BGEZL(r4300, op);
-			break;
-		case 8: TGEI(r4300, op); break;
-		case 9: TGEIU(r4300, op); break;
-		case 10: TLTI(r4300, op); break;
-		case 11: TLTIU(r4300, op); break;
-		case 12: TEQI(r4300, op); break;
-		case 14: TNEI(r4300, op); break;
-		case 16: /* REGIMM opcode 16: BLTZAL */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BLTZAL_IDLE(r4300, op);
-			else                                             BLTZAL(r4300, op);
-			break;
-		case 17: /* REGIMM opcode 17: BGEZAL */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BGEZAL_IDLE(r4300, op);
-			else                                             BGEZAL(r4300, op);
-			break;
-		case 18: /* REGIMM opcode 18: BLTZALL */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BLTZALL_IDLE(r4300, op);
-			else                                             BLTZALL(r4300, op);
-			break;
-		case 19: /* REGIMM opcode 19: BGEZALL */
-			if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BGEZALL_IDLE(r4300, op);
-			else                                             BGEZALL(r4300, op);
-			break;
-		default: /* REGIMM opcodes 4..7, 13, 15, 20..31:
-		            Reserved Instructions */
-			RESERVED(r4300, op);
-			break;
-		} /* switch ((op >> 16) & 0x1F) for the REGIMM prefix */
-		break;
-	case 2: /* Major opcode 2: J */
-		if (IS_ABSOLUTE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) J_IDLE(r4300, op);
-		else                                             J(r4300, op);
-		break;
-	case 3: /* Major opcode 3: JAL */
-		if (IS_ABSOLUTE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) JAL_IDLE(r4300, op);
-		else                                             JAL(r4300, op);
-		break;
-	case 4: /* Major opcode 4: BEQ */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BEQ_IDLE(r4300, op);
-		else                                             BEQ(r4300, op);
-		break;
-	case 5: /* Major opcode 5: BNE */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BNE_IDLE(r4300, op);
-		else                                             BNE(r4300, op);
-		break;
-	case 6: /* Major opcode 6: BLEZ */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BLEZ_IDLE(r4300, op);
-		else                                             BLEZ(r4300, op);
-		break;
-	case 7: /* Major opcode 7: BGTZ */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BGTZ_IDLE(r4300, op);
-		else                                             BGTZ(r4300, op);
-		break;
-	case 8: /* Major opcode 8: ADDI */
-		if (RT_OF(op) != 0) ADDI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 9: /* Major opcode 9: ADDIU */
-		if (RT_OF(op) != 0) ADDIU(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 10: /* Major opcode 10: SLTI */
-		if (RT_OF(op) != 0) SLTI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 11: /* Major opcode 11: SLTIU */
-		if (RT_OF(op) != 0) SLTIU(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 12: /* Major opcode 12: ANDI */
-		if (RT_OF(op) != 0) ANDI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 13: /* Major opcode 13: ORI */
-		if (RT_OF(op) != 0) ORI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 14: /* Major opcode 14: XORI */
-		if (RT_OF(op) != 0) XORI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 15: /* Major opcode 15: LUI */
-		if (RT_OF(op) != 0) LUI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 16: /* Coprocessor 0 prefix */
-		switch ((op >> 21) & 0x1F) {
-		case 0: /* Coprocessor 0 opcode 0: MFC0  */
-			if (RT_OF(op) != 0) MFC0(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 1: /* Coprocessor 0 opcode 1: DMFC0 */
-			if (RT_OF(op) != 0) DMFC0(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 4: /* Coprocessor 0 opcode 4: MTC0  */
-		case 5: /* Coprocessor 0 opcode 5: DMTC0 */
-			MTC0(r4300, op);
-			break;
-		case 16: /* Coprocessor 0 opcode 16: TLB */
-			switch (op & 0x3F) {
-			case 1: TLBR(r4300, op); break;
-			case 2: TLBWI(r4300, op); break;
-			case 6: TLBWR(r4300, op); break;
-			case 8: TLBP(r4300, op); break;
-			case 24: ERET(r4300, op); break;
-			default: /* TLB sub-opcodes 0, 3..5, 7, 9..23, 25..63:
-			            Reserved Instructions */
-				RESERVED(r4300, op);
-				break;
-			} /* switch (op & 0x3F) for Coprocessor 0 TLB opcodes */
-			break;
-		default: /* Coprocessor 0 opcodes 2..3, 5..15, 17..31:
-		            Reserved Instructions */
-			RESERVED(r4300, op);
-			break;
-		} /* switch ((op >> 21) & 0x1F) for the Coprocessor 0 prefix */
-		break;
-	case 17: /* Coprocessor 1 prefix */
-		switch ((op >> 21) & 0x1F) {
-		case 0: /* Coprocessor 1 opcode 0: MFC1 */
-			if (RT_OF(op) != 0) MFC1(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 1: /* Coprocessor 1 opcode 1: DMFC1 */
-			if (RT_OF(op) != 0) DMFC1(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 2: /* Coprocessor 1 opcode 2: CFC1 */
-			if (RT_OF(op) != 0) CFC1(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 3: /* Coprocessor 1 opcode 2: DCFC1  */
-			if (RT_OF(op) != 0) DCFC1(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 4: MTC1(r4300, op); break;
-		case 5: DMTC1(r4300, op); break;
-		case 6: CTC1(r4300, op); break;
-		case 7: DCTC1(r4300, op); break;
-		case 8: /* Coprocessor 1 opcode 8: Branch on C1 condition... */
-			switch ((op >> 16) & 0x3) {
-			case 0: /* opcode 0: BC1F */
-				if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BC1F_IDLE(r4300, op);
-				else                                             BC1F(r4300, op);
-				break;
-			case 1: /* opcode 1: BC1T */
-				if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BC1T_IDLE(r4300, op);
-				else                                             BC1T(r4300, op);
-				break;
-			case 2: /* opcode 2: BC1FL */
-				if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BC1FL_IDLE(r4300, op);
-				else                                             BC1FL(r4300, op);
-				break;
-			case 3: /* opcode 3: BC1TL */
-				if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BC1TL_IDLE(r4300, op);
-				else                                             BC1TL(r4300, op);
-				break;
-			} /* switch ((op >> 16) & 0x3) for branches on C1 condition */
-			break;
-		case 16: /* Coprocessor 1 S-format opcodes */
-			switch (op & 0x3F) {
-			case 0: ADD_S(r4300, op); break;
-			case 1: SUB_S(r4300, op); break;
-			case 2: MUL_S(r4300, op); break;
-			case 3: DIV_S(r4300, op); break;
-			case 4: SQRT_S(r4300, op); break;
-			case 5: ABS_S(r4300, op); break;
-			case 6: MOV_S(r4300, op); break;
-			case 7: NEG_S(r4300, op); break;
-			case 8: ROUND_L_S(r4300, op); break;
-			case 9: TRUNC_L_S(r4300, op); break;
-			case 10: CEIL_L_S(r4300, op); break;
-			case 11: FLOOR_L_S(r4300, op); break;
-			case 12: ROUND_W_S(r4300, op); break;
-			case 13: TRUNC_W_S(r4300, op); break;
-			case 14: CEIL_W_S(r4300, op); break;
-			case 15: FLOOR_W_S(r4300, op); break;
-			case 33: CVT_D_S(r4300, op); break;
-			case 36: CVT_W_S(r4300, op); break;
-			case 37: CVT_L_S(r4300, op); break;
-			case 48: C_F_S(r4300, op); break;
-			case 49: C_UN_S(r4300, op); break;
-			case 50: C_EQ_S(r4300, op); break;
-			case 51: C_UEQ_S(r4300, op); break;
-			case 52: C_OLT_S(r4300, op); break;
-			case 53: C_ULT_S(r4300, op); break;
-			case 54: C_OLE_S(r4300, op); break;
-			case 55: C_ULE_S(r4300, op); break;
-			case 56: C_SF_S(r4300, op); break;
-			case 57: C_NGLE_S(r4300, op); break;
-			case 58: C_SEQ_S(r4300, op); break;
-			case 59: C_NGL_S(r4300, op); break;
-			case 60: C_LT_S(r4300, op); break;
-			case 61: C_NGE_S(r4300, op); break;
-			case 62: C_LE_S(r4300, op); break;
-			case 63: C_NGT_S(r4300, op); break;
-			default: /* Coprocessor 1 S-format opcodes 16..32, 34..35, 38..47:
-			            Reserved Instructions */
-				RESERVED(r4300, op);
-				break;
-			} /* switch (op & 0x3F) for Coprocessor 1 S-format opcodes */
-			break;
-		case 17: /* Coprocessor 1 D-format opcodes */
-			switch (op & 0x3F) {
-			case 0: ADD_D(r4300, op); break;
-			case 1: SUB_D(r4300, op); break;
-			case 2: MUL_D(r4300, op); break;
-			case 3: DIV_D(r4300, op); break;
-			case 4: SQRT_D(r4300, op); break;
-			case 5: ABS_D(r4300, op); break;
-			case 6: MOV_D(r4300, op); break;
-			case 7: NEG_D(r4300, op); break;
-			case 8: ROUND_L_D(r4300, op); break;
-			case 9: TRUNC_L_D(r4300, op); break;
-			case 10: CEIL_L_D(r4300, op); break;
-			case 11: FLOOR_L_D(r4300, op); break;
-			case 12: ROUND_W_D(r4300, op); break;
-			case 13: TRUNC_W_D(r4300, op); break;
-			case 14: CEIL_W_D(r4300, op); break;
-			case 15: FLOOR_W_D(r4300, op); break;
-			case 32: CVT_S_D(r4300, op); break;
-			case 36: CVT_W_D(r4300, op); break;
-			case 37: CVT_L_D(r4300, op); break;
-			case 48: C_F_D(r4300, op); break;
-			case 49: C_UN_D(r4300, op); break;
-			case 50: C_EQ_D(r4300, op); break;
-			case 51: C_UEQ_D(r4300, op); break;
-			case 52: C_OLT_D(r4300, op); break;
-			case 53: C_ULT_D(r4300, op); break;
-			case 54: C_OLE_D(r4300, op); break;
-			case 55: C_ULE_D(r4300, op); break;
-			case 56: C_SF_D(r4300, op); break;
-			case 57: C_NGLE_D(r4300, op); break;
-			case 58: C_SEQ_D(r4300, op); break;
-			case 59: C_NGL_D(r4300, op); break;
-			case 60: C_LT_D(r4300, op); break;
-			case 61: C_NGE_D(r4300, op); break;
-			case 62: C_LE_D(r4300, op); break;
-			case 63: C_NGT_D(r4300, op); break;
-			default: /* Coprocessor 1 D-format opcodes 16..31, 33..35, 38..47:
-			            Reserved Instructions */
-				RESERVED(r4300, op);
-				break;
-			} /* switch (op & 0x3F) for Coprocessor 1 D-format opcodes */
-			break;
-		case 20: /* Coprocessor 1 W-format opcodes */
-			switch (op & 0x3F) {
-			case 32: CVT_S_W(r4300, op); break;
-			case 33: CVT_D_W(r4300, op); break;
-			default: /* Coprocessor 1 W-format opcodes 0..31, 34..63:
-			            Reserved Instructions */
-				RESERVED(r4300, op);
-				break;
-			}
-			break;
-		case 21: /* Coprocessor 1 L-format opcodes */
-			switch (op & 0x3F) {
-			case 32: CVT_S_L(r4300, op); break;
-			case 33: CVT_D_L(r4300, op); break;
-			default: /* Coprocessor 1 L-format opcodes 0..31, 34..63:
-			            Reserved Instructions */
-				RESERVED(r4300, op);
-				break;
-			}
-			break;
-		default: /* Coprocessor 1 opcodes 9..15, 18..19, 22..31:
-		            Reserved Instructions */
-			RESERVED(r4300, op);
-			break;
-		} /* switch ((op >> 21) & 0x1F) for the Coprocessor 1 prefix */
-		break;
-	case 18: /* Coprocessor 2 prefix */
-		switch ((op >> 21) & 0x1F) {
-		case 0: /* Coprocessor 2 opcode 0: MFC2 */
-			if (RT_OF(op) != 0) MFC2(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 1: /* Coprocessor 2 opcode 1: DMFC2 */
-			if (RT_OF(op) != 0) DMFC2(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 2: /* Coprocessor 2 opcode 2: CFC2 */
-			if (RT_OF(op) != 0) CFC2(r4300, op);
-			else                NOP(r4300, 0);
-			break;
-		case 4: MTC2(r4300, op); break;
-		case 5: DMTC2(r4300, op); break;
-		case 6: CTC2(r4300, op); break;
-		default:
-			RESERVED_COP2(r4300, op);
-			break;
-		}
-		break;
-	case 20: /* Major opcode 20: BEQL */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BEQL_IDLE(r4300, op);
-		else                                             BEQL(r4300, op);
-		break;
-	case 21: /* Major opcode 21: BNEL */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BNEL_IDLE(r4300, op);
-		else                                             BNEL(r4300, op);
-		break;
-	case 22: /* Major opcode 22: BLEZL */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BLEZL_IDLE(r4300, op);
-		else                                             BLEZL(r4300, op);
-		break;
-	case 23: /* Major opcode 23: BGTZL */
-		if (IS_RELATIVE_IDLE_LOOP(r4300, op, *r4300_pc(r4300))) BGTZL_IDLE(r4300, op);
-		else                                             BGTZL(r4300, op);
-		break;
-	case 24: /* Major opcode 24: DADDI */
-		if (RT_OF(op) != 0) DADDI(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 25: /* Major opcode 25: DADDIU */
-		if (RT_OF(op) != 0) DADDIU(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 26: /* Major opcode 26: LDL */
-		if (RT_OF(op) != 0) LDL(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 27: /* Major opcode 27: LDR */
-		if (RT_OF(op) != 0) LDR(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 32: /* Major opcode 32: LB */
-		if (RT_OF(op) != 0) LB(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 33: /* Major opcode 33: LH */
-		if (RT_OF(op) != 0) LH(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 34: /* Major opcode 34: LWL */
-		if (RT_OF(op) != 0) LWL(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 35: /* Major opcode 35: LW */
-		if (RT_OF(op) != 0) LW(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 36: /* Major opcode 36: LBU */
-		if (RT_OF(op) != 0) LBU(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 37: /* Major opcode 37: LHU */
-		if (RT_OF(op) != 0) LHU(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 38: /* Major opcode 38: LWR */
-		if (RT_OF(op) != 0) LWR(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 39: /* Major opcode 39: LWU */
-		if (RT_OF(op) != 0) LWU(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 40: SB(r4300, op); break;
-	case 41: SH(r4300, op); break;
-	case 42: SWL(r4300, op); break;
-	case 43: SW(r4300, op); break;
-	case 44: SDL(r4300, op); break;
-	case 45: SDR(r4300, op); break;
-	case 46: SWR(r4300, op); break;
-	case 47: CACHE(r4300, op); break;
-	case 48: /* Major opcode 48: LL */
-		if (RT_OF(op) != 0) LL(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 49: LWC1(r4300, op); break;
-	case 52: /* Major opcode 52: LLD (Not implemented) */
-		NI(r4300, op);
-		break;
-	case 53: LDC1(r4300, op); break;
-	case 55: /* Major opcode 55: LD */
-		if (RT_OF(op) != 0) LD(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 56: /* Major opcode 56: SC */
-		if (RT_OF(op) != 0) SC(r4300, op);
-		else                NOP(r4300, 0);
-		break;
-	case 57: SWC1(r4300, op); break;
-	case 60: /* Major opcode 60: SCD (Not implemented) */
-		NI(r4300, op);
-		break;
-	case 61: SDC1(r4300, op); break;
-	case 63: SD(r4300, op); break;
-	default: /* Major opcodes 18..19, 28..31, 50..51, 54, 58..59, 62:
-	            Reserved Instructions */
-		RESERVED(r4300, op);
-		break;
-	} /* switch ((op >> 26) & 0x3F) */
+#define EXECUTE(name) name(r4300, op)
+#include "pure_interp_decode.def"
+#undef EXECUTE
+}
+
+#ifdef THREADED_INTERP
+/* Threaded build: instructions are decoded once into a small cache keyed by
+ * physical address, and each handler jumps straight to the next one with a
+ * computed goto instead of going back through the decoding switch. An entry
+ * is only used while the instruction word in memory still matches, so code
+ * changes need no invalidation. Delay slots still go through InterpretOpcode. */
+#define PURE_INTERP_HANDLERS \
+    X(ABS_D) X(ABS_S) X(ADD) X(ADDI) X(ADDIU) X(ADDU) \
+    X(ADD_D) X(ADD_S) X(AND) X(ANDI) X(BC1F) X(BC1FL) \
+    X(BC1FL_IDLE) X(BC1F_IDLE) X(BC1T) X(BC1TL) X(BC1TL_IDLE) X(BC1T_IDLE) \
+    X(BEQ) X(BEQL) X(BEQL_IDLE) X(BEQ_IDLE) X(BGEZ) X(BGEZAL) \
+    X(BGEZALL) X(BGEZALL_IDLE) X(BGEZAL_IDLE) X(BGEZL) X(BGEZL_IDLE) X(BGEZ_IDLE) \
+    X(BGTZ) X(BGTZL) X(BGTZL_IDLE) X(BGTZ_IDLE) X(BLEZ) X(BLEZL) \
+    X(BLEZL_IDLE) X(BLEZ_IDLE) X(BLTZ) X(BLTZAL) X(BLTZALL) X(BLTZALL_IDLE) \
+    X(BLTZAL_IDLE) X(BLTZL) X(BLTZL_IDLE) X(BLTZ_IDLE) X(BNE) X(BNEL) \
+    X(BNEL_IDLE) X(BNE_IDLE) X(BREAK) X(CACHE) X(CEIL_L_D) X(CEIL_L_S) \
+    X(CEIL_W_D) X(CEIL_W_S) X(CFC1) X(CFC2) X(CTC1) X(CTC2) \
+    X(CVT_D_L) X(CVT_D_S) X(CVT_D_W) X(CVT_L_D) X(CVT_L_S) X(CVT_S_D) \
+    X(CVT_S_L) X(CVT_S_W) X(CVT_W_D) X(CVT_W_S) X(C_EQ_D) X(C_EQ_S) \
+    X(C_F_D) X(C_F_S) X(C_LE_D) X(C_LE_S) X(C_LT_D) X(C_LT_S) \
+    X(C_NGE_D) X(C_NGE_S) X(C_NGLE_D) X(C_NGLE_S) X(C_NGL_D) X(C_NGL_S) \
+    X(C_NGT_D) X(C_NGT_S) X(C_OLE_D) X(C_OLE_S) X(C_OLT_D) X(C_OLT_S) \
+    X(C_SEQ_D) X(C_SEQ_S) X(C_SF_D) X(C_SF_S) X(C_UEQ_D) X(C_UEQ_S) \
+    X(C_ULE_D) X(C_ULE_S) X(C_ULT_D) X(C_ULT_S) X(C_UN_D) X(C_UN_S) \
+    X(DADD) X(DADDI) X(DADDIU) X(DADDU) X(DCFC1) X(DCTC1) \
+    X(DDIV) X(DDIVU) X(DIV) X(DIVU) X(DIV_D) X(DIV_S) \
+    X(DMFC0) X(DMFC1) X(DMFC2) X(DMTC1) X(DMTC2) X(DMULT) \
+    X(DMULTU) X(DSLL) X(DSLL32) X(DSLLV) X(DSRA) X(DSRA32) \
+    X(DSRAV) X(DSRL) X(DSRL32) X(DSRLV) X(DSUB) X(DSUBU) \
+    X(ERET) X(FLOOR_L_D) X(FLOOR_L_S) X(FLOOR_W_D) X(FLOOR_W_S) X(J) \
+    X(JAL) X(JALR) X(JAL_IDLE) X(JR) X(J_IDLE) X(LB) \
+    X(LBU) X(LD) X(LDC1) X(LDL) X(LDR) X(LH) \
+    X(LHU) X(LL) X(LUI) X(LW) X(LWC1) X(LWL) \
+    X(LWR) X(LWU) X(MFC0) X(MFC1) X(MFC2) X(MFHI) \
+    X(MFLO) X(MOV_D) X(MOV_S) X(MTC0) X(MTC1) X(MTC2) \
+    X(MTHI) X(MTLO) X(MULT) X(MULTU) X(MUL_D) X(MUL_S) \
+    X(NEG_D) X(NEG_S) X(NI) X(NOP) X(NOR) X(OR) \
+    X(ORI) X(RESERVED) X(RESERVED_COP2) X(ROUND_L_D) X(ROUND_L_S) X(ROUND_W_D) \
+    X(ROUND_W_S) X(SB) X(SC) X(SD) X(SDC1) X(SDL) \
+    X(SDR) X(SH) X(SLL) X(SLLV) X(SLT) X(SLTI) \
+    X(SLTIU) X(SLTU) X(SQRT_D) X(SQRT_S) X(SRA) X(SRAV) \
+    X(SRL) X(SRLV) X(SUB) X(SUBU) X(SUB_D) X(SUB_S) \
+    X(SW) X(SWC1) X(SWL) X(SWR) X(SYNC) X(SYSCALL) \
+    X(TEQ) X(TEQI) X(TGE) X(TGEI) X(TGEIU) X(TGEU) \
+    X(TLBP) X(TLBR) X(TLBWI) X(TLBWR) X(TLT) X(TLTI) \
+    X(TLTIU) X(TLTU) X(TNE) X(TNEI) X(TRUNC_L_D) X(TRUNC_L_S) \
+    X(TRUNC_W_D) X(TRUNC_W_S) X(XOR) X(XORI)
+
+#define X(name) PI_OP_##name,
+enum pure_interp_opcode
+{
+    PURE_INTERP_HANDLERS
+    PI_OPCODES_COUNT
+};
+#undef X
+
+#define PURE_INTERP_DECODE_CACHE_SIZE 4096
+#define PURE_INTERP_NO_ADDRESS UINT32_C(0xffffffff)
+
+struct pure_interp_decoded
+{
+    uint32_t paddr;
+    uint32_t op;
+    uint16_t opcode;
+};
+
+static uint16_t pure_interp_decode(struct r4300_core* r4300, uint32_t op, int* cacheable)
+{
+    uint16_t opcode = PI_OP_RESERVED;
+
+#undef IDLE_LOOP_CHECKED
+#define IDLE_LOOP_CHECKED() (*cacheable = 0)
+#define EXECUTE(name) (opcode = PI_OP_##name)
+#include "pure_interp_decode.def"
+#undef EXECUTE
+#undef IDLE_LOOP_CHECKED
+#define IDLE_LOOP_CHECKED() ((void)0)
+
+    return opcode;
+}
+
+static osal_inline const struct pure_interp_decoded* pure_interp_fetch(struct r4300_core* r4300, struct pure_interp_decoded* cache)
+{
+    struct pure_interp_decoded* entry;
+    uint32_t address = *r4300_pc(r4300);
+    uint32_t op;
+    int cacheable = 1;
+
+    /* same translation as fast_mem_access */
+    if ((address & UINT32_C(0xc0000000)) != UINT32_C(0x80000000)) {
+        address = virtual_to_physical_address(r4300, address, 2);
+        if (address == 0) // TLB exception
+            return NULL;
+    }
+
+    address &= UINT32_C(0x1ffffffc);
+    op = *mem_base_u32(r4300->mem->base, address);
+
+    entry = &cache[(address >> 2) & (PURE_INTERP_DECODE_CACHE_SIZE - 1)];
+    if (entry->paddr != address || entry->op != op)
+    {
+        entry->opcode = pure_interp_decode(r4300, op, &cacheable);
+        entry->op = op;
+        entry->paddr = cacheable ? address : PURE_INTERP_NO_ADDRESS;
+    }
+
+    return entry;
 }
 
+#ifdef COMPARE_CORE
+#define COMPARE_CORE_CALLBACK() CoreCompareCallback()
+#else
+#define COMPARE_CORE_CALLBACK() do { } while(0)
+#endif
+#ifdef DBG
+#define UPDATE_DEBUGGER() if (g_DebuggerActive) update_debugger(*r4300_pc(r4300))
+#else
+#define UPDATE_DEBUGGER() do { } while(0)
+#endif
+
+#define DISPATCH() \
+    do { \
+        if (*r4300_stop(r4300)) goto stop; \
+        COMPARE_CORE_CALLBACK(); \
+        UPDATE_DEBUGGER(); \
+        entry = pure_interp_fetch(r4300, cache); \
+        if (entry == NULL) goto no_instruction; \
+        goto *handlers[entry->opcode]; \
+    } while(0)
+
+void run_pure_interpreter(struct r4300_core* r4300)
+{
+#define X(name) &&L_##name,
+    static const void* const handlers[PI_OPCODES_COUNT] = { PURE_INTERP_HANDLERS };
+#undef X
+    struct pure_interp_decoded* cache;
+    const struct pure_interp_decoded* entry;
+    size_t i;
+
+    cache = malloc(PURE_INTERP_DECODE_CACHE_SIZE * sizeof(*cache));
+    if (cache == NULL) {
+        DebugMessage(M64MSG_ERROR, "Failed to allocate pure interpreter decode cache");
+        return;
+    }
+    for (i = 0; i < PURE_INTERP_DECODE_CACHE_SIZE; ++i) {
+        cache[i].paddr = PURE_INTERP_NO_ADDRESS;
+        cache[i].op = 0;
+        cache[i].opcode = PI_OP_RESERVED;
+    }
+
+    *r4300_stop(r4300) = 0;
+    *r4300_pc_struct(r4300) = &r4300->interp_PC;
+    *r4300_pc(r4300) = r4300->cp0.last_addr = r4300->start_address;
+
+    DISPATCH();
+
+no_instruction:
+    DISPATCH();
+
+#define X(name) L_##name: name(r4300, entry->op); DISPATCH();
+    PURE_INTERP_HANDLERS
+#undef X
+
+stop:
+    free(cache);
+}
+#else
 void run_pure_interpreter(struct r4300_core* r4300)
 {
    *r4300_stop(r4300) = 0;
@@ -760,3 +364,4 @@ void run_pure_interpreter(struct r4300_core* r4300)
      InterpretOpcode(r4300);
    }
 }
+#endif
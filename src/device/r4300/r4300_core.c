@@ -34,6 +34,7 @@
 #ifdef DBG
 #include "debugger/dbg_debugger.h"
 #endif
+#include "device/rdram/rdram.h"
 #include "main/main.h"
 
 #include <stdlib.h>
@@ -41,7 +42,7 @@
 #include <time.h>
 
 void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controller* mi, struct rdram* rdram, const struct interrupt_handler* interrupt_handlers,
-    unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, int randomize_interrupt, uint32_t start_address)
+    unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, int fuse_ops, int randomize_interrupt, uint32_t start_address)
 {
     struct new_dynarec_hot_state* new_dynarec_hot_state =
 #ifdef NEW_DYNAREC
@@ -59,6 +60,12 @@ void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controll
     r4300->recomp.no_compiled_jump = no_compiled_jump;
 #endif
 
+#ifdef COMPARE_CORE
+    /* core comparison has to see every instruction */
+    fuse_ops = 0;
+#endif
+    r4300->cached_interp.fuse_ops = fuse_ops;
+
     r4300->mem = mem;
     r4300->mi = mi;
     r4300->rdram = rdram;
@@ -155,7 +162,9 @@ void run_r4300(struct r4300_core* r4300)
         init_blocks(&r4300->cached_interp);
 #ifdef NEW_DYNAREC
         new_dynarec_init();
+        new_dynarec_load_cache();
         new_dyna_start();
+        new_dynarec_save_cache();
         new_dynarec_cleanup();
 #else
         r4300->cached_interp.fin_block = dynarec_fin_block;
@@ -281,13 +290,22 @@ unsigned int get_r4300_emumode(struct r4300_core* r4300)
     return r4300->emumode;
 }
 
+/* Translates a TLB mapped address. Recently used pages are found in the
+ * micro TLB without calling into the full lookup. */
+static osal_inline uint32_t tlb_translate(struct r4300_core* r4300, uint32_t address, int w)
+{
+    uint32_t paddr = tlb_micro_lookup(&r4300->cp0.tlb, address, w);
+
+    return (paddr != 0) ? paddr : virtual_to_physical_address(r4300, address, w);
+}
+
 uint32_t *fast_mem_access(struct r4300_core* r4300, uint32_t address)
 {
     /* This code is performance critical, specially on pure interpreter mode.
      * Removing error checking saves some time, but the emulator may crash. */
 
     if ((address & UINT32_C(0xc0000000)) != UINT32_C(0x80000000)) {
-        address = virtual_to_physical_address(r4300, address, 2);
+        address = tlb_translate(r4300, address, 2);
         if (address == 0) // TLB exception
             return NULL;
     }
@@ -297,6 +315,21 @@ uint32_t *fast_mem_access(struct r4300_core* r4300, uint32_t address)
     return mem_base_u32(r4300->mem->base, address);
 }
 
+/* Plain RDRAM is accessed directly instead of through its handlers.
+ * Anything else goes through the handlers: MMIO, RDRAM whose handlers were
+ * replaced (framebuffer dirty tracking, corruption emulation, breakpoints)
+ * and addresses past the installed RAM.
+ */
+static osal_inline int is_plain_rdram_read(const struct r4300_core* r4300, const struct mem_handler* handler, uint32_t address)
+{
+    return handler->read32 == read_rdram_dram && address < r4300->rdram->dram_size;
+}
+
+static osal_inline int is_plain_rdram_write(const struct r4300_core* r4300, const struct mem_handler* handler, uint32_t address)
+{
+    return handler->write32 == write_rdram_dram && address < r4300->rdram->dram_size;
+}
+
 /* Read aligned word from memory.
  * address may not be word-aligned for byte or hword accesses.
  * Alignment is taken care of when calling mem handler.
@@ -304,7 +337,7 @@ uint32_t *fast_mem_access(struct r4300_core* r4300, uint32_t address)
 int r4300_read_aligned_word(struct r4300_core* r4300, uint32_t address, uint32_t* value)
 {
     if ((address & UINT32_C(0xc0000000)) != UINT32_C(0x80000000)) {
-        address = virtual_to_physical_address(r4300, address, 0);
+        address = tlb_translate(r4300, address, 0);
         if (address == 0) {
             return 0;
         }
@@ -312,7 +345,13 @@ int r4300_read_aligned_word(struct r4300_core* r4300, uint32_t address, uint32_t
 
     address &= UINT32_C(0x1ffffffc);
 
-    mem_read32(mem_get_handler(r4300->mem, address), address & ~UINT32_C(3), value);
+    const struct mem_handler* handler = mem_get_handler(r4300->mem, address);
+    if (is_plain_rdram_read(r4300, handler, address)) {
+        *value = r4300->rdram->dram[rdram_dram_address(address)];
+        return 1;
+    }
+
+    mem_read32(handler, address & ~UINT32_C(3), value);
 
     return 1;
 }
@@ -330,7 +369,7 @@ int r4300_read_aligned_dword(struct r4300_core* r4300, uint32_t address, uint64_
     }
 
     if ((address & UINT32_C(0xc0000000)) != UINT32_C(0x80000000)) {
-        address = virtual_to_physical_address(r4300, address, 0);
+        address = tlb_translate(r4300, address, 0);
         if (address == 0) {
             return 0;
         }
@@ -339,8 +378,14 @@ int r4300_read_aligned_dword(struct r4300_core* r4300, uint32_t address, uint64_
     address &= UINT32_C(0x1ffffffc);
 
     const struct mem_handler* handler = mem_get_handler(r4300->mem, address);
-    mem_read32(handler, address + 0, &w[0]);
-    mem_read32(handler, address + 4, &w[1]);
+    if (is_plain_rdram_read(r4300, handler, address + 4)) {
+        w[0] = r4300->rdram->dram[rdram_dram_address(address + 0)];
+        w[1] = r4300->rdram->dram[rdram_dram_address(address + 4)];
+    }
+    else {
+        mem_read32(handler, address + 0, &w[0]);
+        mem_read32(handler, address + 4, &w[1]);
+    }
 
     *value = ((uint64_t)w[0] << 32) | w[1];
 
@@ -357,7 +402,7 @@ int r4300_write_aligned_word(struct r4300_core* r4300, uint32_t address, uint32_
 
         invalidate_r4300_cached_code(r4300, address, 4);
 
-        address = virtual_to_physical_address(r4300, address, 1);
+        address = tlb_translate(r4300, address, 1);
         if (address == 0) {
             return 0;
         }
@@ -368,7 +413,13 @@ int r4300_write_aligned_word(struct r4300_core* r4300, uint32_t address, uint32_
 
     address &= UINT32_C(0x1ffffffc);
 
-    mem_write32(mem_get_handler(r4300->mem, address), address & ~UINT32_C(3), value, mask);
+    const struct mem_handler* handler = mem_get_handler(r4300->mem, address);
+    if (is_plain_rdram_write(r4300, handler, address)) {
+        masked_write(&r4300->rdram->dram[rdram_dram_address(address)], value, mask);
+        return 1;
+    }
+
+    mem_write32(handler, address & ~UINT32_C(3), value, mask);
 
     return 1;
 }
@@ -387,7 +438,7 @@ int r4300_write_aligned_dword(struct r4300_core* r4300, uint32_t address, uint64
 
         invalidate_r4300_cached_code(r4300, address, 8);
 
-        address = virtual_to_physical_address(r4300, address, 1);
+        address = tlb_translate(r4300, address, 1);
         if (address == 0) {
             return 0;
         }
@@ -399,6 +450,12 @@ int r4300_write_aligned_dword(struct r4300_core* r4300, uint32_t address, uint64
     address &= UINT32_C(0x1ffffffc);
 
     const struct mem_handler* handler = mem_get_handler(r4300->mem, address);
+    if (is_plain_rdram_write(r4300, handler, address + 4)) {
+        masked_write(&r4300->rdram->dram[rdram_dram_address(address + 0)], value >> 32,      mask >> 32);
+        masked_write(&r4300->rdram->dram[rdram_dram_address(address + 4)], (uint32_t) value, (uint32_t) mask      );
+        return 1;
+    }
+
     mem_write32(handler, address + 0, value >> 32,      mask >> 32);
     mem_write32(handler, address + 4, (uint32_t) value, (uint32_t) mask      );
 
@@ -422,6 +479,21 @@ void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, si
     }
 }
 
+#ifndef NEW_DYNAREC
+void r4300_set_fast_memory(struct r4300_core* r4300, int fast_memory)
+{
+    if (r4300->recomp.fast_memory == fast_memory) {
+        return;
+    }
+
+    r4300->recomp.fast_memory = fast_memory;
+
+    /* code generated with the previous setting must not be revalidated
+     * by its page content, which doesn't change here */
+    cached_interp_drop_block_hashes(&r4300->cached_interp);
+}
+#endif
+
 
 void generic_jump_to(struct r4300_core* r4300, uint32_t address)
 {
@@ -44,10 +44,17 @@ struct mi_controller;
 struct rdram;
 
 struct jump_table;
+
+/* blocks is a page directory over the 0x100000 virtual pages, whose leaves
+ * of CACHED_INTERP_LEAF_SIZE block pointers are allocated on first use */
+#define CACHED_INTERP_LEAF_BITS 12
+#define CACHED_INTERP_LEAF_SIZE (1 << CACHED_INTERP_LEAF_BITS)
+#define CACHED_INTERP_LEAVES (0x100000 >> CACHED_INTERP_LEAF_BITS)
+
 struct cached_interp
 {
     char invalid_code[0x100000];
-    struct precomp_block* blocks[0x100000];
+    struct precomp_block** blocks[CACHED_INTERP_LEAVES];
     struct precomp_block* actual;
 
     void (*fin_block)(void);
@@ -59,8 +66,18 @@ struct cached_interp
 
     void (*recompile_block)(struct r4300_core* r4300,
         const uint32_t* source, struct precomp_block* block, uint32_t func);
+
+    /* fuse frequent instruction pairs into superinstructions */
+    int fuse_ops;
 };
 
+/* Returns the block of a virtual page, NULL if it was never set up */
+static osal_inline struct precomp_block* cached_interp_block(const struct cached_interp* cinterp, uint32_t page)
+{
+    struct precomp_block* const* leaf = cinterp->blocks[page >> CACHED_INTERP_LEAF_BITS];
+    return (leaf != NULL) ? leaf[page & (CACHED_INTERP_LEAF_SIZE - 1)] : NULL;
+}
+
 enum {
     EMUMODE_PURE_INTERPRETER = 0,
     EMUMODE_INTERPRETER      = 1,
@@ -215,7 +232,7 @@ struct r4300_core
     offsetof(struct new_dynarec_hot_state, regs))
 #endif
 
-void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controller* mi, struct rdram* rdram, const struct interrupt_handler* interrupt_handlers, unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, int randomize_interrupt, uint32_t start_address);
+void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controller* mi, struct rdram* rdram, const struct interrupt_handler* interrupt_handlers, unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, int fuse_ops, int randomize_interrupt, uint32_t start_address);
 void poweron_r4300(struct r4300_core* r4300);
 
 void run_r4300(struct r4300_core* r4300);
@@ -248,6 +265,12 @@ int r4300_write_aligned_dword(struct r4300_core* r4300, uint32_t address, uint64
  */
 void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, size_t size);
 
+#ifndef NEW_DYNAREC
+/* Enable or disable direct RDRAM accesses in dynarec generated code.
+ * Callers must then invalidate all cached code so it is regenerated. */
+void r4300_set_fast_memory(struct r4300_core* r4300, int fast_memory);
+#endif
+
 /* Jump to the given address. This works for all r4300 emulator, but is slower.
  * Use this for common code which can be executed from any r4300 emulator. */
 void generic_jump_to(struct r4300_core* r4300, unsigned int address);
@@ -455,13 +455,21 @@ static void (*const recomp_funcs[R4300_OPCODES_COUNT])(struct r4300_core* r4300)
 void dynarec_init_block(struct r4300_core* r4300, uint32_t address)
 {
     int i, length, already_exist = 1;
+
+    if (cached_interp_revalidate_block(r4300, address)) {
+        return;
+    }
+
 #if defined(PROFILE)
     timed_section_start(TIMED_SECTION_COMPILER);
 #endif
 
-    struct precomp_block** block = &r4300->cached_interp.blocks[address >> 12];
+    struct precomp_block** block = cached_interp_block_slot(&r4300->cached_interp, address >> 12);
 
     /* allocate block */
+    if (block == NULL) {
+        return;
+    }
     if (*block == NULL) {
         *block = malloc(sizeof(struct precomp_block));
         (*block)->block = NULL;
@@ -569,6 +577,8 @@ void dynarec_init_block(struct r4300_core* r4300, uint32_t address)
         }
     }
 
+    b->xxhash = hash_block_page(r4300, b);
+
     free_all_registers(r4300);
     /* calling pass2 of the assembler is not necessary here because all of the code emitted by
        gennotcompiled() and gendebug() is position-independent and contains no jumps . */
@@ -634,8 +644,10 @@ void dynarec_recompile_block(struct r4300_core* r4300, const uint32_t* iw, struc
     length = get_block_length(block);
     length2 = length - 2 + (length >> 2);
 
-    /* reset xxhash */
-    block->xxhash = 0;
+    /* reset xxhash (TLB pages are rehashed by TLBWrite on unmap) */
+    if (block_start_in_tlb) {
+        block->xxhash = 0;
+    }
 
     r4300->recomp.dst_block = block;
     r4300->recomp.code_length = block->code_length;
@@ -660,8 +672,8 @@ void dynarec_recompile_block(struct r4300_core* r4300, const uint32_t* iw, struc
         if (block_start_in_tlb)
         {
             uint32_t address2 = virtual_to_physical_address(r4300, r4300->recomp.dst->addr, 0);
-            if (r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops == r4300->cached_interp.not_compiled) {
-                r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops = r4300->cached_interp.not_compiled2;
+            if (cached_interp_block(&r4300->cached_interp, address2>>12)->block[(address2&UINT32_C(0xFFF))/4].ops == r4300->cached_interp.not_compiled) {
+                cached_interp_block(&r4300->cached_interp, address2>>12)->block[(address2&UINT32_C(0xFFF))/4].ops = r4300->cached_interp.not_compiled2;
             }
         }
 
@@ -846,13 +858,14 @@ void profile_write_end_of_code_blocks(struct r4300_core* r4300)
     r4300->recomp.pfProfile = osal_file_open("instructionaddrs.dat", "ab");
 
     for (i = 0; i < 0x100000; ++i) {
-        if (r4300->cached_interp.invalid_code[i] == 0 && r4300->cached_interp.blocks[i] != NULL && r4300->cached_interp.blocks[i]->code != NULL && r4300->cached_interp.blocks[i]->block != NULL)
+        const struct precomp_block* b = cached_interp_block(&r4300->cached_interp, i);
+        if (r4300->cached_interp.invalid_code[i] == 0 && b != NULL && b->code != NULL && b->block != NULL)
         {
             unsigned char *x86addr;
             int mipsop;
             // store final code length for this block
             mipsop = -1; /* -1 == end of x86 code block */
-            x86addr = r4300->cached_interp.blocks[i]->code + r4300->cached_interp.blocks[i]->code_length;
+            x86addr = b->code + b->code_length;
             if (fwrite(&mipsop, 1, 4, r4300->recomp.pfProfile) != 4 ||
                     fwrite(&x86addr, 1, sizeof(char *), r4300->recomp.pfProfile) != sizeof(char *))
                 DebugMessage(M64MSG_ERROR, "Error writing R4300 instruction address profiling data");
@@ -21,19 +21,73 @@
 
 #include "tlb.h"
 
+#include "api/callbacks.h"
 #include "api/m64p_types.h"
 #include "device/r4300/r4300_core.h"
 #include "device/rdram/rdram.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+void tlb_lut_set(uint32_t** lut, uint32_t page, uint32_t value)
+{
+    uint32_t** leaf = &lut[page >> TLB_LUT_LEAF_BITS];
+
+    if (*leaf == NULL)
+    {
+        /* unmapping never needs a leaf */
+        if (value == 0)
+            return;
+
+        *leaf = calloc(TLB_LUT_LEAF_SIZE, sizeof(**leaf));
+        if (*leaf == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Failed to allocate TLB lookup table");
+            return;
+        }
+    }
+
+    (*leaf)[page & (TLB_LUT_LEAF_SIZE - 1)] = value;
+}
+
+void tlb_lut_reset(uint32_t** lut)
+{
+    size_t i;
+
+    for (i = 0; i < TLB_LUT_LEAVES; ++i)
+    {
+        free(lut[i]);
+        lut[i] = NULL;
+    }
+}
+
+void tlb_micro_flush(struct tlb* tlb)
+{
+    size_t i;
+
+    for (i = 0; i < TLB_MICRO_SIZE; ++i)
+    {
+        tlb->micro_r[i].page = TLB_MICRO_NO_PAGE;
+        tlb->micro_w[i].page = TLB_MICRO_NO_PAGE;
+    }
+}
+
 void poweron_tlb(struct tlb* tlb)
 {
     /* clear TLB entries */
     memset(tlb->entries, 0, 32 * sizeof(tlb->entries[0]));
-    memset(tlb->LUT_r, 0, 0x100000 * sizeof(tlb->LUT_r[0]));
-    memset(tlb->LUT_w, 0, 0x100000 * sizeof(tlb->LUT_w[0]));
+    tlb_lut_reset(tlb->LUT_r);
+    tlb_lut_reset(tlb->LUT_w);
+    tlb_micro_flush(tlb);
+    memset(tlb->micro_stats, 0, sizeof(tlb->micro_stats));
+}
+
+void release_tlb(struct tlb* tlb)
+{
+    tlb_lut_reset(tlb->LUT_r);
+    tlb_lut_reset(tlb->LUT_w);
+    tlb_micro_flush(tlb);
 }
 
 void tlb_unmap(struct tlb* tlb, size_t entry)
@@ -43,23 +97,24 @@ void tlb_unmap(struct tlb* tlb, size_t entry)
 
     assert(entry < 32);
     e = &tlb->entries[entry];
+    tlb_micro_flush(tlb);
 
     if (e->v_even)
     {
         for (i=e->start_even; i<e->end_even; i += 0x1000)
-            tlb->LUT_r[i>>12] = 0;
+            tlb_lut_set(tlb->LUT_r, i>>12, 0);
         if (e->d_even)
             for (i=e->start_even; i<e->end_even; i += 0x1000)
-                tlb->LUT_w[i>>12] = 0;
+                tlb_lut_set(tlb->LUT_w, i>>12, 0);
     }
 
     if (e->v_odd)
     {
         for (i=e->start_odd; i<e->end_odd; i += 0x1000)
-            tlb->LUT_r[i>>12] = 0;
+            tlb_lut_set(tlb->LUT_r, i>>12, 0);
         if (e->d_odd)
             for (i=e->start_odd; i<e->end_odd; i += 0x1000)
-                tlb->LUT_w[i>>12] = 0;
+                tlb_lut_set(tlb->LUT_w, i>>12, 0);
     }
 }
 
@@ -70,6 +125,7 @@ void tlb_map(struct tlb* tlb, size_t entry)
 
     assert(entry < 32);
     e = &tlb->entries[entry];
+    tlb_micro_flush(tlb);
 
     if (e->v_even)
     {
@@ -78,10 +134,10 @@ void tlb_map(struct tlb* tlb, size_t entry)
             e->phys_even < 0x20000000)
         {
             for (i=e->start_even;i<e->end_even;i+=0x1000)
-                tlb->LUT_r[i>>12] = UINT32_C(0x80000000) | (e->phys_even + (i - e->start_even) + 0xFFF);
+                tlb_lut_set(tlb->LUT_r, i>>12, UINT32_C(0x80000000) | (e->phys_even + (i - e->start_even) + 0xFFF));
             if (e->d_even)
                 for (i=e->start_even;i<e->end_even;i+=0x1000)
-                    tlb->LUT_w[i>>12] = UINT32_C(0x80000000) | (e->phys_even + (i - e->start_even) + 0xFFF);
+                    tlb_lut_set(tlb->LUT_w, i>>12, UINT32_C(0x80000000) | (e->phys_even + (i - e->start_even) + 0xFFF));
         }
     }
 
@@ -92,33 +148,35 @@ void tlb_map(struct tlb* tlb, size_t entry)
             e->phys_odd < 0x20000000)
         {
             for (i=e->start_odd;i<e->end_odd;i+=0x1000)
-                tlb->LUT_r[i>>12] = UINT32_C(0x80000000) | (e->phys_odd + (i - e->start_odd) + 0xFFF);
+                tlb_lut_set(tlb->LUT_r, i>>12, UINT32_C(0x80000000) | (e->phys_odd + (i - e->start_odd) + 0xFFF));
             if (e->d_odd)
                 for (i=e->start_odd;i<e->end_odd;i+=0x1000)
-                    tlb->LUT_w[i>>12] = UINT32_C(0x80000000) | (e->phys_odd + (i - e->start_odd) + 0xFFF);
+                    tlb_lut_set(tlb->LUT_w, i>>12, UINT32_C(0x80000000) | (e->phys_odd + (i - e->start_odd) + 0xFFF));
         }
     }
 }
 
 uint32_t virtual_to_physical_address(struct r4300_core* r4300, uint32_t address, int w)
 {
-    const struct tlb* tlb = &r4300->cp0.tlb;
+    struct tlb* tlb = &r4300->cp0.tlb;
+    struct tlb_micro_entry* e;
     unsigned int addr = address >> 12;
+    uint32_t paddr;
 
 #ifdef NEW_DYNAREC
     if (r4300->emumode == EMUMODE_DYNAREC)
     {
         intptr_t map = r4300->new_dynarec_hot_state.memory_map[addr];
-        if ((tlb->LUT_w[addr]) && (w == 1))
+        if ((tlb_lut(tlb->LUT_w, addr)) && (w == 1))
         {
-            assert(map == (((uintptr_t)r4300->rdram->dram + (uintptr_t)((tlb->LUT_w[addr] & 0xFFFFF000) - 0x80000000) - (address & 0xFFFFF000)) >> 2));
+            assert(map == (((uintptr_t)r4300->rdram->dram + (uintptr_t)((tlb_lut(tlb->LUT_w, addr) & 0xFFFFF000) - 0x80000000) - (address & 0xFFFFF000)) >> 2));
         }
-        else if ((tlb->LUT_r[addr]) && (w == 0))
+        else if ((tlb_lut(tlb->LUT_r, addr)) && (w == 0))
         {
-            assert((map&~WRITE_PROTECT) == (((uintptr_t)r4300->rdram->dram + (uintptr_t)((tlb->LUT_r[addr] & 0xFFFFF000) - 0x80000000) - (address & 0xFFFFF000)) >> 2));
+            assert((map&~WRITE_PROTECT) == (((uintptr_t)r4300->rdram->dram + (uintptr_t)((tlb_lut(tlb->LUT_r, addr) & 0xFFFFF000) - 0x80000000) - (address & 0xFFFFF000)) >> 2));
             if (map & WRITE_PROTECT)
             {
-                assert(tlb->LUT_w[addr] == 0);
+                assert(tlb_lut(tlb->LUT_w, addr) == 0);
             }
         }
         else {
@@ -127,15 +185,20 @@ uint32_t virtual_to_physical_address(struct r4300_core* r4300, uint32_t address,
     }
 #endif
 
-    if (w == 1)
-    {
-        if (tlb->LUT_w[addr])
-            return (tlb->LUT_w[addr] & UINT32_C(0xFFFFF000)) | (address & UINT32_C(0xFFF));
-    }
-    else
+    paddr = tlb_micro_lookup(tlb, address, w);
+    if (paddr)
+        return paddr;
+    ++tlb->micro_stats[1];
+
+    paddr = (w == 1) ? tlb_lut(tlb->LUT_w, addr) : tlb_lut(tlb->LUT_r, addr);
+    if (paddr)
     {
-        if (tlb->LUT_r[addr])
-            return (tlb->LUT_r[addr] & UINT32_C(0xFFFFF000)) | (address & UINT32_C(0xFFF));
+        e = (w == 1)
+            ? &tlb->micro_w[addr & (TLB_MICRO_SIZE - 1)]
+            : &tlb->micro_r[addr & (TLB_MICRO_SIZE - 1)];
+        e->page = addr;
+        e->paddr = paddr & UINT32_C(0xFFFFF000);
+        return e->paddr | (address & UINT32_C(0xFFF));
     }
     //printf("tlb exception !!! @ %x, %x, add:%x\n", address, w, r4300->pc->addr);
     //getchar();
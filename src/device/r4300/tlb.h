@@ -25,8 +25,22 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "osal/preproc.h"
+
 struct r4300_core;
 
+/* The lookup tables are page directories over the 0x100000 virtual pages,
+ * whose leaves of TLB_LUT_LEAF_SIZE entries are only allocated once a
+ * page in their range gets mapped. A missing leaf reads as unmapped. */
+#define TLB_LUT_LEAF_BITS 12
+#define TLB_LUT_LEAF_SIZE (1 << TLB_LUT_LEAF_BITS)
+#define TLB_LUT_LEAVES (0x100000 >> TLB_LUT_LEAF_BITS)
+
+/* Direct-mapped cache of the last LUT translations, one per access kind.
+ * It mirrors the LUTs, so it must be flushed whenever they change. */
+#define TLB_MICRO_SIZE 64
+#define TLB_MICRO_NO_PAGE UINT32_C(0xffffffff)
+
 struct tlb_entry
 {
    short mask;
@@ -52,14 +66,52 @@ struct tlb_entry
    unsigned int phys_odd;
 };
 
+struct tlb_micro_entry
+{
+    uint32_t page;
+    uint32_t paddr;
+};
+
 struct tlb
 {
     struct tlb_entry entries[32];
-    uint32_t LUT_r[0x100000];
-    uint32_t LUT_w[0x100000];
+    uint32_t* LUT_r[TLB_LUT_LEAVES];
+    uint32_t* LUT_w[TLB_LUT_LEAVES];
+
+    struct tlb_micro_entry micro_r[TLB_MICRO_SIZE];
+    struct tlb_micro_entry micro_w[TLB_MICRO_SIZE];
+    uint64_t micro_stats[2]; /* lookups that hit / missed the micro TLB */
 };
 
+/* Returns the LUT entry of a virtual page, 0 if it is not mapped */
+static osal_inline uint32_t tlb_lut(uint32_t* const* lut, uint32_t page)
+{
+    const uint32_t* leaf = lut[page >> TLB_LUT_LEAF_BITS];
+    return (leaf != NULL) ? leaf[page & (TLB_LUT_LEAF_SIZE - 1)] : 0;
+}
+
+/* Returns the translation of a virtual address if it is in the micro TLB,
+ * 0 otherwise. w selects the write LUT when 1, the read one otherwise. */
+static osal_inline uint32_t tlb_micro_lookup(struct tlb* tlb, uint32_t address, int w)
+{
+    uint32_t page = address >> 12;
+    const struct tlb_micro_entry* e = (w == 1)
+        ? &tlb->micro_w[page & (TLB_MICRO_SIZE - 1)]
+        : &tlb->micro_r[page & (TLB_MICRO_SIZE - 1)];
+
+    if (e->page != page)
+        return 0;
+
+    ++tlb->micro_stats[0];
+    return e->paddr | (address & UINT32_C(0xFFF));
+}
+
+void tlb_lut_set(uint32_t** lut, uint32_t page, uint32_t value);
+void tlb_lut_reset(uint32_t** lut);
+void tlb_micro_flush(struct tlb* tlb);
+
 void poweron_tlb(struct tlb* tlb);
+void release_tlb(struct tlb* tlb);
 
 void tlb_unmap(struct tlb* tlb, size_t entry);
 void tlb_map(struct tlb* tlb, size_t entry);
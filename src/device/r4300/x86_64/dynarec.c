@@ -949,10 +949,14 @@ void gen_SB(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_LEAF_BITS); // 3
+    mov_reg64_preg64x8preg64(RDI, RBX, RDI); // 4
+    mov_reg32_reg32(EBX, ECX); // 2
+    and_reg32_imm32(EBX, CACHED_INTERP_LEAF_SIZE - 1); // 6
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
@@ -1038,10 +1042,14 @@ void gen_SH(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_LEAF_BITS); // 3
+    mov_reg64_preg64x8preg64(RDI, RBX, RDI); // 4
+    mov_reg32_reg32(EBX, ECX); // 2
+    and_reg32_imm32(EBX, CACHED_INTERP_LEAF_SIZE - 1); // 6
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
@@ -1121,10 +1129,14 @@ void gen_SW(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_LEAF_BITS); // 3
+    mov_reg64_preg64x8preg64(RDI, RBX, RDI); // 4
+    mov_reg32_reg32(EBX, ECX); // 2
+    and_reg32_imm32(EBX, CACHED_INTERP_LEAF_SIZE - 1); // 6
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
@@ -1214,10 +1226,14 @@ void gen_SD(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_LEAF_BITS); // 3
+    mov_reg64_preg64x8preg64(RDI, RBX, RDI); // 4
+    mov_reg32_reg32(EBX, ECX); // 2
+    and_reg32_imm32(EBX, CACHED_INTERP_LEAF_SIZE - 1); // 6
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
@@ -4495,10 +4511,14 @@ void gen_SWC1(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_LEAF_BITS); // 3
+    mov_reg64_preg64x8preg64(RDI, RBX, RDI); // 4
+    mov_reg32_reg32(EBX, ECX); // 2
+    and_reg32_imm32(EBX, CACHED_INTERP_LEAF_SIZE - 1); // 6
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
@@ -4573,10 +4593,14 @@ void gen_SDC1(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_LEAF_BITS); // 3
+    mov_reg64_preg64x8preg64(RDI, RBX, RDI); // 4
+    mov_reg32_reg32(EBX, ECX); // 2
+    and_reg32_imm32(EBX, CACHED_INTERP_LEAF_SIZE - 1); // 6
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
@@ -229,7 +229,7 @@ void protect_framebuffers(struct fb* fb)
         if (fb->once) {
             fb->once = 0;
 #ifndef NEW_DYNAREC
-            fb->r4300->recomp.fast_memory = 0;
+            r4300_set_fast_memory(fb->r4300, 0);
 #endif
 
             /* also need to invalidate cached code to regen non fast memory code path */
@@ -37,6 +37,9 @@
 #include "jimmi/replay_manager.h"
 #include "jimmi/playback_manager.h"
 #include "jimmi/game_manager.h"
+#include "jimmi/keyframe_manager.h"
+#include "jimmi/hash_manager.h"
+#include "jimmi/watch_manager.h"
 
 
 unsigned int vi_clock_from_tv_standard(m64p_system_type tv_standard)
@@ -172,10 +175,15 @@ void write_vi_regs(void* opaque, uint32_t address, uint32_t value, uint32_t mask
 void vi_vertical_interrupt_event(void* opaque)
 {
     struct vi_controller* vi = (struct vi_controller*)opaque;
-    if (vi->dp->do_on_unfreeze & DELAY_DP_INT)
-        vi->dp->do_on_unfreeze |= DELAY_UPDATESCREEN;
-    else
-        gfx.updateScreen();
+
+    /* batch replays and netplay rollbacks don't present frames, unless they are dumped */
+    if ((!main_is_batch_replay() || main_is_av_dumping()) && !netplay_is_resimulating())
+    {
+        if (vi->dp->do_on_unfreeze & DELAY_DP_INT)
+            vi->dp->do_on_unfreeze |= DELAY_UPDATESCREEN;
+        else
+            gfx.updateScreen();
+    }
 
     /* allow main module to do things on VI event */
     new_vi();
@@ -188,29 +196,26 @@ void vi_vertical_interrupt_event(void* opaque)
     
     int current_game_status = game_manager_get_game_status();
     int match_ongoing = current_game_status == REMIX_STATUS_ONGOING;
-    static int last_game_status = 0;
-    int prev_was_wait = last_game_status != REMIX_STATUS_ONGOING;
+    int prev_was_wait = vi->last_game_status != REMIX_STATUS_ONGOING;
     
     int playback_enabled = playback_manager_is_enabled();
     int replays_enabled = replay_manager_is_enabled();
     
-    // If replays enabled, start writing inputs upon match start
-    if (replays_enabled && !playback_enabled && prev_was_wait && match_ongoing)
+    // If replays enabled, record the inputs of every frame while the match is ongoing
+    if (replays_enabled && !playback_enabled && match_ongoing && replay_manager_is_recording()
+        && !netplay_is_resimulating())
     {
-         char* replay_path = replay_manager_get_path();
-         if (replay_path != NULL)
-         {
-             FILE * replay_file = replay_manager_get_file();
-             if (replay_file != NULL)
-             {
-                // Write input for all 4 controller ports
-                replay_manager_write_input(replay_file, 0, old_f, input_manager_get_raw(0));
-                replay_manager_write_input(replay_file, 1, old_f, input_manager_get_raw(1));
-                replay_manager_write_input(replay_file, 2, old_f, input_manager_get_raw(2));
-                replay_manager_write_input(replay_file, 3, old_f, input_manager_get_raw(3));
-                DebugMessage(M64MSG_INFO, "Replay Manager: Captured transition frame %llu", old_f);
-             }
-         }
+        uint32_t raw_inputs[4];
+        for (int i = 0; i < 4; i++)
+        {
+            raw_inputs[i] = input_manager_get_raw(i);
+        }
+        replay_manager_write_frame(raw_inputs);
+
+        if (prev_was_wait)
+        {
+            DebugMessage(M64MSG_INFO, "Replay Manager: Captured transition frame %llu", old_f);
+        }
     }
     
     // Increment frame index and latch input for new frame
@@ -244,8 +249,11 @@ void vi_vertical_interrupt_event(void* opaque)
         input_plugin_poll_all_controllers_for_frame(f_new);
     }
     
-    last_game_status = current_game_status;
+    vi->last_game_status = current_game_status;
 
+    hash_manager_on_vi();
+    watch_manager_on_vi();
+    keyframe_manager_on_vi(f_new);
 
     /* schedule next vertical interrupt */
     uint32_t next_vi = *get_event(&vi->mi->r4300->cp0.q, VI_INT) + vi->delay;
@@ -60,6 +60,9 @@ struct vi_controller
 
     struct mi_controller* mi;
     struct rdp_core* dp;
+
+    /* game status seen on the previous VI */
+    int last_game_status;
 };
 
 static osal_inline uint32_t vi_reg(uint32_t address)
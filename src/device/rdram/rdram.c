@@ -128,7 +128,7 @@ static void map_corrupt_rdram(struct rdram* rdram, int corrupt)
 
     apply_mem_mapping(rdram->r4300->mem, &mapping);
 #ifndef NEW_DYNAREC
-    rdram->r4300->recomp.fast_memory = (corrupt) ? 0 : 1;
+    r4300_set_fast_memory(rdram->r4300, (corrupt) ? 0 : 1);
     invalidate_r4300_cached_code(rdram->r4300, 0, 0);
 #endif
 }
@@ -1,10 +1,12 @@
 #include "frame_manager.h"
 #include "replay_manager.h"
 #include "api/callbacks.h"
+#include "main/instance.h"
 
 
-static uint64_t frame_index = 0;
-static uint64_t last_seen_frame_index;
+/* per-instance state, see main/instance.h */
+#define frame_index (g_instance->frame_manager.frame_index)
+#define last_seen_frame_index (g_instance->frame_manager.last_seen_frame_index)
 
 void frame_manager_init(void)
 {
@@ -31,3 +33,10 @@ uint64_t frame_manager_get_frame_index(void)
 {
     return frame_index;
 }
+
+
+void frame_manager_set_frame_index(uint64_t index)
+{
+    frame_index = index;
+    last_seen_frame_index = index;
+}
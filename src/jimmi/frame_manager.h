@@ -2,9 +2,17 @@
 #ifndef M64P_JIMMI_FRAME_MANAGER_H
 #define M64P_JIMMI_FRAME_MANAGER_H
 
+struct frame_manager
+{
+    uint64_t frame_index;
+    uint64_t last_seen_frame_index;
+};
+
 void frame_manager_init(void);
 void frame_manager_on_vi_interrupt(void);
 
 uint64_t frame_manager_get_frame_index(void);
+// Used when restoring a replay keyframe
+void frame_manager_set_frame_index(uint64_t index);
 
 #endif /* M64P_JIMMI_FRAME_MANAGER_H */
\ No newline at end of file
@@ -4,11 +4,15 @@
 #include "device/rdram/rdram.h"
 #include "main/main.h"
 #include "main/rom.h"
+#include "main/instance.h"
+#include <string.h>
 
 
 const static RemixMeta REMIX_META =  {"Smash Remix", 3236924630, 1440317707};
 
-static int g_GameType = GAME_IS_REMIX;
+/* per-instance state, see main/instance.h */
+#define g_GameType (g_instance->game_manager.game_type)
+#define watches (g_instance->game_manager.watches)
 
 // TODO: Make a more reliable validation method (MD5 probably)
 int game_manager_get_is_remix(uint32_t crc1, uint32_t crc2)
@@ -27,12 +31,10 @@ int game_manager_get_game() {
 }
 
 
-int game_manager_get_game_status()
+static uint32_t game_manager_read_word(uint32_t virtual_addr)
 {
-    struct rdram* rdram = &g_dev.rdram;
-    uint32_t virtual_addr = 0x800A4D19;  // Game status address
+    struct rdram* rdram = &g_instance->dev->rdram;
     uint32_t physical_offset = virtual_addr & 0x3FFFFF;  // Convert to physical RDRAM offset
-    uint32_t status = 0;
 
     // Validate address is within RDRAM bounds
     if (physical_offset >= rdram->dram_size) {
@@ -40,61 +42,90 @@ int game_manager_get_game_status()
         return 0;
     }
 
-    status = rdram->dram[physical_offset >> 2];
+    return rdram->dram[physical_offset >> 2];
+}
 
-    return status;
+int game_manager_get_game_status()
+{
+    return game_manager_read_word(GAME_STATUS_ADDRESS);
 }
 
 int game_manager_get_stage_id()
 {
-    struct rdram* rdram = &g_dev.rdram;
-    uint32_t virtual_addr = 0x800A4D09;  // Stage ID address
-    uint32_t physical_offset = virtual_addr & 0x3FFFFF;  // Convert to physical RDRAM offset
-    int stage_id = 0;
-
-    // Validate address is within RDRAM bounds
-    if (physical_offset >= rdram->dram_size) {
-        DebugMessage(M64MSG_ERROR, "Game Manager: Address 0x%X out of RDRAM bounds", virtual_addr);
-        return 0;
-    }
+    return game_manager_read_word(GAME_STAGE_ID_ADDRESS);
+}
 
-    stage_id = rdram->dram[physical_offset >> 2];
+int game_manager_get_current_screen()
+{
+    return game_manager_read_word(GAME_CURRENT_SCREEN_ADDRESS);
+}
 
-    return stage_id;
+int game_manager_get_last_screen()
+{
+    return game_manager_read_word(GAME_LAST_SCREEN_ADDRESS);
 }
 
-int game_manager_get_current_screen()
+
+int game_manager_watch(uint32_t virtual_addr, game_watch_callback callback, void* opaque)
 {
-    struct rdram* rdram = &g_dev.rdram;
-    uint32_t virtual_addr = 0x800A4AD0;  // Current screen address
-    uint32_t physical_offset = virtual_addr & 0x3FFFFF;  // Convert to physical RDRAM offset
-    int current_screen = 0;
+    struct rdram* rdram = &g_instance->dev->rdram;
+    uint32_t physical_offset = virtual_addr & 0x3FFFFF;
+    unsigned int index = watches.count;
 
-    // Validate address is within RDRAM bounds
-    if (physical_offset >= rdram->dram_size) {
+    if (index == GAME_WATCH_MAX || callback == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Game Manager: Cannot watch address 0x%X", virtual_addr);
+        return -1;
+    }
+
+    if (rdram->dram == NULL || physical_offset >= rdram->dram_size) {
         DebugMessage(M64MSG_ERROR, "Game Manager: Address 0x%X out of RDRAM bounds", virtual_addr);
-        return 0;
+        return -1;
     }
 
-    current_screen = rdram->dram[physical_offset >> 2];
+    /* translated once, RDRAM does not move while the emulation runs */
+    watches.words[index] = &rdram->dram[physical_offset >> 2];
+    watches.values[index] = *watches.words[index];
+    watches.callbacks[index] = callback;
+    watches.opaques[index] = opaque;
+    watches.count++;
 
-    return current_screen;
+    return (int)index;
 }
 
-int game_manager_get_last_screen()
+void game_manager_unwatch_all(void)
 {
-    struct rdram* rdram = &g_dev.rdram;
-    uint32_t virtual_addr = 0x800A4AD1;  // last screen address
-    uint32_t physical_offset = virtual_addr & 0x3FFFFF;  // Convert to physical RDRAM offset
-    int last_screen = 0;
+    memset(&watches, 0, sizeof(watches));
+}
 
-    // Validate address is within RDRAM bounds
-    if (physical_offset >= rdram->dram_size) {
-        DebugMessage(M64MSG_ERROR, "Game Manager: Address 0x%X out of RDRAM bounds", virtual_addr);
-        return 0;
-    }
+void game_manager_poll_watches(void)
+{
+    const unsigned int count = watches.count;
+    uint32_t current[GAME_WATCH_MAX];
+    uint32_t changed = 0;
+    unsigned int i;
 
-    last_screen = rdram->dram[physical_offset >> 2];
+    /* no branch per watch until something changed */
+    for (i = 0; i < count; i++)
+    {
+        current[i] = *watches.words[i];
+        changed |= (uint32_t)(current[i] != watches.values[i]) << i;
+    }
 
-    return last_screen;
+    while (changed != 0)
+    {
+        uint32_t previous;
+
+        i = 0;
+        while (((changed >> i) & 1) == 0)
+        {
+            i++;
+        }
+        changed &= ~(UINT32_C(1) << i);
+
+        /* callbacks run in registration order */
+        previous = watches.values[i];
+        watches.values[i] = current[i];
+        watches.callbacks[i](previous, current[i], watches.opaques[i]);
+    }
 }
@@ -29,6 +29,30 @@ enum
     GAME_IS_VANILLA,
 };
 
+// Words read by the game_manager_get_* functions
+#define GAME_STATUS_ADDRESS 0x800A4D19
+#define GAME_STAGE_ID_ADDRESS 0x800A4D09
+#define GAME_CURRENT_SCREEN_ADDRESS 0x800A4AD0
+#define GAME_LAST_SCREEN_ADDRESS 0x800A4AD1
+
+#define GAME_WATCH_MAX 32
+
+typedef void (*game_watch_callback)(uint32_t previous, uint32_t current, void* opaque);
+
+struct game_manager
+{
+    int game_type;
+
+    /* RDRAM words watched for changes, see game_manager_watch */
+    struct {
+        const uint32_t* words[GAME_WATCH_MAX];
+        uint32_t values[GAME_WATCH_MAX];
+        game_watch_callback callbacks[GAME_WATCH_MAX];
+        void* opaques[GAME_WATCH_MAX];
+        unsigned int count;
+    } watches;
+};
+
 int game_manager_get_is_remix(uint32_t crc1, uint32_t crc2);
 int game_manager_get_game_status();
 int game_manager_get_stage_id();
@@ -36,4 +60,12 @@ int game_manager_get_game();
 int game_manager_get_current_screen();
 int game_manager_get_last_screen();
 
+// Calls callback from game_manager_poll_watches whenever the RDRAM word holding
+// virtual_addr changes, with the same value game_manager_get_* would return.
+// RDRAM must be initialized. Returns the watch index, -1 on failure.
+int game_manager_watch(uint32_t virtual_addr, game_watch_callback callback, void* opaque);
+void game_manager_unwatch_all(void);
+// Called once per VI
+void game_manager_poll_watches(void);
+
 #endif /* M64P_JIMMI_GAME_MANAGER_H */
\ No newline at end of file
@@ -0,0 +1,333 @@
+#define M64P_CORE_PROTOTYPES 1
+#include "hash_manager.h"
+#include "replay_format.h"
+#include "replay_writer.h"
+#include "replay_manager.h"
+#include "playback_manager.h"
+#include "api/callbacks.h"
+#include "api/config.h"
+#include "api/m64p_config.h"
+#include "main/main.h"
+#include "main/instance.h"
+#include "osal/files.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+
+/* per-instance state, see main/instance.h */
+#define recording (g_instance->hash_manager.recording)
+#define hash_interval (g_instance->hash_manager.interval)
+#define last_hashed_frame (g_instance->hash_manager.last_hashed_frame)
+#define hashed_region_count (g_instance->hash_manager.region_count)
+#define hashed_regions (g_instance->hash_manager.regions)
+#define verify (g_instance->hash_manager.verify)
+#define playback (g_instance->hash_manager.playback)
+
+
+static int hash_rdram(const HashRegion* hashed, uint32_t count, uint64_t* hash)
+{
+    const struct rdram* rdram = &g_instance->dev->rdram;
+    XXH3_state_t state;
+    uint32_t i;
+
+    if (count == 0 || count > HASH_MAX_REGIONS)
+    {
+        return 0;
+    }
+
+    XXH3_64bits_reset(&state);
+    for (i = 0; i < count; ++i)
+    {
+        uint32_t offset = hashed[i].offset;
+        uint32_t size = hashed[i].size;
+
+        if (size == 0 || offset > rdram->dram_size || size > rdram->dram_size - offset)
+        {
+            return 0;
+        }
+
+        XXH3_64bits_update(&state, (const uint8_t*)rdram->dram + offset, size);
+    }
+
+    *hash = XXH3_64bits_digest(&state);
+    return 1;
+}
+
+
+/* ReplayHashRegions is a list of hexadecimal RDRAM ranges, "start-end" with
+ * the end excluded, separated by commas. Empty means all of RDRAM. */
+static void parse_hash_regions(const char* list)
+{
+    uint32_t dram_size = (uint32_t)g_instance->dev->rdram.dram_size;
+    const char* p = (list != NULL) ? list : "";
+
+    hashed_region_count = 0;
+    while (*p != '\0')
+    {
+        char* end;
+        unsigned long start;
+        unsigned long stop;
+
+        while (*p == ' ' || *p == ',')
+            ++p;
+        if (*p == '\0')
+            break;
+
+        start = strtoul(p, &end, 16);
+        stop = (end != p && *end == '-') ? strtoul(end + 1, &end, 16) : 0;
+        if (stop <= start || stop > dram_size || hashed_region_count == HASH_MAX_REGIONS)
+        {
+            DebugMessage(M64MSG_WARNING, "Hash Manager: Invalid ReplayHashRegions \"%s\", hashing all of RDRAM", list);
+            hashed_region_count = 0;
+            break;
+        }
+        p = end;
+
+        hashed_regions[hashed_region_count].offset = (uint32_t)start;
+        hashed_regions[hashed_region_count].size = (uint32_t)(stop - start);
+        ++hashed_region_count;
+    }
+
+    if (hashed_region_count == 0)
+    {
+        hashed_regions[0].offset = 0;
+        hashed_regions[0].size = dram_size;
+        hashed_region_count = 1;
+    }
+}
+
+
+void hash_manager_init(void)
+{
+    int frames = ConfigGetParamInt(g_CoreConfig, "ReplayHashInterval");
+
+    hash_interval = (frames > 0) ? (uint32_t)frames : 0;
+    parse_hash_regions(ConfigGetParamString(g_CoreConfig, "ReplayHashRegions"));
+
+    /* not forced in batch mode: the screen is not updated there, so with an
+     * HLE graphics plugin the framebuffers in RDRAM differ from the recording
+     * unless ReplayHashRegions leaves them out */
+    verify = ConfigGetParamBool(g_CoreConfig, "ReplayVerify");
+
+    hash_manager_unload();
+    if (verify && playback_manager_is_enabled() && playback_manager_get_path() != NULL)
+    {
+        hash_manager_load(playback_manager_get_path());
+    }
+}
+
+
+void hash_manager_open(const char* replay_folder)
+{
+    char path[1024];
+    HashFileHeader* header;
+
+    hash_manager_close();
+
+    if (hash_interval == 0)
+    {
+        return;
+    }
+
+    header = malloc(sizeof(*header));
+    if (header == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Hash Manager: Failed to allocate hash header");
+        return;
+    }
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, HASH_MAGIC, 4);
+    header->version = HASH_VERSION;
+    header->interval = hash_interval;
+    header->region_count = hashed_region_count;
+    memcpy(header->regions, hashed_regions, hashed_region_count * sizeof(hashed_regions[0]));
+
+    snprintf(path, sizeof(path), "%s/hashes.bin", replay_folder);
+    last_hashed_frame = 0;
+    recording = replay_writer_open_hashes(path, header, sizeof(*header));
+}
+
+
+void hash_manager_close(void)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    replay_writer_close_hashes();
+    recording = 0;
+}
+
+
+int hash_manager_load(const char* playback_folder)
+{
+    char path[1024];
+
+    hash_manager_unload();
+
+    snprintf(path, sizeof(path), "%s/hashes.bin", playback_folder);
+    playback.data = osal_file_map(path, &playback.size, &playback.handle);
+    if (playback.data == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Hash Manager: No hashes in %s, playback cannot be verified", playback_folder);
+        return 0;
+    }
+
+    if (playback.size >= sizeof(playback.header))
+    {
+        memcpy(&playback.header, playback.data, sizeof(playback.header));
+    }
+
+    if (playback.size < sizeof(playback.header)
+        || memcmp(playback.header.magic, HASH_MAGIC, 4) != 0
+        || playback.header.version != HASH_VERSION
+        || playback.header.interval == 0
+        || playback.header.region_count == 0
+        || playback.header.region_count > HASH_MAX_REGIONS)
+    {
+        DebugMessage(M64MSG_WARNING, "Hash Manager: Ignoring incompatible hash file %s", path);
+        hash_manager_unload();
+        return 0;
+    }
+
+    /* a replay that was not closed properly may end with a partial entry */
+    playback.count = (playback.size - sizeof(playback.header)) / sizeof(HashEntry);
+
+    DebugMessage(M64MSG_INFO, "Hash Manager: Verifying playback against %llu hashes, every %u frames",
+        (unsigned long long)playback.count, playback.header.interval);
+    return 1;
+}
+
+
+void hash_manager_unload(void)
+{
+    if (playback.data != NULL && playback.checked != 0 && playback.divergent_frame == 0)
+    {
+        DebugMessage(M64MSG_INFO, "Hash Manager: Playback matched %u hashes up to replay frame %llu",
+            playback.checked, (unsigned long long)playback.last_matched_frame);
+    }
+
+    osal_file_unmap(playback.data, playback.size, playback.handle);
+    memset(&playback, 0, sizeof(playback));
+}
+
+
+static int hashes_find(uint64_t replay_frame, HashEntry* entry)
+{
+    uint64_t lo = 0;
+    uint64_t hi = playback.count;
+
+    /* hashes are stored in replay order */
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        memcpy(entry, playback.data + sizeof(HashFileHeader) + mid * sizeof(HashEntry), sizeof(*entry));
+
+        if (entry->replay_frame == replay_frame)
+        {
+            return 1;
+        }
+        else if (entry->replay_frame < replay_frame)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return 0;
+}
+
+
+static void hash_manager_record(void)
+{
+    uint64_t frames = replay_manager_get_frame_count();
+    HashEntry* entry;
+
+    if (frames == 0 || frames == last_hashed_frame || (frames % hash_interval) != 0)
+    {
+        return;
+    }
+    last_hashed_frame = frames;
+
+    entry = malloc(sizeof(*entry));
+    if (entry == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Hash Manager: Failed to allocate hash entry");
+        return;
+    }
+
+    entry->replay_frame = frames;
+    if (!hash_rdram(hashed_regions, hashed_region_count, &entry->hash))
+    {
+        free(entry);
+        return;
+    }
+    replay_writer_append_hashes(entry, sizeof(*entry));
+}
+
+
+static void hash_manager_verify(void)
+{
+    uint64_t position = playback_manager_get_position();
+    HashEntry entry;
+    uint64_t hash;
+
+    if (position == 0 || position == playback.last_checked_frame || (position % playback.header.interval) != 0)
+    {
+        return;
+    }
+    playback.last_checked_frame = position;
+
+    if (!hashes_find(position, &entry)
+        || !hash_rdram(playback.header.regions, playback.header.region_count, &hash))
+    {
+        return;
+    }
+
+    playback.checked++;
+    if (hash == entry.hash)
+    {
+        playback.last_matched_frame = position;
+        return;
+    }
+
+    playback.divergent_frame = position;
+    DebugMessage(M64MSG_WARNING, "Hash Manager: Playback diverged at replay frame %llu (last match at frame %llu)",
+        (unsigned long long)position, (unsigned long long)playback.last_matched_frame);
+}
+
+
+void hash_manager_on_vi(void)
+{
+    if (recording && replay_manager_is_recording())
+    {
+        hash_manager_record();
+    }
+
+    /* once diverged, later hashes tell nothing more */
+    if (verify && playback.data != NULL && playback.divergent_frame == 0)
+    {
+        hash_manager_verify();
+    }
+}
+
+
+uint64_t hash_manager_get_divergent_frame(void)
+{
+    return playback.divergent_frame;
+}
+
+
+unsigned int hash_manager_get_checked_count(void)
+{
+    return playback.checked;
+}
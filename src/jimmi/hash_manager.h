@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <stddef.h>
+#ifndef M64P_JIMMI_HASH_MANAGER_H
+#define M64P_JIMMI_HASH_MANAGER_H
+
+#include "replay_format.h"
+
+/* RDRAM hashes stored next to the replay inputs every few frames, so a
+ * playback that drifts from the original match is detected at the first
+ * hash that no longer matches instead of by someone watching it. */
+
+struct hash_manager
+{
+    /* recording */
+    int recording;
+    uint32_t interval;
+    uint64_t last_hashed_frame;
+    uint32_t region_count;
+    HashRegion regions[HASH_MAX_REGIONS];
+
+    /* verification */
+    int verify;
+    struct {
+        const uint8_t* data;
+        size_t size;
+        void* handle;
+
+        HashFileHeader header;
+        uint64_t count;
+
+        uint64_t last_checked_frame;
+        uint64_t last_matched_frame;
+        uint64_t divergent_frame;
+        unsigned int checked;
+    } playback;
+};
+
+void hash_manager_init(void);
+
+// Recording: hashes.bin is created in the replay folder
+void hash_manager_open(const char* replay_folder);
+void hash_manager_close(void);
+
+// Verification: map hashes.bin from the playback folder
+int hash_manager_load(const char* playback_folder);
+void hash_manager_unload(void);
+
+// Called on every VI, once the inputs of the new frame are set
+void hash_manager_on_vi(void);
+
+// First replay frame whose hash did not match, 0 while the playback is in sync
+uint64_t hash_manager_get_divergent_frame(void);
+unsigned int hash_manager_get_checked_count(void);
+
+#endif /* M64P_JIMMI_HASH_MANAGER_H */
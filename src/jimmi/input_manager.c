@@ -1,12 +1,14 @@
 #include "input_manager.h"
 #include "api/callbacks.h"
+#include "main/instance.h"
 #include <string.h>
 
-static JimmiControllerState ports[4];
-static uint32_t raw_ports[4];
-static uint8_t has_ports[4];
-static uint8_t from_playback[4];
-static uint64_t latched_frame_index = 0;
+/* per-instance state, see main/instance.h */
+#define ports (g_instance->input_manager.ports)
+#define raw_ports (g_instance->input_manager.raw_ports)
+#define has_ports (g_instance->input_manager.has_ports)
+#define from_playback (g_instance->input_manager.from_playback)
+#define latched_frame_index (g_instance->input_manager.latched_frame_index)
 
 
 void input_manager_init(void)
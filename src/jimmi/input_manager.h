@@ -8,6 +8,15 @@ typedef struct {
     int8_t  stick_y;
 } JimmiControllerState;
 
+struct input_manager
+{
+    JimmiControllerState ports[4];
+    uint32_t raw_ports[4];
+    uint8_t has_ports[4];
+    uint8_t from_playback[4];
+    uint64_t latched_frame_index;
+};
+
 
 void input_manager_init(void);
 void input_manager_latch_for_frame(uint64_t frame_index);
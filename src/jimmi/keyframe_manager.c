@@ -0,0 +1,423 @@
+#define M64P_CORE_PROTOTYPES 1
+#include "keyframe_manager.h"
+#include "replay_format.h"
+#include "replay_writer.h"
+#include "replay_manager.h"
+#include "playback_manager.h"
+#include "frame_manager.h"
+#include "input_manager.h"
+#include "api/callbacks.h"
+#include "api/config.h"
+#include "api/m64p_config.h"
+#include "main/main.h"
+#include "main/rom.h"
+#include "main/savestates.h"
+#include "device/rcp/vi/vi_controller.h"
+#include "osal/files.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main/instance.h"
+#include <zlib.h>
+
+
+/* per-instance state, see main/instance.h */
+#define job (g_instance->keyframe_manager.job)
+#define recording (g_instance->keyframe_manager.recording)
+#define capture_interval (g_instance->keyframe_manager.interval)
+#define capture_replay_frame (g_instance->keyframe_manager.capture_replay_frame)
+#define capture_frame_index (g_instance->keyframe_manager.capture_frame_index)
+#define playback (g_instance->keyframe_manager.playback)
+
+
+void keyframe_manager_init(void)
+{
+    int seconds = ConfigGetParamInt(g_CoreConfig, "ReplayKeyframeInterval");
+
+    job = KEYFRAME_JOB_NONE;
+    capture_interval = (seconds > 0)
+        ? (uint32_t)seconds * vi_expected_refresh_rate_from_tv_standard(ROM_PARAMS.systemtype)
+        : 0;
+
+    keyframe_manager_unload();
+    if (playback_manager_is_enabled() && playback_manager_get_path() != NULL)
+    {
+        keyframe_manager_load(playback_manager_get_path());
+    }
+}
+
+
+void keyframe_manager_open(const char* replay_folder)
+{
+    char path[1024];
+    KeyframeFileHeader* header;
+
+    keyframe_manager_close();
+
+    if (capture_interval == 0)
+    {
+        return;
+    }
+
+    header = malloc(sizeof(*header));
+    if (header == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Keyframe Manager: Failed to allocate keyframe header");
+        return;
+    }
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, KEYFRAME_MAGIC, 4);
+    header->version = KEYFRAME_VERSION;
+    header->interval = capture_interval;
+    header->state_size = (uint32_t)savestates_get_memory_size();
+
+    snprintf(path, sizeof(path), "%s/keyframes.bin", replay_folder);
+    capture_replay_frame = 0;
+    recording = replay_writer_open_keyframes(path, header, sizeof(*header));
+}
+
+
+void keyframe_manager_close(void)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    if (job == KEYFRAME_JOB_CAPTURE)
+    {
+        job = KEYFRAME_JOB_NONE;
+    }
+    replay_writer_close_keyframes();
+    recording = 0;
+}
+
+
+static int keyframes_index_walk(void)
+{
+    size_t offset = sizeof(KeyframeFileHeader);
+    uint32_t capacity = 64;
+
+    playback.index = malloc(capacity * sizeof(KeyframeIndexEntry));
+    if (playback.index == NULL)
+    {
+        return 0;
+    }
+
+    while (offset + sizeof(KeyframeHeader) <= playback.size)
+    {
+        KeyframeHeader keyframe;
+        memcpy(&keyframe, playback.data + offset, sizeof(keyframe));
+
+        if (keyframe.state_size != playback.header.state_size
+            || keyframe.compressed_size > playback.size - offset - sizeof(keyframe))
+        {
+            break;
+        }
+
+        if (playback.count == capacity)
+        {
+            KeyframeIndexEntry* grown = realloc(playback.index, 2 * capacity * sizeof(KeyframeIndexEntry));
+            if (grown == NULL)
+            {
+                return 0;
+            }
+            playback.index = grown;
+            capacity *= 2;
+        }
+
+        playback.index[playback.count].replay_frame = keyframe.replay_frame;
+        playback.index[playback.count].offset = offset;
+        playback.count++;
+
+        offset += sizeof(keyframe) + keyframe.compressed_size;
+    }
+
+    return 1;
+}
+
+
+static int keyframes_index_read(void)
+{
+    KeyframeFileTrailer trailer;
+
+    if (playback.size < sizeof(KeyframeFileHeader) + sizeof(trailer))
+    {
+        return 0;
+    }
+
+    memcpy(&trailer, playback.data + playback.size - sizeof(trailer), sizeof(trailer));
+    if (memcmp(trailer.magic, KEYFRAME_INDEX_MAGIC, 4) != 0
+        || trailer.index_offset > playback.size - sizeof(trailer)
+        || trailer.count > (playback.size - sizeof(trailer) - trailer.index_offset) / sizeof(KeyframeIndexEntry))
+    {
+        return 0;
+    }
+
+    playback.index = malloc((trailer.count + 1) * sizeof(KeyframeIndexEntry));
+    if (playback.index == NULL)
+    {
+        return 0;
+    }
+    memcpy(playback.index, playback.data + trailer.index_offset, trailer.count * sizeof(KeyframeIndexEntry));
+    playback.count = trailer.count;
+
+    return 1;
+}
+
+
+int keyframe_manager_load(const char* playback_folder)
+{
+    char path[1024];
+
+    keyframe_manager_unload();
+
+    snprintf(path, sizeof(path), "%s/state.st", playback_folder);
+    playback.state_path = strdup(path);
+
+    snprintf(path, sizeof(path), "%s/keyframes.bin", playback_folder);
+    playback.data = osal_file_map(path, &playback.size, &playback.handle);
+    if (playback.data == NULL)
+    {
+        /* older replays: seeking replays from state.st */
+        return 0;
+    }
+
+    if (playback.size >= sizeof(playback.header))
+    {
+        memcpy(&playback.header, playback.data, sizeof(playback.header));
+    }
+
+    if (playback.size < sizeof(playback.header)
+        || memcmp(playback.header.magic, KEYFRAME_MAGIC, 4) != 0
+        || playback.header.version != KEYFRAME_VERSION
+        || playback.header.state_size != savestates_get_memory_size())
+    {
+        DebugMessage(M64MSG_WARNING, "Keyframe Manager: Ignoring incompatible keyframe file %s", path);
+        osal_file_unmap(playback.data, playback.size, playback.handle);
+        playback.data = NULL;
+        playback.size = 0;
+        playback.handle = NULL;
+        return 0;
+    }
+
+    if (!keyframes_index_read())
+    {
+        /* the recording was not closed properly */
+        free(playback.index);
+        playback.index = NULL;
+        playback.count = 0;
+        if (!keyframes_index_walk())
+        {
+            DebugMessage(M64MSG_ERROR, "Keyframe Manager: Failed to index %s", path);
+            keyframe_manager_unload();
+            return 0;
+        }
+    }
+
+    DebugMessage(M64MSG_INFO, "Keyframe Manager: Indexed %u keyframes, every %u frames",
+        playback.count, playback.header.interval);
+    return 1;
+}
+
+
+void keyframe_manager_unload(void)
+{
+    if (job == KEYFRAME_JOB_RESTORE)
+    {
+        job = KEYFRAME_JOB_NONE;
+    }
+    if (playback.seeking)
+    {
+        main_core_state_set(M64CORE_SPEED_LIMITER, playback.speed_limiter);
+    }
+
+    osal_file_unmap(playback.data, playback.size, playback.handle);
+    free(playback.index);
+    free(playback.state);
+    free(playback.state_path);
+    memset(&playback, 0, sizeof(playback));
+}
+
+
+int keyframe_manager_seek(uint64_t replay_frame)
+{
+    if (!playback_manager_is_enabled() || replay_frame > playback_manager_get_frame_count())
+    {
+        return 0;
+    }
+
+    playback.target = replay_frame;
+    job = KEYFRAME_JOB_RESTORE;
+    return 1;
+}
+
+
+void keyframe_manager_on_vi(uint64_t frame_index)
+{
+    if (recording && capture_interval != 0 && replay_manager_is_recording())
+    {
+        uint64_t frames = replay_manager_get_frame_count();
+        if (frames != 0 && frames != capture_replay_frame && (frames % capture_interval) == 0)
+        {
+            capture_replay_frame = frames;
+            capture_frame_index = frame_index;
+            job = KEYFRAME_JOB_CAPTURE;
+        }
+    }
+
+    if (playback.seeking && playback_manager_get_position() >= playback.target)
+    {
+        playback.seeking = 0;
+        main_core_state_set(M64CORE_SPEED_LIMITER, playback.speed_limiter);
+        DebugMessage(M64MSG_INFO, "Keyframe Manager: Reached replay frame %llu",
+            (unsigned long long)playback.target);
+    }
+}
+
+
+int keyframe_manager_get_job(void)
+{
+    return job;
+}
+
+
+void keyframe_manager_capture(void)
+{
+    size_t state_size = savestates_get_memory_size();
+    KeyframeHeader header;
+    uint8_t* data;
+
+    job = KEYFRAME_JOB_NONE;
+
+    /* the capture was delayed past the frame it was scheduled for */
+    if (frame_manager_get_frame_index() != capture_frame_index)
+    {
+        DebugMessage(M64MSG_WARNING, "Keyframe Manager: Skipped keyframe at replay frame %llu",
+            (unsigned long long)capture_replay_frame);
+        return;
+    }
+
+    data = malloc(sizeof(header) + state_size);
+    if (data == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Keyframe Manager: Failed to allocate keyframe");
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.replay_frame = capture_replay_frame;
+    header.frame_index = capture_frame_index;
+    memcpy(data, &header, sizeof(header));
+
+    savestates_save_memory(data + sizeof(header), state_size);
+    replay_writer_append_keyframe(data, sizeof(header) + state_size);
+}
+
+
+static const KeyframeIndexEntry* keyframes_find(uint64_t replay_frame)
+{
+    const KeyframeIndexEntry* found = NULL;
+    uint32_t lo = 0;
+    uint32_t hi = playback.count;
+
+    /* keyframes are stored in replay order */
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (playback.index[mid].replay_frame <= replay_frame)
+        {
+            found = &playback.index[mid];
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return found;
+}
+
+
+static int keyframes_restore(const KeyframeIndexEntry* entry, uint64_t* replay_frame)
+{
+    KeyframeHeader header;
+    uLongf size;
+
+    if (entry->offset + sizeof(header) > playback.size)
+    {
+        return 0;
+    }
+    memcpy(&header, playback.data + entry->offset, sizeof(header));
+    if (header.compressed_size > playback.size - entry->offset - sizeof(header) || header.replay_frame == 0)
+    {
+        return 0;
+    }
+
+    if (playback.state == NULL)
+    {
+        playback.state_size = playback.header.state_size;
+        playback.state = malloc(playback.state_size);
+        if (playback.state == NULL)
+        {
+            return 0;
+        }
+    }
+
+    size = (uLongf)playback.state_size;
+    if (uncompress(playback.state, &size, playback.data + entry->offset + sizeof(header), header.compressed_size) != Z_OK
+        || size != playback.state_size
+        || !savestates_load_memory(playback.state, playback.state_size))
+    {
+        return 0;
+    }
+
+    /* the keyframe was taken once the inputs of its next frame were latched,
+     * which in playback are the ones of its last replay frame */
+    frame_manager_set_frame_index(header.frame_index);
+    input_manager_latch_for_frame(header.frame_index);
+    playback_manager_seek(header.replay_frame - 1);
+    playback_manager_read_frame(header.frame_index);
+
+    *replay_frame = header.replay_frame;
+    return 1;
+}
+
+
+void keyframe_manager_restore(void)
+{
+    const KeyframeIndexEntry* entry = keyframes_find(playback.target);
+    uint64_t replay_frame = 0;
+
+    job = KEYFRAME_JOB_NONE;
+
+    if (entry == NULL || !keyframes_restore(entry, &replay_frame))
+    {
+        if (entry != NULL)
+        {
+            DebugMessage(M64MSG_WARNING, "Keyframe Manager: Corrupted keyframe at replay frame %llu",
+                (unsigned long long)entry->replay_frame);
+        }
+        if (playback.state_path == NULL)
+        {
+            return;
+        }
+
+        /* no usable keyframe, replay from the initial state like a fresh playback */
+        frame_manager_set_frame_index(1);
+        playback_manager_seek(0);
+        savestates_set_job(savestates_job_load, savestates_type_m64p, playback.state_path);
+    }
+
+    DebugMessage(M64MSG_INFO, "Keyframe Manager: Restored replay frame %llu, fast forwarding to %llu",
+        (unsigned long long)replay_frame, (unsigned long long)playback.target);
+
+    if (replay_frame < playback.target && !playback.seeking)
+    {
+        main_core_state_query(M64CORE_SPEED_LIMITER, &playback.speed_limiter);
+        main_core_state_set(M64CORE_SPEED_LIMITER, 0);
+        playback.seeking = 1;
+    }
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#ifndef M64P_JIMMI_KEYFRAME_MANAGER_H
+#define M64P_JIMMI_KEYFRAME_MANAGER_H
+
+#include "replay_format.h"
+
+/* Periodic savestate keyframes stored next to the replay inputs, so playback
+ * can jump anywhere in a match by restoring the closest keyframe and fast
+ * forwarding the few remaining frames. */
+
+enum {
+    KEYFRAME_JOB_NONE,
+    KEYFRAME_JOB_CAPTURE,
+    KEYFRAME_JOB_RESTORE,
+};
+
+struct keyframe_manager
+{
+    int job;
+
+    /* recording */
+    int recording;
+    uint32_t interval;
+    uint64_t capture_replay_frame;
+    uint64_t capture_frame_index;
+
+    /* playback */
+    struct {
+        const uint8_t* data;
+        size_t size;
+        void* handle;
+
+        KeyframeFileHeader header;
+        KeyframeIndexEntry* index;
+        uint32_t count;
+
+        /* decompressed state, reused across seeks */
+        uint8_t* state;
+        size_t state_size;
+
+        char* state_path;
+        uint64_t target;
+        int seeking;
+        int speed_limiter;
+    } playback;
+};
+
+void keyframe_manager_init(void);
+
+// Recording: keyframes.bin is created in the replay folder
+void keyframe_manager_open(const char* replay_folder);
+void keyframe_manager_close(void);
+
+// Playback: index keyframes.bin from the playback folder
+int keyframe_manager_load(const char* playback_folder);
+void keyframe_manager_unload(void);
+
+// Restore the closest keyframe at or before a replay frame, then fast forward to it
+int keyframe_manager_seek(uint64_t replay_frame);
+
+// Called on every VI, once the frame index and inputs of the new frame are set
+void keyframe_manager_on_vi(uint64_t frame_index);
+
+// Deferred work, run by gen_interrupt when it is safe to touch the whole device
+int keyframe_manager_get_job(void);
+void keyframe_manager_capture(void);
+void keyframe_manager_restore(void);
+
+#endif /* M64P_JIMMI_KEYFRAME_MANAGER_H */
@@ -1,27 +1,300 @@
 #include "playback_manager.h"
+#include "replay_format.h"
+#include "input_manager.h"
 #include "api/callbacks.h"
 #include "main/main.h"
 #include "api/config.h"
+#include <stdlib.h>
 #include <string.h>
+#include "osal/files.h"
+#include "main/instance.h"
 
+/* Legacy record format: controller_index (4) | frame_index (8) | raw_input (4) = 16 bytes */
+#define LEGACY_RECORD_SIZE 16
 
-static int playback_enabled;
-static char* playback_path = NULL;
-static FILE* playback_file = NULL;
+/* per-instance state, see main/instance.h */
+#define playback_enabled (g_instance->playback_manager.enabled)
+#define playback_path (g_instance->playback_manager.path)
+#define playback (g_instance->playback_manager.playback)
+#define last_inputs (g_instance->playback_manager.last_inputs)
+
+
+static int playback_index_v2(void)
+{
+    size_t offset = sizeof(ReplayFileHeader);
+    uint64_t capacity = 16;
+
+    playback.block_offsets = malloc(capacity * sizeof(size_t));
+    if (playback.block_offsets == NULL)
+    {
+        return 0;
+    }
+
+    while (offset + sizeof(ReplayBlockHeader) <= playback.size)
+    {
+        ReplayBlockHeader block;
+        memcpy(&block, playback.data + offset, sizeof(block));
+
+        if (block.first_frame != playback.block_count * REPLAY_BLOCK_FRAMES
+            || block.frame_count == 0 || block.frame_count > REPLAY_BLOCK_FRAMES
+            || block.payload_size > playback.size - offset - sizeof(block))
+        {
+            DebugMessage(M64MSG_WARNING, "Playback Manager: Corrupted block %llu, replay truncated to %llu frames",
+                (unsigned long long)playback.block_count, (unsigned long long)playback.frame_count);
+            break;
+        }
+
+        if (playback.block_count == capacity)
+        {
+            size_t* grown = realloc(playback.block_offsets, 2 * capacity * sizeof(size_t));
+            if (grown == NULL)
+            {
+                return 0;
+            }
+            playback.block_offsets = grown;
+            capacity *= 2;
+        }
+
+        playback.block_offsets[playback.block_count++] = offset;
+        playback.frame_count += block.frame_count;
+        offset += sizeof(block) + block.payload_size;
+
+        /* only the last block may be partial */
+        if (block.frame_count != REPLAY_BLOCK_FRAMES)
+        {
+            break;
+        }
+    }
+
+    return 1;
+}
+
+static int playback_index_legacy(void)
+{
+    size_t record_count = playback.size / LEGACY_RECORD_SIZE;
+    uint64_t last_frame_index = 0;
+
+    /* at most one frame per record, plus the end sentinel */
+    playback.frame_offsets = malloc((record_count + 1) * sizeof(size_t));
+    if (playback.frame_offsets == NULL)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < record_count; i++)
+    {
+        uint64_t frame_index;
+        memcpy(&frame_index, playback.data + i * LEGACY_RECORD_SIZE + 4, sizeof(frame_index));
+
+        if (i == 0 || frame_index != last_frame_index)
+        {
+            playback.frame_offsets[playback.frame_count++] = i * LEGACY_RECORD_SIZE;
+            last_frame_index = frame_index;
+        }
+
+        /* ports recorded in the first frame are expected in every frame */
+        if (playback.frame_count == 1)
+        {
+            int32_t controller_index;
+            memcpy(&controller_index, playback.data + i * LEGACY_RECORD_SIZE, sizeof(controller_index));
+            if (controller_index >= 0 && controller_index < REPLAY_PORTS)
+            {
+                playback.header.port_mask |= (uint8_t)(1u << controller_index);
+            }
+        }
+    }
+    playback.frame_offsets[playback.frame_count] = record_count * LEGACY_RECORD_SIZE;
+
+    return 1;
+}
+
+static int playback_map(const char* path)
+{
+    memset(&playback, 0, sizeof(playback));
+
+    playback.data = osal_file_map(path, &playback.size, &playback.handle);
+    if (playback.data == NULL)
+    {
+        return 0;
+    }
+
+    if (playback.size >= sizeof(ReplayFileHeader))
+    {
+        memcpy(&playback.header, playback.data, sizeof(ReplayFileHeader));
+    }
+
+    if (playback.size >= sizeof(ReplayFileHeader) && replay_header_is_valid(&playback.header))
+    {
+        playback.version = REPLAY_VERSION;
+        if (!playback_index_v2())
+        {
+            return 0;
+        }
+        DebugMessage(M64MSG_INFO, "Playback Manager: v%u replay, ports 0x%x, recorded from frame %llu",
+            playback.header.version, playback.header.port_mask,
+            (unsigned long long)playback.header.start_frame);
+    }
+    else
+    {
+        playback.version = 1;
+        if (!playback_index_legacy())
+        {
+            return 0;
+        }
+    }
+
+    DebugMessage(M64MSG_INFO, "Playback Manager: Indexed %llu frames", (unsigned long long)playback.frame_count);
+    return 1;
+}
+
+static int cursor_decode_run(PlaybackCursor* cursor)
+{
+    const uint8_t* src = cursor->pos;
+    size_t avail = (size_t)(cursor->end - cursor->pos);
+    uint8_t mask;
+    size_t n = 1;
+    size_t used;
+
+    if (avail == 0)
+    {
+        return 0;
+    }
+
+    mask = src[0];
+    for (int i = 0; i < REPLAY_PORTS; i++)
+    {
+        if (mask & (1u << i))
+        {
+            if (n + sizeof(uint32_t) > avail)
+            {
+                return 0;
+            }
+            memcpy(&cursor->inputs[i], src + n, sizeof(uint32_t));
+            n += sizeof(uint32_t);
+        }
+    }
+
+    used = replay_get_varint(src + n, avail - n, &cursor->run_left);
+    if (used == 0 || cursor->run_left == 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Playback Manager: Corrupted run in replay block %llu", (unsigned long long)cursor->block);
+        return 0;
+    }
+
+    cursor->pos += n + used;
+    return 1;
+}
+
+static int cursor_seek(PlaybackCursor* cursor, uint64_t frame)
+{
+    if (frame > playback.frame_count)
+    {
+        return 0;
+    }
+
+    cursor->frame = frame;
+    if (playback.version != REPLAY_VERSION || frame == playback.frame_count)
+    {
+        return 1;
+    }
+
+    /* position at the start of the block, whose first run holds all ports */
+    uint64_t block = frame / REPLAY_BLOCK_FRAMES;
+    uint64_t skip = frame - block * REPLAY_BLOCK_FRAMES;
+    ReplayBlockHeader header;
+    memcpy(&header, playback.data + playback.block_offsets[block], sizeof(header));
+
+    cursor->block = block;
+    cursor->pos = playback.data + playback.block_offsets[block] + sizeof(header);
+    cursor->end = cursor->pos + header.payload_size;
+    cursor->run_left = 0;
+
+    /* skip whole runs until the one covering the requested frame */
+    for (;;)
+    {
+        if (!cursor_decode_run(cursor))
+        {
+            return 0;
+        }
+        if (skip < cursor->run_left)
+        {
+            cursor->run_left -= (uint32_t)skip;
+            return 1;
+        }
+        skip -= cursor->run_left;
+        cursor->run_left = 0;
+    }
+}
+
+/* Fetches the inputs of cursor->frame and moves to the next frame.
+ * Returns the mask of ports present in that frame, 0 at end of replay. */
+static unsigned int cursor_next(PlaybackCursor* cursor, uint32_t inputs[REPLAY_PORTS])
+{
+    unsigned int mask = 0;
+
+    if (cursor->frame >= playback.frame_count)
+    {
+        return 0;
+    }
+
+    if (playback.version == REPLAY_VERSION)
+    {
+        if (cursor->run_left == 0)
+        {
+            if (cursor->pos == cursor->end && !cursor_seek(cursor, cursor->frame))
+            {
+                return 0;
+            }
+            else if (cursor->run_left == 0 && !cursor_decode_run(cursor))
+            {
+                return 0;
+            }
+        }
+        cursor->run_left--;
+        memcpy(inputs, cursor->inputs, sizeof(cursor->inputs));
+        mask = playback.header.port_mask;
+    }
+    else
+    {
+        size_t offset = playback.frame_offsets[cursor->frame];
+        size_t end = playback.frame_offsets[cursor->frame + 1];
+
+        for (; offset < end; offset += LEGACY_RECORD_SIZE)
+        {
+            int32_t controller_index;
+            uint32_t raw_input;
+            memcpy(&controller_index, playback.data + offset, sizeof(controller_index));
+            memcpy(&raw_input, playback.data + offset + 12, sizeof(raw_input));
+
+            if (controller_index < 0 || controller_index >= REPLAY_PORTS)
+            {
+                DebugMessage(M64MSG_WARNING, "Playback Manager: Invalid controller_index %d in playback file", controller_index);
+                continue;
+            }
+            inputs[controller_index] = raw_input;
+            mask |= 1u << controller_index;
+        }
+    }
+
+    cursor->frame++;
+    return mask;
+}
 
 
 void playback_manager_init(void)
 {
     char playback_path_buffer[512] = {0};
-    
+
     playback_enabled = ConfigGetParamBool(g_CoreConfig, "Playback");
-    
+
     if (playback_path != NULL)
     {
         free(playback_path);
         playback_path = NULL;
     }
-    
+
+    playback_manager_close();
+
     if (playback_enabled)
     {
         if (ConfigGetParameter(g_CoreConfig, "PlaybackPath", M64TYPE_STRING, playback_path_buffer, sizeof(playback_path_buffer)) == M64ERR_SUCCESS)
@@ -32,8 +305,7 @@ void playback_manager_init(void)
                 playback_path = strdup(playback_path_buffer);
             }
         }
-        playback_file = playback_manager_open();
-        if (playback_file != NULL)
+        if (playback_manager_open())
         {
             DebugMessage(M64MSG_INFO, "Playback Manager: Reading inputs from %s", playback_path);
         }
@@ -41,115 +313,160 @@ void playback_manager_init(void)
 }
 
 
-FILE* playback_manager_open(void)
+int playback_manager_open(void)
 {
     if (!playback_enabled || playback_path == NULL)
     {
-        return NULL;
+        return 0;
     }
 
     char full_playback_path[1024];
     snprintf(full_playback_path, sizeof(full_playback_path), "%s/inputs.bin", playback_path);
-    FILE *file = fopen(full_playback_path, "rb");
-    if (file == NULL)
+    if (!playback_map(full_playback_path))
     {
         DebugMessage(M64MSG_ERROR, "Playback Manager: Failed to open playback file at path %s", playback_path);
+        playback_manager_close();
+        return 0;
     }
-    return file;
+    return 1;
 }
 
 
 void playback_manager_close(void)
 {
-    if (playback_file != NULL)
-    {
-        fclose(playback_file);
-        playback_file = NULL;
-    }
+    osal_file_unmap(playback.data, playback.size, playback.handle);
+    free(playback.block_offsets);
+    free(playback.frame_offsets);
+    memset(&playback, 0, sizeof(playback));
 }
 
 
-int playback_manager_read_input(PlaybackInputRecord* out_record)
+int playback_manager_is_enabled(void)
 {
-    if (playback_file == NULL || out_record == NULL)
-    {
-        return 0;
-    }
-    
-    // Read record format: controller_index (4) | frame_index (8) | raw_input (4) = 16 bytes
-    if (fread(&out_record->controller_index, sizeof(uint32_t), 1, playback_file) != 1)
-    {
-        // EOF or read error
-        return 0;
-    }
-    
-    if (fread(&out_record->frame_index, sizeof(uint64_t), 1, playback_file) != 1)
+    return playback_enabled;
+}
+
+
+char* playback_manager_get_path(void)
+{
+    return playback_path;
+}
+
+
+int playback_manager_set_path(const char* path)
+{
+    playback_manager_close();
+    free(playback_path);
+    playback_path = NULL;
+    playback_enabled = 0;
+
+    if (path == NULL)
     {
-        DebugMessage(M64MSG_ERROR, "Playback Manager: Failed to read frame_index");
-        return 0;
+        return 1;
     }
-    
-    if (fread(&out_record->raw_input, sizeof(uint32_t), 1, playback_file) != 1)
+
+    playback_path = strdup(path);
+    if (playback_path == NULL)
     {
-        DebugMessage(M64MSG_ERROR, "Playback Manager: Failed to read raw_input");
+        DebugMessage(M64MSG_ERROR, "Playback Manager: Failed to set playback path");
         return 0;
     }
-    
-    // Validate controller_index
-    if (out_record->controller_index < 0 || out_record->controller_index >= 4)
+    playback_enabled = 1;
+
+    if (!playback_manager_open())
     {
-        DebugMessage(M64MSG_WARNING, "Playback Manager: Invalid controller_index %d in playback file", out_record->controller_index);
         return 0;
     }
-    
+    DebugMessage(M64MSG_INFO, "Playback Manager: Reading inputs from %s", playback_path);
     return 1;
 }
 
 
-int playback_manager_is_enabled(void)
+uint64_t playback_manager_get_frame_count(void)
 {
-    return playback_enabled;
+    return playback.frame_count;
 }
 
 
-char* playback_manager_get_path(void)
+uint64_t playback_manager_get_position(void)
 {
-    return playback_path;
+    return playback.cursor.frame;
 }
 
 
-FILE* playback_manager_get_file(void)
+int playback_manager_seek(uint64_t frame)
 {
-    return playback_file;
+    if (playback.data == NULL)
+        return 0;
+
+    return cursor_seek(&playback.cursor, frame);
 }
 
-int playback_manager_read_frame(uint64_t f)
+
+int playback_manager_peek(uint64_t frame, int port, uint32_t* raw_input)
 {
-    if (!playback_enabled || playback_file == NULL)
+    PlaybackCursor cursor;
+    uint32_t inputs[REPLAY_PORTS] = {0};
+
+    if (playback.data == NULL || port < 0 || port >= REPLAY_PORTS)
         return 0;
 
-    PlaybackInputRecord record;
+    memset(&cursor, 0, sizeof(cursor));
+    if (!cursor_seek(&cursor, frame) || !(cursor_next(&cursor, inputs) & (1u << port)))
+        return 0;
+
+    *raw_input = inputs[port] & REPLAY_INPUT_MASK;
+    return 1;
+}
+
+
+int playback_manager_read_frame(uint64_t f)
+{
+    uint32_t inputs[REPLAY_PORTS];
+    unsigned int mask;
     int record_count = 0;
-    
-    while (record_count < 4)
+
+    if (!playback_enabled || playback.data == NULL)
+        return 0;
+
+    if (playback.cursor.frame == 0)
+        memset(last_inputs, 0, sizeof(last_inputs));
+
+    uint64_t replay_frame = playback.cursor.frame;
+    mask = cursor_next(&playback.cursor, inputs);
+    if (mask == 0)
+        return 0;
+
+    /* legacy replays may lack records for some ports: keep their last input
+     * rather than consuming the records of the next frame */
+    if (mask != playback.header.port_mask)
+    {
+        DebugMessage(M64MSG_WARNING, "Playback Manager: Replay frame %llu lacks inputs for ports 0x%x, repeating previous ones",
+            (unsigned long long)replay_frame, playback.header.port_mask & ~mask);
+    }
+
+    for (int i = 0; i < REPLAY_PORTS; i++)
     {
-        long pos = ftell(playback_file);
-        if (!playback_manager_read_input(&record))
+        if (mask & (1u << i))
         {
-            // EOF or Error
-            break;
+            last_inputs[i] = inputs[i];
+        }
+    }
+
+    // Filter out Start button (0x0010) to allow pausing without affecting playback
+    for (int i = 0; i < REPLAY_PORTS; i++)
+    {
+        if (playback.header.port_mask & (1u << i))
+        {
+            input_manager_record_raw(i, f, last_inputs[i] & REPLAY_INPUT_MASK, 1);
+            record_count++;
         }
-        
-        // Filter out Start button (0x0010) to allow pausing without affecting playback
-        uint32_t filtered_input = record.raw_input & ~0x0010u;
-        input_manager_record_raw(record.controller_index, f, filtered_input, 1);
-        record_count++;
     }
-    
+
     if ((f % 60) == 0 && record_count > 0)
     {
         DebugMessage(M64MSG_INFO, "Playback Manager: Replayed frame %llu with %d port inputs", f, record_count);
     }
-    
+
     return record_count;
 }
@@ -3,21 +3,62 @@
 #ifndef M64P_JIMMI_PLAYBACK_MANAGER_H
 #define M64P_JIMMI_PLAYBACK_MANAGER_H
 
+#include "replay_format.h"
+
 typedef struct {
-    int controller_index;
-    uint64_t frame_index;
-    uint32_t raw_input;
-} PlaybackInputRecord;
+    uint64_t frame;
+    /* v2: position inside the current block */
+    uint64_t block;
+    const uint8_t* pos;
+    const uint8_t* end;
+    uint32_t run_left;
+    uint32_t inputs[REPLAY_PORTS];
+} PlaybackCursor;
+
+struct playback_manager
+{
+    int enabled;
+    char* path;
+
+    struct {
+        const uint8_t* data;
+        size_t size;
+        void* handle;
+
+        /* inputs.bin format, 1 for the legacy 16-byte records */
+        int version;
+        ReplayFileHeader header;
+        uint64_t frame_count;
+
+        /* v2: offset of each block header, block i holds frames [i * REPLAY_BLOCK_FRAMES, ...) */
+        size_t* block_offsets;
+        uint64_t block_count;
+
+        /* legacy: offset of the first record of each frame, frame_count + 1 entries */
+        size_t* frame_offsets;
+
+        PlaybackCursor cursor;
+    } playback;
+
+    /* inputs of the last frame read, kept for ports a legacy frame lacks */
+    uint32_t last_inputs[REPLAY_PORTS];
+};
 
 void playback_manager_init(void);
 int playback_manager_is_enabled(void);
 char* playback_manager_get_path(void);
-FILE* playback_manager_get_file(void);
-FILE* playback_manager_open(void);
+// Play the replay folder at path regardless of the config, NULL stops playback
+int playback_manager_set_path(const char* path);
+int playback_manager_open(void);
 
+// Feed the inputs of the next replay frame to the input manager, as emulator frame f
 int playback_manager_read_frame(uint64_t f);
 
-int playback_manager_read_input(PlaybackInputRecord* out_record);
+// Random access, replay frames are counted from the first recorded frame
+uint64_t playback_manager_get_frame_count(void);
+uint64_t playback_manager_get_position(void);
+int playback_manager_seek(uint64_t frame);
+int playback_manager_peek(uint64_t frame, int port, uint32_t* raw_input);
 
 void playback_manager_close(void);
 
@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifndef M64P_JIMMI_REPLAY_FORMAT_H
+#define M64P_JIMMI_REPLAY_FORMAT_H
+
+/* inputs.bin v2 layout
+ *
+ *   ReplayFileHeader
+ *   ReplayBlockHeader + payload
+ *   ReplayBlockHeader + payload
+ *   ...
+ *
+ * Each block payload is a sequence of runs:
+ *   changed_mask (1 byte) | raw_input (4 bytes) per bit set in changed_mask | run_length (LEB128)
+ *
+ * The first run of every block carries all ports of the header port_mask,
+ * so a block can be decoded without looking at the previous one.
+ * Legacy files (no magic) are a flat list of 16-byte records:
+ *   controller_index (4) | frame_index (8) | raw_input (4)
+ */
+
+#define REPLAY_MAGIC "JRPL"
+#define REPLAY_VERSION 2
+#define REPLAY_PORTS 4
+
+/* Frames per encoded block */
+#define REPLAY_BLOCK_FRAMES 1024
+/* Worst case payload of a block: every frame changes every port */
+#define REPLAY_BLOCK_MAX_PAYLOAD (REPLAY_BLOCK_FRAMES * (1 + 4 * REPLAY_PORTS + 5))
+
+/* Start button is never recorded nor replayed, so players can pause freely */
+#define REPLAY_INPUT_MASK (~0x0010u)
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t crc1;
+    uint32_t crc2;
+    char md5[32];
+    uint8_t port_mask;
+    uint8_t reserved[7];
+    uint64_t start_frame;
+} ReplayFileHeader;
+
+typedef struct {
+    uint64_t first_frame;
+    uint32_t frame_count;
+    uint32_t payload_size;
+} ReplayBlockHeader;
+
+/* keyframes.bin layout
+ *
+ *   KeyframeFileHeader
+ *   KeyframeHeader + zlib compressed m64p savestate
+ *   KeyframeHeader + zlib compressed m64p savestate
+ *   ...
+ *   KeyframeIndexEntry * count
+ *   KeyframeFileTrailer
+ *
+ * A keyframe at replay_frame n is the machine state right after the n-th
+ * recorded frame. Index and trailer are written when the replay is closed;
+ * without them the keyframes are found by walking the records.
+ */
+
+#define KEYFRAME_MAGIC "JKFR"
+#define KEYFRAME_INDEX_MAGIC "JKIX"
+#define KEYFRAME_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t interval;      /* frames between keyframes */
+    uint32_t state_size;    /* uncompressed savestate size */
+} KeyframeFileHeader;
+
+typedef struct {
+    uint64_t replay_frame;
+    uint64_t frame_index;   /* emulator frame index, see frame_manager */
+    uint32_t compressed_size;
+    uint32_t state_size;
+} KeyframeHeader;
+
+typedef struct {
+    uint64_t replay_frame;
+    uint64_t offset;        /* of the KeyframeHeader */
+} KeyframeIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint32_t count;
+    char magic[4];
+} KeyframeFileTrailer;
+
+/* hashes.bin layout
+ *
+ *   HashFileHeader
+ *   HashEntry
+ *   HashEntry
+ *   ...
+ *
+ * A hash at replay_frame n is the XXH3 hash of the RDRAM regions given in the
+ * header, hashed one after the other, taken at the VI where the n-th recorded
+ * frame ends, the same point keyframes are taken at. Playback checks it at the
+ * VI where n replay frames have been fed. RDRAM words are hashed in host byte
+ * order.
+ */
+
+#define HASH_MAGIC "JRHS"
+#define HASH_VERSION 2
+#define HASH_MAX_REGIONS 8
+
+typedef struct {
+    uint32_t offset;        /* in bytes */
+    uint32_t size;
+} HashRegion;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t interval;      /* frames between hashes */
+    uint32_t region_count;
+    HashRegion regions[HASH_MAX_REGIONS];
+} HashFileHeader;
+
+typedef struct {
+    uint64_t replay_frame;
+    uint64_t hash;
+} HashEntry;
+
+/* watch.bin layout
+ *
+ *   WatchFileHeader
+ *   WatchColumn * column_count
+ *   WatchBlockHeader + column data
+ *   WatchBlockHeader + column data
+ *   ...
+ *
+ * The row of replay_frame n holds the RAM watch probes sampled at the VI
+ * where the n-th recorded frame ends, the same point hashes are taken at.
+ * A block covers consecutive frames starting at first_frame and stores its
+ * rows column after column: frame_count values of the first column, then of
+ * the second, and so on, each value in the column width and little endian.
+ * Probes that point outside RDRAM read as 0.
+ */
+
+#define WATCH_MAGIC "JWCH"
+#define WATCH_VERSION 1
+
+/* Rows per block */
+#define WATCH_BLOCK_FRAMES 1024
+/* Pointers followed by a probe before its value is read */
+#define WATCH_MAX_DEPTH 3
+
+enum {
+    WATCH_U8,
+    WATCH_S8,
+    WATCH_U16,
+    WATCH_S16,
+    WATCH_U32,
+    WATCH_S32,
+    WATCH_F32,
+};
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t column_count;
+    uint32_t block_frames;
+} WatchFileHeader;
+
+typedef struct {
+    char name[24];
+    uint32_t address;       /* N64 virtual address */
+    uint8_t type;           /* WATCH_* */
+    uint8_t width;          /* in bytes */
+    uint8_t depth;          /* pointers followed, see WatchProbe */
+    uint8_t reserved;
+    uint16_t offsets[WATCH_MAX_DEPTH];
+    uint16_t reserved2;
+} WatchColumn;
+
+typedef struct {
+    uint64_t first_frame;
+    uint32_t frame_count;
+    uint32_t reserved;
+} WatchBlockHeader;
+
+static inline unsigned int watch_type_width(uint8_t type)
+{
+    switch (type)
+    {
+    case WATCH_U8:
+    case WATCH_S8:
+        return 1;
+    case WATCH_U16:
+    case WATCH_S16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+static inline int replay_header_is_valid(const ReplayFileHeader* header)
+{
+    return memcmp(header->magic, REPLAY_MAGIC, 4) == 0
+        && header->version == REPLAY_VERSION;
+}
+
+static inline size_t replay_put_varint(uint8_t* dst, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        dst[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    dst[n++] = (uint8_t)value;
+    return n;
+}
+
+/* Returns number of bytes consumed, or 0 if the varint runs past end */
+static inline size_t replay_get_varint(const uint8_t* src, size_t size, uint32_t* value)
+{
+    uint32_t result = 0;
+    size_t n = 0;
+    unsigned int shift = 0;
+
+    while (n < size && shift < 32)
+    {
+        uint8_t byte = src[n++];
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return n;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+#endif /* M64P_JIMMI_REPLAY_FORMAT_H */
@@ -1,28 +1,97 @@
 #include "replay_manager.h"
+#include "replay_format.h"
+#include "replay_writer.h"
+#include "keyframe_manager.h"
+#include "hash_manager.h"
+#include "watch_manager.h"
+#include "frame_manager.h"
 #include "game_manager.h"
 #include "api/callbacks.h"
 #include "main/main.h"
+#include "main/rom.h"
 #include "api/config.h"
+#include "osal/files.h"
+#include "osal/preproc.h"
+#include "plugin/plugin.h"
+#include "main/instance.h"
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
-#include "osal/files.h"
+#include <stdlib.h>
+
 
+/* per-instance state, see main/instance.h */
+#define replays_enabled (g_instance->replay_manager.enabled)
+#define replay_path (g_instance->replay_manager.path)
+#define recording (g_instance->replay_manager.recording)
+#define encoder (g_instance->replay_manager.encoder)
+
+
+static void encoder_emit_run(void)
+{
+    uint8_t* dst = encoder.payload + encoder.payload_size;
+    size_t n = 0;
+
+    dst[n++] = encoder.run_mask;
+    for (int i = 0; i < REPLAY_PORTS; i++)
+    {
+        if (encoder.run_mask & (1u << i))
+        {
+            memcpy(dst + n, &encoder.run_inputs[i], sizeof(uint32_t));
+            n += sizeof(uint32_t);
+        }
+    }
+    n += replay_put_varint(dst + n, encoder.run_length);
+
+    encoder.payload_size += n;
+    encoder.run_length = 0;
+}
+
+static int encoder_flush_block(void)
+{
+    ReplayBlockHeader block;
+    uint8_t* data;
+
+    if (encoder.block_frames == 0)
+    {
+        return 1;
+    }
+
+    if (encoder.run_length > 0)
+    {
+        encoder_emit_run();
+    }
 
-static int replays_enabled;
-static char* replay_path = NULL;
-static FILE * replay_file = NULL;
+    block.first_frame = encoder.block_first_frame;
+    block.frame_count = encoder.block_frames;
+    block.payload_size = (uint32_t)encoder.payload_size;
+
+    encoder.payload_size = 0;
+    encoder.block_frames = 0;
+
+    data = malloc(sizeof(block) + block.payload_size);
+    if (data == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to allocate replay block");
+        return 0;
+    }
+    memcpy(data, &block, sizeof(block));
+    memcpy(data + sizeof(block), encoder.payload, block.payload_size);
+
+    return replay_writer_append_inputs(data, sizeof(block) + block.payload_size);
+}
 
 void replay_manager_init(void)
 {
-    replays_enabled = ConfigGetParamBool(g_CoreConfig, "Replays");
-    
+    /* the replay writer thread serves the default instance only */
+    replays_enabled = core_instance_is_default() && ConfigGetParamBool(g_CoreConfig, "Replays");
+
     if (replay_path != NULL)
     {
         free(replay_path);
         replay_path = NULL;
     }
-    
+
     if (replays_enabled)
     {
         char replay_path_buffer[512] = {0};
@@ -39,69 +108,141 @@ void replay_manager_init(void)
 void replay_manager_open(char* folder)
 {
     char input_path[1024];
-    snprintf(input_path, sizeof(input_path), "%s/inputs.bin", replay_manager_generate_path(folder));
+    ReplayFileHeader* header;
+
+    replay_manager_close();
 
-    FILE *file = fopen(input_path, "wb");
-    if (file == NULL)
+    char* replay_folder = replay_manager_generate_path(folder);
+    if (replay_folder == NULL)
     {
-        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to open replay file at path %s", input_path);
+        return;
     }
-    replay_file = file;
+    snprintf(input_path, sizeof(input_path), "%s/inputs.bin", replay_folder);
+    keyframe_manager_open(replay_folder);
+    hash_manager_open(replay_folder);
+    watch_manager_open(replay_folder);
+    free(replay_folder);
+
+    header = malloc(sizeof(*header));
+    if (header == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to allocate replay header");
+        return;
+    }
+
+    memset(&encoder, 0, sizeof(encoder));
+    for (int i = 0; i < REPLAY_PORTS; i++)
+    {
+        if (Controls[i].Present)
+        {
+            encoder.port_mask |= (uint8_t)(1u << i);
+        }
+    }
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, REPLAY_MAGIC, 4);
+    header->version = REPLAY_VERSION;
+    header->crc1 = tohl(ROM_HEADER.CRC1);
+    header->crc2 = tohl(ROM_HEADER.CRC2);
+    memcpy(header->md5, ROM_SETTINGS.MD5, sizeof(header->md5));
+    header->port_mask = encoder.port_mask;
+    header->start_frame = frame_manager_get_frame_index();
+
+    recording = replay_writer_open_inputs(input_path, header, sizeof(*header));
 }
 
 
-int replay_manager_write_input(FILE * file, int controller_index, uint64_t frame_index, uint32_t raw_input)
+int replay_manager_write_frame(const uint32_t raw_inputs[4])
 {
-    if (file == NULL)
+    uint32_t inputs[REPLAY_PORTS];
+    uint8_t changed = 0;
+
+    if (!recording)
     {
         return 0;
     }
-    
-    // Validate controller_index
-    if (controller_index < 0 || controller_index >= 4)
+
+    for (int i = 0; i < REPLAY_PORTS; i++)
     {
-        DebugMessage(M64MSG_WARNING, "Replay Manager: Invalid controller_index %d", controller_index);
-        return 0;
+        inputs[i] = (encoder.port_mask & (1u << i)) ? (raw_inputs[i] & REPLAY_INPUT_MASK) : 0;
+        if (inputs[i] != encoder.run_inputs[i])
+        {
+            changed |= (uint8_t)(1u << i);
+        }
     }
-    
-    // Filter out Start button (0x0010) to allow pausing without affecting replay
-    uint32_t filtered_input = raw_input & ~0x0010u;
-    
-    // Write frame data in format: controller_index | frame_index | raw_input
-    if (fwrite(&controller_index, sizeof(int), 1, file) != 1)
+
+    if (encoder.block_frames == 0)
     {
-        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to write controller_index");
-        return 0;
+        /* blocks always start with a full set of inputs */
+        encoder.block_first_frame = encoder.frames_written;
+        encoder.run_mask = encoder.port_mask;
+        encoder.run_length = 1;
+        memcpy(encoder.run_inputs, inputs, sizeof(inputs));
     }
-    
-    if (fwrite(&frame_index, sizeof(uint64_t), 1, file) != 1)
+    else if (changed == 0)
     {
-        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to write frame_index");
-        return 0;
+        encoder.run_length++;
     }
-    
-    if (fwrite(&filtered_input, sizeof(uint32_t), 1, file) != 1)
+    else
     {
-        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to write raw_input");
-        return 0;
+        encoder_emit_run();
+        encoder.run_mask = changed;
+        encoder.run_length = 1;
+        memcpy(encoder.run_inputs, inputs, sizeof(inputs));
     }
-    
-    static uint64_t last_flush_frame = 0;
-    if (frame_index - last_flush_frame >= 60)
+
+    encoder.block_frames++;
+    encoder.frames_written++;
+
+    if (encoder.block_frames == REPLAY_BLOCK_FRAMES)
     {
-        fflush(file);
-        last_flush_frame = frame_index;
+        return encoder_flush_block();
     }
-    
+
     return 1;
 }
 
 
+void replay_manager_close(void)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    encoder_flush_block();
+    replay_writer_close_inputs();
+    keyframe_manager_close();
+    hash_manager_close();
+    watch_manager_close();
+    recording = 0;
+
+    DebugMessage(M64MSG_INFO, "Replay Manager: Closed replay with %llu frames",
+        (unsigned long long)encoder.frames_written);
+}
+
+
+uint64_t replay_manager_get_frame_count(void)
+{
+    return encoder.frames_written;
+}
+
+
 int replay_manager_is_enabled(void)
 {
     return replays_enabled;
 }
 
+void replay_manager_set_enabled(int enabled)
+{
+    replays_enabled = enabled;
+}
+
+int replay_manager_is_recording(void)
+{
+    return recording;
+}
+
 char* replay_manager_get_path(void)
 {
     return replay_path;
@@ -114,7 +255,7 @@ int replay_manager_set_path(char* path)
         free(replay_path);
         replay_path = NULL;
     }
-    
+
     if (path != NULL)
     {
         replay_path = strdup(path);
@@ -124,24 +265,32 @@ int replay_manager_set_path(char* path)
             return 0;
         }
     }
-    
+
     return 1;
 }
 
+// The directory itself is created asynchronously by the replay writer
 char* replay_manager_generate_path(char* folder)
 {
     char replay_folder[1024];
     snprintf(replay_folder, sizeof(replay_folder), "%s%s", replay_path, folder);
-    int dir_result = osal_mkdirp(replay_folder, 0755);
-    if (dir_result != 0)
+    if (!replay_writer_make_folder(replay_folder))
     {
-        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to create replay directory at path %s", replay_folder);
+        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to queue replay directory creation at path %s", replay_folder);
         return NULL;
     }
     return strdup(replay_folder);
 }
 
-FILE* replay_manager_get_file(void)
+// Creates the directory before returning, for files written by the emulation thread
+char* replay_manager_create_path(char* folder)
 {
-    return replay_file;
+    char replay_folder[1024];
+    snprintf(replay_folder, sizeof(replay_folder), "%s%s", replay_path, folder);
+    if (osal_mkdirp(replay_folder, 0755) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Replay Manager: Failed to create replay directory at path %s", replay_folder);
+        return NULL;
+    }
+    return strdup(replay_folder);
 }
@@ -3,17 +3,45 @@
 #ifndef M64P_JIMMI_REPLAY_MANAGER_H
 #define M64P_JIMMI_REPLAY_MANAGER_H
 
+#include "replay_format.h"
+
+struct replay_manager
+{
+    int enabled;
+    char* path;
+    int recording;
+
+    struct {
+        uint8_t port_mask;
+        uint64_t frames_written;
+
+        /* block being built */
+        uint8_t payload[REPLAY_BLOCK_MAX_PAYLOAD];
+        size_t payload_size;
+        uint64_t block_first_frame;
+        uint32_t block_frames;
+
+        /* run being built */
+        uint32_t run_inputs[REPLAY_PORTS];
+        uint32_t run_length;
+        uint8_t run_mask;
+    } encoder;
+};
+
 
 void replay_manager_init(void);
 int replay_manager_is_enabled(void);
+void replay_manager_set_enabled(int enabled);
+int replay_manager_is_recording(void);
 char* replay_manager_get_path(void);
 char* replay_manager_generate_path(char* folder);
+char* replay_manager_create_path(char* folder);
 int replay_manager_set_path(char* path);
-FILE* replay_manager_get_file(void);
 void replay_manager_open(char* folder);
-int replay_manager_write_input(FILE * file, int controller_index, uint64_t frame_index, uint32_t raw_input);
+void replay_manager_close(void);
 
-// Write all 4 controller records for a frame in order
-int replay_manager_write_frame(FILE * file, uint64_t frame_index, const uint32_t raw_inputs[4]);
+// Append the inputs of all 4 controller ports for the next recorded frame
+int replay_manager_write_frame(const uint32_t raw_inputs[4]);
+uint64_t replay_manager_get_frame_count(void);
 
 #endif /* M64P_JIMMI_REPLAY_MANAGER_H */
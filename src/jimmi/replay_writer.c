@@ -0,0 +1,458 @@
+#include "replay_writer.h"
+#include "api/callbacks.h"
+#include "main/list.h"
+#include "main/workqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "osal/files.h"
+#include "replay_format.h"
+
+enum {
+    REPLAY_JOB_FLUSH,
+    REPLAY_JOB_FOLDER,
+    REPLAY_JOB_MARKER,
+    REPLAY_JOB_OPEN_INPUTS,
+    REPLAY_JOB_APPEND_INPUTS,
+    REPLAY_JOB_CLOSE_INPUTS,
+    REPLAY_JOB_OPEN_KEYFRAMES,
+    REPLAY_JOB_KEYFRAME,
+    REPLAY_JOB_CLOSE_KEYFRAMES,
+    REPLAY_JOB_OPEN_HASHES,
+    REPLAY_JOB_APPEND_HASHES,
+    REPLAY_JOB_CLOSE_HASHES,
+    REPLAY_JOB_OPEN_WATCH,
+    REPLAY_JOB_APPEND_WATCH,
+    REPLAY_JOB_CLOSE_WATCH,
+};
+
+typedef struct {
+    int type;
+    char* path;
+    void* data;
+    size_t size;
+} ReplayWriteJob;
+
+struct replay_work {
+    struct work_struct work;
+    ReplayWriteJob job;
+};
+
+/* Files are only touched by replay class work, which runs one job at a time */
+static FILE* inputs_file = NULL;
+static FILE* hashes_file = NULL;
+static FILE* watch_file = NULL;
+
+static struct {
+    FILE* file;
+    uint64_t offset;
+    KeyframeIndexEntry* index;
+    uint32_t count;
+    uint32_t capacity;
+    uint8_t* zbuf;
+    size_t zbuf_size;
+} keyframes;
+
+
+static void keyframes_close(void)
+{
+    KeyframeFileTrailer trailer;
+
+    if (keyframes.file == NULL)
+    {
+        return;
+    }
+
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.index_offset = keyframes.offset;
+    trailer.count = keyframes.count;
+    memcpy(trailer.magic, KEYFRAME_INDEX_MAGIC, 4);
+
+    if (fwrite(keyframes.index, sizeof(KeyframeIndexEntry), keyframes.count, keyframes.file) != keyframes.count
+        || fwrite(&trailer, sizeof(trailer), 1, keyframes.file) != 1)
+    {
+        DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write keyframe index");
+    }
+
+    fclose(keyframes.file);
+    keyframes.file = NULL;
+    keyframes.count = 0;
+}
+
+static void keyframes_append(const uint8_t* data, size_t size)
+{
+    KeyframeHeader header;
+    uLongf zsize;
+
+    if (keyframes.file == NULL || size < sizeof(header))
+    {
+        return;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    size -= sizeof(header);
+
+    if (keyframes.zbuf_size < compressBound(size))
+    {
+        free(keyframes.zbuf);
+        keyframes.zbuf_size = compressBound(size);
+        keyframes.zbuf = malloc(keyframes.zbuf_size);
+        if (keyframes.zbuf == NULL)
+        {
+            keyframes.zbuf_size = 0;
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to allocate keyframe compression buffer");
+            return;
+        }
+    }
+
+    if (keyframes.count == keyframes.capacity)
+    {
+        uint32_t capacity = (keyframes.capacity == 0) ? 64 : 2 * keyframes.capacity;
+        KeyframeIndexEntry* grown = realloc(keyframes.index, capacity * sizeof(*grown));
+        if (grown == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to grow keyframe index");
+            return;
+        }
+        keyframes.index = grown;
+        keyframes.capacity = capacity;
+    }
+
+    zsize = (uLongf)keyframes.zbuf_size;
+    if (compress2(keyframes.zbuf, &zsize, data, (uLong)size, Z_BEST_SPEED) != Z_OK)
+    {
+        DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to compress keyframe %llu",
+            (unsigned long long)header.replay_frame);
+        return;
+    }
+
+    header.compressed_size = (uint32_t)zsize;
+    header.state_size = (uint32_t)size;
+
+    if (fwrite(&header, sizeof(header), 1, keyframes.file) != 1
+        || fwrite(keyframes.zbuf, 1, zsize, keyframes.file) != zsize)
+    {
+        DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write keyframe %llu",
+            (unsigned long long)header.replay_frame);
+        return;
+    }
+
+    keyframes.index[keyframes.count].replay_frame = header.replay_frame;
+    keyframes.index[keyframes.count].offset = keyframes.offset;
+    keyframes.count++;
+    keyframes.offset += sizeof(header) + zsize;
+}
+
+static void replay_writer_execute(ReplayWriteJob* job)
+{
+    switch (job->type)
+    {
+    case REPLAY_JOB_FOLDER:
+        if (osal_mkdirp(job->path, 0755) != 0)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to create replay directory at path %s", job->path);
+        }
+        break;
+
+    case REPLAY_JOB_MARKER:
+    {
+        FILE* fp = fopen(job->path, "w");
+        if (fp == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to create %s", job->path);
+            break;
+        }
+        fclose(fp);
+        break;
+    }
+
+    case REPLAY_JOB_OPEN_INPUTS:
+        if (inputs_file != NULL)
+        {
+            fclose(inputs_file);
+        }
+        inputs_file = fopen(job->path, "wb");
+        if (inputs_file == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to open replay file at path %s", job->path);
+        }
+        else if (fwrite(job->data, 1, job->size, inputs_file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write replay header to %s", job->path);
+        }
+        break;
+
+    case REPLAY_JOB_APPEND_INPUTS:
+        if (inputs_file != NULL && fwrite(job->data, 1, job->size, inputs_file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write replay data");
+        }
+        break;
+
+    case REPLAY_JOB_CLOSE_INPUTS:
+        if (inputs_file != NULL)
+        {
+            fclose(inputs_file);
+            inputs_file = NULL;
+        }
+        break;
+
+    case REPLAY_JOB_OPEN_KEYFRAMES:
+        keyframes_close();
+        keyframes.file = fopen(job->path, "wb");
+        keyframes.offset = 0;
+        if (keyframes.file == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to open keyframe file at path %s", job->path);
+        }
+        else if (fwrite(job->data, 1, job->size, keyframes.file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write keyframe header to %s", job->path);
+        }
+        else
+        {
+            keyframes.offset = job->size;
+        }
+        break;
+
+    case REPLAY_JOB_KEYFRAME:
+        keyframes_append((const uint8_t*)job->data, job->size);
+        break;
+
+    case REPLAY_JOB_CLOSE_KEYFRAMES:
+        keyframes_close();
+        break;
+
+    case REPLAY_JOB_OPEN_HASHES:
+        if (hashes_file != NULL)
+        {
+            fclose(hashes_file);
+        }
+        hashes_file = fopen(job->path, "wb");
+        if (hashes_file == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to open hash file at path %s", job->path);
+        }
+        else if (fwrite(job->data, 1, job->size, hashes_file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write hash header to %s", job->path);
+        }
+        break;
+
+    case REPLAY_JOB_APPEND_HASHES:
+        if (hashes_file != NULL && fwrite(job->data, 1, job->size, hashes_file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write replay hashes");
+        }
+        break;
+
+    case REPLAY_JOB_CLOSE_HASHES:
+        if (hashes_file != NULL)
+        {
+            fclose(hashes_file);
+            hashes_file = NULL;
+        }
+        break;
+
+    case REPLAY_JOB_OPEN_WATCH:
+        if (watch_file != NULL)
+        {
+            fclose(watch_file);
+        }
+        watch_file = fopen(job->path, "wb");
+        if (watch_file == NULL)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to open watch file at path %s", job->path);
+        }
+        else if (fwrite(job->data, 1, job->size, watch_file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write watch header to %s", job->path);
+        }
+        break;
+
+    case REPLAY_JOB_APPEND_WATCH:
+        if (watch_file != NULL && fwrite(job->data, 1, job->size, watch_file) != job->size)
+        {
+            DebugMessage(M64MSG_ERROR, "Replay Writer: Failed to write watch block");
+        }
+        break;
+
+    case REPLAY_JOB_CLOSE_WATCH:
+        if (watch_file != NULL)
+        {
+            fclose(watch_file);
+            watch_file = NULL;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    free(job->path);
+    free(job->data);
+}
+
+static void replay_writer_work(struct work_struct* work)
+{
+    struct replay_work* replay = container_of(work, struct replay_work, work);
+
+    replay_writer_execute(&replay->job);
+    free(replay);
+}
+
+static int replay_writer_queue(ReplayWriteJob* job, struct work_completion* completion)
+{
+    struct replay_work* replay = malloc(sizeof(*replay));
+
+    if (replay == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Replay Writer: Out of memory, dropping job %d", job->type);
+        free(job->path);
+        free(job->data);
+        return 0;
+    }
+
+    replay->job = *job;
+    init_work(&replay->work, replay_writer_work, WORK_CLASS_REPLAY);
+    replay->work.completion = completion;
+
+    queue_work(&replay->work);
+    return 1;
+}
+
+static int replay_writer_submit(ReplayWriteJob* job)
+{
+    return replay_writer_queue(job, NULL);
+}
+
+static int replay_writer_submit_simple(int type, const char* path, void* data, size_t size)
+{
+    ReplayWriteJob job;
+
+    memset(&job, 0, sizeof(job));
+    job.type = type;
+    job.path = (path != NULL) ? strdup(path) : NULL;
+    job.data = data;
+    job.size = size;
+
+    return replay_writer_submit(&job);
+}
+
+
+int replay_writer_init(void)
+{
+    /* replay I/O runs on the core workqueue */
+    return 0;
+}
+
+void replay_writer_shutdown(void)
+{
+    struct work_completion flushed;
+    ReplayWriteJob job;
+
+    /* replay jobs run in submission order, so all pending ones are done
+     * once this one is */
+    memset(&job, 0, sizeof(job));
+    job.type = REPLAY_JOB_FLUSH;
+    init_completion(&flushed);
+    if (replay_writer_queue(&job, &flushed))
+    {
+        wait_for_completion(&flushed);
+    }
+
+    if (inputs_file != NULL)
+    {
+        fclose(inputs_file);
+        inputs_file = NULL;
+    }
+
+    if (hashes_file != NULL)
+    {
+        fclose(hashes_file);
+        hashes_file = NULL;
+    }
+
+    if (watch_file != NULL)
+    {
+        fclose(watch_file);
+        watch_file = NULL;
+    }
+
+    keyframes_close();
+    free(keyframes.index);
+    free(keyframes.zbuf);
+    memset(&keyframes, 0, sizeof(keyframes));
+}
+
+int replay_writer_make_folder(const char* path)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_FOLDER, path, NULL, 0);
+}
+
+int replay_writer_create_marker(const char* path)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_MARKER, path, NULL, 0);
+}
+
+int replay_writer_open_inputs(const char* path, void* header, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_OPEN_INPUTS, path, header, size);
+}
+
+int replay_writer_append_inputs(void* data, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_APPEND_INPUTS, NULL, data, size);
+}
+
+int replay_writer_close_inputs(void)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_CLOSE_INPUTS, NULL, NULL, 0);
+}
+
+int replay_writer_open_keyframes(const char* path, void* header, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_OPEN_KEYFRAMES, path, header, size);
+}
+
+int replay_writer_append_keyframe(void* data, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_KEYFRAME, NULL, data, size);
+}
+
+int replay_writer_close_keyframes(void)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_CLOSE_KEYFRAMES, NULL, NULL, 0);
+}
+
+int replay_writer_open_hashes(const char* path, void* header, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_OPEN_HASHES, path, header, size);
+}
+
+int replay_writer_append_hashes(void* data, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_APPEND_HASHES, NULL, data, size);
+}
+
+int replay_writer_close_hashes(void)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_CLOSE_HASHES, NULL, NULL, 0);
+}
+
+int replay_writer_open_watch(const char* path, void* header, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_OPEN_WATCH, path, header, size);
+}
+
+int replay_writer_append_watch(void* data, size_t size)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_APPEND_WATCH, NULL, data, size);
+}
+
+int replay_writer_close_watch(void)
+{
+    return replay_writer_submit_simple(REPLAY_JOB_CLOSE_WATCH, NULL, NULL, 0);
+}
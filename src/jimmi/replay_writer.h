@@ -0,0 +1,35 @@
+#include <stdint.h>
+#include <stddef.h>
+#ifndef M64P_JIMMI_REPLAY_WRITER_H
+#define M64P_JIMMI_REPLAY_WRITER_H
+
+/* All replay disk I/O runs on the core workqueue, in the replay class whose
+ * jobs are executed one at a time in submission order, so a folder queued
+ * for creation exists before any file queued after it is written.
+ * Functions taking a buffer take ownership of it (it must have been
+ * malloc'd). */
+
+int replay_writer_init(void);
+void replay_writer_shutdown(void);
+
+int replay_writer_make_folder(const char* path);
+int replay_writer_create_marker(const char* path);
+int replay_writer_open_inputs(const char* path, void* header, size_t size);
+int replay_writer_append_inputs(void* data, size_t size);
+int replay_writer_close_inputs(void);
+
+/* Keyframes are a KeyframeHeader followed by an uncompressed savestate,
+ * compressed by the writer thread before being appended to keyframes.bin */
+int replay_writer_open_keyframes(const char* path, void* header, size_t size);
+int replay_writer_append_keyframe(void* data, size_t size);
+int replay_writer_close_keyframes(void);
+
+int replay_writer_open_hashes(const char* path, void* header, size_t size);
+int replay_writer_append_hashes(void* data, size_t size);
+int replay_writer_close_hashes(void);
+
+int replay_writer_open_watch(const char* path, void* header, size_t size);
+int replay_writer_append_watch(void* data, size_t size);
+int replay_writer_close_watch(void);
+
+#endif /* M64P_JIMMI_REPLAY_WRITER_H */
@@ -0,0 +1,326 @@
+#define M64P_CORE_PROTOTYPES 1
+#include "watch_manager.h"
+#include "replay_format.h"
+#include "replay_writer.h"
+#include "replay_manager.h"
+#include "playback_manager.h"
+#include "api/callbacks.h"
+#include "api/config.h"
+#include "api/m64p_config.h"
+#include "device/device.h"
+#include "device/rdram/rdram.h"
+#include "main/main.h"
+#include "main/instance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Match state of Smash Remix and vanilla SSB64 (NTSC-U) */
+#define SSB_MATCH_INFO 0x800A4D08
+#define SSB_PLAYER(n) (SSB_MATCH_INFO + 0x20 + (n) * 0x74)
+
+/* fighter GObj -> DObj (+0x74) -> translation (+0x1C) */
+#define WATCH_PLAYER(n, prefix) \
+    { prefix "_character", SSB_PLAYER(n) + 0x03, WATCH_U8, 0, { 0 } }, \
+    { prefix "_stocks", SSB_PLAYER(n) + 0x0A, WATCH_S8, 0, { 0 } }, \
+    { prefix "_percent", SSB_PLAYER(n) + 0x4C, WATCH_S32, 0, { 0 } }, \
+    { prefix "_x", SSB_PLAYER(n) + 0x58, WATCH_F32, 2, { 0x74, 0x1C } }, \
+    { prefix "_y", SSB_PLAYER(n) + 0x58, WATCH_F32, 2, { 0x74, 0x20 } }
+
+static const WatchProbe WATCH_TABLE[] = {
+    { "status", SSB_MATCH_INFO + 0x11, WATCH_U8, 0, { 0 } },
+    { "stage", SSB_MATCH_INFO + 0x01, WATCH_U8, 0, { 0 } },
+    { "time_passed", SSB_MATCH_INFO + 0x18, WATCH_U32, 0, { 0 } },
+    WATCH_PLAYER(0, "p1"),
+    WATCH_PLAYER(1, "p2"),
+    WATCH_PLAYER(2, "p3"),
+    WATCH_PLAYER(3, "p4"),
+};
+
+#define WATCH_COUNT (sizeof(WATCH_TABLE) / sizeof(WATCH_TABLE[0]))
+
+
+/* per-instance state, see main/instance.h */
+#define recording (g_instance->watch_manager.recording)
+#define backfill (g_instance->watch_manager.backfill)
+#define last_frame (g_instance->watch_manager.last_frame)
+#define columns (g_instance->watch_manager.columns)
+#define block_first_frame (g_instance->watch_manager.block_first_frame)
+#define block_count (g_instance->watch_manager.block_count)
+
+
+static size_t watch_row_size(void)
+{
+    size_t size = 0;
+    unsigned int i;
+
+    for (i = 0; i < WATCH_COUNT; i++)
+    {
+        size += watch_type_width(WATCH_TABLE[i].type);
+    }
+    return size;
+}
+
+
+/* Reads width bytes at a virtual address, 0 when it is not in RDRAM */
+static int watch_read(const struct rdram* rdram, uint32_t address, unsigned int width, uint32_t* value)
+{
+    uint32_t offset = address & UINT32_C(0x1FFFFFFF);
+    uint32_t word;
+
+    if ((address & UINT32_C(0xC0000000)) != UINT32_C(0x80000000)
+        || (offset & (width - 1)) != 0
+        || offset >= rdram->dram_size - (width - 1))
+    {
+        return 0;
+    }
+
+    word = rdram->dram[offset >> 2];
+    if (width < 4)
+    {
+        unsigned int shift = (4 - width - (offset & 3)) * 8;
+        word = (word >> shift) & ((UINT32_C(1) << (width * 8)) - 1);
+    }
+
+    *value = word;
+    return 1;
+}
+
+
+static uint32_t watch_sample(const struct rdram* rdram, const WatchProbe* probe)
+{
+    uint32_t address = probe->address;
+    uint32_t value = 0;
+    unsigned int level;
+
+    for (level = 0; level < probe->depth; level++)
+    {
+        if (!watch_read(rdram, address, 4, &address))
+        {
+            return 0;
+        }
+        address += probe->offsets[level];
+    }
+
+    if (!watch_read(rdram, address, watch_type_width(probe->type), &value))
+    {
+        return 0;
+    }
+    return value;
+}
+
+
+static void watch_flush_block(void)
+{
+    WatchBlockHeader header;
+    const uint8_t* column = columns;
+    uint8_t* block;
+    uint8_t* dst;
+    unsigned int i;
+
+    if (block_count == 0)
+    {
+        return;
+    }
+
+    block = malloc(sizeof(header) + watch_row_size() * block_count);
+    if (block == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Watch Manager: Failed to allocate watch block");
+        block_count = 0;
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.first_frame = block_first_frame;
+    header.frame_count = block_count;
+    memcpy(block, &header, sizeof(header));
+
+    /* the columns of a partial block are packed together */
+    dst = block + sizeof(header);
+    for (i = 0; i < WATCH_COUNT; i++)
+    {
+        unsigned int width = watch_type_width(WATCH_TABLE[i].type);
+        memcpy(dst, column, width * block_count);
+        dst += width * block_count;
+        column += width * WATCH_BLOCK_FRAMES;
+    }
+
+    replay_writer_append_watch(block, dst - block);
+    block_count = 0;
+}
+
+
+void watch_manager_init(void)
+{
+    const char* playback_path = playback_manager_get_path();
+
+    watch_manager_close();
+
+    /* a batch replay of an older replay fills in its missing watch.bin;
+     * the replay writer keeps one set of open files, so only the default
+     * instance may use it */
+    if (core_instance_is_default() && main_is_batch_replay() && playback_path != NULL
+        && ConfigGetParamBool(g_CoreConfig, "ReplayWatch"))
+    {
+        char path[1024];
+        FILE* file;
+
+        snprintf(path, sizeof(path), "%s/watch.bin", playback_path);
+        file = fopen(path, "rb");
+        if (file != NULL)
+        {
+            fclose(file);
+            return;
+        }
+
+        watch_manager_open(playback_path);
+        backfill = recording;
+    }
+}
+
+
+void watch_manager_open(const char* replay_folder)
+{
+    char path[1024];
+    uint8_t* header;
+    WatchFileHeader file_header;
+    size_t size = sizeof(file_header) + WATCH_COUNT * sizeof(WatchColumn);
+    unsigned int i;
+
+    watch_manager_close();
+
+    if (!ConfigGetParamBool(g_CoreConfig, "ReplayWatch"))
+    {
+        return;
+    }
+
+    columns = malloc(watch_row_size() * WATCH_BLOCK_FRAMES);
+    header = malloc(size);
+    if (columns == NULL || header == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Watch Manager: Failed to allocate watch buffers");
+        free(columns);
+        free(header);
+        columns = NULL;
+        return;
+    }
+
+    memset(header, 0, size);
+    memcpy(file_header.magic, WATCH_MAGIC, 4);
+    file_header.version = WATCH_VERSION;
+    file_header.column_count = WATCH_COUNT;
+    file_header.block_frames = WATCH_BLOCK_FRAMES;
+    memcpy(header, &file_header, sizeof(file_header));
+
+    for (i = 0; i < WATCH_COUNT; i++)
+    {
+        const WatchProbe* probe = &WATCH_TABLE[i];
+        WatchColumn column;
+
+        memset(&column, 0, sizeof(column));
+        strncpy(column.name, probe->name, sizeof(column.name) - 1);
+        column.address = probe->address;
+        column.type = probe->type;
+        column.width = (uint8_t)watch_type_width(probe->type);
+        column.depth = probe->depth;
+        memcpy(column.offsets, probe->offsets, sizeof(column.offsets));
+        memcpy(header + sizeof(file_header) + i * sizeof(column), &column, sizeof(column));
+    }
+
+    snprintf(path, sizeof(path), "%s/watch.bin", replay_folder);
+    last_frame = 0;
+    block_count = 0;
+    recording = replay_writer_open_watch(path, header, size);
+}
+
+
+void watch_manager_close(void)
+{
+    if (recording)
+    {
+        watch_flush_block();
+        replay_writer_close_watch();
+        recording = 0;
+    }
+
+    free(columns);
+    columns = NULL;
+    backfill = 0;
+}
+
+
+void watch_manager_on_vi(void)
+{
+    const struct rdram* rdram = &g_instance->dev->rdram;
+    uint8_t* column = columns;
+    uint64_t frames;
+    unsigned int i;
+
+    if (!recording)
+    {
+        return;
+    }
+
+    if (backfill)
+    {
+        frames = playback_manager_get_position();
+    }
+    else if (replay_manager_is_recording())
+    {
+        frames = replay_manager_get_frame_count();
+    }
+    else
+    {
+        return;
+    }
+
+    if (frames == 0 || frames == last_frame)
+    {
+        return;
+    }
+
+    /* rows of a block are consecutive frames */
+    if (frames != last_frame + 1)
+    {
+        watch_flush_block();
+    }
+    last_frame = frames;
+
+    if (block_count == 0)
+    {
+        block_first_frame = frames;
+    }
+
+    for (i = 0; i < WATCH_COUNT; i++)
+    {
+        unsigned int width = watch_type_width(WATCH_TABLE[i].type);
+        uint32_t value = watch_sample(rdram, &WATCH_TABLE[i]);
+        uint8_t* dst = column + block_count * width;
+        unsigned int byte;
+
+        for (byte = 0; byte < width; byte++)
+        {
+            dst[byte] = (uint8_t)(value >> (8 * byte));
+        }
+        column += width * WATCH_BLOCK_FRAMES;
+    }
+
+    if (++block_count == WATCH_BLOCK_FRAMES)
+    {
+        watch_flush_block();
+    }
+}
+
+
+unsigned int watch_manager_get_probe_count(void)
+{
+    return WATCH_COUNT;
+}
+
+
+const WatchProbe* watch_manager_get_probe(unsigned int index)
+{
+    return (index < WATCH_COUNT) ? &WATCH_TABLE[index] : NULL;
+}
@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <stddef.h>
+#ifndef M64P_JIMMI_WATCH_MANAGER_H
+#define M64P_JIMMI_WATCH_MANAGER_H
+
+#include "replay_format.h"
+
+/* RAM watch table: a fixed list of RDRAM probes (player percent, stocks,
+ * positions, characters...) sampled once per recorded frame and stored
+ * column by column in watch.bin next to the replay inputs, so match data
+ * can be read without emulating the match again. */
+
+typedef struct {
+    const char* name;
+    uint32_t address;       /* N64 virtual address */
+    uint8_t type;           /* WATCH_* */
+    /* With depth > 0, address holds a pointer: each level reads the 32-bit
+     * pointer at the current address and adds offsets[level] to it. */
+    uint8_t depth;
+    uint16_t offsets[WATCH_MAX_DEPTH];
+} WatchProbe;
+
+struct watch_manager
+{
+    int recording;
+    /* sampling a replay that was recorded without watch.bin */
+    int backfill;
+    uint64_t last_frame;
+
+    /* current block, column after column, WATCH_BLOCK_FRAMES values each */
+    uint8_t* columns;
+    uint64_t block_first_frame;
+    uint32_t block_count;
+};
+
+void watch_manager_init(void);
+
+// Recording: watch.bin is created in the replay folder
+void watch_manager_open(const char* replay_folder);
+void watch_manager_close(void);
+
+// Called on every VI, once the inputs of the new frame are set
+void watch_manager_on_vi(void);
+
+unsigned int watch_manager_get_probe_count(void);
+const WatchProbe* watch_manager_get_probe(unsigned int index);
+
+#endif /* M64P_JIMMI_WATCH_MANAGER_H */
@@ -0,0 +1,119 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - instance.c                                              *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instance.h"
+#include "main.h"
+#include "api/callbacks.h"
+#include "device/memory/memory.h"
+
+/* the default instance works on g_dev, which the dynarecs address directly */
+static struct core_instance l_DefaultInstance = { &g_dev };
+
+osal_thread_local struct core_instance* g_instance CORE_INSTANCE_TLS_MODEL = &l_DefaultInstance;
+
+static SDL_atomic_t l_InstanceCount;
+
+struct core_instance* core_instance_default(void)
+{
+    return &l_DefaultInstance;
+}
+
+int core_instance_is_default(void)
+{
+    return g_instance == &l_DefaultInstance;
+}
+
+void core_instance_reset(struct core_instance* instance)
+{
+    struct device* dev = instance->dev;
+    void* mem_base = instance->mem_base;
+
+    memset(instance, 0, sizeof(*instance));
+    memset(dev, 0, sizeof(*dev));
+
+    instance->dev = dev;
+    instance->mem_base = mem_base;
+
+    instance->main.start_address = UINT32_C(0xa4000040);
+    instance->main.speed_factor = 100;
+    instance->main.speed_limit = 1;
+    instance->main.last_speed_factor = 100;
+    instance->main.saved_speed_factor = 100;
+}
+
+struct core_instance* core_instance_create(void)
+{
+    struct core_instance* instance = malloc(sizeof(*instance));
+    if (instance == NULL)
+        return NULL;
+
+    instance->dev = malloc(sizeof(struct device));
+    instance->mem_base = init_mem_base();
+    if (instance->dev == NULL || instance->mem_base == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Failed to allocate emulator instance");
+        if (instance->mem_base != NULL)
+            release_mem_base(instance->mem_base);
+        free(instance->dev);
+        free(instance);
+        return NULL;
+    }
+
+    core_instance_reset(instance);
+    SDL_AtomicIncRef(&l_InstanceCount);
+
+    return instance;
+}
+
+void core_instance_destroy(struct core_instance* instance)
+{
+    struct core_instance* previous;
+
+    if (instance == NULL || instance == &l_DefaultInstance)
+        return;
+
+    /* module cleanup works on the current instance */
+    previous = core_instance_enter(instance);
+    release_mem_rom();
+    core_instance_enter(previous);
+
+    release_mem_base(instance->mem_base);
+    free(instance->dev);
+    free(instance);
+
+    SDL_AtomicDecRef(&l_InstanceCount);
+}
+
+unsigned int core_instance_count(void)
+{
+    return (unsigned int)SDL_AtomicGet(&l_InstanceCount);
+}
+
+struct core_instance* core_instance_enter(struct core_instance* instance)
+{
+    struct core_instance* previous = g_instance;
+    g_instance = instance;
+    return previous;
+}
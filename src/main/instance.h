@@ -0,0 +1,211 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - instance.h                                              *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_INSTANCE_H
+#define M64P_MAIN_INSTANCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "api/m64p_types.h"
+#include "backends/file_storage.h"
+#include "device/device.h"
+#include "main/cheat.h"
+#include "main/rom.h"
+#include "main/savestates.h"
+#include "main/util.h"
+#include "main/workqueue.h"
+#include "osal/preproc.h"
+#include "osd/osd.h"
+#include "jimmi/frame_manager.h"
+#include "jimmi/game_manager.h"
+#include "jimmi/hash_manager.h"
+#include "jimmi/input_manager.h"
+#include "jimmi/keyframe_manager.h"
+#include "jimmi/playback_manager.h"
+#include "jimmi/replay_manager.h"
+#include "jimmi/watch_manager.h"
+
+struct av_dump_backend_interface;
+struct controller_input_compat;
+struct pak_interface;
+struct video_capture_backend_interface;
+
+/* compatible paks */
+enum { PAK_MAX_SIZE = 5 };
+
+struct gb_cart_data
+{
+    int control_id;
+    struct file_storage rom_fstorage;
+    struct file_storage ram_fstorage;
+    void* gbcam_backend;
+    const struct video_capture_backend_interface* igbcam_backend;
+};
+
+/* Everything one emulated console needs, so that several of them can run
+ * concurrently in the same process, each on its own thread.
+ *
+ * Plugins, configuration, front-end callbacks and the ROM database stay
+ * process wide. The dynamic recompilers, netplay, replay recording, the OSD,
+ * the SDL event loop and the debugger are only available to the default
+ * instance, whose device is the g_dev global the dynarecs address directly.
+ */
+struct core_instance
+{
+    struct device* dev;
+    void* mem_base;
+
+    /* device/memory */
+    void* mem_rom;
+    uint32_t mem_rom_size;
+
+    /* main/rom */
+    struct
+    {
+        int size;
+        m64p_rom_header header;
+        rom_params params;
+        m64p_rom_settings settings;
+    } rom;
+
+    /* api/frontend */
+    struct
+    {
+        int rom_open;
+        int disk_open;
+    } frontend;
+
+    /* main/main */
+    struct
+    {
+        int emulator_running;
+        int rom_pause;
+        struct cheat_ctx cheat_ctx;
+        m64p_media_loader media_loader;
+        uint32_t start_address;
+        int gs_vi_counter;
+        struct controller_input_compat* cin_by_port[GAME_CONTROLLERS_COUNT];
+
+        int current_frame;
+        int take_screenshot;
+        int speed_factor;
+        int frame_advance;
+        int speed_limit;
+
+        int batch_replay;
+        char* batch_replay_path;
+        m64p_batch_replay_stats batch_replay_stats;
+        unsigned int batch_replay_start_time;
+        unsigned int batch_replay_idle_vis;
+
+        void* av_dump;
+        const struct av_dump_backend_interface* iav_dump;
+        int av_dump_width;
+        int av_dump_height;
+        uint32_t av_dump_vi_mode[6];
+
+        osd_message_t* msg_vol;
+        osd_message_t* msg_ff;
+        osd_message_t* msg_pause;
+
+        size_t paks_idx[GAME_CONTROLLERS_COUNT];
+        void* paks[GAME_CONTROLLERS_COUNT][PAK_MAX_SIZE];
+        const struct pak_interface* ipaks[PAK_MAX_SIZE];
+        size_t pak_type_idx[6];
+        struct xoshiro256pp_state mpk_idgen;
+        struct gb_cart_data gb_carts_data[GAME_CONTROLLERS_COUNT];
+
+        char timestamp_folder[1024];
+
+        /* speed limiter */
+        unsigned long total_vis;
+        int reset_once;
+        int last_speed_factor;
+        unsigned int start_fps_time;
+
+        /* fast forward */
+        int ff_state;
+        int saved_speed_factor;
+
+        char savepath[1024];
+        char save_filename[256];
+    } main;
+
+    /* main/savestates */
+    struct
+    {
+        savestates_job job;
+        savestates_type type;
+        char* fname;
+        unsigned int slot;
+        int autoinc_save_slot;
+
+        unsigned char* mem_buffer;
+        size_t mem_size;
+
+        /* file saves are serialized in turn in one of these, then compressed
+         * on the workqueue */
+        unsigned char* save_buffers[2];
+        struct work_completion save_written[2];
+        unsigned int save_next;
+
+        /* incremental savestates, see savestates_set_delta_base */
+        const unsigned char* delta_base;
+        uint64_t delta_base_hash;
+        uint64_t* delta_page_hashes;
+        unsigned char* delta_scratch;
+    } savestates;
+
+    /* jimmi */
+    struct frame_manager frame_manager;
+    struct game_manager game_manager;
+    struct input_manager input_manager;
+    struct replay_manager replay_manager;
+    struct playback_manager playback_manager;
+    struct keyframe_manager keyframe_manager;
+    struct hash_manager hash_manager;
+    struct watch_manager watch_manager;
+};
+
+#if defined(__ELF__)
+#define CORE_INSTANCE_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#define CORE_INSTANCE_TLS_MODEL
+#endif
+
+/* Instance the calling thread works on. It is the default instance unless the
+ * thread is inside CoreDoCommandEx, so emulation code running under
+ * M64CMD_EXECUTE always sees its own instance. */
+extern osal_thread_local struct core_instance* g_instance CORE_INSTANCE_TLS_MODEL;
+
+struct core_instance* core_instance_default(void);
+int core_instance_is_default(void);
+
+struct core_instance* core_instance_create(void);
+void core_instance_destroy(struct core_instance* instance);
+void core_instance_reset(struct core_instance* instance);
+unsigned int core_instance_count(void);
+
+/* Makes instance current on the calling thread, returns the previous one */
+struct core_instance* core_instance_enter(struct core_instance* instance);
+
+#endif /* M64P_MAIN_INSTANCE_H */
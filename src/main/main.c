@@ -45,6 +45,7 @@
 #include "api/m64p_vidext.h"
 #include "api/vidext.h"
 #include "backends/api/audio_out_backend.h"
+#include "backends/api/av_dump_backend.h"
 #include "backends/api/clock_backend.h"
 #include "backends/api/controller_input_backend.h"
 #include "backends/api/joybus.h"
@@ -83,6 +84,10 @@
 #include "jimmi/replay_manager.h"
 #include "jimmi/playback_manager.h"
 #include "jimmi/game_manager.h"
+#include "jimmi/replay_writer.h"
+#include "jimmi/keyframe_manager.h"
+#include "jimmi/hash_manager.h"
+#include "jimmi/watch_manager.h"
 
 #ifdef DBG
 #include "debugger/dbg_debugger.h"
@@ -102,26 +107,11 @@ m64p_frame_callback g_FrameCallback = NULL;
 
 
 int         g_RomWordsLittleEndian = 0; // after loading, ROM words are in native N64 byte order (big endian). We will swap them on x86
-int         g_EmulatorRunning = 0;      // need separate boolean to tell if emulator is running, since --nogui doesn't use a thread
-
-int g_rom_pause;
-
-struct cheat_ctx g_cheat_ctx;
-
-/* g_mem_base is global to allow plugins early access (before device is initialized).
- * Do not use this variable directly in emulation code.
- * Initialization and DeInitialization of this variable is done at CoreStartup and CoreShutdown.
- */
-void* g_mem_base = NULL;
-
-uint32_t g_start_address = UINT32_C(0xa4000040);
 
+/* Storage for the device of the default instance. Emulation code must go through
+ * g_instance->dev, only the dynarecs (which never run in other instances) address it directly. */
 struct device g_dev;
 
-m64p_media_loader g_media_loader;
-
-int g_gs_vi_counter = 0;
-
 #define CUSTOM_TAG_STRING_POOL_START  0x80123800u
 #define CUSTOM_TAG_STRING_POOL_END    0x80124000u
 #define STRING_TABLE_BASE_ADDR         0x80138E10u  // CharacterSelectDebugMenu.PlayerTag.string_table
@@ -129,33 +119,47 @@ int g_gs_vi_counter = 0;
 
 static uint32_t g_tag_string_pool_next = CUSTOM_TAG_STRING_POOL_START;
 
-struct controller_input_compat* g_cin_by_port[] = { NULL, NULL, NULL, NULL };
-
-/** static (local) variables **/
-static int   l_CurrentFrame = 0;         // frame counter
-static int   l_TakeScreenshot = 0;       // Tell OSD Rendering callback to take a screenshot just before drawing the OSD
-static int   l_SpeedFactor = 100;        // percentage of nominal game speed at which emulator is running
-static int   l_FrameAdvance = 0;         // variable to check if we pause on next frame
-static int   l_MainSpeedLimit = 1;       // insert delay during vi_interrupt to keep speed at real-time
-
-static osd_message_t *l_msgVol = NULL;
-static osd_message_t *l_msgFF = NULL;
-static osd_message_t *l_msgPause = NULL;
+/** per-instance (local) variables, see main/instance.h **/
+#define g_start_address        (g_instance->main.start_address)
+#define l_CurrentFrame         (g_instance->main.current_frame)     // frame counter
+#define l_TakeScreenshot       (g_instance->main.take_screenshot)   // Tell OSD Rendering callback to take a screenshot just before drawing the OSD
+#define l_SpeedFactor          (g_instance->main.speed_factor)      // percentage of nominal game speed at which emulator is running
+#define l_FrameAdvance         (g_instance->main.frame_advance)     // variable to check if we pause on next frame
+#define l_MainSpeedLimit       (g_instance->main.speed_limit)       // insert delay during vi_interrupt to keep speed at real-time
+#define l_BatchReplay          (g_instance->main.batch_replay)      // headless, unthrottled playback of l_BatchReplayPath until the match ends
+#define l_BatchReplayPath      (g_instance->main.batch_replay_path)
+#define l_BatchReplayStats     (g_instance->main.batch_replay_stats)
+#define l_BatchReplayStartTime (g_instance->main.batch_replay_start_time)
+#define l_BatchReplayIdleVIs   (g_instance->main.batch_replay_idle_vis)
+#define l_AVDump               (g_instance->main.av_dump)           // frames and samples are dumped here for rendering videos
+#define l_iAVDump              (g_instance->main.iav_dump)
+#define l_AVDumpWidth          (g_instance->main.av_dump_width)     // frame size read from the video plugin for l_AVDumpVIMode
+#define l_AVDumpHeight         (g_instance->main.av_dump_height)
+#define l_AVDumpVIMode         (g_instance->main.av_dump_vi_mode)
+
+#define l_msgVol   (g_instance->main.msg_vol)
+#define l_msgFF    (g_instance->main.msg_ff)
+#define l_msgPause (g_instance->main.msg_pause)
+
+/* speed limiter */
+#define totalVIs        (g_instance->main.total_vis)
+#define resetOnce       (g_instance->main.reset_once)
+#define lastSpeedFactor (g_instance->main.last_speed_factor)
+#define StartFPSTime    (g_instance->main.start_fps_time)
 
 /* compatible paks */
-enum { PAK_MAX_SIZE = 5 };
-static size_t l_paks_idx[GAME_CONTROLLERS_COUNT];
-static void* l_paks[GAME_CONTROLLERS_COUNT][PAK_MAX_SIZE];
-static const struct pak_interface* l_ipaks[PAK_MAX_SIZE];
-static size_t l_pak_type_idx[6];
+#define l_paks_idx     (g_instance->main.paks_idx)
+#define l_paks         (g_instance->main.paks)
+#define l_ipaks        (g_instance->main.ipaks)
+#define l_pak_type_idx (g_instance->main.pak_type_idx)
 
 /* PRNG state - used for Mempaks ID generation */
-static struct xoshiro256pp_state l_mpk_idgen;
+#define l_mpk_idgen (g_instance->main.mpk_idgen)
+
+#define l_gb_carts_data (g_instance->main.gb_carts_data)
 
 /* Jimmi replay stuff */
-static int last_game_state = 0;
-static int last_game_screen = 0;
-static char timestamp_folder[1024];
+#define timestamp_folder (g_instance->main.timestamp_folder)
 
 /*********************************************************************************************************
 * static functions
@@ -174,17 +178,17 @@ static inline void rdram_write_u8(uint32_t addr, uint8_t v)
     const uint32_t shift = (3u - byte_off) * 8u;
     const uint32_t mask = 0xFFu << shift;
     const uint32_t value = ((uint32_t)v) << shift;
-    r4300_write_aligned_word(&g_dev.r4300, aligned, value, mask);
+    r4300_write_aligned_word(&g_instance->dev->r4300, aligned, value, mask);
 }
 
 static inline void rdram_write_u32(uint32_t addr, uint32_t value)
 {
-    r4300_write_aligned_word(&g_dev.r4300, viraddr_to_physaddr(addr), value, 0xFFFFFFFFu);
+    r4300_write_aligned_word(&g_instance->dev->r4300, viraddr_to_physaddr(addr), value, 0xFFFFFFFFu);
 }
 
 static const char *get_savepathdefault(const char *configpath)
 {
-    static char path[1024];
+    char *path = g_instance->main.savepath;
 
     if (!configpath || (strlen(configpath) == 0)) {
         snprintf(path, 1024, "%ssave%c", ConfigGetUserDataPath(), OSAL_DIR_SEPARATORS[0]);
@@ -202,7 +206,7 @@ static const char *get_savepathdefault(const char *configpath)
 
 static char *get_save_filename(void)
 {
-    static char filename[256];
+    char *filename = g_instance->main.save_filename;
 
     int format = ConfigGetParamInt(g_CoreConfig, "SaveFilenameFormat");
 
@@ -339,6 +343,66 @@ static char *get_dd_disk_save_path(const char* disk, int format)
 }
 
 
+/* AI samples go to the audio plugin, and to the dump when there is one */
+static void av_dump_set_frequency(void* aout, unsigned int frequency)
+{
+    g_iaudio_out_backend_plugin_compat.set_frequency(aout, frequency);
+
+    if (l_AVDump != NULL)
+        l_iAVDump->set_frequency(l_AVDump, frequency);
+}
+
+static void av_dump_push_samples(void* aout, const void* buffer, size_t size)
+{
+    g_iaudio_out_backend_plugin_compat.push_samples(aout, buffer, size);
+
+    if (l_AVDump != NULL && !netplay_is_resimulating())
+        l_iAVDump->push_samples(l_AVDump, buffer, size);
+}
+
+static const struct audio_out_backend_interface l_iaudio_out_backend_av_dump =
+{
+    av_dump_set_frequency,
+    av_dump_push_samples
+};
+
+static void init_av_dump_backend(void)
+{
+    const char* name = ConfigGetParamString(g_CoreConfig, "AVDumpBackend");
+
+    l_AVDump = NULL;
+    l_AVDumpWidth = 0;
+    l_AVDumpHeight = 0;
+    l_iAVDump = get_av_dump_backend(name);
+    if (l_iAVDump == NULL) {
+        if (name != NULL && strlen(name) > 0) {
+            DebugMessage(M64MSG_WARNING, "Could not find %s av_dump_backend_interface. Not dumping.", name);
+        }
+        return;
+    }
+
+    /* build section name */
+    char* section = formatstr("AVDumpBackend:%s", l_iAVDump->name);
+
+    /* init backend */
+    if (l_iAVDump->init(&l_AVDump, section, g_instance->dev->vi.expected_refresh_rate) != M64ERR_SUCCESS) {
+        DebugMessage(M64MSG_ERROR, "Failed to initialize %s av dump backend. Not dumping.", l_iAVDump->name);
+        l_AVDump = NULL;
+        l_iAVDump = NULL;
+    }
+
+    free(section);
+}
+
+static void release_av_dump_backend(void)
+{
+    if (l_AVDump != NULL) {
+        l_iAVDump->release(l_AVDump);
+    }
+    l_AVDump = NULL;
+    l_iAVDump = NULL;
+}
+
 static m64p_error init_video_capture_backend(const struct video_capture_backend_interface** ivcap, void** vcap, m64p_handle config, const char* key)
 {
     m64p_error err;
@@ -396,6 +460,30 @@ const char *get_savesrampath(void)
     return get_savepathdefault(ConfigGetParamString(g_CoreConfig, "SaveSRAMPath"));
 }
 
+const char *get_dynarec_cachepath(void)
+{
+    char *path = g_instance->main.savepath;
+    const char *configpath;
+
+    if (!ConfigGetParamBool(g_CoreConfig, "DynarecCache"))
+        return NULL;
+
+    /* try to get the DynarecCachePath string variable in the Core configuration section */
+    configpath = ConfigGetParamString(g_CoreConfig, "DynarecCachePath");
+    if (!configpath || (strlen(configpath) == 0)) {
+        snprintf(path, 1024, "%sdynarec%c", ConfigGetUserCachePath(), OSAL_DIR_SEPARATORS[0]);
+        path[1023] = 0;
+    } else {
+        snprintf(path, 1024, "%s%c", configpath, OSAL_DIR_SEPARATORS[0]);
+        path[1023] = 0;
+    }
+
+    /* create directory if it doesn't exist */
+    osal_mkdirp(path, 0700);
+
+    return path;
+}
+
 const char *get_savestatefilename(void)
 {
     /* return same file name as save files */
@@ -420,6 +508,10 @@ void main_message(m64p_msg_level level, unsigned int corner, const char *format,
 
 static void main_check_inputs(void)
 {
+    /* the SDL event loop belongs to the default instance */
+    if (!core_instance_is_default())
+        return;
+
 #ifdef WITH_LIRC
     lircCheckInput();
 #endif
@@ -465,6 +557,9 @@ int main_set_core_defaults(void)
     ConfigSetDefaultInt(g_CoreConfig, "R4300Emulator", 1, "Use Pure Interpreter if 0, Cached Interpreter if 1, or Dynamic Recompiler if 2 or more");
 #endif
     ConfigSetDefaultBool(g_CoreConfig, "NoCompiledJump", 0, "Disable compiled jump commands in dynamic recompiler (should be set to False) ");
+    ConfigSetDefaultBool(g_CoreConfig, "FuseInstructions", 1, "Fuse frequent instruction pairs into superinstructions in the cached interpreter");
+    ConfigSetDefaultBool(g_CoreConfig, "DynarecCache", 0, "Keep code compiled by the dynamic recompiler in a file per ROM and reuse it on the next run (x86-64 dynamic recompiler only, reused by the same core build)");
+    ConfigSetDefaultString(g_CoreConfig, "DynarecCachePath", "", "Path to directory where dynamic recompiler code caches are stored. If this is blank, the default value of ${UserCachePath}/dynarec will be used");
     ConfigSetDefaultBool(g_CoreConfig, "DisableExtraMem", 0, "Disable 4MB expansion RAM pack. May be necessary for some games");
     ConfigSetDefaultInt(g_CoreConfig, "CountPerOp", 0, "Force number of cycles per emulated instruction");
     ConfigSetDefaultInt(g_CoreConfig, "CountPerOpDenomPot", 0, "Reduce number of cycles per update by power of two when set greater than 0 (overclock)");
@@ -472,23 +567,33 @@ int main_set_core_defaults(void)
     ConfigSetDefaultInt(g_CoreConfig, "CurrentStateSlot", 0, "Save state slot (0-9) to use when saving/loading the emulator state");
     ConfigSetDefaultBool(g_CoreConfig, "EnableDebugger", 0, "Activate the R4300 debugger when ROM execution begins, if core was built with Debugger support");
     ConfigSetDefaultString(g_CoreConfig, "ScreenshotPath", "", "Path to directory where screenshots are saved. If this is blank, the default value of ${UserDataPath}/screenshot will be used");
+    ConfigSetDefaultInt(g_CoreConfig, "ScreenshotFormat", 0, "Screenshot file format (0: PNG, 1: QOI, faster to encode)");
+    ConfigSetDefaultInt(g_CoreConfig, "ScreenshotCompression", 1, "PNG compression level, from 0 (fastest) to 9 (smallest files)");
     ConfigSetDefaultString(g_CoreConfig, "SaveStatePath", "", "Path to directory where emulator save states (snapshots) are saved. If this is blank, the default value of ${UserDataPath}/save will be used");
     ConfigSetDefaultString(g_CoreConfig, "SaveSRAMPath", "", "Path to directory where SRAM/EEPROM data (in-game saves) are stored. If this is blank, the default value of ${UserDataPath}/save will be used");
     ConfigSetDefaultString(g_CoreConfig, "SharedDataPath", "", "Path to a directory to search when looking for shared data files");
     ConfigSetDefaultBool(g_CoreConfig, "RandomizeInterrupt", 1, "Randomize PI/SI Interrupt Timing");
     ConfigSetDefaultInt(g_CoreConfig, "SiDmaDuration", -1, "Duration of SI DMA (-1: use per game settings)");
     ConfigSetDefaultString(g_CoreConfig, "GbCameraVideoCaptureBackend1", DEFAULT_VIDEO_CAPTURE_BACKEND, "Gameboy Camera Video Capture backend");
+    ConfigSetDefaultString(g_CoreConfig, "AVDumpBackend", "", "Backend every frame and audio sample is dumped with to render videos (\"y4m\"), empty to disable");
     ConfigSetDefaultInt(g_CoreConfig, "SaveDiskFormat", 1, "Disk Save Format (0: Full Disk Copy (*.ndr/*.d6r), 1: RAM Area Only (*.ram))");
     ConfigSetDefaultInt(g_CoreConfig, "SaveFilenameFormat", 1, "Save (SRAM/State) Filename Format (0: ROM Header Name, 1: Automatic (including partial MD5 hash))");
     ConfigSetDefaultBool(g_CoreConfig, "Replays", 0, "Enable input replays (recording and playback of controller inputs)");
     ConfigSetDefaultString(g_CoreConfig, "ReplaysPath", "", "Path to directory where replay files are saved");
     ConfigSetDefaultBool(g_CoreConfig, "Playback", 0, "Enable input playback from previously recorded replays");
     ConfigSetDefaultString(g_CoreConfig, "PlaybackPath", "", "Path to replay file being played.");
+    ConfigSetDefaultInt(g_CoreConfig, "ReplayKeyframeInterval", 5, "Seconds between savestate keyframes stored with replays, used for seeking (0: disabled)");
+    ConfigSetDefaultInt(g_CoreConfig, "ReplayHashInterval", 60, "Frames between RDRAM hashes stored with replays, used to detect desyncs (0: disabled)");
+    ConfigSetDefaultString(g_CoreConfig, "ReplayHashRegions", "", "RDRAM ranges hashed with replays, as hexadecimal start-end pairs separated by commas (empty: all of RDRAM). Leave out the framebuffers to verify batch replays, which do not update the screen");
+    ConfigSetDefaultBool(g_CoreConfig, "ReplayVerify", 0, "Check RDRAM hashes during playback and report the first replay frame that diverged");
+    ConfigSetDefaultBool(g_CoreConfig, "ReplayWatch", 1, "Store per-frame match data read from RDRAM (percent, stocks, positions, characters) with replays");
     ConfigSetDefaultBool(g_CoreConfig, "Netplay", 0, "Enable Netplay");
     ConfigSetDefaultString(g_CoreConfig, "NetplayRelayHost", "45.76.57.98", "Netplay relay host address");
     ConfigSetDefaultString(g_CoreConfig, "NetplayToken", "", "Netplay session token");
     ConfigSetDefaultBool(g_CoreConfig, "NetplayHosting", 0, "Netplay role (0: Client, 1: Server)");
     ConfigSetDefaultString(g_CoreConfig, "NetplayStatePath", "", "Path to state file used for Netplay synchronization");
+    ConfigSetDefaultInt(g_CoreConfig, "NetplaySyncHash", 60, "Frames between RDRAM and GPR hashes compared to detect netplay desyncs, 0 to compare CP0 registers every 600 frames instead (host only)");
+    ConfigSetDefaultInt(g_CoreConfig, "NetplayRollback", 0, "Frames of remote input predicted and rolled back when wrong, 0 to delay inputs instead (host only)");
 
     ConfigSetParameter(g_CoreConfig, "Replays", M64TYPE_BOOL, &bFalse);
     ConfigSetParameter(g_CoreConfig, "Playback", M64TYPE_BOOL, &bFalse);
@@ -563,13 +668,13 @@ void main_set_fastforward(int enable)
     if (netplay_is_init())
         return;
 
-    static int ff_state = 0;
-    static int SavedSpeedFactor = 100;
+    int* ff_state = &g_instance->main.ff_state;
+    int* SavedSpeedFactor = &g_instance->main.saved_speed_factor;
 
-    if (enable && !ff_state)
+    if (enable && !*ff_state)
     {
-        ff_state = 1; /* activate fast-forward */
-        SavedSpeedFactor = l_SpeedFactor;
+        *ff_state = 1; /* activate fast-forward */
+        *SavedSpeedFactor = l_SpeedFactor;
         l_SpeedFactor = 250;
         audio.setSpeedFactor(l_SpeedFactor);
         StateChanged(M64CORE_SPEED_FACTOR, l_SpeedFactor);
@@ -578,10 +683,10 @@ void main_set_fastforward(int enable)
         osd_message_set_static(l_msgFF);
         osd_message_set_user_managed(l_msgFF);
     }
-    else if (!enable && ff_state)
+    else if (!enable && *ff_state)
     {
-        ff_state = 0; /* de-activate fast-forward */
-        l_SpeedFactor = SavedSpeedFactor;
+        *ff_state = 0; /* de-activate fast-forward */
+        l_SpeedFactor = *SavedSpeedFactor;
         audio.setSpeedFactor(l_SpeedFactor);
         StateChanged(M64CORE_SPEED_FACTOR, l_SpeedFactor);
         // remove message
@@ -735,6 +840,22 @@ void main_state_save(int format, const char *filename)
         savestates_set_job(savestates_job_save, (savestates_type)format, filename);
 }
 
+void main_state_snapshot(void *buffer, size_t size)
+{
+    if (netplay_is_init())
+        return;
+
+    savestates_set_memory_job(savestates_job_save, (unsigned char *) buffer, size);
+}
+
+void main_state_restore(void *buffer, size_t size)
+{
+    if (netplay_is_init())
+        return;
+
+    savestates_set_memory_job(savestates_job_load, (unsigned char *) buffer, size);
+}
+
 m64p_error main_core_state_query(m64p_core_param param, int *rval)
 {
     switch (param)
@@ -785,6 +906,9 @@ m64p_error main_core_state_query(m64p_core_param param, int *rval)
         case M64CORE_INPUT_GAMESHARK:
             *rval = event_gameshark_active();
             break;
+        case M64CORE_STATE_SNAPSHOT_SIZE:
+            *rval = (int) savestates_get_memory_size();
+            break;
         // these are only used for callbacks; they cannot be queried or set
         case M64CORE_SCREENSHOT_CAPTURED:
         case M64CORE_STATE_LOADCOMPLETE:
@@ -884,6 +1008,8 @@ m64p_error main_core_state_set(m64p_core_param param, int val)
         // these are only used for callbacks; they cannot be queried or set
         case M64CORE_STATE_LOADCOMPLETE:
         case M64CORE_STATE_SAVECOMPLETE:
+        // read only
+        case M64CORE_STATE_SNAPSHOT_SIZE:
             return M64ERR_INPUT_INVALID;
         default:
             return M64ERR_INPUT_INVALID;
@@ -954,10 +1080,10 @@ int main_volume_get_muted(void)
 m64p_error main_reset(int do_hard_reset)
 {
     if (do_hard_reset) {
-        hard_reset_device(&g_dev);
+        hard_reset_device(g_instance->dev);
     }
     else {
-        soft_reset_device(&g_dev);
+        soft_reset_device(g_instance->dev);
     }
 
     return M64ERR_SUCCESS;
@@ -988,8 +1114,8 @@ static void video_plugin_render_callback(int bScreenRedrawn)
     }
 
 #ifdef M64P_OSD
-    // if the OSD is enabled, then draw it now
-    if (bOSD)
+    // if the OSD is enabled, then draw it now, except over the frames being dumped
+    if (bOSD && !l_BatchReplay && l_AVDump == NULL)
     {
         osd_render();
     }
@@ -1019,15 +1145,11 @@ void new_frame(void)
 
 static void apply_speed_limiter(void)
 {
-    static unsigned long totalVIs = 0;
-    static int resetOnce = 0;
-    static int lastSpeedFactor = 100;
-    static unsigned int StartFPSTime = 0;
     static const double defaultSpeedFactor = 100.0;
     unsigned int CurrentFPSTime = SDL_GetTicks();
 
     // calculate frame duration based upon ROM setting (50/60hz) and mupen64plus speed adjustment
-    const double VILimitMilliseconds = 1000.0 / g_dev.vi.expected_refresh_rate;
+    const double VILimitMilliseconds = 1000.0 / g_instance->dev->vi.expected_refresh_rate;
     const double SpeedFactorMultiple = defaultSpeedFactor/l_SpeedFactor;
     const double AdjustedLimit = VILimitMilliseconds * SpeedFactorMultiple;
 
@@ -1089,7 +1211,7 @@ static void apply_speed_limiter(void)
 /* TODO: make a GameShark module and move that there */
 static void gs_apply_cheats(struct cheat_ctx* ctx)
 {
-    struct r4300_core* r4300 = &g_dev.r4300;
+    struct r4300_core* r4300 = &g_instance->dev->r4300;
 
     if (g_gs_vi_counter < 60)
     {
@@ -1117,63 +1239,219 @@ static void pause_loop(void)
     }
 }
 
-/* called on vertical interrupt.
- * Allow the core to perform various things */
-void new_vi(void)
+int main_is_batch_replay(void)
+{
+    return l_BatchReplay;
+}
+
+int main_is_av_dumping(void)
+{
+    return l_AVDump != NULL;
+}
+
+m64p_error main_set_batch_replay(const char *replay_folder)
+{
+    if (g_EmulatorRunning)
+        return M64ERR_INVALID_STATE;
+
+    free(l_BatchReplayPath);
+    l_BatchReplayPath = NULL;
+    l_BatchReplay = 0;
+
+    if (replay_folder == NULL)
+        return M64ERR_SUCCESS;
+
+    l_BatchReplayPath = strdup(replay_folder);
+    if (l_BatchReplayPath == NULL)
+        return M64ERR_NO_MEMORY;
+
+    l_BatchReplay = 1;
+    return M64ERR_SUCCESS;
+}
+
+m64p_error main_get_batch_replay_stats(m64p_batch_replay_stats *stats)
+{
+    if (g_EmulatorRunning)
+        return M64ERR_INVALID_STATE;
+
+    *stats = l_BatchReplayStats;
+    return M64ERR_SUCCESS;
+}
+
+/* The replay is handed to the managers directly rather than through the
+ * config, which is shared by all instances. */
+static void batch_replay_start(void)
+{
+    replay_manager_set_enabled(0);
+    playback_manager_set_path(l_BatchReplayPath);
+
+    memset(&l_BatchReplayStats, 0, sizeof(l_BatchReplayStats));
+    l_BatchReplayIdleVIs = 0;
+    l_MainSpeedLimit = 0;
+    l_BatchReplayStartTime = SDL_GetTicks();
+
+    DebugMessage(M64MSG_INFO, "Batch replay: Running %s", l_BatchReplayPath);
+}
+
+static void batch_replay_finish(void)
 {
-    int recording_enabled = replay_manager_is_enabled();
-    int current_game_state = game_manager_get_game_status();
+    l_BatchReplayStats.milliseconds = SDL_GetTicks() - l_BatchReplayStartTime;
+    if (l_BatchReplayStats.milliseconds > 0)
+        l_BatchReplayStats.fps = l_BatchReplayStats.frames * 1000.0f / l_BatchReplayStats.milliseconds;
+    l_BatchReplayStats.hashes_checked = hash_manager_get_checked_count();
+    l_BatchReplayStats.divergent_frame = (unsigned int)hash_manager_get_divergent_frame();
 
-    if (last_game_state == REMIX_STATUS_WAIT &&
-        current_game_state == REMIX_STATUS_ONGOING &&
-        recording_enabled)
+    playback_manager_set_path(NULL);
+    l_MainSpeedLimit = 1;
+
+    DebugMessage(M64MSG_INFO, "Batch replay: %u frames in %u ms, %.1f fps (%.1fx real time)%s",
+                 l_BatchReplayStats.frames, l_BatchReplayStats.milliseconds, l_BatchReplayStats.fps,
+                 l_BatchReplayStats.fps / g_instance->dev->vi.expected_refresh_rate,
+                 l_BatchReplayStats.match_ended ? "" : ", match end not reached");
+}
+
+/* Stops at match end. A desynced replay may never get there, so also give up
+ * once the inputs have run out for a while. */
+static void batch_replay_update(void)
+{
+    l_BatchReplayStats.frames++;
+
+    if (l_BatchReplayStats.match_ended)
+    {
+        main_stop();
+        return;
+    }
+
+    if (playback_manager_get_frame_count() != 0 &&
+        playback_manager_get_position() >= playback_manager_get_frame_count() &&
+        ++l_BatchReplayIdleVIs > 10 * g_instance->dev->vi.expected_refresh_rate)
+    {
+        DebugMessage(M64MSG_WARNING, "Batch replay: Inputs exhausted without reaching match end");
+        main_stop();
+    }
+}
+
+/* Jimmi replays: a match starts recording when it leaves the wait state,
+ * after the initial state was saved on the way from the stage select screen */
+static void game_status_changed(uint32_t previous, uint32_t current, void* opaque)
+{
+    if (previous == REMIX_STATUS_WAIT &&
+        current == REMIX_STATUS_ONGOING &&
+        replay_manager_is_enabled())
     {
         replay_manager_open(timestamp_folder);
         char* replay_folder = replay_manager_generate_path(timestamp_folder);
-        ConfigSetParameter(g_CoreConfig, "ScreenshotPath", M64TYPE_STRING, replay_folder);
-        TakeScreenshot(l_CurrentFrame);
-        char game_type_path[1024];
-        if (game_manager_get_game() == GAME_IS_REMIX)
-        {
-            snprintf(game_type_path, sizeof(game_type_path), "%s/%s", replay_folder, "remix");
-            FILE *fp = fopen(game_type_path, "w");
-            fclose(fp);
-        }
-        else if (game_manager_get_game() == GAME_IS_VANILLA)
-        {
-            snprintf(game_type_path, sizeof(game_type_path), "%s/%s", replay_folder, "vanilla");
-            FILE *fp = fopen(game_type_path, "w");
-            fclose(fp);
-        }
-        else
+        if (replay_folder != NULL)
         {
-            DebugMessage(M64MSG_WARNING, "Unknown game type: %d", game_manager_get_game());
+            /* only the frame copy happens here, encoding runs on the workqueue */
+            QueueScreenshotInFolder(replay_folder);
+
+            char game_type_path[1024];
+            if (game_manager_get_game() == GAME_IS_REMIX)
+            {
+                snprintf(game_type_path, sizeof(game_type_path), "%s/%s", replay_folder, "remix");
+                replay_writer_create_marker(game_type_path);
+            }
+            else if (game_manager_get_game() == GAME_IS_VANILLA)
+            {
+                snprintf(game_type_path, sizeof(game_type_path), "%s/%s", replay_folder, "vanilla");
+                replay_writer_create_marker(game_type_path);
+            }
+            else
+            {
+                DebugMessage(M64MSG_WARNING, "Unknown game type: %d", game_manager_get_game());
+            }
+            free(replay_folder);
         }
-        free(replay_folder);
     }
-    
-    last_game_state = current_game_state;
+    else if (current == REMIX_STATUS_MATCHEND && replay_manager_is_recording())
+    {
+        replay_manager_close();
+    }
 
-    int current_game_screen = game_manager_get_current_screen();
+    if (current == REMIX_STATUS_MATCHEND && l_BatchReplay)
+    {
+        l_BatchReplayStats.match_ended = 1;
+    }
+}
 
-    if (last_game_screen == REMIX_SCREEN_SSS &&
-        current_game_screen == REMIX_SCREEN_MATCH &&
-        recording_enabled)
+static void game_screen_changed(uint32_t previous, uint32_t current, void* opaque)
+{
+    if (previous == REMIX_SCREEN_SSS &&
+        current == REMIX_SCREEN_MATCH &&
+        replay_manager_is_enabled())
     {
         time_t now = time(0);
         struct tm tmv;
         localtime_s(&tmv, &now);
         strftime(timestamp_folder, sizeof(timestamp_folder), "%Y-%m-%dT%H@%M@%S", &tmv);
-        char* replay_folder = replay_manager_generate_path(timestamp_folder);
-        char state_path[1024];
-        snprintf(state_path, sizeof(state_path), "%s/%s", replay_folder, "state.st");
-        DebugMessage(M64MSG_INFO, "Creating replay save state: %s", state_path);
-        main_state_save(savestates_type_m64p, state_path);   
+        char* replay_folder = replay_manager_create_path(timestamp_folder);
+        if (replay_folder != NULL && !netplay_is_init())
+        {
+            char state_path[1024];
+            snprintf(state_path, sizeof(state_path), "%s/%s", replay_folder, "state.st");
+            if (savestates_get_job() != savestates_job_nothing)
+            {
+                /* don't drop a savestate the frontend already asked for */
+                DebugMessage(M64MSG_WARNING, "Savestate job pending, not creating replay save state: %s", state_path);
+            }
+            else
+            {
+                /* taken at the next interrupt of this instance, so on the same
+                 * frame relative to the screen change in every run */
+                DebugMessage(M64MSG_INFO, "Creating replay save state: %s", state_path);
+                savestates_set_job(savestates_job_save, savestates_type_m64p, state_path);
+            }
+        }
         free(replay_folder);
     }
+}
+
+static void av_dump_frame(void)
+{
+    /* the VI registers which set the size of the displayed image */
+    static const unsigned int mode_regs[] = {
+        VI_STATUS_REG, VI_WIDTH_REG, VI_H_START_REG, VI_V_START_REG, VI_X_SCALE_REG, VI_Y_SCALE_REG
+    };
+    const uint32_t* vi_regs = g_instance->dev->vi.regs;
+    int mode_changed = (l_AVDumpWidth <= 0 || l_AVDumpHeight <= 0);
+    int width, height;
+    void* pixels;
+    size_t i;
+
+    for (i = 0; i < sizeof(mode_regs) / sizeof(mode_regs[0]); ++i) {
+        if (l_AVDumpVIMode[i] != vi_regs[mode_regs[i]]) {
+            l_AVDumpVIMode[i] = vi_regs[mode_regs[i]];
+            mode_changed = 1;
+        }
+    }
+
+    /* the frame size only has to be queried again when the video mode changed */
+    if (mode_changed) {
+        l_AVDumpWidth = 640;
+        l_AVDumpHeight = 480;
+        gfx.readScreen(NULL, &l_AVDumpWidth, &l_AVDumpHeight, 0);
+    }
 
-    last_game_screen = current_game_screen;
+    width = l_AVDumpWidth;
+    height = l_AVDumpHeight;
+    pixels = l_iAVDump->get_frame_buffer(l_AVDump, (size_t)width * height * 3);
+    if (pixels == NULL)
+        return;
 
+    gfx.readScreen(pixels, &width, &height, 0);
+    l_iAVDump->push_frame(l_AVDump, width, height);
+}
+
+/* called on vertical interrupt.
+ * Allow the core to perform various things */
+void new_vi(void)
+{
+    /* one frame per VI keeps the video in step with the samples */
+    if (l_AVDump != NULL && !netplay_is_resimulating())
+        av_dump_frame();
+
+    game_manager_poll_watches();
 
 #if defined(PROFILE)
     timed_sections_refresh();
@@ -1181,18 +1459,28 @@ void new_vi(void)
 
     gs_apply_cheats(&g_cheat_ctx);
 
-    apply_speed_limiter();
+    if (l_BatchReplay)
+    {
+        /* no speed limiter, pause or netplay while batch replaying */
+        batch_replay_update();
+        main_check_inputs();
+        return;
+    }
+
+    /* frames simulated again by a netplay rollback run as fast as possible */
+    if (!netplay_is_resimulating())
+        apply_speed_limiter();
     main_check_inputs();
 
     pause_loop();
 
-    netplay_check_sync(&g_dev.r4300.cp0);
+    netplay_check_sync(g_instance->dev);
 
 }
 
 static void main_switch_pak(int control_id)
 {
-    struct game_controller* cont = &g_dev.controllers[control_id];
+    struct game_controller* cont = &g_instance->dev->controllers[control_id];
 
     change_pak(cont, l_paks[control_id][l_paks_idx[control_id]], l_ipaks[l_paks_idx[control_id]]);
 
@@ -1548,17 +1836,6 @@ static void close_dd_disk(struct dd_disk* disk)
 }
 
 
-struct gb_cart_data
-{
-    int control_id;
-    struct file_storage rom_fstorage;
-    struct file_storage ram_fstorage;
-    void* gbcam_backend;
-    const struct video_capture_backend_interface* igbcam_backend;
-};
-
-static struct gb_cart_data l_gb_carts_data[GAME_CONTROLLERS_COUNT];
-
 static void init_gb_rom(void* opaque, void** storage, const struct storage_backend_interface** istorage)
 {
     struct gb_cart_data* data = (struct gb_cart_data*)opaque;
@@ -1651,8 +1928,8 @@ static void release_gb_ram(void* opaque)
 
 void main_change_gb_cart(int control_id)
 {
-    struct transferpak* tpk = &g_dev.transferpaks[control_id];
-    struct gb_cart* gb_cart = &g_dev.gb_carts[control_id];
+    struct transferpak* tpk = &g_instance->dev->transferpaks[control_id];
+    struct gb_cart* gb_cart = &g_instance->dev->gb_carts[control_id];
     struct gb_cart_data* data = &l_gb_carts_data[control_id];
 
     /* reset gb_cart_data */
@@ -1690,8 +1967,8 @@ m64p_error main_run(void)
 {
 
     DebugMessage(M64MSG_INFO, "ROM MD5 hash: %s", ROM_SETTINGS.MD5);
-    // Auto-start Netplay if enabled
-    if (ConfigGetParamBool(g_CoreConfig, "Netplay"))
+    // Auto-start Netplay if enabled, only the default instance can netplay
+    if (core_instance_is_default() && ConfigGetParamBool(g_CoreConfig, "Netplay"))
     {
         const char *token = ConfigGetParamString(g_CoreConfig, "NetplayToken");
         const char *relay = ConfigGetParamString(g_CoreConfig, "NetplayRelayHost");
@@ -1720,6 +1997,7 @@ m64p_error main_run(void)
     uint32_t disable_extra_mem;
     int32_t si_dma_duration;
     int32_t no_compiled_jump;
+    int32_t fuse_ops;
     int32_t randomize_interrupt;
     struct file_storage eep;
     struct file_storage fla;
@@ -1756,11 +2034,18 @@ m64p_error main_run(void)
 
     /* take the r4300 emulator mode from the config file at this point and cache it in a global variable */
     emumode = ConfigGetParamInt(g_CoreConfig, "R4300Emulator");
+    /* the dynamic recompilers work on g_dev, which only the default instance uses */
+    if (emumode == EMUMODE_DYNAREC && !core_instance_is_default())
+    {
+        DebugMessage(M64MSG_WARNING, "Dynamic recompiler not available to secondary instances, using cached interpreter");
+        emumode = EMUMODE_INTERPRETER;
+    }
 
     /* set some other core parameters based on the config file values */
     savestates_set_autoinc_slot(ConfigGetParamBool(g_CoreConfig, "AutoStateSlotIncrement"));
     savestates_select_slot(ConfigGetParamInt(g_CoreConfig, "CurrentStateSlot"));
     no_compiled_jump = ConfigGetParamBool(g_CoreConfig, "NoCompiledJump");
+    fuse_ops = ConfigGetParamBool(g_CoreConfig, "FuseInstructions");
     //We disable any randomness for netplay
     randomize_interrupt = !netplay_is_init() ? ConfigGetParamBool(g_CoreConfig, "RandomizeInterrupt") : 0;
     count_per_op = ConfigGetParamInt(g_CoreConfig, "CountPerOp");
@@ -1872,7 +2157,7 @@ m64p_error main_run(void)
     void* joybus_devices[PIF_CHANNELS_COUNT];
     const struct joybus_device_interface* ijoybus_devices[PIF_CHANNELS_COUNT];
 
-    memset(&g_dev.gb_carts, 0, GAME_CONTROLLERS_COUNT*sizeof(*g_dev.gb_carts));
+    memset(&g_instance->dev->gb_carts, 0, GAME_CONTROLLERS_COUNT*sizeof(*g_instance->dev->gb_carts));
     memset(&l_gb_carts_data, 0, GAME_CONTROLLERS_COUNT*sizeof(*l_gb_carts_data));
     memset(cin_compats, 0, GAME_CONTROLLERS_COUNT*sizeof(*cin_compats));
 
@@ -1893,11 +2178,11 @@ m64p_error main_run(void)
         else if (Controls[i].Type == CONT_TYPE_VRU) {
             const struct game_controller_flavor* cont_flavor =
                 &g_vru_controller_flavor;
-            joybus_devices[i] = &g_dev.controllers[i];
+            joybus_devices[i] = &g_instance->dev->controllers[i];
             ijoybus_devices[i] = &g_ijoybus_vru_controller;
 
             cin_compats[i].control_id = (int)i;
-            cin_compats[i].cont = &g_dev.controllers[i];
+            cin_compats[i].cont = &g_instance->dev->controllers[i];
             cin_compats[i].last_pak_type = Controls[i].Plugin;
             cin_compats[i].last_input = 0;
             cin_compats[i].netplay_count = 0;
@@ -1908,7 +2193,7 @@ m64p_error main_run(void)
             Controls[i].Plugin = PLUGIN_NONE;
 
             /* init vru_controller */
-            init_game_controller(&g_dev.controllers[i],
+            init_game_controller(&g_instance->dev->controllers[i],
                     cont_flavor,
                     &cin_compats[i], &g_icontroller_input_backend_plugin_compat,
                     NULL, NULL);
@@ -1922,12 +2207,12 @@ m64p_error main_run(void)
             const struct game_controller_flavor* cont_flavor =
                 &g_standard_controller_flavor;
 
-            joybus_devices[i] = &g_dev.controllers[i];
+            joybus_devices[i] = &g_instance->dev->controllers[i];
             ijoybus_devices[i] = &g_ijoybus_device_controller;
 
             cin_compats[i].control_id = (int)i;
-            cin_compats[i].cont = &g_dev.controllers[i];
-            cin_compats[i].tpk = &g_dev.transferpaks[i];
+            cin_compats[i].cont = &g_instance->dev->controllers[i];
+            cin_compats[i].tpk = &g_instance->dev->transferpaks[i];
             cin_compats[i].last_pak_type = Controls[i].Plugin;
             cin_compats[i].last_input = 0;
             cin_compats[i].netplay_count = 0;
@@ -1951,8 +2236,8 @@ m64p_error main_run(void)
             for(k = 0; k < PAK_MAX_SIZE; ++k) {
                 /* Bio Pak */
                 if (l_ipaks[k] == &g_ibiopak) {
-                    init_biopak(&g_dev.biopaks[i], 64);
-                    l_paks[i][k] = &g_dev.biopaks[i];
+                    init_biopak(&g_instance->dev->biopaks[i], 64);
+                    l_paks[i][k] = &g_instance->dev->biopaks[i];
 
                     if (Controls[i].Plugin == PLUGIN_BIO_PAK) {
                         l_paks_idx[i] = k;
@@ -1965,8 +2250,8 @@ m64p_error main_run(void)
                     mpk_storages[i].offset = i * MEMPAK_SIZE;
                     mpk_storages[i].filename = (void*)&mpk; /* OK for isubfile_storage */
 
-                    init_mempak(&g_dev.mempaks[i], &mpk_storages[i], &g_isubfile_storage);
-                    l_paks[i][k] = &g_dev.mempaks[i];
+                    init_mempak(&g_instance->dev->mempaks[i], &mpk_storages[i], &g_isubfile_storage);
+                    l_paks[i][k] = &g_instance->dev->mempaks[i];
 
                     if (Controls[i].Plugin == PLUGIN_MEMPAK) {
                         l_paks_idx[i] = k;
@@ -1974,8 +2259,8 @@ m64p_error main_run(void)
                 }
                 /* Rumble Pak */
                 else if (l_ipaks[k] == &g_irumblepak) {
-                    init_rumblepak(&g_dev.rumblepaks[i], &control_ids[i], &g_irumble_backend_plugin_compat);
-                    l_paks[i][k] = &g_dev.rumblepaks[i];
+                    init_rumblepak(&g_instance->dev->rumblepaks[i], &control_ids[i], &g_irumble_backend_plugin_compat);
+                    l_paks[i][k] = &g_instance->dev->rumblepaks[i];
 
                     if (Controls[i].Plugin == PLUGIN_RUMBLE_PAK
                      || Controls[i].Plugin == PLUGIN_RAW) {
@@ -1986,15 +2271,15 @@ m64p_error main_run(void)
                 else if (l_ipaks[k] == &g_itransferpak) {
 
                     /* init GB cart */
-                    init_gb_cart(&g_dev.gb_carts[i],
+                    init_gb_cart(&g_instance->dev->gb_carts[i],
                             &l_gb_carts_data[i], init_gb_rom, release_gb_rom,
                             &l_gb_carts_data[i], init_gb_ram, release_gb_ram,
                             NULL, &g_iclock_ctime_plus_delta,
                             &l_gb_carts_data[i].control_id, &g_irumble_backend_plugin_compat,
                             l_gb_carts_data[i].gbcam_backend, l_gb_carts_data[i].igbcam_backend);
 
-                    init_transferpak(&g_dev.transferpaks[i], (g_dev.gb_carts[i].read_gb_cart == NULL) ? NULL : &g_dev.gb_carts[i]);
-                    l_paks[i][k] = &g_dev.transferpaks[i];
+                    init_transferpak(&g_instance->dev->transferpaks[i], (g_instance->dev->gb_carts[i].read_gb_cart == NULL) ? NULL : &g_instance->dev->gb_carts[i]);
+                    l_paks[i][k] = &g_instance->dev->transferpaks[i];
 
                     if (Controls[i].Plugin == PLUGIN_TRANSFER_PAK) {
                         l_paks_idx[i] = k;
@@ -2017,7 +2302,7 @@ m64p_error main_run(void)
             }
 
             /* init game_controller */
-            init_game_controller(&g_dev.controllers[i],
+            init_game_controller(&g_instance->dev->controllers[i],
                     cont_flavor,
                     &cin_compats[i], &g_icontroller_input_backend_plugin_compat,
                     l_paks[i][l_paks_idx[i]], l_ipaks[l_paks_idx[i]]);
@@ -2032,19 +2317,20 @@ m64p_error main_run(void)
         }
     }
     for (i = GAME_CONTROLLERS_COUNT; i < PIF_CHANNELS_COUNT; ++i) {
-        joybus_devices[i] = &g_dev.cart;
+        joybus_devices[i] = &g_instance->dev->cart;
         ijoybus_devices[i] = &g_ijoybus_device_cart;
     }
 
-    init_device(&g_dev,
+    init_device(g_instance->dev,
                 g_mem_base,
                 emumode,
                 count_per_op,
                 count_per_op_denom_pot,
                 no_compiled_jump,
+                fuse_ops,
                 randomize_interrupt,
                 g_start_address,
-                &g_dev.ai, &g_iaudio_out_backend_plugin_compat, ((float)ROM_SETTINGS.aidmamodifier / 100.0),
+                &g_instance->dev->ai, &l_iaudio_out_backend_av_dump, ((float)ROM_SETTINGS.aidmamodifier / 100.0),
                 si_dma_duration,
                 rdram_size,
                 joybus_devices, ijoybus_devices,
@@ -2075,52 +2361,78 @@ m64p_error main_run(void)
         goto on_input_open_failure;
     }
 
-    /* set up the SDL key repeat and event filter to catch keyboard/joystick commands for the core */
-    event_initialize();
-
     /* initialize frame counter */
     l_CurrentFrame = 0;
 
-    /* initialize the on-screen display */
-    if (ConfigGetParamBool(g_CoreConfig, "OnScreenDisplay"))
+    /* event loop, OSD, LIRC and debugger only serve the default instance */
+    if (core_instance_is_default())
     {
-        // init on-screen display
-        int width = 640, height = 480;
-        gfx.readScreen(NULL, &width, &height, 0); // read screen to get width and height
-        osd_init(width, height);
-    }
+        /* set up the SDL key repeat and event filter to catch keyboard/joystick commands for the core */
+        event_initialize();
+
+        /* initialize the on-screen display */
+        if (ConfigGetParamBool(g_CoreConfig, "OnScreenDisplay"))
+        {
+            // init on-screen display
+            int width = 640, height = 480;
+            gfx.readScreen(NULL, &width, &height, 0); // read screen to get width and height
+            osd_init(width, height);
+        }
 
-    // setup rendering callback from video plugin to the core, for screenshots and On-Screen-Display
-    gfx.setRenderingCallback(video_plugin_render_callback);
+        // setup rendering callback from video plugin to the core, for screenshots and On-Screen-Display
+        gfx.setRenderingCallback(video_plugin_render_callback);
 
 #ifdef WITH_LIRC
-    lircStart();
+        lircStart();
 #endif // WITH_LIRC
 
 #ifdef DBG
-    if (ConfigGetParamBool(g_CoreConfig, "EnableDebugger"))
-        init_debugger();
+        if (ConfigGetParamBool(g_CoreConfig, "EnableDebugger"))
+            init_debugger();
 #endif
 
+        /* frames are read back from the video plugin */
+        init_av_dump_backend();
+    }
+
     /* Startup message on the OSD */
     osd_new_message(OSD_MIDDLE_CENTER, "Mupen64Plus Started...");
 
     g_EmulatorRunning = 1;
     StateChanged(M64CORE_EMU_STATE, M64EMU_RUNNING);
 
-    poweron_device(&g_dev);
-    pif_bootrom_hle_execute(&g_dev.r4300);
+    poweron_device(g_instance->dev);
+    pif_bootrom_hle_execute(&g_instance->dev->r4300);
 
     /* Initialize Jimmi stuff*/
     frame_manager_init();
     input_manager_init();
     replay_manager_init();
-    playback_manager_init();
+    if (l_BatchReplay)
+        batch_replay_start();
+    else
+        playback_manager_init();
+    keyframe_manager_init();
+    hash_manager_init();
+    watch_manager_init();
+
+    /* Watch the game state for Jimmi replays */
+    game_manager_unwatch_all();
+    game_manager_watch(GAME_STATUS_ADDRESS, game_status_changed, NULL);
+    game_manager_watch(GAME_CURRENT_SCREEN_ADDRESS, game_screen_changed, NULL);
 
-    /* Get initial game state for Jimmi replays */
-    last_game_state = game_manager_get_game_status();
+    run_device(g_instance->dev);
+    release_tlb(&g_instance->dev->r4300.cp0.tlb);
 
-    run_device(&g_dev);
+    /* flush any replay still being recorded */
+    replay_manager_close();
+    watch_manager_close();
+    keyframe_manager_unload();
+    savestates_release_buffers();
+
+    if (l_BatchReplay)
+        batch_replay_finish();
+    hash_manager_unload();
 
     if (netplay_is_init())
     {
@@ -2133,17 +2445,22 @@ m64p_error main_run(void)
     
 
     /* now begin to shut down */
+    if (core_instance_is_default())
+    {
 #ifdef WITH_LIRC
-    lircStop();
+        lircStop();
 #endif // WITH_LIRC
 
 #ifdef DBG
-    if (g_DebuggerActive)
-        destroy_debugger();
+        if (g_DebuggerActive)
+            destroy_debugger();
 #endif
+
+        release_av_dump_backend();
+    }
     /* release gb_carts */
     for(i = 0; i < GAME_CONTROLLERS_COUNT; ++i) {
-        if (!Controls[i].RawData  && (Controls[i].Type == CONT_TYPE_STANDARD) && g_dev.gb_carts[i].read_gb_cart != NULL) {
+        if (!Controls[i].RawData  && (Controls[i].Type == CONT_TYPE_STANDARD) && g_instance->dev->gb_carts[i].read_gb_cart != NULL) {
             release_gb_rom(&l_gb_carts_data[i]);
             release_gb_ram(&l_gb_carts_data[i]);
         }
@@ -2165,7 +2482,7 @@ m64p_error main_run(void)
     /* reset pif */
     close_pif();
 
-    if (ConfigGetParamBool(g_CoreConfig, "OnScreenDisplay"))
+    if (core_instance_is_default() && ConfigGetParamBool(g_CoreConfig, "OnScreenDisplay"))
     {
         osd_exit();
     }
@@ -2192,7 +2509,7 @@ on_audio_open_failure:
 on_gfx_open_failure:
     /* release gb_carts */
     for(i = 0; i < GAME_CONTROLLERS_COUNT; ++i) {
-        if (!Controls[i].RawData  && (Controls[i].Type == CONT_TYPE_STANDARD) && g_dev.gb_carts[i].read_gb_cart != NULL) {
+        if (!Controls[i].RawData  && (Controls[i].Type == CONT_TYPE_STANDARD) && g_instance->dev->gb_carts[i].read_gb_cart != NULL) {
             release_gb_rom(&l_gb_carts_data[i]);
             release_gb_ram(&l_gb_carts_data[i]);
         }
@@ -2243,7 +2560,7 @@ void main_stop(void)
         StateChanged(M64CORE_EMU_STATE, M64EMU_RUNNING);
     }
 
-    stop_device(&g_dev);
+    stop_device(g_instance->dev);
 
 #ifdef DBG
     if(g_DebuggerActive)
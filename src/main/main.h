@@ -28,6 +28,7 @@
 #include "api/m64p_types.h"
 #include "main/cheat.h"
 #include "device/device.h"
+#include "main/instance.h"
 #include "osal/preproc.h"
 
 #if defined(__GNUC__)
@@ -40,26 +41,25 @@
 extern m64p_handle g_CoreConfig;
 
 extern int g_RomWordsLittleEndian;
-extern int g_EmulatorRunning;
-extern int g_rom_pause;
-
-extern struct cheat_ctx g_cheat_ctx;
-
-extern void* g_mem_base;
 
+/* device of the default instance, use g_instance->dev instead */
 extern struct device g_dev;
 
-extern m64p_media_loader g_media_loader;
-
 extern m64p_frame_callback g_FrameCallback;
 
-extern int g_gs_vi_counter;
-
-extern struct controller_input_compat* g_cin_by_port[];
+/* per-instance globals, see main/instance.h */
+#define g_EmulatorRunning (g_instance->main.emulator_running)
+#define g_rom_pause       (g_instance->main.rom_pause)
+#define g_cheat_ctx       (g_instance->main.cheat_ctx)
+#define g_mem_base        (g_instance->mem_base)
+#define g_media_loader    (g_instance->main.media_loader)
+#define g_gs_vi_counter   (g_instance->main.gs_vi_counter)
+#define g_cin_by_port     (g_instance->main.cin_by_port)
 
 const char* get_savestatepath(void);
 const char* get_savesrampath(void);
 const char* get_savestatefilename(void);
+const char* get_dynarec_cachepath(void);
 
 void new_frame(void);
 void new_vi(void);
@@ -83,10 +83,17 @@ void main_speedlimiter_toggle(void);
 
 void main_take_next_screenshot(void);
 
+int main_is_batch_replay(void);
+int main_is_av_dumping(void);
+m64p_error main_set_batch_replay(const char *replay_folder);
+m64p_error main_get_batch_replay_stats(m64p_batch_replay_stats *stats);
+
 void main_state_set_slot(int slot);
 void main_state_inc_slot(void);
 void main_state_load(const char *filename);
 void main_state_save(int format, const char *filename);
+void main_state_snapshot(void *buffer, size_t size);
+void main_state_restore(void *buffer, size_t size);
 
 m64p_error main_core_state_query(m64p_core_param param, int *rval);
 m64p_error main_core_state_set(m64p_core_param param, int val);
@@ -24,13 +24,20 @@
 #define M64P_CORE_PROTOTYPES 1
 #include <enet/enet.h>
 #include "api/callbacks.h"
+#include "api/config.h"
+#include "api/m64p_config.h"
 #include "main.h"
 #include "util.h"
 #include "plugin/plugin.h"
 #include "backends/plugins_compat/plugins_compat.h"
 #include "netplay.h"
+#include "rollback.h"
+#include "device/device.h"
 #include <string.h>
 
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
 // Methods to streamline writing/reading ENet values to emulator
 static inline void Net_Write32(uint32_t value, void *areap)
 {
@@ -45,6 +52,17 @@ static inline uint32_t Net_Read32(const void *areap)
     return ENET_NET_TO_HOST_32(temp);
 }
 
+static inline void Net_Write64(uint64_t value, void *areap)
+{
+    Net_Write32((uint32_t)(value >> 32), areap);
+    Net_Write32((uint32_t)value, (uint8_t*)areap + 4);
+}
+
+static inline uint64_t Net_Read64(const void *areap)
+{
+    return ((uint64_t)Net_Read32(areap) << 32) | Net_Read32((const uint8_t*)areap + 4);
+}
+
 static inline void Net_Write16(uint16_t value, void *areap)
 {
     uint16_t temp = ENET_HOST_TO_NET_16(value);
@@ -83,6 +101,33 @@ static uint32_t l_cached_inputs[4] = { 0u, 0u, 0u, 0u };
 
 static uint32_t l_sync_vi = 0xffffffffu; // The last VI on which a sync happened
 static uint32_t l_sync_regs[CP0_REGS_COUNT];
+static int l_sync_sent = 0; // Registers are only sent once every input of their VI is known
+static uint32_t l_remote_sync_vi = 0xffffffffu; // Registers of the other player, waiting for ours
+static uint32_t l_remote_sync_regs[CP0_REGS_COUNT];
+
+// RDRAM is hashed a slice per VI, over the first SYNC_HASH_SLICES VIs of each interval
+#define SYNC_HASH_SLICES 16
+#define SYNC_HASH_MIN_INTERVAL SYNC_HASH_SLICES
+#define SYNC_HASH_MAX_INTERVAL 3600
+
+struct sync_hash {
+    uint32_t vi; // First VI of the interval
+    uint64_t digest; // Of the slices and the GPRs
+    uint64_t slices[SYNC_HASH_SLICES];
+    uint64_t gprs[32];
+};
+
+static uint16_t l_sync_hash_interval = 0; // 0 to compare CP0 registers instead
+static struct sync_hash l_sync_hash;
+static int l_sync_hash_state = 0; // Slices hashed, then SYNC_HASH_SLICES + 1 once sent
+static struct sync_hash l_remote_sync_hash;
+static int l_remote_sync_hash_valid = 0;
+static uint32_t l_sync_hash_matched_vi = 0xffffffffu; // Last interval both players agreed on
+static int l_sync_hash_diverged = 0;
+
+static uint8_t l_rollback_frames = 0; // Frames remote inputs can be predicted ahead, 0 to delay inputs instead
+static uint32_t l_rollback_vi = ROLLBACK_NONE; // First VI that ran with a wrong prediction
+static uint32_t l_latest_count[4]; // Most recent VI a player sent input for
 
 static uint8_t* l_incoming_data = NULL;
 static size_t l_incoming_size = 0;
@@ -97,6 +142,7 @@ static const int32_t l_check_sync_packet_size = (CP0_REGS_COUNT * 4) + 5;
 #define PACKET_REQUEST_KEY_INFO 2
 #define PACKET_RECEIVE_KEY_INFO_GRATUITOUS 3
 #define PACKET_SYNC_DATA 4
+#define PACKET_SYNC_HASH 5
 #define PACKET_SEND_SAVE 10
 #define PACKET_RECEIVE_SAVE 11
 #define PACKET_SEND_SETTINGS 12
@@ -142,10 +188,15 @@ typedef struct {
 // Circular buffer for inputs, should be more efficient for FIFO
 input_slot l_input_ring[4][INPUT_BUF];
 
+// Remote inputs a VI ran with before they arrived, checked when they do
+input_slot l_predicted[4][INPUT_BUF];
+
 #define RELAY_DATA_PORT 27015 // Server port for relaying packets
 #define RELAY_CTRL_PORT 27016 // Server port for establishing connection
 
 #define NETPLAY_DEFAULT_INPUT_DELAY 6
+#define NETPLAY_ROLLBACK_INPUT_DELAY 1
+#define NETPLAY_MAX_ROLLBACK_FRAMES 30
 
 // Disconnect helper
 static void disconnect_and_cleanup(void);
@@ -168,6 +219,23 @@ m64p_error netplay_start(const char* relay_host, const char* token, int is_host)
 
     l_is_host = (is_host == 1);
 
+    // The host decides, the client is told at registration
+    int rollback_frames = l_is_host ? ConfigGetParamInt(g_CoreConfig, "NetplayRollback") : 0;
+    if (rollback_frames < 0)
+        rollback_frames = 0;
+    if (rollback_frames > NETPLAY_MAX_ROLLBACK_FRAMES)
+        rollback_frames = NETPLAY_MAX_ROLLBACK_FRAMES;
+    l_rollback_frames = (uint8_t)rollback_frames;
+
+    int sync_hash_interval = l_is_host ? ConfigGetParamInt(g_CoreConfig, "NetplaySyncHash") : 0;
+    if (sync_hash_interval <= 0)
+        sync_hash_interval = 0;
+    else if (sync_hash_interval < SYNC_HASH_MIN_INTERVAL)
+        sync_hash_interval = SYNC_HASH_MIN_INTERVAL;
+    else if (sync_hash_interval > SYNC_HASH_MAX_INTERVAL)
+        sync_hash_interval = SYNC_HASH_MAX_INTERVAL;
+    l_sync_hash_interval = (uint16_t)sync_hash_interval;
+
     if (enet_initialize() != 0)
     {
         DebugMessage(M64MSG_ERROR, "Netplay: ENet init failed.");
@@ -314,8 +382,13 @@ m64p_error netplay_start(const char* relay_host, const char* token, int is_host)
         l_plugin[i] = 0;
         l_player_lag[i] = 0;
         l_last_inputs[i] = 0;
+        l_latest_count[i] = 0;
         l_early_events[i] = NULL;
-        for (int j = 0; j < INPUT_BUF; ++j) l_input_ring[i][j].valid = 0;
+        for (int j = 0; j < INPUT_BUF; ++j)
+        {
+            l_input_ring[i][j].valid = 0;
+            l_predicted[i][j].valid = 0;
+        }
     }
 
     l_canFF = 0;
@@ -325,11 +398,27 @@ m64p_error netplay_start(const char* relay_host, const char* token, int is_host)
     l_vi_counter = 0;
     l_status = 0;
     l_reg_id = 0;
-    l_buffer_target = NETPLAY_DEFAULT_INPUT_DELAY;
+    l_buffer_target = l_rollback_frames ? NETPLAY_ROLLBACK_INPUT_DELAY : NETPLAY_DEFAULT_INPUT_DELAY;
+    l_rollback_vi = ROLLBACK_NONE;
+    l_sync_vi = 0xffffffffu;
+    l_sync_sent = 0;
+    l_remote_sync_vi = 0xffffffffu;
+    l_sync_hash_state = 0;
+    l_remote_sync_hash_valid = 0;
+    l_sync_hash_matched_vi = 0xffffffffu;
+    l_sync_hash_diverged = 0;
 
     if (l_incoming_data) { free(l_incoming_data); l_incoming_data = NULL; }
     l_incoming_size = 0;
 
+    // The client is told about rollback at registration, so the host must know now whether it can
+    if (l_rollback_frames != 0 && !rollback_init(l_rollback_frames))
+    {
+        DebugMessage(M64MSG_WARNING, "Netplay: Rollback unavailable, delaying inputs instead.");
+        l_rollback_frames = 0;
+        l_buffer_target = NETPLAY_DEFAULT_INPUT_DELAY;
+    }
+
     DebugMessage(M64MSG_INFO, "Netplay: connected. is_host=%d", l_is_host);
     return M64ERR_SUCCESS;
 }
@@ -409,6 +498,9 @@ disconnect_success:
     l_peer = NULL;
     l_is_host = 0;
     l_netplay_is_init = 0;
+
+    rollback_deinit();
+    l_rollback_frames = 0;
     
     if (l_incoming_data)
         free(l_incoming_data);
@@ -436,6 +528,107 @@ static int check_valid(uint8_t control_id, uint32_t count)
     return 0;
 }
 
+// Store an input received from the other player
+static void netplay_store_input(uint8_t player, uint32_t count, uint32_t inputs, uint8_t plugin)
+{
+    int idx = count % INPUT_BUF;
+    l_input_ring[player][idx].count = count;
+    l_input_ring[player][idx].inputs = inputs;
+    l_input_ring[player][idx].plugin = plugin;
+    l_input_ring[player][idx].valid = 1;
+
+    if (l_rollback_frames == 0)
+        return;
+
+    // Predictions repeat the most recent input
+    if (count >= l_latest_count[player])
+    {
+        l_latest_count[player] = count;
+        l_last_inputs[player] = inputs;
+    }
+
+    // A VI already ran with a guess for this input, roll back if it was wrong
+    if (l_predicted[player][idx].valid && l_predicted[player][idx].count == count)
+    {
+        if (l_predicted[player][idx].inputs != inputs && count < l_rollback_vi)
+            l_rollback_vi = count;
+        l_predicted[player][idx].valid = 0;
+    }
+}
+
+// Whether the inputs of every player are known up to this VI
+static int netplay_is_confirmed(uint32_t vi)
+{
+    if (l_rollback_frames == 0 || vi < (uint32_t)l_buffer_target)
+        return 1;
+
+    // Inputs are sent reliably in rollback mode, so they arrive in order
+    for (int i = 0; i < 4; ++i)
+    {
+        if (Controls[i].Present == 1 && l_netplay_control[i] == -1 && !check_valid((uint8_t)i, vi))
+            return 0;
+    }
+    return 1;
+}
+
+static void netplay_compare_sync(void)
+{
+    if (!l_sync_sent || l_remote_sync_vi != l_sync_vi)
+        return;
+
+    int error = 0;
+    for (int i = 0; i < CP0_REGS_COUNT; ++i)
+    {
+        if (l_remote_sync_regs[i] != l_sync_regs[i])
+        {
+            DebugMessage(M64MSG_ERROR, "Netplay: Sync Error at VI %u. Reg %d: Local %X Remote %X", (unsigned)l_sync_vi, i, l_sync_regs[i], l_remote_sync_regs[i]);
+            error = 1;
+        }
+    }
+
+    if (error)
+    {
+        DebugMessage(M64MSG_ERROR, "Netplay: Synchronization failure detected.");
+    }
+    l_remote_sync_vi = 0xffffffffu;
+}
+
+static void netplay_compare_sync_hash(void)
+{
+    if (l_sync_hash_state <= SYNC_HASH_SLICES || !l_remote_sync_hash_valid || l_remote_sync_hash.vi != l_sync_hash.vi)
+        return;
+    l_remote_sync_hash_valid = 0;
+
+    if (l_remote_sync_hash.digest == l_sync_hash.digest)
+    {
+        l_sync_hash_matched_vi = l_sync_hash.vi;
+        return;
+    }
+
+    // Once diverged every later hash differs too, only the first one tells something
+    if (l_sync_hash_diverged)
+        return;
+    l_sync_hash_diverged = 1;
+
+    uint32_t last_vi = l_sync_hash.vi + SYNC_HASH_SLICES - 1;
+    if (l_sync_hash_matched_vi == 0xffffffffu)
+        DebugMessage(M64MSG_ERROR, "Netplay: Desync detected by VI %u, no earlier hash matched", (unsigned)last_vi);
+    else
+        DebugMessage(M64MSG_ERROR, "Netplay: Desync detected between VI %u and VI %u", (unsigned)(l_sync_hash_matched_vi + SYNC_HASH_SLICES - 1), (unsigned)last_vi);
+
+    uint32_t slice_size = (uint32_t)(g_instance->dev->rdram.dram_size / SYNC_HASH_SLICES);
+    for (int i = 0; i < SYNC_HASH_SLICES; ++i)
+    {
+        if (l_remote_sync_hash.slices[i] != l_sync_hash.slices[i])
+            DebugMessage(M64MSG_ERROR, "Netplay: RDRAM 0x%08X-0x%08X differs (hashed at VI %u)", i * slice_size, (i + 1) * slice_size - 1, (unsigned)(l_sync_hash.vi + i));
+    }
+    for (int i = 0; i < 32; ++i)
+    {
+        if (l_remote_sync_hash.gprs[i] != l_sync_hash.gprs[i])
+            DebugMessage(M64MSG_ERROR, "Netplay: GPR %d differs at VI %u. Local %llX Remote %llX", i, (unsigned)last_vi, (unsigned long long)l_sync_hash.gprs[i], (unsigned long long)l_remote_sync_hash.gprs[i]);
+    }
+}
+
 static void netplay_poll(void)
 {
     ENetEvent event;
@@ -468,26 +661,27 @@ static void netplay_poll(void)
                         case PACKET_SYNC_DATA:
                             if (len < l_check_sync_packet_size) break;
 
-                            uint32_t sync_vi = Net_Read32(&data[1]);
-                            
-                            if (sync_vi == l_sync_vi)
+                            l_remote_sync_vi = Net_Read32(&data[1]);
+                            for (int i = 0; i < CP0_REGS_COUNT; ++i)
                             {
-                                int error = 0;
-                                for (int i = 0; i < CP0_REGS_COUNT; ++i)
-                                {
-                                    uint32_t val = Net_Read32(&data[(i * 4) + 5]);
-                                    if (val != l_sync_regs[i])
-                                    {
-                                        DebugMessage(M64MSG_ERROR, "Netplay: Sync Error at VI %u. Reg %d: Local %X Remote %X", (unsigned)sync_vi, i, l_sync_regs[i], val);
-                                        error = 1;
-                                    }
-                                }
+                                l_remote_sync_regs[i] = Net_Read32(&data[(i * 4) + 5]);
+                            }
+                            netplay_compare_sync();
+                            break;
+                        case PACKET_SYNC_HASH:
+                            if (len < 5 + 8 * (1 + SYNC_HASH_SLICES + 32)) break;
 
-                                if (error)
-                                {
-                                    DebugMessage(M64MSG_ERROR, "Netplay: Synchronization failure detected.");
-                                }
+                            l_remote_sync_hash.vi = Net_Read32(&data[1]);
+                            {
+                                size_t curr = 5;
+                                l_remote_sync_hash.digest = Net_Read64(&data[curr]); curr += 8;
+                                for (int i = 0; i < SYNC_HASH_SLICES; ++i, curr += 8)
+                                    l_remote_sync_hash.slices[i] = Net_Read64(&data[curr]);
+                                for (int i = 0; i < 32; ++i, curr += 8)
+                                    l_remote_sync_hash.gprs[i] = Net_Read64(&data[curr]);
                             }
+                            l_remote_sync_hash_valid = 1;
+                            netplay_compare_sync_hash();
                             break;
                         case PACKET_REGISTER_PLAYER: // Server side handler
                             if (l_is_host)
@@ -511,8 +705,9 @@ static void netplay_poll(void)
                             if (l_is_host)
                             {
                                 // DebugMessage(M64MSG_INFO, "Netplay: Client requested registration");
-                                // Send 24 bytes of registration info wrapped in packet
-                                uint8_t resp[25] = {0};
+                                // Send 24 bytes of registration info wrapped in packet, then the input delay,
+                                // rollback frames and sync hash interval
+                                uint8_t resp[29] = {0};
                                 resp[0] = PACKET_RECEIVE_REGISTRATION;
                                 
                                 uint32_t curr = 1;
@@ -528,8 +723,11 @@ static void netplay_poll(void)
                                 // P4
                                 Net_Write32(0, &resp[curr]); curr+=4;
                                 resp[curr++] = PLUGIN_NONE; resp[curr++] = 0;
+                                resp[curr++] = l_buffer_target;
+                                resp[curr++] = l_rollback_frames;
+                                Net_Write16(l_sync_hash_interval, &resp[curr]); curr+=2;
                                 
-                                ENetPacket* p = enet_packet_create(resp, 25, ENET_PACKET_FLAG_RELIABLE);
+                                ENetPacket* p = enet_packet_create(resp, 29, ENET_PACKET_FLAG_RELIABLE);
                                 enet_peer_send(event.peer, 0, p);
                             }
                             break;
@@ -560,11 +758,7 @@ static void netplay_poll(void)
                                 }
                                 if (!check_valid(player, count))
                                 {
-                                    int idx = count % INPUT_BUF;
-                                    l_input_ring[player][idx].count = count;
-                                    l_input_ring[player][idx].inputs = inputs;
-                                    l_input_ring[player][idx].plugin = plugin;
-                                    l_input_ring[player][idx].valid = 1;
+                                    netplay_store_input(player, count, inputs, plugin);
                                 }
                             }
                             break;
@@ -617,11 +811,7 @@ static void netplay_poll(void)
                                 uint8_t plugin = data[curr];
                                 curr += 1;
                                 
-                                int idx = count % INPUT_BUF;
-                                l_input_ring[player][idx].count = count;
-                                l_input_ring[player][idx].inputs = inputs;
-                                l_input_ring[player][idx].plugin = plugin;
-                                l_input_ring[player][idx].valid = 1;
+                                netplay_store_input(player, count, inputs, plugin);
                             }
                             break;
                         }
@@ -680,26 +870,41 @@ static uint32_t netplay_get_input_for_vi(uint8_t control_id, uint32_t vi)
 
     main_core_state_set(M64CORE_SPEED_LIMITER, 1);
     l_canFF = 0;
+
+    // With rollback, only wait when the input is too old to roll back to
+    uint32_t wait_vi = vi;
+    if (l_rollback_frames != 0)
+    {
+        wait_vi = (vi >= (uint32_t)l_buffer_target + l_rollback_frames) ? vi - l_rollback_frames : ROLLBACK_NONE;
+    }
     
     uint32_t start_wait = SDL_GetTicks();
-    while (!check_valid(control_id, vi) && (SDL_GetTicks() - start_wait) < 500)
+    while (wait_vi != ROLLBACK_NONE && !check_valid(control_id, wait_vi) && (SDL_GetTicks() - start_wait) < 500)
     {
         netplay_poll();
-        if (check_valid(control_id, vi))
+        if (check_valid(control_id, wait_vi))
             break;
         SDL_Delay(1);
     }
 
+    int idx = vi % INPUT_BUF;
     if (check_valid(control_id, vi))
     {
-        int idx = vi % INPUT_BUF;
         inputs = l_input_ring[control_id][idx].inputs;
         Controls[control_id].Plugin = l_input_ring[control_id][idx].plugin;
-        l_last_inputs[control_id] = inputs;
+        if (l_rollback_frames == 0)
+            l_last_inputs[control_id] = inputs;
+        l_predicted[control_id][idx].valid = 0;
     }
     else
     {
         inputs = l_last_inputs[control_id];
+        if (l_rollback_frames != 0)
+        {
+            l_predicted[control_id][idx].count = vi;
+            l_predicted[control_id][idx].inputs = inputs;
+            l_predicted[control_id][idx].valid = 1;
+        }
     }
     
     return inputs;
@@ -730,7 +935,7 @@ static void netplay_send_scheduled_input(uint8_t control_id, uint32_t vi, uint32
         Net_Write32(keys, &pkt[9]);
         pkt[13] = l_plugin[control_id];
 
-        ENetPacket* p = enet_packet_create(pkt, 14, 0);
+        ENetPacket* p = enet_packet_create(pkt, 14, l_rollback_frames ? ENET_PACKET_FLAG_RELIABLE : 0);
         enet_peer_send(l_peer, 0, p);
     }
     else
@@ -742,7 +947,7 @@ static void netplay_send_scheduled_input(uint8_t control_id, uint32_t vi, uint32
         Net_Write32(keys, &pkt[6]);
         pkt[10] = l_plugin[control_id];
 
-        ENetPacket* p = enet_packet_create(pkt, 11, 0);
+        ENetPacket* p = enet_packet_create(pkt, 11, l_rollback_frames ? ENET_PACKET_FLAG_RELIABLE : 0);
         enet_peer_send(l_peer, 1, p);
     }
 }
@@ -1006,36 +1211,129 @@ void netplay_sync_settings(uint32_t *count_per_op, uint32_t *count_per_op_denom_
     }
 }
 
-void netplay_check_sync(struct cp0* cp0)
+static void netplay_check_sync_hash(struct device* dev)
 {
-    if (!netplay_is_init())
-        return;
+    uint32_t phase = l_vi_counter % l_sync_hash_interval;
 
-    // Check sync every 600 frames
-    if (l_vi_counter % 600 == 0)
+    if (phase == 0)
     {
-        const uint32_t* cp0_regs = r4300_cp0_regs(cp0);
+        l_sync_hash.vi = l_vi_counter;
+        l_sync_hash_state = 0;
+    }
+
+    // One slice of RDRAM per VI keeps the cost of a frame low
+    if (phase < SYNC_HASH_SLICES && l_sync_hash_state == (int)phase && l_sync_hash.vi + phase == l_vi_counter)
+    {
+        size_t slice_size = dev->rdram.dram_size / SYNC_HASH_SLICES;
 
-        l_sync_vi = l_vi_counter;
-        for (int i = 0; i < CP0_REGS_COUNT; ++i)
+        l_sync_hash.slices[phase] = XXH3_64bits((const uint8_t*)dev->rdram.dram + phase * slice_size, slice_size);
+        if (phase == SYNC_HASH_SLICES - 1)
         {
-            l_sync_regs[i] = cp0_regs[i];
+            const int64_t* regs = r4300_regs(&dev->r4300);
+            for (int i = 0; i < 32; ++i)
+            {
+                l_sync_hash.gprs[i] = (uint64_t)regs[i];
+            }
+            l_sync_hash.digest = XXH3_64bits_withSeed(l_sync_hash.gprs, sizeof(l_sync_hash.gprs),
+                XXH3_64bits(l_sync_hash.slices, sizeof(l_sync_hash.slices)));
         }
+        ++l_sync_hash_state;
+    }
 
-        uint8_t data[ (CP0_REGS_COUNT * 4) + 5 ];
+    // A VI that ran with predicted inputs may still be simulated again
+    if (l_sync_hash_state == SYNC_HASH_SLICES && netplay_is_confirmed(l_sync_hash.vi + SYNC_HASH_SLICES - 1))
+    {
+        uint8_t data[5 + 8 * (1 + SYNC_HASH_SLICES + 32)];
+        size_t curr = 0;
+
+        data[curr++] = PACKET_SYNC_HASH;
+        Net_Write32(l_sync_hash.vi, &data[curr]); curr += 4;
+        Net_Write64(l_sync_hash.digest, &data[curr]); curr += 8;
+        for (int i = 0; i < SYNC_HASH_SLICES; ++i, curr += 8)
+            Net_Write64(l_sync_hash.slices[i], &data[curr]);
+        for (int i = 0; i < 32; ++i, curr += 8)
+            Net_Write64(l_sync_hash.gprs[i], &data[curr]);
+
+        ENetPacket* packet = enet_packet_create(data, curr, ENET_PACKET_FLAG_RELIABLE);
+        enet_peer_send(l_peer, 0, packet);
 
-        data[0] = PACKET_SYNC_DATA;
-        Net_Write32(l_vi_counter, &data[1]); //current VI count
-        for (int i = 0; i < CP0_REGS_COUNT; ++i)
+        l_sync_hash_state = SYNC_HASH_SLICES + 1;
+        netplay_compare_sync_hash();
+    }
+}
+
+void netplay_check_sync(struct device* dev)
+{
+    if (!netplay_is_init())
+        return;
+
+    if (l_sync_hash_interval != 0)
+    {
+        netplay_check_sync_hash(dev);
+    }
+    else
+    {
+        // Check sync every 600 frames
+        if (l_vi_counter % 600 == 0)
         {
-            Net_Write32(cp0_regs[i], &data[(i * 4) + 5]);
+            const uint32_t* cp0_regs = r4300_cp0_regs(&dev->r4300.cp0);
+
+            l_sync_vi = l_vi_counter;
+            l_sync_sent = 0;
+            for (int i = 0; i < CP0_REGS_COUNT; ++i)
+            {
+                l_sync_regs[i] = cp0_regs[i];
+            }
         }
+
+        // A VI that ran with predicted inputs may still be simulated again
+        if (!l_sync_sent && l_sync_vi != 0xffffffffu && netplay_is_confirmed(l_sync_vi))
+        {
+            uint8_t data[ (CP0_REGS_COUNT * 4) + 5 ];
+
+            data[0] = PACKET_SYNC_DATA;
+            Net_Write32(l_sync_vi, &data[1]);
+            for (int i = 0; i < CP0_REGS_COUNT; ++i)
+            {
+                Net_Write32(l_sync_regs[i], &data[(i * 4) + 5]);
+            }
         
-        ENetPacket* packet = enet_packet_create(data, (CP0_REGS_COUNT * 4) + 5, ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(l_peer, 0, packet);
+            ENetPacket* packet = enet_packet_create(data, (CP0_REGS_COUNT * 4) + 5, ENET_PACKET_FLAG_RELIABLE);
+            enet_peer_send(l_peer, 0, packet);
+
+            l_sync_sent = 1;
+            netplay_compare_sync();
+        }
     }
 
     ++l_vi_counter;
+
+    if (l_rollback_frames != 0)
+    {
+        // Pick up the inputs that arrived during the frame before deciding
+        netplay_poll();
+        rollback_on_vi(l_vi_counter, l_rollback_vi);
+        l_rollback_vi = ROLLBACK_NONE;
+    }
+}
+
+void netplay_rewind(uint32_t vi)
+{
+    l_vi_counter = vi;
+
+    // Slices hashed from the frames about to run again are stale
+    if (l_sync_hash_state <= SYNC_HASH_SLICES && vi >= l_sync_hash.vi && vi - l_sync_hash.vi < (uint32_t)l_sync_hash_state)
+        l_sync_hash_state = (int)(vi - l_sync_hash.vi);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        l_cached_vi[i] = 0xffffffffu;
+    }
+}
+
+int netplay_is_resimulating(void)
+{
+    return l_rollback_frames != 0 && rollback_is_resimulating();
 }
 
 static void netplay_flush_early_buffer(void)
@@ -1133,6 +1431,17 @@ void netplay_read_registration(struct controller_input_compat* cin_compats)
             l_incoming_size >= 25)
         {
             memcpy(input_data, &l_incoming_data[1], 24);
+
+            // Hosts before rollback only send the players
+            if (l_incoming_size >= 27)
+            {
+                l_buffer_target = l_incoming_data[25];
+                l_rollback_frames = l_incoming_data[26];
+            }
+            if (l_incoming_size >= 29)
+            {
+                l_sync_hash_interval = Net_Read16(&l_incoming_data[27]);
+            }
             free(l_incoming_data); l_incoming_data = NULL;
             break;
         }
@@ -1187,6 +1496,15 @@ void netplay_read_registration(struct controller_input_compat* cin_compats)
     //     }
     // }
     
+    // Both players must agree on the rollback window, so the host may not
+    // turn it off here: a client that cannot allocate it gives up instead
+    if (l_rollback_frames != 0 && !rollback_init(l_rollback_frames))
+    {
+        DebugMessage(M64MSG_ERROR, "Netplay: Rollback unavailable, leaving the session.");
+        disconnect_and_cleanup();
+        return;
+    }
+
     // Send Ready Signal
     output_data = PACKET_CLIENT_READY;
     packet = enet_packet_create(&output_data, 1, ENET_PACKET_FLAG_RELIABLE);
@@ -1207,6 +1525,8 @@ static void netplay_send_raw_input(struct pif* pif)
             {
                 if (l_last_send_vi[i] == vi) // Already sent for this VI, continue
                     continue;
+                if (netplay_is_resimulating()) // Sent when the VI first ran
+                    continue;
                 l_last_send_vi[i] = vi;
 
                 uint32_t keys_now = *(uint32_t*)pif->channels[i].rx_buf;
@@ -40,6 +40,7 @@ struct netplay_event {
 };
 
 struct controller_input_compat;
+struct device;
 
 #ifdef M64P_NETPLAY
 
@@ -52,13 +53,17 @@ int netplay_is_init();
 int netplay_get_controller(uint8_t player);
 file_status_t netplay_read_storage(const char *filename, void *data, size_t size);
 void netplay_sync_settings(uint32_t *count_per_op, uint32_t *count_per_op_denom_pot, uint32_t *disable_extra_mem, int32_t *si_dma_duration, uint32_t *emumode, int32_t *no_compiled_jump);
-void netplay_check_sync(struct cp0* cp0);
+void netplay_check_sync(struct device* dev);
 int netplay_next_controller();
 void netplay_read_registration(struct controller_input_compat* cin_compats);
 void netplay_update_input(struct pif* pif);
 m64p_error netplay_send_config(char* data, int size);
 m64p_error netplay_receive_config(char* data, int size);
 
+// Rollback: called once an older VI was restored, and while the VIs after it run again
+void netplay_rewind(uint32_t vi);
+int netplay_is_resimulating(void);
+
 #else
 
 m64p_error netplay_start(const char* relay_host, const char* token, int is_server);
@@ -104,7 +109,7 @@ static osal_inline void netplay_sync_settings(uint32_t *count_per_op, uint32_t *
 {
 }
 
-static osal_inline void netplay_check_sync(struct cp0* cp0)
+static osal_inline void netplay_check_sync(struct device* dev)
 {
 }
 
@@ -135,6 +140,15 @@ static osal_inline m64p_error netplay_receive_config(char* data, int size)
     return M64ERR_INCOMPATIBLE;
 }
 
+static osal_inline void netplay_rewind(uint32_t vi)
+{
+}
+
+static osal_inline int netplay_is_resimulating(void)
+{
+    return 0;
+}
+
 #endif
 
 #endif
@@ -0,0 +1,279 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rollback.c                                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "api/callbacks.h"
+#include "api/m64p_types.h"
+#include "jimmi/frame_manager.h"
+#include "jimmi/input_manager.h"
+#include "main/netplay.h"
+#include "main/rollback.h"
+#include "main/savestates.h"
+
+/* Deltas are taken against one of two full states. The base is replaced
+ * once deltas grow past ROLLBACK_REBASE_SIZE, keeping the previous one for
+ * the frames still in the window, so at least a window of frames must go
+ * by between two replacements. */
+#define ROLLBACK_REBASE_SIZE (1024 * 1024)
+#define ROLLBACK_INITIAL_CAPACITY (256 * 1024)
+
+struct rollback_frame
+{
+    uint32_t vi;
+    uint64_t frame_index;
+    unsigned int base;
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+};
+
+static struct rollback_frame* l_frames = NULL;
+static unsigned int l_frame_count = 0;
+
+static unsigned char* l_bases[2] = { NULL, NULL };
+static unsigned int l_active_base = 0;
+static uint32_t l_rebase_vi = ROLLBACK_NONE; /* when the active base was taken */
+
+static int l_job = ROLLBACK_JOB_NONE;
+static uint32_t l_vi = 0;           /* frame about to start */
+static uint32_t l_target_vi = 0;    /* frame to capture or restore */
+static uint32_t l_resume_vi = 0;    /* first frame presented again after a rollback */
+
+int rollback_init(unsigned int frames)
+{
+    unsigned int i;
+
+    rollback_deinit();
+
+    /* the frame about to start is kept too */
+    l_frame_count = frames + 1;
+    l_frames = calloc(l_frame_count, sizeof(*l_frames));
+    l_bases[0] = malloc(savestates_get_memory_size());
+    l_bases[1] = malloc(savestates_get_memory_size());
+    if (l_frames == NULL || l_bases[0] == NULL || l_bases[1] == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Netplay: Failed to allocate rollback states");
+        rollback_deinit();
+        return 0;
+    }
+
+    for (i = 0; i < l_frame_count; i++)
+        l_frames[i].vi = ROLLBACK_NONE;
+
+    DebugMessage(M64MSG_INFO, "Netplay: Rolling back up to %u frames", frames);
+    return 1;
+}
+
+void rollback_deinit(void)
+{
+    unsigned int i;
+
+    if (l_frames != NULL)
+    {
+        for (i = 0; i < l_frame_count; i++)
+            free(l_frames[i].data);
+        free(l_frames);
+    }
+    l_frames = NULL;
+    l_frame_count = 0;
+
+    if (l_bases[0] != NULL || l_bases[1] != NULL)
+        savestates_clear_delta_base();
+    free(l_bases[0]);
+    free(l_bases[1]);
+    l_bases[0] = NULL;
+    l_bases[1] = NULL;
+    l_active_base = 0;
+    l_rebase_vi = ROLLBACK_NONE;
+
+    l_job = ROLLBACK_JOB_NONE;
+    l_vi = 0;
+    l_resume_vi = 0;
+}
+
+static struct rollback_frame* rollback_find(uint32_t vi)
+{
+    struct rollback_frame* frame = &l_frames[vi % l_frame_count];
+    return (frame->vi == vi) ? frame : NULL;
+}
+
+void rollback_on_vi(uint32_t vi, uint32_t mispredicted_vi)
+{
+    if (l_frames == NULL)
+        return;
+
+    l_vi = vi;
+
+    /* a restore gen_interrupt could not run yet still has to happen */
+    if (l_job == ROLLBACK_JOB_RESTORE && l_target_vi < mispredicted_vi)
+        mispredicted_vi = l_target_vi;
+
+    if (mispredicted_vi < vi)
+    {
+        if (rollback_find(mispredicted_vi) != NULL)
+        {
+            l_job = ROLLBACK_JOB_RESTORE;
+            l_target_vi = mispredicted_vi;
+            if (l_resume_vi < vi)
+                l_resume_vi = vi;
+            return;
+        }
+
+        DebugMessage(M64MSG_ERROR, "Netplay: Cannot roll back to VI %u from VI %u, players will desync",
+            mispredicted_vi, vi);
+    }
+
+    l_job = ROLLBACK_JOB_CAPTURE;
+    l_target_vi = vi;
+}
+
+int rollback_is_resimulating(void)
+{
+    return l_vi < l_resume_vi;
+}
+
+int rollback_get_job(void)
+{
+    return l_job;
+}
+
+static int rollback_rebase(uint32_t vi)
+{
+    unsigned int base = (l_rebase_vi == ROLLBACK_NONE) ? 0 : (l_active_base ^ 1);
+    unsigned int i;
+
+    if (!savestates_save_memory(l_bases[base], savestates_get_memory_size())
+        || !savestates_set_delta_base(l_bases[base], savestates_get_memory_size()))
+    {
+        return 0;
+    }
+
+    /* frames against the base being replaced are gone */
+    for (i = 0; i < l_frame_count; i++)
+    {
+        if (l_frames[i].base == base)
+            l_frames[i].vi = ROLLBACK_NONE;
+    }
+
+    l_active_base = base;
+    l_rebase_vi = vi;
+    return 1;
+}
+
+static void rollback_capture(void)
+{
+    struct rollback_frame* frame = &l_frames[l_target_vi % l_frame_count];
+    size_t max_size = savestates_get_delta_max_size();
+
+    frame->vi = ROLLBACK_NONE;
+
+    /* the initial netplay state replaces this one, frames before it are gone */
+    if (savestates_get_job() == savestates_job_load)
+    {
+        unsigned int i;
+        for (i = 0; i < l_frame_count; i++)
+            l_frames[i].vi = ROLLBACK_NONE;
+        l_rebase_vi = ROLLBACK_NONE;
+        return;
+    }
+
+    if (l_rebase_vi == ROLLBACK_NONE && !rollback_rebase(l_target_vi))
+        return;
+
+    if (frame->data == NULL)
+    {
+        frame->capacity = ROLLBACK_INITIAL_CAPACITY;
+        frame->data = malloc(frame->capacity);
+    }
+
+    frame->size = (frame->data != NULL) ? savestates_save_delta(frame->data, frame->capacity) : 0;
+    if (frame->size == 0 && frame->capacity < max_size)
+    {
+        unsigned char* grown = realloc(frame->data, max_size);
+        if (grown != NULL)
+        {
+            frame->data = grown;
+            frame->capacity = max_size;
+            frame->size = savestates_save_delta(frame->data, frame->capacity);
+        }
+    }
+
+    if (frame->size == 0)
+    {
+        DebugMessage(M64MSG_ERROR, "Netplay: Failed to capture rollback state for VI %u", l_target_vi);
+        return;
+    }
+
+    frame->vi = l_target_vi;
+    frame->frame_index = frame_manager_get_frame_index();
+    frame->base = l_active_base;
+
+    /* once deltas get large a new base pays off, the next frame uses it */
+    if (frame->size > ROLLBACK_REBASE_SIZE && l_target_vi - l_rebase_vi >= l_frame_count)
+        rollback_rebase(l_target_vi);
+}
+
+static void rollback_restore(void)
+{
+    struct rollback_frame* frame = rollback_find(l_target_vi);
+    int loaded;
+
+    if (frame == NULL)
+        return;
+
+    if (frame->base != l_active_base)
+    {
+        savestates_set_delta_base(l_bases[frame->base], savestates_get_memory_size());
+        loaded = savestates_load_delta(frame->data, frame->size);
+        savestates_set_delta_base(l_bases[l_active_base], savestates_get_memory_size());
+    }
+    else
+    {
+        loaded = savestates_load_delta(frame->data, frame->size);
+    }
+
+    if (!loaded)
+    {
+        DebugMessage(M64MSG_ERROR, "Netplay: Failed to roll back to VI %u, players will desync", l_target_vi);
+        return;
+    }
+
+    /* the state was captured once the inputs of its frame were latched */
+    frame_manager_set_frame_index(frame->frame_index);
+    input_manager_latch_for_frame(frame->frame_index);
+
+    l_vi = l_target_vi;
+    netplay_rewind(l_target_vi);
+}
+
+void rollback_run_job(void)
+{
+    int current = l_job;
+
+    l_job = ROLLBACK_JOB_NONE;
+
+    if (current == ROLLBACK_JOB_CAPTURE)
+        rollback_capture();
+    else if (current == ROLLBACK_JOB_RESTORE)
+        rollback_restore();
+}
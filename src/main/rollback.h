@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rollback.h                                               *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_ROLLBACK_H
+#define M64P_MAIN_ROLLBACK_H
+
+#include <stdint.h>
+
+#include "osal/preproc.h"
+
+/* Rollback netplay: the state at the start of each of the last frames is
+ * kept as an incremental savestate, so when a remote input contradicts the
+ * prediction a frame ran with, that frame is restored and the following
+ * ones are simulated again with the corrected inputs, without being shown
+ * or heard. */
+
+enum
+{
+    ROLLBACK_JOB_NONE,
+    ROLLBACK_JOB_CAPTURE,
+    ROLLBACK_JOB_RESTORE
+};
+
+/* no rollback, see rollback_on_vi */
+#define ROLLBACK_NONE 0xffffffffu
+
+#ifdef M64P_NETPLAY
+
+int rollback_init(unsigned int frames);
+void rollback_deinit(void);
+
+/* Called by netplay on every VI with the frame about to start, and the
+ * first frame that ran with a wrong prediction if there is one */
+void rollback_on_vi(uint32_t vi, uint32_t mispredicted_vi);
+int rollback_is_resimulating(void);
+
+/* Deferred work, run by gen_interrupt when it is safe to touch the whole device */
+int rollback_get_job(void);
+void rollback_run_job(void);
+
+#else
+
+static osal_inline int rollback_init(unsigned int frames)
+{
+    return 0;
+}
+
+static osal_inline void rollback_deinit(void)
+{
+}
+
+static osal_inline void rollback_on_vi(uint32_t vi, uint32_t mispredicted_vi)
+{
+}
+
+static osal_inline int rollback_is_resimulating(void)
+{
+    return 0;
+}
+
+static osal_inline int rollback_get_job(void)
+{
+    return ROLLBACK_JOB_NONE;
+}
+
+static osal_inline void rollback_run_job(void)
+{
+}
+
+#endif
+
+#endif /* M64P_MAIN_ROLLBACK_H */
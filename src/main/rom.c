@@ -62,13 +62,6 @@ static romdatabase_entry* ini_search_by_md5(md5_byte_t* md5);
 
 static _romdatabase g_romdatabase;
 
-/* Global loaded rom size. */
-int g_rom_size = 0;
-
-m64p_rom_header   ROM_HEADER;
-rom_params        ROM_PARAMS;
-m64p_rom_settings ROM_SETTINGS;
-
 static m64p_system_type rom_country_code_to_system_type(uint16_t country_code);
 
 static unsigned char rom_homebrew_savetype_to_savetype(uint8_t save_type);
@@ -44,8 +44,6 @@ m64p_error close_rom(void);
 m64p_error open_disk(void);
 m64p_error close_disk(void);
 
-extern int g_rom_size;
-
 typedef struct _rom_params
 {
    char *cheats;
@@ -53,9 +51,11 @@ typedef struct _rom_params
    char headername[21];  /* ROM Name as in the header, removing trailing whitespace */
 } rom_params;
 
-extern m64p_rom_header   ROM_HEADER;
-extern rom_params        ROM_PARAMS;
-extern m64p_rom_settings ROM_SETTINGS;
+/* per-instance, see main/instance.h */
+#define g_rom_size   (g_instance->rom.size)
+#define ROM_HEADER   (g_instance->rom.header)
+#define ROM_PARAMS   (g_instance->rom.params)
+#define ROM_SETTINGS (g_instance->rom.settings)
 
 /* Supported rom compressiontypes. */
 enum 
@@ -159,5 +159,7 @@ void romdatabase_close(void);
  */
 romdatabase_entry* ini_search_by_crc(unsigned int crc1, unsigned int crc2);
 
+#include "main/instance.h"
+
 #endif /* __ROM_H__ */
 
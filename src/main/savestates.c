@@ -52,6 +52,9 @@
 #include "util.h"
 #include "workqueue.h"
 
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
 enum { GB_CART_FINGERPRINT_SIZE = 0x1c };
 enum { GB_CART_FINGERPRINT_OFFSET = 0x134 };
 
@@ -61,15 +64,66 @@ static const char* savestate_magic = "M64+SAVE";
 static const int savestate_latest_version = 0x00010900;  /* 1.9 */
 static const unsigned char pj64_magic[4] = { 0xC8, 0xA6, 0xD8, 0x23 };
 
-static savestates_job job = savestates_job_nothing;
-static savestates_type type = savestates_type_unknown;
-static char *fname = NULL;
+/* per-instance, see main/instance.h */
+#define job      (g_instance->savestates.job)
+#define job_type (g_instance->savestates.type)
+#define fname    (g_instance->savestates.fname)
+#define mem_buffer (g_instance->savestates.mem_buffer)
+#define mem_size   (g_instance->savestates.mem_size)
+
+#define save_buffers (g_instance->savestates.save_buffers)
+#define save_written (g_instance->savestates.save_written)
+#define save_next    (g_instance->savestates.save_next)
+
+#define delta_base        (g_instance->savestates.delta_base)
+#define delta_base_hash   (g_instance->savestates.delta_base_hash)
+#define delta_page_hashes (g_instance->savestates.delta_page_hashes)
+#define delta_scratch     (g_instance->savestates.delta_scratch)
 
-static unsigned int slot = 0;
-static int autoinc_save_slot = 0;
+#define slot              (g_instance->savestates.slot)
+#define autoinc_save_slot (g_instance->savestates.autoinc_save_slot)
 
 static SDL_mutex *savestates_lock;
 
+/* header (44) + device state + event queue (1024) + using_tlb (4) + extra state (4096) */
+#define M64P_SAVESTATE_SIZE (16788288 + 1024 + 4 + 4096)
+
+/* The large arrays of an m64p image, which incremental savestates
+ * compare page by page instead of byte by byte */
+enum
+{
+    SAVESTATE_REGION_RDRAM,
+    SAVESTATE_REGION_LUT_R,
+    SAVESTATE_REGION_LUT_W,
+    SAVESTATE_REGIONS
+};
+
+struct savestate_region {
+    const void *src;    /* device memory */
+    uint32_t *const *lut; /* or TLB lookup table, see savestates_region_page */
+    size_t offset;      /* in the image */
+    size_t size;
+};
+
+/* Incremental savestates: the image is split in pages and a delta only
+ * holds the pages that differ from the base image, as patches of
+ * consecutive bytes. Deltas are in host byte order and only meant
+ * for the process that saved them. */
+enum { DELTA_PAGE_SIZE = 0x1000 };
+static const char* delta_magic = "M64+DLTA";
+
+struct delta_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t patch_count;
+    uint64_t base_hash;
+};
+
+struct delta_patch {
+    uint32_t offset;
+    uint32_t length;
+};
+
 struct savestate_work {
     char *filepath;
     char *data;
@@ -160,9 +214,18 @@ void savestates_set_job(savestates_job j, savestates_type t, const char *fn)
     }
 
     job = j;
-    type = t;
+    job_type = t;
     if (fn != NULL)
         fname = strdup(fn);
+    mem_buffer = NULL;
+    mem_size = 0;
+}
+
+void savestates_set_memory_job(savestates_job j, unsigned char *buffer, size_t size)
+{
+    savestates_set_job(j, savestates_type_memory, NULL);
+    mem_buffer = buffer;
+    mem_size = size;
 }
 
 static void savestates_clear_job(void)
@@ -185,13 +248,34 @@ static void savestates_clear_job(void)
 #define PUTDATA(buff, type, value) \
     do { type x = value; PUTARRAY(&x, buff, type, 1); } while(0)
 
+/* Loads a TLB lookup table stored as 0x100000 words. Leaves are only
+ * allocated for the ranges holding mapped pages. */
+static unsigned char *savestates_get_lut(uint32_t **lut, unsigned char *curr)
+{
+    const unsigned char *values = (const unsigned char *)GETARRAY(curr, uint32_t, 0x100000);
+    uint32_t page;
+    uint32_t value;
+
+    tlb_lut_reset(lut);
+    for (page = 0; page < 0x100000; page++)
+    {
+        memcpy(&value, values + page * sizeof(value), sizeof(value));
+        if (value != 0)
+            tlb_lut_set(lut, page, value);
+    }
+
+    return curr;
+}
+
+static void savestates_load_m64p_data(struct device* dev, unsigned int version,
+                                      unsigned char *savestateData, char *queue,
+                                      unsigned char *using_tlb_data, unsigned char *data_0001_0200);
+
 static int savestates_load_m64p(struct device* dev, char *filepath)
 {
     unsigned char header[44];
     gzFile f;
     unsigned int version;
-    int i;
-    uint32_t FCR31;
 
     size_t savestateSize;
     unsigned char *savestateData, *curr;
@@ -199,8 +283,6 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
     unsigned char using_tlb_data[4];
     unsigned char data_0001_0200[4096]; // 4k for extra state from v1.2
 
-    uint32_t* cp0_regs = r4300_cp0_regs(&dev->r4300.cp0);
-
     SDL_LockMutex(savestates_lock);
 
     f = osal_gzopen(filepath, "rb");
@@ -253,7 +335,7 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
 
     /* Read the rest of the savestate */
     savestateSize = 16788244;
-    savestateData = curr = (unsigned char *)malloc(savestateSize);
+    savestateData = (unsigned char *)malloc(savestateSize);
     if (savestateData == NULL)
     {
         main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
@@ -304,6 +386,25 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
     gzclose(f);
     SDL_UnlockMutex(savestates_lock);
 
+    savestates_load_m64p_data(dev, version, savestateData, queue, using_tlb_data, data_0001_0200);
+
+    free(savestateData);
+    // main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State loaded from: %s", namefrompath(filepath));
+    return 1;
+}
+
+/* Restores the device from the uncompressed body of a m64p savestate (everything
+ * after the 44 bytes header). Buffers are byte swapped in place on big endian hosts. */
+static void savestates_load_m64p_data(struct device* dev, unsigned int version,
+                                      unsigned char *savestateData, char *queue,
+                                      unsigned char *using_tlb_data, unsigned char *data_0001_0200)
+{
+    int i;
+    uint32_t FCR31;
+    unsigned char *curr = savestateData;
+
+    uint32_t* cp0_regs = r4300_cp0_regs(&dev->r4300.cp0);
+
     // Parse savestate
     dev->rdram.regs[0][RDRAM_CONFIG_REG]       = GETDATA(curr, uint32_t);
     dev->rdram.regs[0][RDRAM_DEVICE_ID_REG]    = GETDATA(curr, uint32_t);
@@ -428,8 +529,9 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
     /* by default, reset flashram state here and load it later if available */
     poweron_flashram(&dev->cart.flashram);
 
-    COPYARRAY(dev->r4300.cp0.tlb.LUT_r, curr, uint32_t, 0x100000);
-    COPYARRAY(dev->r4300.cp0.tlb.LUT_w, curr, uint32_t, 0x100000);
+    curr = savestates_get_lut(dev->r4300.cp0.tlb.LUT_r, curr);
+    curr = savestates_get_lut(dev->r4300.cp0.tlb.LUT_w, curr);
+    tlb_micro_flush(&dev->r4300.cp0.tlb);
 
     *r4300_llbit(&dev->r4300) = GETDATA(curr, uint32_t);
     COPYARRAY(r4300_regs(&dev->r4300), curr, int64_t, 32);
@@ -953,10 +1055,6 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
     dev->r4300.cp0.interrupt_unsafe_state = 0;
 
     *r4300_cp0_last_addr(&dev->r4300.cp0) = *r4300_pc(&dev->r4300);
-
-    free(savestateData);
-    // main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State loaded from: %s", namefrompath(filepath));
-    return 1;
 }
 
 static int savestates_load_pj64(struct device* dev,
@@ -1181,8 +1279,9 @@ static int savestates_load_pj64(struct device* dev,
     dev->si.regs[SI_STATUS_REG]         = GETDATA(curr, uint32_t);
 
     // tlb
-    memset(dev->r4300.cp0.tlb.LUT_r, 0, 0x400000);
-    memset(dev->r4300.cp0.tlb.LUT_w, 0, 0x400000);
+    tlb_lut_reset(dev->r4300.cp0.tlb.LUT_r);
+    tlb_lut_reset(dev->r4300.cp0.tlb.LUT_w);
+    tlb_micro_flush(&dev->r4300.cp0.tlb);
     for (i=0; i < 32; i++)
     {
         unsigned int MyPageMask, MyEntryHi, MyEntryLo0, MyEntryLo1;
@@ -1404,32 +1503,40 @@ int savestates_load(void)
     char *filepath = NULL;
     int ret = 0;
 
+    if (job_type == savestates_type_memory)
+    {
+        ret = savestates_load_memory(mem_buffer, mem_size);
+        StateChanged(M64CORE_STATE_LOADCOMPLETE, ret);
+        savestates_clear_job();
+        return ret;
+    }
+
     if (fname == NULL) // For slots, autodetect the savestate type
     {
         // try M64P type first
-        type = savestates_type_m64p;
-        filepath = savestates_generate_path(type);
+        job_type = savestates_type_m64p;
+        filepath = savestates_generate_path(job_type);
         fPtr = osal_file_open(filepath, "rb"); // can I open this?
         if (fPtr == NULL)
         {
             free(filepath);
             // try PJ64 zipped type second
-            type = savestates_type_pj64_zip;
-            filepath = savestates_generate_path(type);
+            job_type = savestates_type_pj64_zip;
+            filepath = savestates_generate_path(job_type);
             fPtr = osal_file_open(filepath, "rb"); // can I open this?
             if (fPtr == NULL)
             {
                 free(filepath);
                 // finally, try PJ64 uncompressed
-                type = savestates_type_pj64_unc;
-                filepath = savestates_generate_path(type);
+                job_type = savestates_type_pj64_unc;
+                filepath = savestates_generate_path(job_type);
                 fPtr = osal_file_open(filepath, "rb"); // can I open this?
                 if (fPtr == NULL)
                 {
                     free(filepath);
                     filepath = NULL;
                     main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "No Mupen64Plus/PJ64 state file found for slot %i", slot);
-                    type = savestates_type_unknown;
+                    job_type = savestates_type_unknown;
                 }
             }
         }
@@ -1437,11 +1544,11 @@ int savestates_load(void)
     else // filename of state file to load was set explicitly in 'fname'
     {
         // detect type if unknown
-        if (type == savestates_type_unknown)
+        if (job_type == savestates_type_unknown)
         {
-            type = savestates_detect_type(fname);
+            job_type = savestates_detect_type(fname);
         }
-        filepath = savestates_generate_path(type);
+        filepath = savestates_generate_path(job_type);
         if (filepath != NULL)
             fPtr = osal_file_open(filepath, "rb"); // can I open this?
         if (fPtr == NULL)
@@ -1458,9 +1565,9 @@ int savestates_load(void)
 
     if (filepath != NULL)
     {
-        struct device* dev = &g_dev;
+        struct device* dev = g_instance->dev;
 
-        switch (type)
+        switch (job_type)
         {
             case savestates_type_m64p: ret = savestates_load_m64p(dev, filepath); break;
             case savestates_type_pj64_zip: ret = savestates_load_pj64_zip(dev, filepath); break;
@@ -1493,7 +1600,9 @@ static void savestates_save_m64p_work(struct work_struct *work)
     if (f==NULL)
     {
         main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", save->filepath);
-        free(save->data);
+        free(save->filepath);
+        free(save);
+        SDL_UnlockMutex(savestates_lock);
         StateChanged(M64CORE_STATE_SAVECOMPLETE, 0);
         return;
     }
@@ -1503,14 +1612,15 @@ static void savestates_save_m64p_work(struct work_struct *work)
     {
         main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not write data to state file: %s", save->filepath);
         gzclose(f);
-        free(save->data);
+        free(save->filepath);
+        free(save);
+        SDL_UnlockMutex(savestates_lock);
         StateChanged(M64CORE_STATE_SAVECOMPLETE, 0);
         return;
     }
 
     gzclose(f);
     //main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Saved state to: %s", namefrompath(save->filepath));
-    free(save->data);
     free(save->filepath);
     free(save);
 
@@ -1518,46 +1628,93 @@ static void savestates_save_m64p_work(struct work_struct *work)
     StateChanged(M64CORE_STATE_SAVECOMPLETE, 1);
 }
 
-static int savestates_save_m64p(const struct device* dev, char *filepath)
+/* Stores count words of device memory at curr. With a region the words
+ * are not copied, only their place in the image is recorded. */
+static unsigned char *savestates_put_region(unsigned char *curr, const unsigned char *data,
+                                            const uint32_t *src, size_t count,
+                                            struct savestate_region *region)
 {
-    unsigned char outbuf[4];
-    int i;
-
-    char queue[1024];
+    if (region == NULL)
+    {
+        PUTARRAY(src, curr, uint32_t, count);
+        return curr;
+    }
 
-    struct savestate_work *save;
-    char *curr;
+    region->src = src;
+    region->lut = NULL;
+    region->offset = curr - data;
+    region->size = count * sizeof(uint32_t);
+    return curr + region->size;
+}
 
-    /* OK to cast away const qualifier */
-    const uint32_t* cp0_regs = r4300_cp0_regs((struct cp0*)&dev->r4300.cp0);
+/* Same as savestates_put_region for a TLB lookup table, which is
+ * stored as 0x100000 words, unallocated leaves as zeros. */
+static unsigned char *savestates_put_lut(unsigned char *curr, const unsigned char *data,
+                                         uint32_t *const *lut, struct savestate_region *region)
+{
+    size_t i;
 
-    save = malloc(sizeof(*save));
-    if (!save) {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
-        StateChanged(M64CORE_STATE_SAVECOMPLETE, 0);
-        return 0;
+    if (region == NULL)
+    {
+        for (i = 0; i < TLB_LUT_LEAVES; i++)
+        {
+            if (lut[i] != NULL)
+            {
+                PUTARRAY(lut[i], curr, uint32_t, TLB_LUT_LEAF_SIZE);
+            }
+            else
+            {
+                memset(curr, 0, TLB_LUT_LEAF_SIZE * sizeof(uint32_t));
+                curr += TLB_LUT_LEAF_SIZE * sizeof(uint32_t);
+            }
+        }
+        return curr;
     }
 
-    save->filepath = strdup(filepath);
+    region->src = NULL;
+    region->lut = lut;
+    region->offset = curr - data;
+    region->size = TLB_LUT_LEAVES * TLB_LUT_LEAF_SIZE * sizeof(uint32_t);
+    return curr + region->size;
+}
 
-    if(autoinc_save_slot)
-        savestates_inc_slot();
+/* Returns the device memory of the region page at offset. Pages of a
+ * TLB lookup table leaf that is not allocated read as zeros. */
+static const unsigned char *savestates_region_page(const struct savestate_region *region, size_t offset)
+{
+    static const uint32_t zero_page[DELTA_PAGE_SIZE / sizeof(uint32_t)];
+    const size_t leaf_size = TLB_LUT_LEAF_SIZE * sizeof(uint32_t);
+    const uint32_t *leaf;
 
-    save_eventqueue_infos(&dev->r4300.cp0, queue);
+    if (region->lut == NULL)
+        return (const unsigned char *)region->src + offset;
 
-    // Allocate memory for the save state data
-    save->size = 16788288 + sizeof(queue) + 4 + 4096;
-    save->data = curr = malloc(save->size);
-    if (save->data == NULL)
-    {
-        free(save->filepath);
-        free(save);
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
-        StateChanged(M64CORE_STATE_SAVECOMPLETE, 0);
-        return 0;
-    }
+    leaf = region->lut[offset / leaf_size];
+    if (leaf == NULL)
+        return (const unsigned char *)zero_page;
+
+    return (const unsigned char *)leaf + offset % leaf_size;
+}
+
+/* Serializes the device into an uncompressed m64p savestate image
+ * of M64P_SAVESTATE_SIZE bytes, header included. With regions, the
+ * large arrays (see SAVESTATE_REGION_*) are left out of the image. */
+static void savestates_save_m64p_data(const struct device* dev, unsigned char *data,
+                                      struct savestate_region *regions)
+{
+    unsigned char outbuf[4];
+    int i;
 
-    memset(save->data, 0, save->size);
+    char queue[1024];
+    unsigned char *curr = data;
+
+    /* OK to cast away const qualifier */
+    const uint32_t* cp0_regs = r4300_cp0_regs((struct cp0*)&dev->r4300.cp0);
+
+    /* every byte of the image is written below, unused ones as zeros, so
+     * the buffer does not need clearing first */
+    memset(queue, 0, sizeof(queue));
+    save_eventqueue_infos(&dev->r4300.cp0, queue);
 
     // Write the save state data to memory
     PUTARRAY(savestate_magic, curr, unsigned char, 8);
@@ -1710,15 +1867,19 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
     PUTDATA(curr, uint32_t, dev->dp.dps_regs[DPS_BUFTEST_ADDR_REG]);
     PUTDATA(curr, uint32_t, dev->dp.dps_regs[DPS_BUFTEST_DATA_REG]);
 
-    PUTARRAY(dev->rdram.dram, curr, uint32_t, RDRAM_MAX_SIZE/4);
+    curr = savestates_put_region(curr, data, dev->rdram.dram, RDRAM_MAX_SIZE/4,
+                                 regions ? &regions[SAVESTATE_REGION_RDRAM] : NULL);
     PUTARRAY(dev->sp.mem, curr, uint32_t, SP_MEM_SIZE/4);
     PUTARRAY(dev->pif.ram, curr, uint8_t, PIF_RAM_SIZE);
 
     PUTDATA(curr, int32_t, dev->cart.use_flashram);
+    memset(curr, 0, 4+8+4+4);
     curr += 4+8+4+4; // Here used to be flashram state
 
-    PUTARRAY(dev->r4300.cp0.tlb.LUT_r, curr, uint32_t, 0x100000);
-    PUTARRAY(dev->r4300.cp0.tlb.LUT_w, curr, uint32_t, 0x100000);
+    curr = savestates_put_lut(curr, data, dev->r4300.cp0.tlb.LUT_r,
+                              regions ? &regions[SAVESTATE_REGION_LUT_R] : NULL);
+    curr = savestates_put_lut(curr, data, dev->r4300.cp0.tlb.LUT_w,
+                              regions ? &regions[SAVESTATE_REGION_LUT_W] : NULL);
 
     /* OK to cast away const qualifier */
     PUTDATA(curr, uint32_t, *r4300_llbit((struct r4300_core*)&dev->r4300));
@@ -1854,6 +2015,7 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
 
     if (disk_id == NULL) {
         PUTDATA(curr, uint32_t, 0);
+        memset(curr, 0, (3+DD_ASIC_REGS_COUNT)*sizeof(uint32_t) + 0x100 + 0x40 + 2*sizeof(int64_t) + 2*sizeof(uint32_t));
         curr += (3+DD_ASIC_REGS_COUNT)*sizeof(uint32_t) + 0x100 + 0x40 + 2*sizeof(int64_t) + 2*sizeof(uint32_t);
     }
     else {
@@ -1916,12 +2078,329 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
     PUTDATA(curr, uint64_t, *r4300_cp0_latch((struct cp0*)&dev->r4300.cp0));
     PUTDATA(curr, uint64_t, *r4300_cp2_latch((struct cp2*)&dev->r4300.cp2));
 
-    init_work(&save->work, savestates_save_m64p_work);
+    /* rest of the extra state area */
+    memset(curr, 0, data + M64P_SAVESTATE_SIZE - curr);
+}
+
+static int savestates_save_m64p(const struct device* dev, char *filepath)
+{
+    struct savestate_work *save;
+    unsigned int i = save_next;
+
+    if (save_buffers[i] == NULL)
+    {
+        save_buffers[i] = malloc(M64P_SAVESTATE_SIZE);
+        save_written[i].done = 1;
+    }
+
+    save = malloc(sizeof(*save));
+    if (!save || save_buffers[i] == NULL) {
+        free(save);
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
+        StateChanged(M64CORE_STATE_SAVECOMPLETE, 0);
+        return 0;
+    }
+
+    save->filepath = strdup(filepath);
+
+    if(autoinc_save_slot)
+        savestates_inc_slot();
+
+    /* the buffer is free again once the save queued two saves ago is written */
+    wait_for_completion(&save_written[i]);
+    save_next = i ^ 1;
+
+    save->size = M64P_SAVESTATE_SIZE;
+    save->data = (char *)save_buffers[i];
+
+    savestates_save_m64p_data(dev, save_buffers[i], NULL);
+
+    init_work(&save->work, savestates_save_m64p_work, WORK_CLASS_SAVESTATE);
+    init_completion(&save_written[i]);
+    save->work.completion = &save_written[i];
     queue_work(&save->work);
 
     return 1;
 }
 
+void savestates_release_buffers(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (save_buffers[i] == NULL)
+            continue;
+
+        wait_for_completion(&save_written[i]);
+        free(save_buffers[i]);
+        save_buffers[i] = NULL;
+    }
+    save_next = 0;
+
+    savestates_clear_delta_base();
+}
+
+size_t savestates_get_memory_size(void)
+{
+    return M64P_SAVESTATE_SIZE;
+}
+
+int savestates_save_memory(unsigned char *buffer, size_t size)
+{
+    if (buffer == NULL || size < M64P_SAVESTATE_SIZE)
+        return 0;
+
+    savestates_save_m64p_data(g_instance->dev, buffer, NULL);
+    return 1;
+}
+
+int savestates_load_memory(unsigned char *buffer, size_t size)
+{
+    const size_t body_size = 16788244;
+    unsigned char *curr = buffer;
+    unsigned int version;
+
+    if (buffer == NULL || size < M64P_SAVESTATE_SIZE)
+        return 0;
+
+    if (strncmp((char *)curr, savestate_magic, 8) != 0)
+    {
+        DebugMessage(M64MSG_ERROR, "In-memory state is not a valid Mupen64plus savestate.");
+        return 0;
+    }
+    curr += 8;
+
+    version = *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    if (version != savestate_latest_version)
+    {
+        DebugMessage(M64MSG_ERROR, "In-memory state version (%08x) doesn't match this core.", version);
+        return 0;
+    }
+
+    if (memcmp((char *)curr, ROM_SETTINGS.MD5, 32))
+    {
+        DebugMessage(M64MSG_ERROR, "In-memory state ROM MD5 does not match current ROM.");
+        return 0;
+    }
+    curr += 32;
+
+    savestates_load_m64p_data(g_instance->dev, version, curr,
+                              (char *)(curr + body_size),
+                              curr + body_size + 1024,
+                              curr + body_size + 1024 + 4);
+    return 1;
+}
+
+size_t savestates_get_delta_max_size(void)
+{
+    /* every page patched, plus the pages split around the regions */
+    return sizeof(struct delta_header) + M64P_SAVESTATE_SIZE
+         + (M64P_SAVESTATE_SIZE / DELTA_PAGE_SIZE + 2 * SAVESTATE_REGIONS + 2) * sizeof(struct delta_patch);
+}
+
+int savestates_set_delta_base(const unsigned char *base, size_t size)
+{
+    struct savestate_region regions[SAVESTATE_REGIONS];
+    size_t page_count = 0;
+    size_t k = 0;
+    unsigned int i;
+
+    if (base == NULL || size < M64P_SAVESTATE_SIZE || strncmp((const char *)base, savestate_magic, 8) != 0)
+        return 0;
+
+    if (delta_scratch == NULL)
+        delta_scratch = malloc(M64P_SAVESTATE_SIZE);
+
+    if (delta_scratch != NULL)
+    {
+        /* locate the regions, they are at the same place in every image */
+        savestates_save_m64p_data(g_instance->dev, delta_scratch, regions);
+
+        for (i = 0; i < SAVESTATE_REGIONS; i++)
+            page_count += regions[i].size / DELTA_PAGE_SIZE;
+
+        if (delta_page_hashes == NULL)
+            delta_page_hashes = malloc(page_count * sizeof(*delta_page_hashes));
+    }
+
+    if (delta_scratch == NULL || delta_page_hashes == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Insufficient memory for incremental savestates.");
+        savestates_clear_delta_base();
+        return 0;
+    }
+
+    for (i = 0; i < SAVESTATE_REGIONS; i++)
+    {
+        size_t offset;
+
+        for (offset = 0; offset < regions[i].size; offset += DELTA_PAGE_SIZE)
+            delta_page_hashes[k++] = XXH3_64bits(base + regions[i].offset + offset, DELTA_PAGE_SIZE);
+    }
+
+    delta_base = base;
+    delta_base_hash = XXH3_64bits(base, M64P_SAVESTATE_SIZE);
+    return 1;
+}
+
+void savestates_clear_delta_base(void)
+{
+    free(delta_scratch);
+    free(delta_page_hashes);
+    delta_scratch = NULL;
+    delta_page_hashes = NULL;
+    delta_base = NULL;
+    delta_base_hash = 0;
+}
+
+/* Appends a patch of the image at offset, merged with the previous patch
+ * when they touch. Patches are not aligned, so their headers are copied
+ * in and out. Returns 0 when the delta buffer is full. */
+static int savestates_delta_patch(unsigned char *buffer, size_t size, size_t *used,
+                                  size_t *last, uint32_t *patch_count, size_t offset,
+                                  const void *src, size_t length, int swap)
+{
+    struct delta_patch patch;
+    unsigned char *dst;
+
+    if (*last != 0)
+        memcpy(&patch, buffer + *last, sizeof(patch));
+
+    if (*last != 0 && patch.offset + patch.length == offset)
+    {
+        if (size - *used < length)
+            return 0;
+
+        patch.length += (uint32_t)length;
+        memcpy(buffer + *last, &patch, sizeof(patch));
+    }
+    else
+    {
+        if (size - *used < sizeof(patch) + length)
+            return 0;
+
+        patch.offset = (uint32_t)offset;
+        patch.length = (uint32_t)length;
+        memcpy(buffer + *used, &patch, sizeof(patch));
+        *last = *used;
+        *used += sizeof(patch);
+        (*patch_count)++;
+    }
+
+    dst = buffer + *used;
+    memcpy(dst, src, length);
+    if (swap)
+        to_little_endian_buffer(dst, 4, length / 4);
+    *used += length;
+    return 1;
+}
+
+size_t savestates_save_delta(unsigned char *buffer, size_t size)
+{
+    struct savestate_region regions[SAVESTATE_REGIONS];
+    struct delta_header header;
+    size_t used = sizeof(header);
+    size_t last = 0;
+    size_t start = 0;
+    size_t k = 0;
+    unsigned int i;
+
+    if (delta_base == NULL || buffer == NULL || size < sizeof(header))
+        return 0;
+
+    /* only the small state is serialized, the regions are read in place */
+    savestates_save_m64p_data(g_instance->dev, delta_scratch, regions);
+
+    memcpy(header.magic, delta_magic, 8);
+    header.version = savestate_latest_version;
+    header.patch_count = 0;
+    header.base_hash = delta_base_hash;
+
+    for (i = 0; i <= SAVESTATE_REGIONS; i++)
+    {
+        size_t end = (i < SAVESTATE_REGIONS) ? regions[i].offset : M64P_SAVESTATE_SIZE;
+        size_t offset;
+
+        /* serialized state before the region */
+        for (offset = start; offset < end; offset += DELTA_PAGE_SIZE)
+        {
+            size_t length = (end - offset < DELTA_PAGE_SIZE) ? end - offset : DELTA_PAGE_SIZE;
+
+            if (memcmp(delta_scratch + offset, delta_base + offset, length) != 0
+                && !savestates_delta_patch(buffer, size, &used, &last, &header.patch_count,
+                                           offset, delta_scratch + offset, length, 0))
+                return 0;
+        }
+
+        if (i == SAVESTATE_REGIONS)
+            break;
+
+        /* the region, page hashes tell the pages written since the base */
+        for (offset = 0; offset < regions[i].size; offset += DELTA_PAGE_SIZE, k++)
+        {
+            const unsigned char *page = savestates_region_page(&regions[i], offset);
+
+            if (XXH3_64bits(page, DELTA_PAGE_SIZE) != delta_page_hashes[k]
+                && !savestates_delta_patch(buffer, size, &used, &last, &header.patch_count,
+                                           regions[i].offset + offset, page, DELTA_PAGE_SIZE, 1))
+                return 0;
+        }
+
+        start = regions[i].offset + regions[i].size;
+    }
+
+    memcpy(buffer, &header, sizeof(header));
+    return used;
+}
+
+int savestates_load_delta(const unsigned char *buffer, size_t size)
+{
+    struct delta_header header;
+    size_t used = sizeof(header);
+    uint32_t i;
+
+    if (delta_base == NULL || buffer == NULL || size < sizeof(header))
+        return 0;
+
+    memcpy(&header, buffer, sizeof(header));
+    if (memcmp(header.magic, delta_magic, 8) != 0
+        || header.version != (uint32_t)savestate_latest_version
+        || header.base_hash != delta_base_hash)
+    {
+        DebugMessage(M64MSG_ERROR, "Incremental savestate does not match its base state.");
+        return 0;
+    }
+
+    memcpy(delta_scratch, delta_base, M64P_SAVESTATE_SIZE);
+
+    for (i = 0; i < header.patch_count; i++)
+    {
+        struct delta_patch patch;
+
+        if (size - used < sizeof(patch))
+            return 0;
+        memcpy(&patch, buffer + used, sizeof(patch));
+        used += sizeof(patch);
+
+        if (size - used < patch.length
+            || patch.offset > M64P_SAVESTATE_SIZE
+            || patch.length > M64P_SAVESTATE_SIZE - patch.offset)
+        {
+            DebugMessage(M64MSG_ERROR, "Incremental savestate is truncated or corrupt.");
+            return 0;
+        }
+
+        memcpy(delta_scratch + patch.offset, buffer + used, patch.length);
+        used += patch.length;
+    }
+
+    return savestates_load_memory(delta_scratch, M64P_SAVESTATE_SIZE);
+}
+
 static int savestates_save_pj64(const struct device* dev,
                                 char *filepath, void *handle,
                                 int (*write_func)(void *, const void *, size_t))
@@ -2165,24 +2644,32 @@ int savestates_save(void)
 {
     char *filepath;
     int ret = 0;
-    const struct device* dev = &g_dev;
+    const struct device* dev = g_instance->dev;
+
+    if (job_type == savestates_type_memory)
+    {
+        ret = savestates_save_memory(mem_buffer, mem_size);
+        StateChanged(M64CORE_STATE_SAVECOMPLETE, ret);
+        savestates_clear_job();
+        return ret;
+    }
 
     /* Can only save PJ64 savestates on VI / COMPARE interrupt.
        Otherwise try again in a little while. */
-    if ((type == savestates_type_pj64_zip ||
-         type == savestates_type_pj64_unc) &&
+    if ((job_type == savestates_type_pj64_zip ||
+         job_type == savestates_type_pj64_unc) &&
         get_next_event_type(&dev->r4300.cp0.q) > COMPARE_INT)
         return 0;
 
-    if (fname != NULL && type == savestates_type_unknown)
-        type = savestates_type_m64p;
+    if (fname != NULL && job_type == savestates_type_unknown)
+        job_type = savestates_type_m64p;
     else if (fname == NULL) // Always save slots in M64P format
-        type = savestates_type_m64p;
+        job_type = savestates_type_m64p;
 
-    filepath = savestates_generate_path(type);
+    filepath = savestates_generate_path(job_type);
     if (filepath != NULL)
     {
-        switch (type)
+        switch (job_type)
         {
             case savestates_type_m64p: ret = savestates_save_m64p(dev, filepath); break;
             case savestates_type_pj64_zip: ret = savestates_save_pj64_zip(dev, filepath); break;
@@ -2211,6 +2698,7 @@ void savestates_init(void)
 
 void savestates_deinit(void)
 {
+    savestates_release_buffers();
     SDL_DestroyMutex(savestates_lock);
     savestates_clear_job();
 }
@@ -25,6 +25,8 @@
 #ifndef __SAVESTAVES_H__
 #define __SAVESTAVES_H__
 
+#include <stddef.h>
+
 typedef enum _savestates_job
 {
     savestates_job_nothing,
@@ -37,17 +39,47 @@ typedef enum _savestates_type
     savestates_type_unknown,
     savestates_type_m64p,
     savestates_type_pj64_zip,
-    savestates_type_pj64_unc
+    savestates_type_pj64_unc,
+    savestates_type_memory
 } savestates_type;
 
 savestates_job savestates_get_job(void);
 void savestates_set_job(savestates_job j, savestates_type t, const char *fn);
+/* Like savestates_set_job, with an uncompressed m64p savestate in caller owned
+ * memory instead of a file. The buffer must stay valid until the job is done,
+ * which is reported with the usual M64CORE_STATE_*COMPLETE callbacks. */
+void savestates_set_memory_job(savestates_job j, unsigned char *buffer, size_t size);
 void savestates_init(void);
 void savestates_deinit(void);
 
 int savestates_load(void);
 int savestates_save(void);
 
+/* Frees the buffers kept for saving to files, once their saves are written,
+ * and drops the base of incremental savestates */
+void savestates_release_buffers(void);
+
+/* Uncompressed m64p savestates kept in caller owned memory. These act
+ * immediately, so they must only be called from the emulation thread
+ * at an interrupt boundary. Loading byte swaps the buffer in place on
+ * big endian hosts. */
+size_t savestates_get_memory_size(void);
+int savestates_save_memory(unsigned char *buffer, size_t size);
+int savestates_load_memory(unsigned char *buffer, size_t size);
+
+/* Incremental savestates, for snapshots taken every frame. A delta holds
+ * the state that differs from a base savestates_save_memory image, mostly
+ * the few 4 KB RDRAM pages written since. The base stays in caller owned
+ * memory and must not change while deltas against it are in use.
+ * savestates_save_delta returns the size of the delta, 0 if it does not
+ * fit; a buffer of savestates_get_delta_max_size() bytes always does.
+ * Like the functions above these act immediately. */
+size_t savestates_get_delta_max_size(void);
+int savestates_set_delta_base(const unsigned char *base, size_t size);
+void savestates_clear_delta_base(void);
+size_t savestates_save_delta(unsigned char *buffer, size_t size);
+int savestates_load_delta(const unsigned char *buffer, size_t size);
+
 void savestates_select_slot(unsigned int s);
 unsigned int savestates_get_slot(void);
 void savestates_set_autoinc_slot(int b);
@@ -32,9 +32,11 @@
 #include "api/callbacks.h"
 #include "api/m64p_config.h"
 #include "api/m64p_types.h"
+#include "main/list.h"
 #include "main/main.h"
 #include "main/rom.h"
 #include "main/util.h"
+#include "main/workqueue.h"
 #include "osal/files.h"
 #include "osal/preproc.h"
 #include "osd/osd.h"
@@ -71,7 +73,7 @@ static void user_flush_data(png_structp png_write)
 * Other Local (static) functions
 */
 
-static int SaveRGBBufferToFile(const char *filename, const unsigned char *buf, int width, int height, int pitch)
+static int SaveRGBBufferToFile(const char *filename, const unsigned char *buf, int width, int height, int pitch, int level)
 {
     int i;
 
@@ -108,6 +110,10 @@ static int SaveRGBBufferToFile(const char *filename, const unsigned char *buf, i
     // set the info
     png_set_IHDR(png_write, png_info, width, height, 8, PNG_COLOR_TYPE_RGB,
                  PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // low levels are for speed, where trying every row filter costs more than it saves
+    png_set_compression_level(png_write, level);
+    if (level <= 3)
+        png_set_filter(png_write, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
     // allocate row pointers and scale each row to 24-bit color
     png_byte **row_pointers;
     row_pointers = (png_byte **) malloc(height * sizeof(png_bytep));
@@ -128,9 +134,118 @@ static int SaveRGBBufferToFile(const char *filename, const unsigned char *buf, i
     return 0;
 }
 
+/* QOI (https://qoiformat.org/) encodes about as small as a fast PNG for a fraction of the time */
+static int SaveQOIBufferToFile(const char *filename, const unsigned char *buf, int width, int height, int pitch)
+{
+    static const unsigned char qoi_end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    unsigned char index[64][4]; // alpha starts at 0, so unused entries never match
+    unsigned char prev[3] = { 0, 0, 0 };
+    unsigned char *out, *curr;
+    int run = 0;
+    int x, y;
+
+    // every pixel takes at most 4 bytes
+    out = (unsigned char *) malloc(14 + (size_t)width * height * 4 + sizeof(qoi_end));
+    if (out == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Error allocating QOI buffer.");
+        return 1;
+    }
+    memset(index, 0, sizeof(index));
+
+    curr = out;
+    memcpy(curr, "qoif", 4); curr += 4;
+    *curr++ = (unsigned char) (width >> 24);  *curr++ = (unsigned char) (width >> 16);
+    *curr++ = (unsigned char) (width >> 8);   *curr++ = (unsigned char) width;
+    *curr++ = (unsigned char) (height >> 24); *curr++ = (unsigned char) (height >> 16);
+    *curr++ = (unsigned char) (height >> 8);  *curr++ = (unsigned char) height;
+    *curr++ = 3; // RGB
+    *curr++ = 0; // sRGB
+
+    // the video plugin returns the image bottom-up
+    for (y = height - 1; y >= 0; y--)
+    {
+        const unsigned char *px = buf + y * pitch;
+        for (x = 0; x < width; x++, px += 3)
+        {
+            if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+            {
+                if (++run == 62)
+                {
+                    *curr++ = 0xc0 | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0)
+            {
+                *curr++ = 0xc0 | (run - 1);
+                run = 0;
+            }
+
+            // alpha is always 255, it adds 255 * 11 to the hash
+            int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+            if (index[hash][0] == px[0] && index[hash][1] == px[1] && index[hash][2] == px[2] && index[hash][3] == 255)
+            {
+                *curr++ = (unsigned char) hash;
+            }
+            else
+            {
+                signed char dr = (signed char) (px[0] - prev[0]);
+                signed char dg = (signed char) (px[1] - prev[1]);
+                signed char db = (signed char) (px[2] - prev[2]);
+                int dr_dg = dr - dg;
+                int db_dg = db - dg;
+
+                memcpy(index[hash], px, 3);
+                index[hash][3] = 255;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    *curr++ = 0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                }
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    *curr++ = 0x80 | (dg + 32);
+                    *curr++ = (unsigned char) (((dr_dg + 8) << 4) | (db_dg + 8));
+                }
+                else
+                {
+                    *curr++ = 0xfe;
+                    *curr++ = px[0];
+                    *curr++ = px[1];
+                    *curr++ = px[2];
+                }
+            }
+            memcpy(prev, px, 3);
+        }
+    }
+    if (run > 0)
+        *curr++ = 0xc0 | (run - 1);
+    memcpy(curr, qoi_end, sizeof(qoi_end));
+    curr += sizeof(qoi_end);
+
+    FILE *savefile = osal_file_open(filename, "wb");
+    if (savefile == NULL)
+    {
+        DebugMessage(M64MSG_ERROR, "Error opening '%s' to save screenshot.", filename);
+        free(out);
+        return 4;
+    }
+    int rval = 0;
+    if (fwrite(out, 1, curr - out, savefile) != (size_t) (curr - out))
+    {
+        DebugMessage(M64MSG_ERROR, "Failed to write %zi bytes to screenshot file.", (size_t) (curr - out));
+        rval = 5;
+    }
+    fclose(savefile);
+    free(out);
+    return rval;
+}
+
 static int CurrentShotIndex;
 
-static char *GetNextScreenshotPath(void)
+static char *GetNextScreenshotPath(const char *SshotDir, int *ShotIndex, const char *extension)
 {
     char *ScreenshotPath;
     char ScreenshotFileName[60 + 8 + 1];
@@ -169,10 +284,10 @@ static char *GetNextScreenshotPath(void)
     // sanitize filename
     string_replace_chars(ScreenshotFileName, " :<>\"/\\|?*", '_');
 
-    strcat(ScreenshotFileName, "-###.png");
+    strcat(ScreenshotFileName, "-###");
+    strcat(ScreenshotFileName, extension);
     
     // add the base path to the screenshot file name
-    const char *SshotDir = ConfigGetParamString(g_CoreConfig, "ScreenshotPath");
     if (SshotDir == NULL || *SshotDir == '\0')
     {
         // note the trick to avoid an allocation. we add a NUL character
@@ -191,79 +306,204 @@ static char *GetNextScreenshotPath(void)
     }
 
     // patch the number part of the name (the '###' part) until we find a free spot
-    char *NumberPtr = ScreenshotPath + strlen(ScreenshotPath) - 7;
-    for (; CurrentShotIndex < 1000; CurrentShotIndex++)
+    char *NumberPtr = ScreenshotPath + strlen(ScreenshotPath) - strlen(extension) - 3;
+    for (; *ShotIndex < 1000; (*ShotIndex)++)
     {
-        sprintf(NumberPtr, "%03i.png", CurrentShotIndex);
+        sprintf(NumberPtr, "%03i%s", *ShotIndex, extension);
         FILE *pFile = osal_file_open(ScreenshotPath, "r");
         if (pFile == NULL)
             break;
         fclose(pFile);
     }
 
-    if (CurrentShotIndex >= 1000)
+    if (*ShotIndex >= 1000)
     {
         DebugMessage(M64MSG_ERROR, "Can't save screenshot; folder already contains 1000 screenshots for this ROM");
         free(ScreenshotPath);
         return NULL;
     }
-    CurrentShotIndex++;
+    (*ShotIndex)++;
 
     return ScreenshotPath;
 }
 
 /*********************************************************************************************************
-* Global screenshot functions
+* Capture pipeline: the frame is read into a pooled buffer on the emulation thread, then encoded
+* and written in the screenshot class of the workqueue
 */
 
-void ScreenshotRomOpen(void)
+enum { SCREENSHOT_FORMAT_PNG, SCREENSHOT_FORMAT_QOI };
+
+#define SCREENSHOT_BUFFERS 2
+
+struct screenshot_work
 {
-    CurrentShotIndex = 0;
+    struct work_struct work;
+    struct work_completion written;
+
+    unsigned char *pixels;
+    size_t capacity;
+    int width;
+    int height;
+
+    int format;
+    int level;
+    char *path;     // file to write, or the folder to pick a name in
+    int in_folder;
+    int notify;     // report M64CORE_SCREENSHOT_CAPTURED once written
+};
+
+static struct screenshot_work l_Shots[SCREENSHOT_BUFFERS];
+static unsigned int l_NextShot;
+
+static int GetScreenshotFormat(void)
+{
+    return (ConfigGetParamInt(g_CoreConfig, "ScreenshotFormat") == SCREENSHOT_FORMAT_QOI) ? SCREENSHOT_FORMAT_QOI : SCREENSHOT_FORMAT_PNG;
 }
 
-void TakeScreenshot(int iFrameNumber)
+static const char *GetScreenshotExtension(int format)
 {
-    char *filename;
+    return (format == SCREENSHOT_FORMAT_QOI) ? ".qoi" : ".png";
+}
 
-    // look for an unused screenshot filename
-    filename = GetNextScreenshotPath();
-    if (filename == NULL)
+static void ScreenshotWork(struct work_struct *work)
+{
+    struct screenshot_work *shot = container_of(work, struct screenshot_work, work);
+    char *filename = shot->path;
+    int ShotIndex = 0;
+    int rval = 1;
+
+    if (shot->in_folder)
     {
-        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
-        return;
+        // the folder may still be queued for creation
+        osal_mkdirp(shot->path, 0755);
+        filename = GetNextScreenshotPath(shot->path, &ShotIndex, GetScreenshotExtension(shot->format));
     }
 
-    // get the width and height
+    if (filename != NULL)
+    {
+        if (shot->format == SCREENSHOT_FORMAT_QOI)
+            rval = SaveQOIBufferToFile(filename, shot->pixels, shot->width, shot->height, shot->width * 3);
+        else
+            rval = SaveRGBBufferToFile(filename, shot->pixels, shot->width, shot->height, shot->width * 3, shot->level);
+    }
+    if (rval != 0 && shot->in_folder)
+        DebugMessage(M64MSG_ERROR, "Failed to save screenshot in %s", shot->path);
+
+    if (filename != shot->path)
+        free(filename);
+    free(shot->path);
+    shot->path = NULL;
+
+    // print message -- this allows developers to capture frames and use them in the regression test
+    if (shot->notify)
+        StateChanged(M64CORE_SCREENSHOT_CAPTURED, rval == 0);
+}
+
+/* Takes ownership of path */
+static int QueueScreenshot(char *path, int in_folder, int notify, int format)
+{
+    struct screenshot_work *shot = &l_Shots[l_NextShot];
     int width = 640;
     int height = 480;
+    size_t size;
+
+    if (shot->capacity == 0)
+        shot->written.done = 1;
+
+    // the buffer is free again once the screenshot queued with it last time is written
+    wait_for_completion(&shot->written);
+
+    // get the width and height
     gfx.readScreen(NULL, &width, &height, 0);
 
-    // allocate memory for the image
-    unsigned char *pucFrame = (unsigned char *) malloc(width * height * 3);
-    if (pucFrame == NULL)
+    size = (size_t) width * height * 3;
+    if (shot->capacity < size)
     {
-        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
-        free(filename);
-        return;
+        unsigned char *pixels = (unsigned char *) realloc(shot->pixels, size);
+        if (pixels == NULL)
+        {
+            free(path);
+            return 1;
+        }
+        shot->pixels = pixels;
+        shot->capacity = size;
     }
 
     // grab the back image from OpenGL by calling the video plugin
-    gfx.readScreen(pucFrame, &width, &height, 0);
+    gfx.readScreen(shot->pixels, &width, &height, 0);
+    l_NextShot = (l_NextShot + 1) % SCREENSHOT_BUFFERS;
 
-    // write the image to a PNG
-    int rval = SaveRGBBufferToFile(filename, pucFrame, width, height, width * 3);
-    // free the memory
-    free(pucFrame);
-    free(filename);
-    // print message -- this allows developers to capture frames and use them in the regression test
-    if (rval != 0)
+    shot->width = width;
+    shot->height = height;
+    shot->format = format;
+    shot->level = ConfigGetParamInt(g_CoreConfig, "ScreenshotCompression");
+    if (shot->level < 0)
+        shot->level = 0;
+    if (shot->level > 9)
+        shot->level = 9;
+    shot->path = path;
+    shot->in_folder = in_folder;
+    shot->notify = notify;
+
+    init_work(&shot->work, ScreenshotWork, WORK_CLASS_SCREENSHOT);
+    init_completion(&shot->written);
+    shot->work.completion = &shot->written;
+    queue_work(&shot->work);
+
+    return 0;
+}
+
+/*********************************************************************************************************
+* Global screenshot functions
+*/
+
+void ScreenshotRomOpen(void)
+{
+    CurrentShotIndex = 0;
+}
+
+void ScreenshotShutdown(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < SCREENSHOT_BUFFERS; i++)
     {
-        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
+        if (l_Shots[i].capacity == 0)
+            continue;
+
+        wait_for_completion(&l_Shots[i].written);
+        free(l_Shots[i].pixels);
+        l_Shots[i].pixels = NULL;
+        l_Shots[i].capacity = 0;
     }
-    else
+    l_NextShot = 0;
+}
+
+void TakeScreenshot(int iFrameNumber)
+{
+    int format = GetScreenshotFormat();
+    char *filename;
+
+    // look for an unused screenshot filename
+    filename = GetNextScreenshotPath(ConfigGetParamString(g_CoreConfig, "ScreenshotPath"), &CurrentShotIndex, GetScreenshotExtension(format));
+    if (filename == NULL)
     {
-        // main_message(M64MSG_INFO, OSD_BOTTOM_LEFT, "Captured screenshot for frame %i.", iFrameNumber);
-        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 1);
+        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
+        return;
     }
+
+    // main_message(M64MSG_INFO, OSD_BOTTOM_LEFT, "Captured screenshot for frame %i.", iFrameNumber);
+    if (QueueScreenshot(filename, 0, 1, format) != 0)
+        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
 }
 
+int QueueScreenshotInFolder(const char *directory)
+{
+    char *path = strdup(directory);
+
+    if (path == NULL)
+        return 1;
+
+    return QueueScreenshot(path, 1, 0, GetScreenshotFormat());
+}
@@ -23,6 +23,11 @@
 #define M64P_MAIN_SCREENSHOT_H
 
 void ScreenshotRomOpen(void);
+void ScreenshotShutdown(void);
 void TakeScreenshot(int iFrameNumber);
 
+/* The frame is copied from the video plugin on the calling thread, then encoded on the
+ * workqueue under an unused name in directory, which is created if needed */
+int QueueScreenshotInFolder(const char *directory);
+
 #endif
@@ -31,66 +31,102 @@
 #include "api/m64p_types.h"
 #include "main/list.h"
 
-#define WORKQUEUE_THREADS 1
+#define WORKQUEUE_MAX_THREADS 8
 
 struct workqueue_mgmt_globals {
-    struct list_head work_queue;
-    struct list_head thread_queue;
+    struct list_head work_queue[WORK_CLASS_COUNT];
+    unsigned int running[WORK_CLASS_COUNT];
     struct list_head thread_list;
+    unsigned int thread_count;
+    int quit;
     SDL_mutex *lock;
+    SDL_cond *work_avail;
+    SDL_cond *work_done;
+    struct workqueue_stats stats;
 };
 
 struct workqueue_thread {
     SDL_Thread *thread;
-    SDL_cond *work_avail;
-    struct list_head list;
     struct list_head list_mgmt;
 };
 
 static struct workqueue_mgmt_globals workqueue_mgmt;
 
-static void workqueue_dismiss(struct work_struct *work)
+static int workqueue_class_is_ordered(enum work_class work_class)
+{
+    return work_class == WORK_CLASS_SAVESTATE || work_class == WORK_CLASS_REPLAY;
+}
+
+static uint64_t workqueue_now_us(void)
 {
+    return SDL_GetPerformanceCounter() * 1000000 / SDL_GetPerformanceFrequency();
 }
 
-static struct work_struct *workqueue_get_work(struct workqueue_thread *thread)
+/* must be called with the lock held */
+static struct work_struct *workqueue_next_work(void)
 {
-    int found = 0;
     struct work_struct *work;
+    uint64_t wait;
+    int c;
+
+    for (c = 0; c < WORK_CLASS_COUNT; c++) {
+        if (list_empty(&workqueue_mgmt.work_queue[c]))
+            continue;
+        if (workqueue_class_is_ordered(c) && workqueue_mgmt.running[c] != 0)
+            continue;
+
+        work = list_first_entry(&workqueue_mgmt.work_queue[c], struct work_struct, list);
+        list_del_init(&work->list);
+
+        wait = workqueue_now_us() - work->queued_at;
+        workqueue_mgmt.running[c]++;
+        workqueue_mgmt.stats.classes[c].depth--;
+        workqueue_mgmt.stats.classes[c].wait_us += wait;
+        if (wait > workqueue_mgmt.stats.classes[c].max_wait_us)
+            workqueue_mgmt.stats.classes[c].max_wait_us = wait;
+        return work;
+    }
 
-    for (;;) {
-        SDL_LockMutex(workqueue_mgmt.lock);
-        list_del_init(&thread->list);
-        if (!list_empty(&workqueue_mgmt.work_queue)) {
-            found = 1;
-            work = list_first_entry(&workqueue_mgmt.work_queue, struct work_struct, list);
-            list_del_init(&work->list);
-        } else {
-            list_add(&thread->list, &workqueue_mgmt.thread_queue);
-	        SDL_CondWait(thread->work_avail, workqueue_mgmt.lock);
-        }
-        SDL_UnlockMutex(workqueue_mgmt.lock);
+    return NULL;
+}
 
-        if (found)
-            break;
-    }
+static void workqueue_run(struct work_struct *work)
+{
+    enum work_class work_class = work->work_class;
+    struct work_completion *completion = work->completion;
+    uint64_t start = workqueue_now_us();
+
+    /* the job may free itself */
+    work->func(work);
 
-    return work;
+    SDL_LockMutex(workqueue_mgmt.lock);
+    workqueue_mgmt.running[work_class]--;
+    workqueue_mgmt.stats.classes[work_class].completed++;
+    workqueue_mgmt.stats.classes[work_class].run_us += workqueue_now_us() - start;
+    if (completion != NULL)
+        completion->done = 1;
+    SDL_CondBroadcast(workqueue_mgmt.work_done);
+    /* the next job of an ordered class can start now */
+    if (workqueue_class_is_ordered(work_class) && !list_empty(&workqueue_mgmt.work_queue[work_class]))
+        SDL_CondSignal(workqueue_mgmt.work_avail);
+    SDL_UnlockMutex(workqueue_mgmt.lock);
 }
 
 static int workqueue_thread_handler(void *data)
 {
-    struct workqueue_thread *thread = data;
     struct work_struct *work;
 
     for (;;) {
-        work = workqueue_get_work(thread);
-        if (work->func == workqueue_dismiss) {
-            free(work);
+        SDL_LockMutex(workqueue_mgmt.lock);
+        while ((work = workqueue_next_work()) == NULL && !workqueue_mgmt.quit)
+            SDL_CondWait(workqueue_mgmt.work_avail, workqueue_mgmt.lock);
+        SDL_UnlockMutex(workqueue_mgmt.lock);
+
+        /* pending work is done before quitting */
+        if (work == NULL)
             break;
-        }
 
-        work->func(work);
+        workqueue_run(work);
     }
 
     return 0;
@@ -99,48 +135,57 @@ static int workqueue_thread_handler(void *data)
 int workqueue_init(void)
 {
     size_t i;
+    int threads;
     struct workqueue_thread *thread;
 
     memset(&workqueue_mgmt, 0, sizeof(workqueue_mgmt));
-    INIT_LIST_HEAD(&workqueue_mgmt.work_queue);
-    INIT_LIST_HEAD(&workqueue_mgmt.thread_queue);
+    for (i = 0; i < WORK_CLASS_COUNT; i++)
+        INIT_LIST_HEAD(&workqueue_mgmt.work_queue[i]);
     INIT_LIST_HEAD(&workqueue_mgmt.thread_list);
 
     workqueue_mgmt.lock = SDL_CreateMutex();
-    if (!workqueue_mgmt.lock) {
+    workqueue_mgmt.work_avail = SDL_CreateCond();
+    workqueue_mgmt.work_done = SDL_CreateCond();
+    if (!workqueue_mgmt.lock || !workqueue_mgmt.work_avail || !workqueue_mgmt.work_done) {
         DebugMessage(M64MSG_ERROR, "Could not create workqueue management");
         return -1;
     }
 
+    /* one core is left to the emulation thread */
+    threads = SDL_GetCPUCount() - 1;
+    if (threads < 1)
+        threads = 1;
+    if (threads > WORKQUEUE_MAX_THREADS)
+        threads = WORKQUEUE_MAX_THREADS;
+
     SDL_LockMutex(workqueue_mgmt.lock);
-    for (i = 0; i < WORKQUEUE_THREADS; i++) {
+    for (i = 0; i < (size_t)threads; i++) {
         thread = malloc(sizeof(*thread));
         if (!thread) {
             DebugMessage(M64MSG_ERROR, "Could not create workqueue thread management data");
-            SDL_UnlockMutex(workqueue_mgmt.lock);
-            return -1;
+            break;
         }
 
         memset(thread, 0, sizeof(*thread));
-        list_add(&thread->list_mgmt, &workqueue_mgmt.thread_list);
-        INIT_LIST_HEAD(&thread->list);
-        thread->work_avail = SDL_CreateCond();
-        if (!thread->work_avail) {
-            DebugMessage(M64MSG_ERROR, "Could not create workqueue thread work_avail condition");
-            SDL_UnlockMutex(workqueue_mgmt.lock);
-            return -1;
-        }
-
         thread->thread = SDL_CreateThread(workqueue_thread_handler, "m64pwq", thread);
 
         if (!thread->thread) {
             DebugMessage(M64MSG_ERROR, "Could not create workqueue thread handler");
-            SDL_UnlockMutex(workqueue_mgmt.lock);
-            return -1;
+            free(thread);
+            break;
         }
+
+        list_add(&thread->list_mgmt, &workqueue_mgmt.thread_list);
+        workqueue_mgmt.thread_count++;
     }
+    workqueue_mgmt.stats.threads = workqueue_mgmt.thread_count;
     SDL_UnlockMutex(workqueue_mgmt.lock);
 
+    /* without threads, work runs synchronously in queue_work */
+    if (workqueue_mgmt.thread_count == 0)
+        return -1;
+
+    DebugMessage(M64MSG_VERBOSE, "Workqueue started with %u threads", workqueue_mgmt.thread_count);
     return 0;
 }
 
@@ -148,41 +193,81 @@ void workqueue_shutdown(void)
 {
     size_t i;
     int status;
-    struct work_struct *work;
     struct workqueue_thread *thread, *safe;
+    static const char *class_names[WORK_CLASS_COUNT] = { "savestate", "replay", "screenshot" };
 
-    for (i = 0; i < WORKQUEUE_THREADS; i++) {
-        work = malloc(sizeof(*work));
-        init_work(work, workqueue_dismiss);
-        queue_work(work);
-    }
+    SDL_LockMutex(workqueue_mgmt.lock);
+    workqueue_mgmt.quit = 1;
+    SDL_CondBroadcast(workqueue_mgmt.work_avail);
+    SDL_UnlockMutex(workqueue_mgmt.lock);
 
     list_for_each_entry_safe_t(thread, safe, &workqueue_mgmt.thread_list, struct workqueue_thread, list_mgmt) {
         list_del(&thread->list_mgmt);
         SDL_WaitThread(thread->thread, &status);
-        SDL_DestroyCond(thread->work_avail);
         free(thread);
     }
+    workqueue_mgmt.thread_count = 0;
 
-    if (!list_empty(&workqueue_mgmt.work_queue))
-        DebugMessage(M64MSG_WARNING, "Stopped workqueue with work still pending");
+    for (i = 0; i < WORK_CLASS_COUNT; i++) {
+        const struct workqueue_stats *stats = &workqueue_mgmt.stats;
 
+        if (!list_empty(&workqueue_mgmt.work_queue[i]))
+            DebugMessage(M64MSG_WARNING, "Stopped workqueue with work still pending");
+
+        if (stats->classes[i].completed != 0)
+            DebugMessage(M64MSG_VERBOSE, "Workqueue %s jobs: %llu done, peak depth %u, wait avg %llu us max %llu us, run avg %llu us",
+                         class_names[i], (unsigned long long)stats->classes[i].completed, stats->classes[i].peak_depth,
+                         (unsigned long long)(stats->classes[i].wait_us / stats->classes[i].completed),
+                         (unsigned long long)stats->classes[i].max_wait_us,
+                         (unsigned long long)(stats->classes[i].run_us / stats->classes[i].completed));
+    }
+
+    SDL_DestroyCond(workqueue_mgmt.work_done);
+    SDL_DestroyCond(workqueue_mgmt.work_avail);
     SDL_DestroyMutex(workqueue_mgmt.lock);
+    memset(&workqueue_mgmt, 0, sizeof(workqueue_mgmt));
 }
 
 int queue_work(struct work_struct *work)
 {
-    struct workqueue_thread *thread;
+    struct workqueue_stats *stats = &workqueue_mgmt.stats;
+    enum work_class work_class = work->work_class;
 
-    SDL_LockMutex(workqueue_mgmt.lock);
-    list_add_tail(&work->list, &workqueue_mgmt.work_queue);
-    if (!list_empty(&workqueue_mgmt.thread_queue)) {
-        thread = list_first_entry(&workqueue_mgmt.thread_queue, struct workqueue_thread, list);
-        list_del_init(&thread->list);
+    work->queued_at = workqueue_now_us();
+
+    if (workqueue_mgmt.thread_count == 0) {
+        struct work_completion *completion = work->completion;
 
-        SDL_CondSignal(thread->work_avail);
+        work->func(work);
+        if (completion != NULL)
+            completion->done = 1;
+        return 0;
     }
+
+    SDL_LockMutex(workqueue_mgmt.lock);
+    list_add_tail(&work->list, &workqueue_mgmt.work_queue[work_class]);
+    if (++stats->classes[work_class].depth > stats->classes[work_class].peak_depth)
+        stats->classes[work_class].peak_depth = stats->classes[work_class].depth;
+    SDL_CondSignal(workqueue_mgmt.work_avail);
     SDL_UnlockMutex(workqueue_mgmt.lock);
 
     return 0;
 }
+
+void wait_for_completion(struct work_completion *completion)
+{
+    if (workqueue_mgmt.thread_count == 0)
+        return;
+
+    SDL_LockMutex(workqueue_mgmt.lock);
+    while (!completion->done)
+        SDL_CondWait(workqueue_mgmt.work_done, workqueue_mgmt.lock);
+    SDL_UnlockMutex(workqueue_mgmt.lock);
+}
+
+void workqueue_get_stats(struct workqueue_stats *stats)
+{
+    SDL_LockMutex(workqueue_mgmt.lock);
+    *stats = workqueue_mgmt.stats;
+    SDL_UnlockMutex(workqueue_mgmt.lock);
+}
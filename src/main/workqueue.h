@@ -22,21 +22,60 @@
 #ifndef __WORKQUEUE_H__
 #define __WORKQUEUE_H__
 
+#include <stdint.h>
+
 #include "list.h"
 #include "osal/preproc.h"
 
+/* Work is picked by class, in this order. Jobs of an ordered class run one at
+ * a time and in submission order, the others run on any free thread. */
+enum work_class {
+    WORK_CLASS_SAVESTATE,   /* savestate compression, ordered */
+    WORK_CLASS_REPLAY,      /* replay file writes, ordered */
+    WORK_CLASS_SCREENSHOT,  /* PNG encoding */
+    WORK_CLASS_COUNT
+};
+
 struct work_struct;
 
+/* Set once the job it is attached to has returned */
+struct work_completion {
+    int done;
+};
+
 typedef void (*work_func_t)(struct work_struct *work);
 struct work_struct {
     work_func_t func;
     struct list_head list;
+    enum work_class work_class;
+    struct work_completion *completion;
+    uint64_t queued_at;
 };
 
-static osal_inline void init_work(struct work_struct *work, work_func_t func)
+struct workqueue_stats {
+    unsigned int threads;
+    struct {
+        unsigned int depth;         /* jobs waiting */
+        unsigned int peak_depth;
+        uint64_t completed;
+        uint64_t wait_us;           /* total time spent queued */
+        uint64_t max_wait_us;
+        uint64_t run_us;            /* total time spent running */
+    } classes[WORK_CLASS_COUNT];
+};
+
+static osal_inline void init_work(struct work_struct *work, work_func_t func, enum work_class work_class)
 {
     INIT_LIST_HEAD(&work->list);
     work->func = func;
+    work->work_class = work_class;
+    work->completion = NULL;
+    work->queued_at = 0;
+}
+
+static osal_inline void init_completion(struct work_completion *completion)
+{
+    completion->done = 0;
 }
 
 #ifdef M64P_PARALLEL
@@ -44,9 +83,13 @@ static osal_inline void init_work(struct work_struct *work, work_func_t func)
 int workqueue_init(void);
 void workqueue_shutdown(void);
 int queue_work(struct work_struct *work);
+void wait_for_completion(struct work_completion *completion);
+void workqueue_get_stats(struct workqueue_stats *stats);
 
 #else
 
+#include <string.h>
+
 static osal_inline int workqueue_init(void)
 {
     return 0;
@@ -58,10 +101,23 @@ static osal_inline void workqueue_shutdown(void)
 
 static osal_inline int queue_work(struct work_struct *work)
 {
+    struct work_completion *completion = work->completion;
+
     work->func(work);
+    if (completion != NULL)
+        completion->done = 1;
     return 0;
 }
 
+static osal_inline void wait_for_completion(struct work_completion *completion)
+{
+}
+
+static osal_inline void workqueue_get_stats(struct workqueue_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
 #endif
 
 #endif
@@ -67,5 +67,12 @@ extern const char * osal_get_user_cachepath(void);
 extern FILE * osal_file_open (const char *filename, const char *mode);
 extern gzFile osal_gzopen(const char *filename, const char *mode);
 
+/* Map a whole file read-only into memory, and hint the OS to prefetch it.
+ * Returns NULL on failure (including empty files). On success, *size receives the
+ * file size and *handle an opaque value to pass back to osal_file_unmap.
+ */
+extern const void * osal_file_map(const char *filename, size_t *size, void **handle);
+extern void osal_file_unmap(const void *data, size_t size, void *handle);
+
 #endif /* OSAL_FILES_H */
 
@@ -23,10 +23,12 @@
  * functions
  */
 
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -241,3 +243,35 @@ gzFile osal_gzopen(const char *filename, const char *mode)
 {
     return gzopen(filename, mode);
 }
+
+const void * osal_file_map(const char *filename, size_t *size, void **handle)
+{
+    struct stat fileinfo;
+    void *data;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &fileinfo) != 0 || fileinfo.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    data = mmap(NULL, (size_t) fileinfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    posix_madvise(data, (size_t) fileinfo.st_size, POSIX_MADV_WILLNEED);
+
+    *size = (size_t) fileinfo.st_size;
+    *handle = NULL;
+    return data;
+}
+
+void osal_file_unmap(const void *data, size_t size, void *handle)
+{
+    if (data != NULL)
+        munmap((void *) data, size);
+}
@@ -220,3 +220,46 @@ gzFile osal_gzopen(const char *filename, const char *mode)
     MultiByteToWideChar(CP_UTF8, 0, filename, -1, wstr_filename, PATH_MAX);
     return gzopen_w(wstr_filename, mode);
 }
+
+const void * osal_file_map(const char *filename, size_t *size, void **handle)
+{
+    wchar_t wstr_filename[PATH_MAX];
+    LARGE_INTEGER filesize;
+    HANDLE file, mapping;
+    void *data;
+
+    MultiByteToWideChar(CP_UTF8, 0, filename, -1, wstr_filename, PATH_MAX);
+    file = CreateFileW(wstr_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!GetFileSizeEx(file, &filesize) || filesize.QuadPart <= 0)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        return NULL;
+    }
+
+    *size = (size_t) filesize.QuadPart;
+    *handle = mapping;
+    return data;
+}
+
+void osal_file_unmap(const void *data, size_t size, void *handle)
+{
+    if (data != NULL)
+        UnmapViewOfFile(data);
+    if (handle != NULL)
+        CloseHandle((HANDLE) handle);
+}
@@ -30,6 +30,7 @@
   #define OSAL_BREAKPOINT_INTERRUPT __debugbreak();
   #define ALIGN(BYTES,DATA) __declspec(align(BYTES)) DATA
   #define osal_inline __inline
+  #define osal_thread_local __declspec(thread)
 
   #define OSAL_WARNING_PUSH __pragma(warning(push))
   #define OSAL_WARNING_POP  __pragma(warning(pop))
@@ -55,6 +56,7 @@
   #define OSAL_BREAKPOINT_INTERRUPT __asm__(" int $3; ");
   #define ALIGN(BYTES,DATA) DATA __attribute__((aligned(BYTES)))
   #define osal_inline inline
+  #define osal_thread_local __thread
 
   #define OSAL_WARNING_PUSH _Pragma("GCC diagnostic push")
   #define OSAL_WARNING_POP  _Pragma("GCC diagnostic pop")
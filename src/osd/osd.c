@@ -36,6 +36,7 @@
 #include "api/m64p_config.h"
 #include "api/m64p_vidext.h"
 #include "api/callbacks.h"
+#include "main/instance.h"
 
 #define FONT_FILENAME "font.ttf"
 
@@ -449,7 +450,8 @@ osd_message_t * osd_new_message(enum osd_corner eCorner, const char *fmt, ...)
     va_list ap;
     char buf[1024];
 
-    if (!l_OsdInitialized) return NULL;
+    /* the OSD belongs to the default instance */
+    if (!l_OsdInitialized || !core_instance_is_default()) return NULL;
 
     osd_message_t *msg = (osd_message_t *)malloc(sizeof(*msg));
 
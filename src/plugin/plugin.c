@@ -255,34 +255,34 @@ static m64p_error plugin_start_gfx(void)
     gfx_info.RDRAM = (unsigned char *)mem_base_u32(g_mem_base, MM_RDRAM_DRAM);
     gfx_info.DMEM = (unsigned char *)mem_base_u32(g_mem_base, MM_RSP_MEM);
     gfx_info.IMEM = (unsigned char *)mem_base_u32(g_mem_base, MM_RSP_MEM + 0x1000);
-    gfx_info.MI_INTR_REG = &(g_dev.mi.regs[MI_INTR_REG]);
-    gfx_info.DPC_START_REG = &(g_dev.dp.dpc_regs[DPC_START_REG]);
-    gfx_info.DPC_END_REG = &(g_dev.dp.dpc_regs[DPC_END_REG]);
-    gfx_info.DPC_CURRENT_REG = &(g_dev.dp.dpc_regs[DPC_CURRENT_REG]);
-    gfx_info.DPC_STATUS_REG = &(g_dev.dp.dpc_regs[DPC_STATUS_REG]);
-    gfx_info.DPC_CLOCK_REG = &(g_dev.dp.dpc_regs[DPC_CLOCK_REG]);
-    gfx_info.DPC_BUFBUSY_REG = &(g_dev.dp.dpc_regs[DPC_BUFBUSY_REG]);
-    gfx_info.DPC_PIPEBUSY_REG = &(g_dev.dp.dpc_regs[DPC_PIPEBUSY_REG]);
-    gfx_info.DPC_TMEM_REG = &(g_dev.dp.dpc_regs[DPC_TMEM_REG]);
-    gfx_info.VI_STATUS_REG = &(g_dev.vi.regs[VI_STATUS_REG]);
-    gfx_info.VI_ORIGIN_REG = &(g_dev.vi.regs[VI_ORIGIN_REG]);
-    gfx_info.VI_WIDTH_REG = &(g_dev.vi.regs[VI_WIDTH_REG]);
-    gfx_info.VI_INTR_REG = &(g_dev.vi.regs[VI_V_INTR_REG]);
-    gfx_info.VI_V_CURRENT_LINE_REG = &(g_dev.vi.regs[VI_CURRENT_REG]);
-    gfx_info.VI_TIMING_REG = &(g_dev.vi.regs[VI_BURST_REG]);
-    gfx_info.VI_V_SYNC_REG = &(g_dev.vi.regs[VI_V_SYNC_REG]);
-    gfx_info.VI_H_SYNC_REG = &(g_dev.vi.regs[VI_H_SYNC_REG]);
-    gfx_info.VI_LEAP_REG = &(g_dev.vi.regs[VI_LEAP_REG]);
-    gfx_info.VI_H_START_REG = &(g_dev.vi.regs[VI_H_START_REG]);
-    gfx_info.VI_V_START_REG = &(g_dev.vi.regs[VI_V_START_REG]);
-    gfx_info.VI_V_BURST_REG = &(g_dev.vi.regs[VI_V_BURST_REG]);
-    gfx_info.VI_X_SCALE_REG = &(g_dev.vi.regs[VI_X_SCALE_REG]);
-    gfx_info.VI_Y_SCALE_REG = &(g_dev.vi.regs[VI_Y_SCALE_REG]);
+    gfx_info.MI_INTR_REG = &(g_instance->dev->mi.regs[MI_INTR_REG]);
+    gfx_info.DPC_START_REG = &(g_instance->dev->dp.dpc_regs[DPC_START_REG]);
+    gfx_info.DPC_END_REG = &(g_instance->dev->dp.dpc_regs[DPC_END_REG]);
+    gfx_info.DPC_CURRENT_REG = &(g_instance->dev->dp.dpc_regs[DPC_CURRENT_REG]);
+    gfx_info.DPC_STATUS_REG = &(g_instance->dev->dp.dpc_regs[DPC_STATUS_REG]);
+    gfx_info.DPC_CLOCK_REG = &(g_instance->dev->dp.dpc_regs[DPC_CLOCK_REG]);
+    gfx_info.DPC_BUFBUSY_REG = &(g_instance->dev->dp.dpc_regs[DPC_BUFBUSY_REG]);
+    gfx_info.DPC_PIPEBUSY_REG = &(g_instance->dev->dp.dpc_regs[DPC_PIPEBUSY_REG]);
+    gfx_info.DPC_TMEM_REG = &(g_instance->dev->dp.dpc_regs[DPC_TMEM_REG]);
+    gfx_info.VI_STATUS_REG = &(g_instance->dev->vi.regs[VI_STATUS_REG]);
+    gfx_info.VI_ORIGIN_REG = &(g_instance->dev->vi.regs[VI_ORIGIN_REG]);
+    gfx_info.VI_WIDTH_REG = &(g_instance->dev->vi.regs[VI_WIDTH_REG]);
+    gfx_info.VI_INTR_REG = &(g_instance->dev->vi.regs[VI_V_INTR_REG]);
+    gfx_info.VI_V_CURRENT_LINE_REG = &(g_instance->dev->vi.regs[VI_CURRENT_REG]);
+    gfx_info.VI_TIMING_REG = &(g_instance->dev->vi.regs[VI_BURST_REG]);
+    gfx_info.VI_V_SYNC_REG = &(g_instance->dev->vi.regs[VI_V_SYNC_REG]);
+    gfx_info.VI_H_SYNC_REG = &(g_instance->dev->vi.regs[VI_H_SYNC_REG]);
+    gfx_info.VI_LEAP_REG = &(g_instance->dev->vi.regs[VI_LEAP_REG]);
+    gfx_info.VI_H_START_REG = &(g_instance->dev->vi.regs[VI_H_START_REG]);
+    gfx_info.VI_V_START_REG = &(g_instance->dev->vi.regs[VI_V_START_REG]);
+    gfx_info.VI_V_BURST_REG = &(g_instance->dev->vi.regs[VI_V_BURST_REG]);
+    gfx_info.VI_X_SCALE_REG = &(g_instance->dev->vi.regs[VI_X_SCALE_REG]);
+    gfx_info.VI_Y_SCALE_REG = &(g_instance->dev->vi.regs[VI_Y_SCALE_REG]);
     gfx_info.CheckInterrupts = EmptyFunc;
 
     gfx_info.version = 2; //Version 2 added SP_STATUS_REG and RDRAM_SIZE
-    gfx_info.SP_STATUS_REG = &g_dev.sp.regs[SP_STATUS_REG];
-    gfx_info.RDRAM_SIZE = (unsigned int*) &g_dev.rdram.dram_size;
+    gfx_info.SP_STATUS_REG = &g_instance->dev->sp.regs[SP_STATUS_REG];
+    gfx_info.RDRAM_SIZE = (unsigned int*) &g_instance->dev->rdram.dram_size;
 
     /* call the audio plugin */
     if (!gfx.initiateGFX(gfx_info))
@@ -351,13 +351,13 @@ static m64p_error plugin_start_audio(void)
     audio_info.RDRAM = (unsigned char *)mem_base_u32(g_mem_base, MM_RDRAM_DRAM);
     audio_info.DMEM = (unsigned char *)mem_base_u32(g_mem_base, MM_RSP_MEM);
     audio_info.IMEM = (unsigned char *)mem_base_u32(g_mem_base, MM_RSP_MEM + 0x1000);
-    audio_info.MI_INTR_REG = &(g_dev.mi.regs[MI_INTR_REG]);
-    audio_info.AI_DRAM_ADDR_REG = &(g_dev.ai.regs[AI_DRAM_ADDR_REG]);
-    audio_info.AI_LEN_REG = &(g_dev.ai.regs[AI_LEN_REG]);
-    audio_info.AI_CONTROL_REG = &(g_dev.ai.regs[AI_CONTROL_REG]);
+    audio_info.MI_INTR_REG = &(g_instance->dev->mi.regs[MI_INTR_REG]);
+    audio_info.AI_DRAM_ADDR_REG = &(g_instance->dev->ai.regs[AI_DRAM_ADDR_REG]);
+    audio_info.AI_LEN_REG = &(g_instance->dev->ai.regs[AI_LEN_REG]);
+    audio_info.AI_CONTROL_REG = &(g_instance->dev->ai.regs[AI_CONTROL_REG]);
     audio_info.AI_STATUS_REG = &dummy;
-    audio_info.AI_DACRATE_REG = &(g_dev.ai.regs[AI_DACRATE_REG]);
-    audio_info.AI_BITRATE_REG = &(g_dev.ai.regs[AI_BITRATE_REG]);
+    audio_info.AI_DACRATE_REG = &(g_instance->dev->ai.regs[AI_DACRATE_REG]);
+    audio_info.AI_BITRATE_REG = &(g_instance->dev->ai.regs[AI_BITRATE_REG]);
     audio_info.CheckInterrupts = EmptyFunc;
 
     /* call the audio plugin */
@@ -500,24 +500,24 @@ static m64p_error plugin_start_rsp(void)
     rsp_info.RDRAM = (unsigned char *)mem_base_u32(g_mem_base, MM_RDRAM_DRAM);
     rsp_info.DMEM = (unsigned char *)mem_base_u32(g_mem_base, MM_RSP_MEM);
     rsp_info.IMEM = (unsigned char *)mem_base_u32(g_mem_base, MM_RSP_MEM + 0x1000);
-    rsp_info.MI_INTR_REG = &g_dev.mi.regs[MI_INTR_REG];
-    rsp_info.SP_MEM_ADDR_REG = &g_dev.sp.regs[SP_MEM_ADDR_REG];
-    rsp_info.SP_DRAM_ADDR_REG = &g_dev.sp.regs[SP_DRAM_ADDR_REG];
-    rsp_info.SP_RD_LEN_REG = &g_dev.sp.regs[SP_RD_LEN_REG];
-    rsp_info.SP_WR_LEN_REG = &g_dev.sp.regs[SP_WR_LEN_REG];
-    rsp_info.SP_STATUS_REG = &g_dev.sp.regs[SP_STATUS_REG];
-    rsp_info.SP_DMA_FULL_REG = &g_dev.sp.regs[SP_DMA_FULL_REG];
-    rsp_info.SP_DMA_BUSY_REG = &g_dev.sp.regs[SP_DMA_BUSY_REG];
-    rsp_info.SP_PC_REG = &g_dev.sp.regs2[SP_PC_REG];
-    rsp_info.SP_SEMAPHORE_REG = &g_dev.sp.regs[SP_SEMAPHORE_REG];
-    rsp_info.DPC_START_REG = &g_dev.dp.dpc_regs[DPC_START_REG];
-    rsp_info.DPC_END_REG = &g_dev.dp.dpc_regs[DPC_END_REG];
-    rsp_info.DPC_CURRENT_REG = &g_dev.dp.dpc_regs[DPC_CURRENT_REG];
-    rsp_info.DPC_STATUS_REG = &g_dev.dp.dpc_regs[DPC_STATUS_REG];
-    rsp_info.DPC_CLOCK_REG = &g_dev.dp.dpc_regs[DPC_CLOCK_REG];
-    rsp_info.DPC_BUFBUSY_REG = &g_dev.dp.dpc_regs[DPC_BUFBUSY_REG];
-    rsp_info.DPC_PIPEBUSY_REG = &g_dev.dp.dpc_regs[DPC_PIPEBUSY_REG];
-    rsp_info.DPC_TMEM_REG = &g_dev.dp.dpc_regs[DPC_TMEM_REG];
+    rsp_info.MI_INTR_REG = &g_instance->dev->mi.regs[MI_INTR_REG];
+    rsp_info.SP_MEM_ADDR_REG = &g_instance->dev->sp.regs[SP_MEM_ADDR_REG];
+    rsp_info.SP_DRAM_ADDR_REG = &g_instance->dev->sp.regs[SP_DRAM_ADDR_REG];
+    rsp_info.SP_RD_LEN_REG = &g_instance->dev->sp.regs[SP_RD_LEN_REG];
+    rsp_info.SP_WR_LEN_REG = &g_instance->dev->sp.regs[SP_WR_LEN_REG];
+    rsp_info.SP_STATUS_REG = &g_instance->dev->sp.regs[SP_STATUS_REG];
+    rsp_info.SP_DMA_FULL_REG = &g_instance->dev->sp.regs[SP_DMA_FULL_REG];
+    rsp_info.SP_DMA_BUSY_REG = &g_instance->dev->sp.regs[SP_DMA_BUSY_REG];
+    rsp_info.SP_PC_REG = &g_instance->dev->sp.regs2[SP_PC_REG];
+    rsp_info.SP_SEMAPHORE_REG = &g_instance->dev->sp.regs[SP_SEMAPHORE_REG];
+    rsp_info.DPC_START_REG = &g_instance->dev->dp.dpc_regs[DPC_START_REG];
+    rsp_info.DPC_END_REG = &g_instance->dev->dp.dpc_regs[DPC_END_REG];
+    rsp_info.DPC_CURRENT_REG = &g_instance->dev->dp.dpc_regs[DPC_CURRENT_REG];
+    rsp_info.DPC_STATUS_REG = &g_instance->dev->dp.dpc_regs[DPC_STATUS_REG];
+    rsp_info.DPC_CLOCK_REG = &g_instance->dev->dp.dpc_regs[DPC_CLOCK_REG];
+    rsp_info.DPC_BUFBUSY_REG = &g_instance->dev->dp.dpc_regs[DPC_BUFBUSY_REG];
+    rsp_info.DPC_PIPEBUSY_REG = &g_instance->dev->dp.dpc_regs[DPC_PIPEBUSY_REG];
+    rsp_info.DPC_TMEM_REG = &g_instance->dev->dp.dpc_regs[DPC_TMEM_REG];
     rsp_info.CheckInterrupts = EmptyFunc;
     rsp_info.ProcessDlistList = gfx.processDList;
     rsp_info.ProcessAlistList = audio.processAList;
@@ -575,6 +575,12 @@ m64p_error plugin_start(m64p_plugin_type type)
     return M64ERR_INTERNAL;
 }
 
+/* non-zero if any plugin other than a dummy one is attached */
+int plugin_is_attached(void)
+{
+    return l_GfxAttached || l_AudioAttached || l_InputAttached || l_RspAttached;
+}
+
 m64p_error plugin_check(void)
 {
     if (!l_GfxAttached)
@@ -0,0 +1,133 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - code_revalidation_test.c                                *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Check of the page hash revalidation of cached code
+ * (cached_interp_revalidate_block in src/device/r4300/cached_interp.c).
+ *
+ * It sets up a KSEG0 block the way init_block does, invalidates all cached
+ * code and checks that:
+ * - an unchanged page is revalidated after a plain full flush,
+ * - a page written to after the block was set up is not,
+ * - no page is revalidated after the full flush which follows a change of
+ *   the dynarec fast memory setting (framebuffer tracking, corrupted RDRAM),
+ *   as its code was generated for the previous setting.
+ * It prints each step and exits with EXIT_FAILURE if one of them fails.
+ *
+ * Build from the repository root with:
+ *
+ * gcc -O2 -ffunction-sections -fdata-sections -Wl,--gc-sections -Isrc -Isrc/asm_defines \
+ *     -Isubprojects/md5 -Isubprojects/xxhash tools/code_revalidation_test.c \
+ *     src/device/r4300/cached_interp.c src/device/r4300/r4300_core.c -o code_revalidation_test
+ *
+ * (--gc-sections drops the interpreters and the rest of the emulator)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device/r4300/cached_interp.h"
+#include "device/r4300/r4300_core.h"
+#include "device/rdram/rdram.h"
+
+#define DRAM_SIZE 0x800000
+#define BLOCK_START UINT32_C(0x80001000)
+
+void DebugMessage(int level, const char* message, ...)
+{
+}
+
+static struct rdram l_rdram;
+static struct r4300_core l_r4300;
+static int l_failures;
+
+/* stand-in for init_block, which regenerates the code of a page */
+static void init_block(struct r4300_core* r4300, uint32_t address)
+{
+    struct precomp_block** slot = cached_interp_block_slot(&r4300->cached_interp, address >> 12);
+    struct precomp_block* b = *slot;
+
+    if (b == NULL) {
+        b = calloc(1, sizeof(*b));
+        *slot = b;
+        b->start = address & ~UINT32_C(0xfff);
+        b->end = b->start + 0x1000;
+        b->block = calloc(1, get_block_memsize(b));
+    }
+
+    b->xxhash = hash_block_page(r4300, b);
+    r4300->cached_interp.invalid_code[address >> 12] = 0;
+}
+
+static void check(const char* step, int revalidated, int expected)
+{
+    printf("%-40s %s\n", step, (revalidated == expected) ? "ok" : "FAILED");
+    if (revalidated != expected) {
+        ++l_failures;
+    }
+}
+
+int main(void)
+{
+    uint32_t* dram = calloc(1, DRAM_SIZE);
+
+    if (dram == NULL)
+        return EXIT_FAILURE;
+
+    l_rdram.dram = dram;
+    l_rdram.dram_size = DRAM_SIZE;
+    l_r4300.rdram = &l_rdram;
+    l_r4300.emumode = EMUMODE_INTERPRETER;
+    l_r4300.recomp.fast_memory = 1;
+    l_r4300.cached_interp.init_block = init_block;
+    l_r4300.cached_interp.free_block = cached_interp_free_block;
+    init_blocks(&l_r4300.cached_interp);
+
+    dram[(BLOCK_START & 0xfff000) / 4] = UINT32_C(0x03e00008); /* jr $ra */
+    init_block(&l_r4300, BLOCK_START);
+
+    invalidate_r4300_cached_code(&l_r4300, 0, 0);
+    check("full flush", cached_interp_revalidate_block(&l_r4300, BLOCK_START), 1);
+
+    invalidate_r4300_cached_code(&l_r4300, 0, 0);
+    dram[(BLOCK_START & 0xfff000) / 4 + 1] = UINT32_C(0x24020001); /* addiu $v0, $zero, 1 */
+    check("page written", cached_interp_revalidate_block(&l_r4300, BLOCK_START), 0);
+    init_block(&l_r4300, BLOCK_START);
+
+    r4300_set_fast_memory(&l_r4300, 0);
+    invalidate_r4300_cached_code(&l_r4300, 0, 0);
+    check("fast memory disabled", cached_interp_revalidate_block(&l_r4300, BLOCK_START), 0);
+    init_block(&l_r4300, BLOCK_START);
+
+    r4300_set_fast_memory(&l_r4300, 0);
+    invalidate_r4300_cached_code(&l_r4300, 0, 0);
+    check("fast memory unchanged", cached_interp_revalidate_block(&l_r4300, BLOCK_START), 1);
+
+    r4300_set_fast_memory(&l_r4300, 1);
+    invalidate_r4300_cached_code(&l_r4300, 0, 0);
+    check("fast memory enabled", cached_interp_revalidate_block(&l_r4300, BLOCK_START), 0);
+
+    free_blocks(&l_r4300.cached_interp);
+    free(dram);
+
+    return (l_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
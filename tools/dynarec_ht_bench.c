@@ -0,0 +1,263 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - dynarec_ht_bench.c                                      *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Replays a trace of new_dynarec block lookups against the former 2-way
+ * hash_table and the set-associative one in new_dynarec.c, and prints the
+ * miss rate and lookup time of each. Every miss is a walk of the jump_in
+ * lists in get_addr().
+ *
+ * A trace is a file of little-endian 32-bit virtual addresses, as written
+ * by a core built with HT_TRACE set to 1 in new_dynarec.c. Without a trace
+ * file, a synthetic one is used: indirect jumps to 40000 sites spread over
+ * 4 MB of code, with a skewed working set of 8000 sites that changes
+ * every million lookups like a game changing scenes.
+ *
+ * Build from the repository root with:
+ *
+ * gcc -O2 tools/dynarec_ht_bench.c -o dynarec_ht_bench
+ *
+ * adding -DNEW_DYNAREC_HT_WAYS=n to try another number of ways, like the
+ * core. Usage: dynarec_ht_bench [trace file|-] [set bits]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SYNTHETIC_LOOKUPS 20000000
+#define SYNTHETIC_SITES 40000
+#define SYNTHETIC_WORKING_SET 8000
+#define SYNTHETIC_SCENE_LENGTH 1000000
+
+#ifndef NEW_DYNAREC_HT_WAYS
+#define NEW_DYNAREC_HT_WAYS 4
+#endif
+#define HT_WAYS NEW_DYNAREC_HT_WAYS
+
+/* hash_table[65536][2] as it was: new entries pushed in front */
+static uint32_t* l_old_table;
+
+static int old_lookup(uint32_t vaddr)
+{
+    uint32_t* bin = &l_old_table[(((vaddr >> 16) ^ vaddr) & 0xFFFF) * 2];
+
+    if (bin[0] == vaddr || bin[1] == vaddr)
+        return 1;
+    bin[1] = bin[0];
+    bin[0] = vaddr;
+    return 0;
+}
+
+/* struct ht_set as in new_dynarec.c: multiplicative hash, all ways compared
+ * at once, used ways packed in front, misses inserted as the most recent way */
+#define HT_EMPTY UINT32_C(0xFFFFFFFF)
+
+static uint32_t* l_new_table;
+static int l_bits;
+
+static int new_lookup(uint32_t vaddr)
+{
+    uint32_t* set = &l_new_table[((vaddr * UINT32_C(0x9E3779B1)) >> (32 - l_bits)) * HT_WAYS];
+    int hit = 0;
+    int i;
+
+    for (i = 0; i < HT_WAYS; i++)
+        hit |= (set[i] == vaddr);
+    if (hit)
+        return 1;
+
+    for (i = 0; i < HT_WAYS - 1 && set[i] != HT_EMPTY; i++);
+    memmove(&set[1], &set[0], i * sizeof(set[0]));
+    set[0] = vaddr;
+    return 0;
+}
+
+/* misses no table can avoid: the first lookup of each address */
+static size_t count_distinct(const uint32_t* trace, size_t count)
+{
+    size_t size = 1;
+    size_t distinct = 0;
+    uint32_t* seen;
+    size_t i;
+
+    while (size < 2 * count)
+        size <<= 1;
+    seen = malloc(size * sizeof(seen[0]));
+    if (seen == NULL)
+        return 0;
+    memset(seen, 0xff, size * sizeof(seen[0]));
+
+    for (i = 0; i < count; i++)
+    {
+        size_t h = (trace[i] * UINT32_C(0x9E3779B1)) & (size - 1);
+
+        while (seen[h] != HT_EMPTY && seen[h] != trace[i])
+            h = (h + 1) & (size - 1);
+        if (seen[h] == HT_EMPTY)
+        {
+            seen[h] = trace[i];
+            distinct++;
+        }
+    }
+
+    free(seen);
+    return distinct;
+}
+
+static uint32_t l_seed = 0x12345678;
+
+static uint32_t next_random(void)
+{
+    l_seed ^= l_seed << 13;
+    l_seed ^= l_seed >> 17;
+    l_seed ^= l_seed << 5;
+    return l_seed;
+}
+
+static uint32_t* synthetic_trace(size_t* count)
+{
+    uint32_t* sites = malloc(SYNTHETIC_SITES * sizeof(sites[0]));
+    uint32_t* working_set = malloc(SYNTHETIC_WORKING_SET * sizeof(working_set[0]));
+    uint32_t* trace = malloc(SYNTHETIC_LOOKUPS * sizeof(trace[0]));
+    size_t i;
+    int j;
+
+    if (sites == NULL || working_set == NULL || trace == NULL)
+        return NULL;
+
+    for (j = 0; j < SYNTHETIC_SITES; j++)
+        sites[j] = UINT32_C(0x80000400) + ((next_random() % 0x100000) << 2);
+
+    for (i = 0; i < SYNTHETIC_LOOKUPS; i++)
+    {
+        uint32_t r;
+        double u;
+
+        /* new scene: most of the working set is replaced */
+        if (i % SYNTHETIC_SCENE_LENGTH == 0)
+        {
+            for (j = 0; j < SYNTHETIC_WORKING_SET; j++)
+            {
+                if (i == 0 || next_random() % 4 != 0)
+                    working_set[j] = sites[next_random() % SYNTHETIC_SITES];
+            }
+        }
+
+        /* skewed towards the first sites of the working set */
+        r = next_random();
+        u = (double)r / 4294967296.0;
+        trace[i] = working_set[(int)(u * u * u * SYNTHETIC_WORKING_SET)];
+    }
+
+    free(sites);
+    free(working_set);
+    *count = SYNTHETIC_LOOKUPS;
+    return trace;
+}
+
+static uint32_t* load_trace(const char* filename, size_t* count)
+{
+    FILE* f = fopen(filename, "rb");
+    uint32_t* trace;
+    long size;
+    size_t i;
+
+    if (f == NULL)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    trace = malloc(size);
+    if (trace == NULL || fread(trace, 4, size / 4, f) != (size_t)(size / 4))
+    {
+        fclose(f);
+        free(trace);
+        return NULL;
+    }
+    fclose(f);
+
+    /* traces are little-endian */
+    for (i = 0; i < (size_t)(size / 4); i++)
+    {
+        const unsigned char* b = (const unsigned char*)&trace[i];
+        trace[i] = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+
+    *count = size / 4;
+    return trace;
+}
+
+static void run(const char* name, int (*lookup)(uint32_t), const uint32_t* trace, size_t count)
+{
+    size_t misses = 0;
+    size_t i;
+    clock_t start = clock();
+    double seconds;
+
+    for (i = 0; i < count; i++)
+        misses += !lookup(trace[i]);
+
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("%-24s %10zu misses, %6.3f%% miss rate, %.2f ns per lookup\n",
+        name, misses, 100.0 * misses / count, seconds * 1e9 / count);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t* trace;
+    size_t count;
+    char name[32];
+
+    l_bits = (argc > 2) ? atoi(argv[2]) : 15;
+    if (l_bits < 11 || l_bits > 24)
+    {
+        fprintf(stderr, "set bits must be 11 to 24\n");
+        return EXIT_FAILURE;
+    }
+
+    trace = (argc > 1 && strcmp(argv[1], "-") != 0) ? load_trace(argv[1], &count) : synthetic_trace(&count);
+    if (trace == NULL || count == 0)
+    {
+        fprintf(stderr, "couldn't read trace\n");
+        return EXIT_FAILURE;
+    }
+
+    l_old_table = calloc(65536 * 2, sizeof(uint32_t));
+    l_new_table = malloc(((size_t)HT_WAYS << l_bits) * sizeof(uint32_t));
+    if (l_old_table == NULL || l_new_table == NULL)
+        return EXIT_FAILURE;
+    memset(l_new_table, 0xff, ((size_t)HT_WAYS << l_bits) * sizeof(uint32_t));
+
+    printf("%zu lookups, %zu addresses\n", count, count_distinct(trace, count));
+    run("65536 sets x 2 ways", old_lookup, trace, count);
+    snprintf(name, sizeof(name), "%d sets x %d ways", 1 << l_bits, HT_WAYS);
+    run(name, new_lookup, trace, count);
+
+    free(l_old_table);
+    free(l_new_table);
+    free(trace);
+
+    return EXIT_SUCCESS;
+}
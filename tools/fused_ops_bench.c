@@ -0,0 +1,288 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - fused_ops_bench.c                                       *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Benchmark of the cached interpreter superinstructions
+ * (FUSED_OPS in src/device/r4300/cached_interp.c).
+ *
+ * It runs the same MIPS routine from KSEG0 RDRAM with the cached interpreter,
+ * with FuseInstructions off and with it on. The routine
+ * walks an array the way game code does (address built with LUI+ADDIU, loads
+ * followed by their use, compare+branch pairs, a store per element) and
+ * stops the run by writing to an unmapped register. Both settings are run
+ * RUNS times in turn. It prints the emulated instructions per second of the
+ * fastest run of each and a checksum of the registers and of RDRAM, which
+ * must be the same for all runs.
+ *
+ * Build from the repository root with:
+ *
+ * gcc -O3 -flto -DNO_ASM -ffunction-sections -fdata-sections -Wl,--gc-sections -Isrc -Isrc/api \
+ *     -Isrc/asm_defines -Isubprojects/md5 -Isubprojects/xxhash tools/fused_ops_bench.c \
+ *     src/device/r4300/cached_interp.c src/device/r4300/r4300_core.c src/device/r4300/cp0.c \
+ *     src/device/r4300/cp1.c src/device/r4300/cp2.c src/device/r4300/idec.c \
+ *     src/device/r4300/tlb.c src/device/memory/memory.c src/device/rdram/rdram.c -lm -o fused_ops_bench
+ *
+ * (-O3 -flto are the default OPTFLAGS of the unix build, without LTO the
+ * accessors of r4300_core.c are not inlined and eat most of the gain;
+ * --gc-sections drops the other interpreters and the rest of the emulator)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device/device.h"
+#include "device/memory/memory.h"
+#include "device/r4300/cached_interp.h"
+#include "device/r4300/r4300_core.h"
+#include "device/r4300/interrupt.h"
+#include "device/rdram/rdram.h"
+#include "main/instance.h"
+
+#define DRAM_SIZE 0x800000
+#define CODE_START UINT32_C(0x80001000)
+#define DATA_START UINT32_C(0x80100000)
+#define ELEMENTS 1024
+#define PASSES 20000
+#define RUNS 5
+
+/* MIPS encodings */
+#define R_TYPE(rs, rt, rd, sa, funct) (((rs) << 21) | ((rt) << 16) | ((rd) << 11) | ((sa) << 6) | (funct))
+#define I_TYPE(op, rs, rt, imm) (((op) << 26) | ((rs) << 21) | ((rt) << 16) | ((imm) & 0xffff))
+
+#define ADDU(rd, rs, rt)   R_TYPE(rs, rt, rd, 0, 0x21)
+#define SLT(rd, rs, rt)    R_TYPE(rs, rt, rd, 0, 0x2a)
+#define SLL(rd, rt, sa)    R_TYPE(0, rt, rd, sa, 0x00)
+#define SRA(rd, rt, sa)    R_TYPE(0, rt, rd, sa, 0x03)
+#define BEQ(rs, rt, off)   I_TYPE(0x04, rs, rt, off)
+#define BNE(rs, rt, off)   I_TYPE(0x05, rs, rt, off)
+#define ADDIU(rt, rs, imm) I_TYPE(0x09, rs, rt, imm)
+#define ANDI(rt, rs, imm)  I_TYPE(0x0c, rs, rt, imm)
+#define ORI(rt, rs, imm)   I_TYPE(0x0d, rs, rt, imm)
+#define LUI(rt, imm)       I_TYPE(0x0f, 0, rt, imm)
+#define LBU(rt, off, base) I_TYPE(0x24, base, rt, off)
+#define LW(rt, off, base)  I_TYPE(0x23, base, rt, off)
+#define SW(rt, off, base)  I_TYPE(0x2b, base, rt, off)
+#define NOP 0
+
+enum { ZERO = 0, T0 = 8, T1, T2, T3, T4, T5, T6, T7, S0 = 16, S1 };
+
+static const uint32_t l_routine[] =
+{
+    LUI(S0, 0),
+    ORI(S0, S0, PASSES),
+/* pass: */
+    LUI(T0, DATA_START >> 16),
+    ADDIU(T0, T0, DATA_START & 0xffff),
+    ADDIU(T1, ZERO, ELEMENTS),
+/* element: */
+    LW(T2, 0, T0),
+    ADDU(T3, T3, T2),
+    LBU(T4, 3, T0),
+    ANDI(T4, T4, 0xf),
+    BEQ(T4, ZERO, 3),           /* to next */
+    NOP,
+    SLL(T5, T2, 2),
+    SRA(T5, T5, 1),
+/* next: */
+    ADDU(T3, T3, T5),
+    LW(T6, 4, T0),
+    SLT(T7, T6, T3),
+    BNE(T7, ZERO, 2),           /* to store */
+    NOP,
+    ADDIU(T3, T3, 1),
+/* store: */
+    SW(T3, 8, T0),
+    ADDIU(T0, T0, 16),
+    ADDIU(T1, T1, -1),
+    BNE(T1, ZERO, -18),         /* to element */
+    NOP,
+    ADDIU(S0, S0, -1),
+    BNE(S0, ZERO, -24),         /* to pass */
+    NOP,
+    LUI(S1, 0xa460),
+    SW(ZERO, 0, S1),            /* stops the run */
+    NOP,
+};
+
+/* instructions executed by one element, depending on the branches taken */
+#define ROUTINE_INSTRUCTIONS ((uint64_t)PASSES * ELEMENTS * 17)
+
+osal_thread_local struct core_instance* g_instance CORE_INSTANCE_TLS_MODEL;
+
+void DebugMessage(int level, const char* message, ...)
+{
+}
+
+/* no interrupt is ever scheduled, the routine touches neither COUNT nor COMPARE */
+void gen_interrupt(struct r4300_core* r4300)
+{
+    *r4300_cp0_next_interrupt(&r4300->cp0) = r4300_cp0_regs(&r4300->cp0)[CP0_COUNT_REG] + UINT32_C(0x40000000);
+    *r4300_cp0_cycle_count(&r4300->cp0) = -0x40000000;
+}
+
+void r4300_check_interrupt(struct r4300_core* r4300, uint32_t cause_ip, int set_cause)
+{
+}
+
+void translate_event_queue(struct cp0* cp0, unsigned int base)
+{
+}
+
+void remove_event(struct interrupt_queue* q, int type)
+{
+}
+
+void add_interrupt_event_count(struct cp0* cp0, int type, unsigned int count)
+{
+}
+
+unsigned int get_next_event_count(const struct interrupt_queue* q)
+{
+    return 0;
+}
+
+static void read_stop(void* opaque, uint32_t address, uint32_t* value)
+{
+    *value = 0;
+}
+
+static void write_stop(void* opaque, uint32_t address, uint32_t value, uint32_t mask)
+{
+    *r4300_stop((struct r4300_core*)opaque) = 1;
+}
+
+static uint32_t l_seed;
+
+static uint32_t next_random(void)
+{
+    l_seed ^= l_seed << 13;
+    l_seed ^= l_seed >> 17;
+    l_seed ^= l_seed << 5;
+    return l_seed;
+}
+
+static uint64_t checksum(uint64_t sum, uint64_t value)
+{
+    return (sum ^ value) * UINT64_C(0x100000001b3);
+}
+
+static struct device l_dev;
+static struct core_instance l_instance;
+
+static uint64_t run(int fuse_ops, double* best)
+{
+    struct r4300_core* r4300 = &l_dev.r4300;
+    uint32_t* dram = l_dev.rdram.dram;
+    uint64_t sum = UINT64_C(0xcbf29ce484222325);
+    clock_t start;
+    double seconds;
+    size_t i;
+
+    memset(dram, 0, DRAM_SIZE);
+    memcpy(dram + (CODE_START & 0xffffff) / 4, l_routine, sizeof(l_routine));
+    l_seed = 0x12345678;
+    for (i = 0; i < ELEMENTS * 4; i++)
+        dram[(DATA_START & 0xffffff) / 4 + i] = next_random();
+    memset(r4300_regs(r4300), 0, 32 * sizeof(int64_t));
+    gen_interrupt(r4300);
+
+    r4300->cached_interp.fuse_ops = fuse_ops;
+    init_blocks(&r4300->cached_interp);
+    *r4300_stop(r4300) = 0;
+    cached_interpreter_jump_to(r4300, CODE_START);
+
+    start = clock();
+    run_cached_interpreter(r4300);
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    free_blocks(&r4300->cached_interp);
+
+    for (i = 0; i < 32; i++)
+        sum = checksum(sum, (uint64_t)r4300_regs(r4300)[i]);
+    for (i = 0; i < DRAM_SIZE / 4; i++)
+        sum = checksum(sum, dram[i]);
+
+    if (*best == 0 || seconds < *best)
+        *best = seconds;
+
+    return sum;
+}
+
+int main(void)
+{
+    struct r4300_core* r4300 = &l_dev.r4300;
+    struct mem_mapping mappings[] =
+    {
+        { MM_RDRAM_DRAM, MM_RDRAM_DRAM + DRAM_SIZE - 1, M64P_MEM_RDRAM, { &l_dev.rdram, read_rdram_dram, write_rdram_dram } },
+        { 0x04600000, 0x046fffff, M64P_MEM_PI, { r4300, read_stop, write_stop } },
+    };
+    double best[2] = { 0, 0 };
+    double warmup = 0;
+    uint64_t sums[2];
+    int failures = 0;
+    int i, fuse_ops;
+    void* base = init_mem_base();
+
+    if (base == NULL)
+        return EXIT_FAILURE;
+
+    l_instance.dev = &l_dev;
+    g_instance = &l_instance;
+
+    init_memory(&l_dev.mem, mappings, sizeof(mappings) / sizeof(mappings[0]), base, NULL);
+    init_rdram(&l_dev.rdram, mem_base_u32(base, MM_RDRAM_DRAM), DRAM_SIZE, r4300);
+    r4300->mem = &l_dev.mem;
+    r4300->rdram = &l_dev.rdram;
+    r4300->emumode = EMUMODE_INTERPRETER;
+    r4300->cp0.count_per_op = 2;
+    r4300->cached_interp.fin_block = cached_interp_FIN_BLOCK;
+    r4300->cached_interp.not_compiled = cached_interp_NOTCOMPILED;
+    r4300->cached_interp.not_compiled2 = cached_interp_NOTCOMPILED2;
+    r4300->cached_interp.init_block = cached_interp_init_block;
+    r4300->cached_interp.free_block = cached_interp_free_block;
+    r4300->cached_interp.recompile_block = cached_interp_recompile_block;
+
+    /* reference checksum, also warms up the caches */
+    sums[0] = run(0, &warmup);
+    for (i = 0; i < RUNS; i++)
+    {
+        for (fuse_ops = 0; fuse_ops < 2; fuse_ops++)
+        {
+            sums[fuse_ops] = run(fuse_ops, &best[fuse_ops]);
+            if (sums[fuse_ops] != sums[0])
+                ++failures;
+        }
+    }
+
+    for (fuse_ops = 0; fuse_ops < 2; fuse_ops++)
+    {
+        printf("%-8s ~%llu instructions in %.3f s, %.1f MIPS, checksum %016llx\n",
+            fuse_ops ? "fused" : "unfused", (unsigned long long)ROUTINE_INSTRUCTIONS, best[fuse_ops],
+            ROUTINE_INSTRUCTIONS / best[fuse_ops] / 1e6, (unsigned long long)sums[fuse_ops]);
+    }
+    printf("speedup  %.2fx\n", best[0] / best[1]);
+
+    release_mem_base(base);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - interrupt_queue_bench.c                                 *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Microbenchmark of the r4300 interrupt queue (src/device/r4300/interrupt.c).
+ *
+ * It replays a synthetic but typical event mix: VI and COMPARE events
+ * rescheduled as they happen, SI/PI/AI/SP/DP/RSP DMA events scheduled and
+ * cancelled at random, CHECK_INT raised on top of the queue, and the queue
+ * saved and loaded as savestates do. It prints the time per operation and a
+ * checksum of every saved queue, which must not change between two queue
+ * implementations since savestates store the queue in that format.
+ *
+ * Build from the repository root with:
+ *
+ * gcc -O2 -ffunction-sections -Wl,--gc-sections -Isrc -Isrc/asm_defines -Isubprojects/md5 \
+ *     -Isubprojects/minizip -Isubprojects/xxhash tools/interrupt_queue_bench.c \
+ *     src/device/r4300/interrupt.c -o interrupt_queue_bench
+ *
+ * (--gc-sections drops gen_interrupt and the rest of the emulator it calls)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device/r4300/cp0.h"
+#include "device/r4300/interrupt.h"
+#include "device/r4300/r4300_core.h"
+
+#define ITERATIONS 20000000
+#define VI_DELAY 1562500
+
+/* the parts of the core interrupt.c needs for queue operations */
+uint32_t* r4300_cp0_regs(struct cp0* cp0)
+{
+    return cp0->regs;
+}
+
+unsigned int* r4300_cp0_next_interrupt(struct cp0* cp0)
+{
+    return &cp0->next_interrupt;
+}
+
+int* r4300_cp0_cycle_count(struct cp0* cp0)
+{
+    return &cp0->cycle_count;
+}
+
+void DebugMessage(int level, const char* message, ...)
+{
+}
+
+static const int device_events[] = { SI_INT, PI_INT, AI_INT, SP_INT, DP_INT, RSP_DMA_EVT };
+#define DEVICE_EVENTS (sizeof(device_events) / sizeof(device_events[0]))
+
+static uint32_t l_seed = 0x12345678;
+
+static uint32_t next_random(void)
+{
+    l_seed ^= l_seed << 13;
+    l_seed ^= l_seed >> 17;
+    l_seed ^= l_seed << 5;
+    return l_seed;
+}
+
+static uint64_t checksum(uint64_t sum, const char* buf, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        sum = (sum ^ (unsigned char)buf[i]) * UINT64_C(0x100000001b3);
+    return sum;
+}
+
+static struct r4300_core l_r4300;
+static struct cp0 l_loaded;
+
+int main(void)
+{
+    static char saved[8 * (INTERRUPT_QUEUE_CAPACITY + 1)];
+    static char resaved[8 * (INTERRUPT_QUEUE_CAPACITY + 1)];
+    uint64_t sum = UINT64_C(0xcbf29ce484222325);
+    uint64_t operations = 0;
+    unsigned int mismatches = 0;
+    clock_t start;
+    double seconds;
+    long i;
+
+    l_r4300.cp0.regs[CP0_COUNT_REG] = 0x5000;
+    l_r4300.cp0.count_per_op = 2;
+    init_interrupt(&l_r4300.cp0);
+    add_interrupt_event(&l_r4300.cp0, VI_INT, VI_DELAY);
+
+    start = clock();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        uint32_t r = next_random();
+        int type = device_events[r % DEVICE_EVENTS];
+
+        /* run to the next event and handle it */
+        if ((r & 0x3) == 0)
+        {
+            int next = get_next_event_type(&l_r4300.cp0.q);
+
+            l_r4300.cp0.regs[CP0_COUNT_REG] = l_r4300.cp0.next_interrupt;
+            l_r4300.cp0.cycle_count = 0;
+
+            if (next == SPECIAL_INT)
+            {
+                remove_event(&l_r4300.cp0.q, SPECIAL_INT);
+                add_interrupt_event_count(&l_r4300.cp0, SPECIAL_INT, ((l_r4300.cp0.regs[CP0_COUNT_REG] & UINT32_C(0x80000000)) ^ UINT32_C(0x80000000)));
+            }
+            else
+            {
+                remove_interrupt_event(&l_r4300.cp0);
+                if (next == VI_INT)
+                    add_interrupt_event(&l_r4300.cp0, VI_INT, VI_DELAY);
+                else if (next == COMPARE_INT)
+                    add_interrupt_event(&l_r4300.cp0, COMPARE_INT, 93750000 / 60);
+            }
+            operations += 2;
+        }
+
+        /* schedule or cancel a device event */
+        if (get_event(&l_r4300.cp0.q, type) == NULL)
+            add_interrupt_event(&l_r4300.cp0, type, (r >> 8) % 0x8000 + 1);
+        else if ((r & 0x30) == 0)
+            remove_event(&l_r4300.cp0.q, type);
+        operations += 2;
+
+        /* an interrupt line raised with interrupts enabled */
+        if ((r & 0x3ff) == 0x3ff)
+        {
+            l_r4300.cp0.regs[CP0_STATUS_REG] = CP0_STATUS_IE | UINT32_C(0x0400);
+            l_r4300.cp0.regs[CP0_CAUSE_REG] = UINT32_C(0x0400);
+            r4300_check_interrupt(&l_r4300, 0, 1);
+            remove_interrupt_event(&l_r4300.cp0);
+            operations += 2;
+        }
+
+        /* savestate round trip */
+        if ((i & 0xffff) == 0)
+        {
+            int len = save_eventqueue_infos(&l_r4300.cp0, saved);
+            int relen;
+
+            memcpy(l_loaded.regs, l_r4300.cp0.regs, sizeof(l_loaded.regs));
+            l_loaded.cycle_count = l_r4300.cp0.cycle_count;
+            load_eventqueue_infos(&l_loaded, saved);
+            relen = save_eventqueue_infos(&l_loaded, resaved);
+            if (relen != len || memcmp(saved, resaved, len) != 0)
+                ++mismatches;
+
+            sum = checksum(sum, saved, len);
+        }
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%llu queue operations in %.3f s, %.2f ns per operation\n",
+        (unsigned long long)operations, seconds, seconds * 1e9 / operations);
+    printf("saved queue checksum %016llx, %u save/load mismatches\n", (unsigned long long)sum, mismatches);
+
+    return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
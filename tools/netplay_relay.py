@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+'''* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - netplay_relay.py                                        *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+Stand-in for the netplay relay, to run two emulators against each other on
+one machine. It accepts any token, serves a single session and forwards the
+ENet traffic between the two players, optionally with added latency to
+exercise rollback.
+
+Usage:
+
+python3 netplay_relay.py [--delay MS] [--jitter MS] [--loss PERCENT]
+
+then start both emulators with NetplayRelayHost=127.0.0.1, the same
+NetplayToken, NetplayHosting=1 for one of them, and NetplayRollback set
+on the host.
+
+'''
+
+import argparse
+import heapq
+import random
+import select
+import socket
+import struct
+import time
+
+DATA_PORT = 27015
+CTRL_PORT = 27016
+
+MAGIC = b'NRLY'
+VERSION = 1
+MSG_HELLO = 0x01
+MSG_READY = 0x02
+MSG_DATA_BIND = 0x10
+
+
+def parse_header(packet):
+    if len(packet) < 6 or packet[0:4] != MAGIC or packet[4] != VERSION:
+        return None
+    return packet[5]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Loopback netplay relay')
+    parser.add_argument('--bind', default='127.0.0.1', help='address to listen on')
+    parser.add_argument('--delay', type=float, default=0.0, help='one way latency in ms')
+    parser.add_argument('--jitter', type=float, default=0.0, help='random extra latency in ms')
+    parser.add_argument('--loss', type=float, default=0.0, help='percent of data packets dropped')
+    args = parser.parse_args()
+
+    ctrl = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    ctrl.bind((args.bind, CTRL_PORT))
+    data = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    data.bind((args.bind, DATA_PORT))
+
+    players = []        # data addresses, in bind order
+    pending = []        # (due time, sequence, packet, destination)
+    sequence = 0
+
+    print('relay: listening on %s:%d (control) and %s:%d (data)' % (args.bind, CTRL_PORT, args.bind, DATA_PORT))
+
+    while True:
+        timeout = None
+        if pending:
+            timeout = max(0.0, pending[0][0] - time.monotonic())
+
+        readable, _, _ = select.select([ctrl, data], [], [], timeout)
+
+        if ctrl in readable:
+            packet, sender = ctrl.recvfrom(2048)
+            if parse_header(packet) == MSG_HELLO:
+                ctrl.sendto(MAGIC + struct.pack('BB', VERSION, MSG_READY), sender)
+                print('relay: HELLO from %s:%d' % sender)
+
+        if data in readable:
+            packet, sender = data.recvfrom(65536)
+            if parse_header(packet) == MSG_DATA_BIND:
+                if sender not in players:
+                    if len(players) == 2:
+                        # a new session: the previous one is over
+                        players = []
+                    players.append(sender)
+                    print('relay: player %d bound from %s:%d' % (len(players), sender[0], sender[1]))
+            elif sender in players and len(players) == 2:
+                if random.uniform(0.0, 100.0) >= args.loss:
+                    destination = players[1] if sender == players[0] else players[0]
+                    latency = (args.delay + random.uniform(0.0, args.jitter)) / 1000.0
+                    heapq.heappush(pending, (time.monotonic() + latency, sequence, packet, destination))
+                    sequence += 1
+
+        now = time.monotonic()
+        while pending and pending[0][0] <= now:
+            _, _, packet, destination = heapq.heappop(pending)
+            data.sendto(packet, destination)
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
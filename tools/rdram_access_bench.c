@@ -0,0 +1,168 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rdram_access_bench.c                                    *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2026 Jimmi Team                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Microbenchmark of the interpreter memory accessors
+ * (r4300_read_aligned_word and friends in src/device/r4300/r4300_core.c).
+ *
+ * It runs the same mix of KSEG0 RDRAM word and dword loads and stores twice:
+ * once with the plain RDRAM handlers, which the accessors bypass, and once
+ * with wrapper handlers standing in for the framebuffer dirty tracking ones,
+ * which go through the handler calls like every access used to. It prints
+ * the time per access of both runs and a checksum of the loaded values and
+ * of RDRAM, which must be the same for both.
+ *
+ * Build from the repository root with:
+ *
+ * gcc -O2 -ffunction-sections -Wl,--gc-sections -Isrc -Isrc/asm_defines -Isubprojects/md5 \
+ *     -Isubprojects/xxhash tools/rdram_access_bench.c src/device/r4300/r4300_core.c \
+ *     src/device/memory/memory.c src/device/rdram/rdram.c -o rdram_access_bench
+ *
+ * (--gc-sections drops the interpreters and the rest of the emulator)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device/memory/memory.h"
+#include "device/r4300/r4300_core.h"
+#include "device/rdram/rdram.h"
+
+#define ITERATIONS 50000000
+#define DRAM_SIZE 0x800000
+
+/* the parts of the core the accessors need for KSEG0 accesses */
+uint32_t virtual_to_physical_address(struct r4300_core* r4300, uint32_t address, int w)
+{
+    return address;
+}
+
+void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size)
+{
+}
+
+void DebugMessage(int level, const char* message, ...)
+{
+}
+
+/* stand-ins for the framebuffer handlers */
+static void read_tracked_dram(void* opaque, uint32_t address, uint32_t* value)
+{
+    read_rdram_dram(opaque, address, value);
+}
+
+static void write_tracked_dram(void* opaque, uint32_t address, uint32_t value, uint32_t mask)
+{
+    write_rdram_dram(opaque, address, value, mask);
+}
+
+static uint32_t l_seed;
+
+static uint32_t next_random(void)
+{
+    l_seed ^= l_seed << 13;
+    l_seed ^= l_seed >> 17;
+    l_seed ^= l_seed << 5;
+    return l_seed;
+}
+
+static uint64_t checksum(uint64_t sum, uint64_t value)
+{
+    return (sum ^ value) * UINT64_C(0x100000001b3);
+}
+
+static struct memory l_mem;
+static struct rdram l_rdram;
+static struct r4300_core l_r4300;
+
+static uint64_t run(read32fn read32, write32fn write32, const char* name)
+{
+    struct mem_mapping mapping = { 0, 0x3efffff, 0, { &l_rdram, read32, write32 } };
+    uint64_t sum = UINT64_C(0xcbf29ce484222325);
+    clock_t start;
+    double seconds;
+    long i;
+
+    apply_mem_mapping(&l_mem, &mapping);
+    for (i = 0; i < DRAM_SIZE / 4; i++)
+        l_rdram.dram[i] = (uint32_t)i * UINT32_C(0x9e3779b9);
+    l_seed = 0x12345678;
+
+    start = clock();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        uint32_t r = next_random();
+        /* mostly accesses close to each other, like stack and struct accesses */
+        uint32_t address = UINT32_C(0x80000000) | ((r >> 4) & (DRAM_SIZE - 8) & ((r & 0x8) ? UINT32_C(0x7ff8) : UINT32_C(0x7ffff8)));
+
+        switch (r & 0x7)
+        {
+        case 0: case 1: case 2: case 3: { /* LW */
+            uint32_t w;
+            r4300_read_aligned_word(&l_r4300, address, &w);
+            sum = checksum(sum, w);
+            break; }
+        case 4: case 5: /* SW */
+            r4300_write_aligned_word(&l_r4300, address, r, ~UINT32_C(0));
+            break;
+        case 6: { /* LD */
+            uint64_t d;
+            r4300_read_aligned_dword(&l_r4300, address, &d);
+            sum = checksum(sum, d);
+            break; }
+        case 7: /* SD */
+            r4300_write_aligned_dword(&l_r4300, address, (uint64_t)r << 16, ~UINT64_C(0));
+            break;
+        }
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    for (i = 0; i < DRAM_SIZE / 4; i++)
+        sum = checksum(sum, l_rdram.dram[i]);
+
+    printf("%-8s %d accesses in %.3f s, %.2f ns per access, checksum %016llx\n",
+        name, ITERATIONS, seconds, seconds * 1e9 / ITERATIONS, (unsigned long long)sum);
+
+    return sum;
+}
+
+int main(void)
+{
+    uint32_t* dram = malloc(DRAM_SIZE);
+    uint64_t direct, handlers;
+
+    if (dram == NULL)
+        return EXIT_FAILURE;
+
+    init_rdram(&l_rdram, dram, DRAM_SIZE, &l_r4300);
+    l_r4300.mem = &l_mem;
+    l_r4300.rdram = &l_rdram;
+    l_r4300.emumode = EMUMODE_INTERPRETER;
+
+    handlers = run(read_tracked_dram, write_tracked_dram, "handlers");
+    direct = run(read_rdram_dram, write_rdram_dram, "direct");
+
+    free(dram);
+
+    return (direct == handlers) ? EXIT_SUCCESS : EXIT_FAILURE;
+}